@@ -0,0 +1,604 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+/**
+ * Benchmarks for the C++ core: distance kernels, index construction, search
+ * throughput against recall, and load time.
+ *
+ * By default, a synthetic dataset is generated from a fixed seed, so that
+ * results are comparable between runs on the same machine. Standard datasets
+ * in the .fvecs/.ivecs format (e.g.: SIFT1M, or GloVe converted to .fvecs)
+ * can be passed instead:
+ *
+ *   VoyagerBenchmarks --base sift_base.fvecs --queries sift_query.fvecs \
+ *                     --groundtruth sift_groundtruth.ivecs
+ *
+ * Every result is printed as one tab-separated line (section, name, metric,
+ * value) so that two runs can be compared with standard tools. Run with
+ * --help for all options.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "TypedIndex.h"
+
+struct BenchmarkOptions {
+  std::string basePath;
+  std::string queriesPath;
+  std::string groundTruthPath;
+  SpaceType space = SpaceType::Euclidean;
+  StorageDataType storageDataType = StorageDataType::Float32;
+  int numBase = 50000;
+  int numQueries = 1000;
+  int dimensions = 128;
+  int k = 10;
+  size_t M = 12;
+  size_t efConstruction = 200;
+  int numThreads = std::thread::hardware_concurrency();
+  int repetitions = 5;
+  bool bulkBuild = false;
+  std::vector<long> efValues = {10, 20, 40, 80, 160, 320};
+  std::vector<int> kernelDimensions = {16, 128, 384, 768, 1536};
+  std::set<std::string> sections = {"kernels", "build", "search", "load"};
+};
+
+/**
+ * Vectors stored back to back, as read from an .fvecs file or generated.
+ */
+struct Dataset {
+  std::vector<float> data;
+  int numVectors = 0;
+  int dimensions = 0;
+
+  const float *operator[](int i) const { return &data[(size_t)i * dimensions]; }
+
+  NDArray<float, 2> toNDArray() const {
+    return NDArray<float, 2>(data, {numVectors, dimensions});
+  }
+};
+
+void printResult(const std::string &section, const std::string &name,
+                 const std::string &metric, double value) {
+  printf("%s\t%s\t%s\t%.6g\n", section.c_str(), name.c_str(), metric.c_str(),
+         value);
+  fflush(stdout);
+}
+
+/**
+ * Run `function` `repetitions` times and return the median wall-clock time
+ * of one run, in seconds.
+ */
+template <typename F> double medianSeconds(int repetitions, F function) {
+  std::vector<double> times;
+  for (int i = 0; i < std::max(1, repetitions); i++) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    times.push_back(elapsed.count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+/**
+ * Read vectors in the .fvecs format (each vector is an int32 dimension count
+ * followed by that many floats), or .ivecs if T is int32_t. At most
+ * `maxVectors` are read, if positive.
+ */
+template <typename T>
+std::vector<T> readVecs(const std::string &path, int maxVectors,
+                        int &numVectors, int &dimensions) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+
+  std::vector<T> data;
+  numVectors = 0;
+  dimensions = 0;
+  int32_t rowDimensions;
+  while ((maxVectors <= 0 || numVectors < maxVectors) &&
+         file.read((char *)&rowDimensions, sizeof(rowDimensions))) {
+    if (dimensions == 0) {
+      dimensions = rowDimensions;
+    } else if (rowDimensions != dimensions) {
+      throw std::runtime_error(path + " contains vectors of different sizes (" +
+                               std::to_string(dimensions) + " and " +
+                               std::to_string(rowDimensions) + ").");
+    }
+    size_t offset = data.size();
+    data.resize(offset + dimensions);
+    if (!file.read((char *)&data[offset], dimensions * sizeof(T))) {
+      throw std::runtime_error(path + " ended in the middle of a vector.");
+    }
+    numVectors++;
+  }
+  return data;
+}
+
+Dataset loadDataset(const std::string &path, int maxVectors) {
+  Dataset dataset;
+  dataset.data = readVecs<float>(path, maxVectors, dataset.numVectors,
+                                 dataset.dimensions);
+  return dataset;
+}
+
+/**
+ * Random vectors clustered around a few hundred centers, which (unlike
+ * uniformly random vectors) have meaningful nearest neighbors. Values are in
+ * [-1, 1], so that every storage data type can represent them.
+ */
+Dataset generateDataset(int numVectors, int dimensions, unsigned int seed) {
+  std::mt19937 generator(seed);
+  std::uniform_real_distribution<float> uniform(-0.8f, 0.8f);
+  std::normal_distribution<float> noise(0.0f, 0.05f);
+
+  const int numClusters = 256;
+  std::vector<float> centers((size_t)numClusters * dimensions);
+  for (float &value : centers) {
+    value = uniform(generator);
+  }
+
+  Dataset dataset;
+  dataset.numVectors = numVectors;
+  dataset.dimensions = dimensions;
+  dataset.data.resize((size_t)numVectors * dimensions);
+  for (int i = 0; i < numVectors; i++) {
+    const float *center = &centers[(size_t)(generator() % numClusters) *
+                                   dimensions];
+    for (int j = 0; j < dimensions; j++) {
+      dataset.data[(size_t)i * dimensions + j] =
+          std::clamp(center[j] + noise(generator), -1.0f, 1.0f);
+    }
+  }
+  return dataset;
+}
+
+/**
+ * The exact `k` nearest neighbors of each query, found by brute force.
+ */
+std::vector<int> computeGroundTruth(const Dataset &base,
+                                    const Dataset &queries, SpaceType space,
+                                    int k, int numThreads) {
+  std::vector<float> normalizedBase;
+  std::vector<float> normalizedQueries;
+  const float *baseData = base.data.data();
+  const float *queryData = queries.data.data();
+  if (space == SpaceType::Cosine) {
+    normalizedBase.resize(base.data.size());
+    normalizedQueries.resize(queries.data.size());
+    for (int i = 0; i < base.numVectors; i++) {
+      normalizeVector<float, float>(base[i], &normalizedBase[(size_t)i *
+                                                             base.dimensions],
+                                    base.dimensions);
+    }
+    for (int i = 0; i < queries.numVectors; i++) {
+      normalizeVector<float, float>(
+          queries[i], &normalizedQueries[(size_t)i * queries.dimensions],
+          queries.dimensions);
+    }
+    baseData = normalizedBase.data();
+    queryData = normalizedQueries.data();
+  }
+
+  int dimensions = base.dimensions;
+  std::vector<int> groundTruth((size_t)queries.numVectors * k);
+  ParallelFor(0, queries.numVectors, numThreads, [&](size_t q, size_t) {
+    const float *query = queryData + q * dimensions;
+    std::vector<std::pair<float, int>> distances(base.numVectors);
+    for (int i = 0; i < base.numVectors; i++) {
+      const float *vector = baseData + (size_t)i * dimensions;
+      float distance = 0;
+      for (int j = 0; j < dimensions; j++) {
+        if (space == SpaceType::Euclidean) {
+          float difference = query[j] - vector[j];
+          distance += difference * difference;
+        } else {
+          distance -= query[j] * vector[j];
+        }
+      }
+      distances[i] = {distance, i};
+    }
+    std::partial_sort(distances.begin(), distances.begin() + k,
+                      distances.end());
+    for (int i = 0; i < k; i++) {
+      groundTruth[q * k + i] = distances[i].second;
+    }
+  });
+  return groundTruth;
+}
+
+/**
+ * Time every distance function used for the given storage type, in both
+ * spaces, at each of the requested dimensions.
+ */
+template <typename data_t, typename scalefactor = std::ratio<1, 1>>
+void benchmarkKernels(const BenchmarkOptions &options) {
+  const int numVectors = 1024;
+  const size_t numCalls = 1 << 20;
+  std::string storageName = storageDataTypeName<data_t>();
+
+  for (int dimensions : options.kernelDimensions) {
+    Dataset vectors = generateDataset(numVectors, dimensions, 42);
+    std::vector<data_t> converted(vectors.data.size());
+    floatToDataType<data_t, scalefactor>(vectors.data.data(), converted.data(),
+                                         vectors.data.size());
+
+    for (SpaceType space : {SpaceType::Euclidean, SpaceType::InnerProduct}) {
+      std::unique_ptr<hnswlib::Space<float, data_t>> spaceImpl;
+      if (space == SpaceType::Euclidean) {
+        spaceImpl = std::make_unique<
+            hnswlib::EuclideanSpace<float, data_t, scalefactor>>(dimensions);
+      } else {
+        spaceImpl = std::make_unique<
+            hnswlib::InnerProductSpace<float, data_t, scalefactor>>(
+            dimensions);
+      }
+      hnswlib::DISTFUNC<float, data_t> distance = spaceImpl->get_dist_func();
+      size_t param = spaceImpl->get_dist_func_param();
+
+      // Sum the distances so that the calls can't be optimized away.
+      volatile float sink = 0;
+      double seconds = medianSeconds(options.repetitions, [&]() {
+        float sum = 0;
+        for (size_t i = 0; i < numCalls; i++) {
+          sum += distance(&converted[(i % numVectors) * dimensions],
+                          &converted[((i * 7 + 1) % numVectors) * dimensions],
+                          param);
+        }
+        sink = sink + sum;
+      });
+
+      printResult("kernels",
+                  toString(space) + "/" + storageName + "/" +
+                      std::to_string(dimensions),
+                  "ns_per_distance", seconds * 1e9 / numCalls);
+    }
+  }
+}
+
+/**
+ * Build an index of the base vectors, then measure search throughput and
+ * recall at each `ef`, and how long the saved index takes to load.
+ */
+template <typename data_t, typename scalefactor = std::ratio<1, 1>>
+void benchmarkIndex(const BenchmarkOptions &options, const Dataset &base,
+                    const Dataset &queries,
+                    const std::vector<int> &groundTruth) {
+  std::string name = toString(options.space) + "/" +
+                     storageDataTypeName<data_t>() + "/M" +
+                     std::to_string(options.M);
+  NDArray<float, 2> baseArray = base.toNDArray();
+  NDArray<float, 2> queryArray = queries.toNDArray();
+
+  std::unique_ptr<TypedIndex<float, data_t, scalefactor>> index;
+  auto buildIndex = [&](bool bulk) {
+    index = std::make_unique<TypedIndex<float, data_t, scalefactor>>(
+        options.space, base.dimensions, options.M, options.efConstruction,
+        /* randomSeed */ 1, base.numVectors);
+    if (bulk) {
+      index->buildFromArray(baseArray, {}, options.numThreads);
+    } else {
+      index->addItems(baseArray, {}, options.numThreads);
+    }
+  };
+
+  if (options.sections.count("build")) {
+    // Building is slow, so each method is only timed once. The index built
+    // last (with --build-mode) is the one searched below.
+    for (bool bulk : {!options.bulkBuild, options.bulkBuild}) {
+      std::string buildName =
+          name + (bulk ? "/buildFromArray" : "/addItems");
+      double seconds = medianSeconds(1, [&]() { buildIndex(bulk); });
+      printResult("build", buildName, "seconds", seconds);
+      printResult("build", buildName, "vectors_per_second",
+                  base.numVectors / seconds);
+    }
+  } else {
+    buildIndex(options.bulkBuild);
+  }
+
+  if (options.sections.count("search")) {
+    for (long ef : options.efValues) {
+      if (ef < options.k) {
+        continue;
+      }
+      std::string efName = name + "/ef" + std::to_string(ef);
+
+      std::vector<hnswlib::labeltype> labels;
+      double singleThreadedSeconds =
+          medianSeconds(options.repetitions, [&]() {
+            labels = std::get<0>(
+                         index->query(queryArray, options.k,
+                                      /* numThreads */ 1, ef))
+                         .data;
+          });
+      double multiThreadedSeconds =
+          medianSeconds(options.repetitions, [&]() {
+            index->query(queryArray, options.k, options.numThreads, ef);
+          });
+
+      size_t numFound = 0;
+      for (int q = 0; q < queries.numVectors; q++) {
+        const int *expected = &groundTruth[(size_t)q * options.k];
+        for (int i = 0; i < options.k; i++) {
+          if (std::find(expected, expected + options.k,
+                        (int)labels[(size_t)q * options.k + i]) !=
+              expected + options.k) {
+            numFound++;
+          }
+        }
+      }
+
+      printResult("search", efName, "recall_at_" + std::to_string(options.k),
+                  (double)numFound / ((size_t)queries.numVectors * options.k));
+      printResult("search", efName, "qps_1_thread",
+                  queries.numVectors / singleThreadedSeconds);
+      printResult("search", efName,
+                  "qps_" + std::to_string(options.numThreads) + "_threads",
+                  queries.numVectors / multiThreadedSeconds);
+    }
+  }
+
+  if (options.sections.count("load")) {
+    std::string path =
+        (std::filesystem::temp_directory_path() /
+         ("voyager_benchmark_" + std::to_string(getpid()) + ".voy"))
+            .string();
+    index->saveIndex(path);
+    printResult("load", name, "file_megabytes",
+                std::filesystem::file_size(path) / 1e6);
+
+    double loadSeconds = medianSeconds(options.repetitions, [&]() {
+      auto inputStream = std::make_shared<FileInputStream>(path);
+      loadTypedIndexFromMetadata(voyager::Metadata::loadFromStream(inputStream),
+                                 inputStream);
+    });
+    printResult("load", name, "seconds", loadSeconds);
+
+    double mmapSeconds = medianSeconds(options.repetitions, [&]() {
+      auto inputStream = std::make_shared<MemoryMappedInputStream>(path);
+      loadTypedIndexFromMetadata(voyager::Metadata::loadFromStream(inputStream),
+                                 inputStream, /* searchOnly */ true);
+    });
+    printResult("load", name, "mmap_seconds", mmapSeconds);
+
+    std::remove(path.c_str());
+  }
+}
+
+template <typename T> std::vector<T> parseList(const std::string &value) {
+  std::vector<T> result;
+  std::stringstream stream(value);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    result.push_back((T)std::stol(item));
+  }
+  return result;
+}
+
+void printUsage() {
+  printf(
+      "Usage: VoyagerBenchmarks [options]\n"
+      "\n"
+      "Dataset (synthetic unless --base is given):\n"
+      "  --base PATH           Base vectors (.fvecs)\n"
+      "  --queries PATH        Query vectors (.fvecs); required with --base\n"
+      "  --groundtruth PATH    Nearest neighbors of each query (.ivecs);\n"
+      "                        computed by brute force if not given\n"
+      "  --num-base N          Number of base vectors to use (default: "
+      "50000)\n"
+      "  --num-queries N       Number of queries to use (default: 1000)\n"
+      "  --dimensions N        Synthetic vector size (default: 128)\n"
+      "\n"
+      "Index:\n"
+      "  --space NAME          Euclidean, InnerProduct or Cosine\n"
+      "  --storage NAME        Float32, Float8 or E4M3 (default: Float32)\n"
+      "  --M N                 (default: 12)\n"
+      "  --ef-construction N   (default: 200)\n"
+      "  --build-mode NAME     addItems or buildFromArray: how to build the\n"
+      "                        index that's searched (default: addItems)\n"
+      "  --k N                 Neighbors per query (default: 10)\n"
+      "  --ef LIST             Comma-separated ef values to search with\n"
+      "\n"
+      "Benchmark:\n"
+      "  --only LIST           Comma-separated sections to run, from: "
+      "kernels,\n"
+      "                        build, search, load (default: all)\n"
+      "  --kernel-dimensions LIST  Vector sizes for the kernel benchmarks\n"
+      "  --threads N           Threads for building and batch search\n"
+      "  --repetitions N       Repetitions per measurement; the median is\n"
+      "                        reported (default: 5)\n");
+}
+
+BenchmarkOptions parseOptions(int argc, char **argv) {
+  BenchmarkOptions options;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (flag == "--help" || flag == "-h") {
+      printUsage();
+      exit(0);
+    }
+    if (i + 1 >= argc) {
+      throw std::invalid_argument("Missing value for " + flag);
+    }
+    std::string value = argv[++i];
+
+    if (flag == "--base") {
+      options.basePath = value;
+    } else if (flag == "--queries") {
+      options.queriesPath = value;
+    } else if (flag == "--groundtruth") {
+      options.groundTruthPath = value;
+    } else if (flag == "--num-base") {
+      options.numBase = std::stoi(value);
+    } else if (flag == "--num-queries") {
+      options.numQueries = std::stoi(value);
+    } else if (flag == "--dimensions") {
+      options.dimensions = std::stoi(value);
+    } else if (flag == "--space") {
+      if (value == "Euclidean") {
+        options.space = SpaceType::Euclidean;
+      } else if (value == "InnerProduct") {
+        options.space = SpaceType::InnerProduct;
+      } else if (value == "Cosine") {
+        options.space = SpaceType::Cosine;
+      } else {
+        throw std::invalid_argument("Unknown space: " + value);
+      }
+    } else if (flag == "--storage") {
+      if (value == "Float32") {
+        options.storageDataType = StorageDataType::Float32;
+      } else if (value == "Float8") {
+        options.storageDataType = StorageDataType::Float8;
+      } else if (value == "E4M3") {
+        options.storageDataType = StorageDataType::E4M3;
+      } else {
+        throw std::invalid_argument("Unknown storage data type: " + value);
+      }
+    } else if (flag == "--build-mode") {
+      if (value == "addItems" || value == "buildFromArray") {
+        options.bulkBuild = value == "buildFromArray";
+      } else {
+        throw std::invalid_argument("Unknown build mode: " + value);
+      }
+    } else if (flag == "--M") {
+      options.M = std::stoul(value);
+    } else if (flag == "--ef-construction") {
+      options.efConstruction = std::stoul(value);
+    } else if (flag == "--k") {
+      options.k = std::stoi(value);
+    } else if (flag == "--ef") {
+      options.efValues = parseList<long>(value);
+    } else if (flag == "--only") {
+      std::stringstream stream(value);
+      std::string section;
+      options.sections.clear();
+      while (std::getline(stream, section, ',')) {
+        options.sections.insert(section);
+      }
+    } else if (flag == "--kernel-dimensions") {
+      options.kernelDimensions = parseList<int>(value);
+    } else if (flag == "--threads") {
+      options.numThreads = std::stoi(value);
+    } else if (flag == "--repetitions") {
+      options.repetitions = std::stoi(value);
+    } else {
+      throw std::invalid_argument("Unknown option: " + flag);
+    }
+  }
+  return options;
+}
+
+int main(int argc, char **argv) {
+  BenchmarkOptions options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    fprintf(stderr, "%s\n\n", e.what());
+    printUsage();
+    return 1;
+  }
+
+  try {
+    if (options.sections.count("kernels")) {
+      benchmarkKernels<float>(options);
+      benchmarkKernels<int8_t, std::ratio<1, 127>>(options);
+      benchmarkKernels<E4M3>(options);
+    }
+
+    if (!options.sections.count("build") && !options.sections.count("search") &&
+        !options.sections.count("load")) {
+      return 0;
+    }
+
+    Dataset base;
+    Dataset queries;
+    if (!options.basePath.empty()) {
+      if (options.queriesPath.empty()) {
+        throw std::invalid_argument("--queries is required with --base");
+      }
+      base = loadDataset(options.basePath, options.numBase);
+      queries = loadDataset(options.queriesPath, options.numQueries);
+      if (base.dimensions != queries.dimensions) {
+        throw std::invalid_argument(
+            "Base and query vectors have different sizes.");
+      }
+    } else {
+      base = generateDataset(options.numBase, options.dimensions, 1);
+      queries = generateDataset(options.numQueries, options.dimensions, 2);
+    }
+
+    std::vector<int> groundTruth;
+    if (!options.groundTruthPath.empty()) {
+      // Ground truth files usually list 100 neighbors per query; only the
+      // first k of each are needed.
+      int numRows, numColumns;
+      std::vector<int> allNeighbors = readVecs<int32_t>(
+          options.groundTruthPath, queries.numVectors, numRows, numColumns);
+      if (numRows < queries.numVectors || numColumns < options.k) {
+        throw std::invalid_argument(
+            "The ground truth file has too few queries or neighbors.");
+      }
+      for (int q = 0; q < queries.numVectors; q++) {
+        groundTruth.insert(groundTruth.end(),
+                           allNeighbors.begin() + (size_t)q * numColumns,
+                           allNeighbors.begin() + (size_t)q * numColumns +
+                               options.k);
+      }
+    } else if (options.sections.count("search")) {
+      groundTruth = computeGroundTruth(base, queries, options.space, options.k,
+                                       options.numThreads);
+    }
+
+    fprintf(stderr, "Indexing %d vectors of %d dimensions, with %d queries.\n",
+            base.numVectors, base.dimensions, queries.numVectors);
+
+    switch (options.storageDataType) {
+    case StorageDataType::Float32:
+      benchmarkIndex<float>(options, base, queries, groundTruth);
+      break;
+    case StorageDataType::Float8:
+      benchmarkIndex<int8_t, std::ratio<1, 127>>(options, base, queries,
+                                                  groundTruth);
+      break;
+    case StorageDataType::E4M3:
+      benchmarkIndex<E4M3>(options, base, queries, groundTruth);
+      break;
+    default:
+      throw std::invalid_argument("Unsupported storage data type.");
+    }
+  } catch (const std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+
+  return 0;
+}
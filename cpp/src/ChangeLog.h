@@ -0,0 +1,435 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "hnswlib.h"
+
+/**
+ * An append-only log of the changes made to an index since its last
+ * snapshot was written, stored next to the snapshot's file (see
+ * TypedIndex::openChangeLog). Appending a change costs as much as the
+ * change itself, rather than as much as re-saving the whole index.
+ *
+ * The log starts with the ID of the snapshot it applies to, so a log left
+ * behind by an older snapshot is never replayed onto a newer one. Each
+ * record after that carries its length and a checksum; replaying stops at
+ * the first incomplete or corrupt record, which is what's left behind if a
+ * process dies halfway through appending one.
+ *
+ * Records are flushed to the operating system as they're written, so they
+ * survive the process crashing; only snapshots are synced to disk.
+ */
+class ChangeLog {
+public:
+  static constexpr uint32_t MAGIC =
+      'V' | 'L' << 8 | 'O' << 16 | 'G' << 24; // "VLOG" on disk
+  static constexpr int ser_version = 1;       // serialization version
+
+  // The largest record payload, as its length is stored in 32 bits.
+  static constexpr size_t MAX_RECORD_SIZE = UINT32_MAX;
+
+  enum RecordType : uint8_t {
+    AddItems = 1,
+    MarkDeleted = 2,
+    UnmarkDeleted = 3,
+  };
+
+  struct Record {
+    RecordType type;
+
+    // For AddItems: the vectors added (row-major) and their IDs, and the ID
+    // the index would have assigned to the next vector afterwards.
+    std::vector<float> vectors;
+    std::vector<hnswlib::labeltype> ids;
+    hnswlib::labeltype nextLabel = 0;
+    bool replaceDeleted = false;
+
+    // For MarkDeleted and UnmarkDeleted:
+    hnswlib::labeltype label = 0;
+  };
+
+  struct ReplayResult {
+    // False if there was no log for the given snapshot.
+    bool matched = false;
+    size_t numChanges = 0;
+    // True if replaying stopped at an incomplete or corrupt record.
+    bool truncated = false;
+  };
+
+  /**
+   * The path of the change log for the index stored at `pathToIndex`.
+   */
+  static std::string getPath(const std::string &pathToIndex) {
+    return pathToIndex + ".log";
+  }
+
+  /**
+   * Create an empty change log for the snapshot with the given ID,
+   * atomically replacing any log already at `path`.
+   */
+  static std::unique_ptr<ChangeLog> create(const std::string &path,
+                                           uint64_t snapshotId,
+                                           int numDimensions) {
+    std::string tmpPath = path + ".tmp";
+    {
+      ChangeLog log(tmpPath, "wb");
+      std::string header;
+      append(header, MAGIC);
+      append(header, ser_version);
+      append(header, snapshotId);
+      append(header, numDimensions);
+      log.write(header);
+    }
+    syncFile(tmpPath);
+    replaceFile(tmpPath, path);
+    return std::unique_ptr<ChangeLog>(new ChangeLog(path, "ab"));
+  }
+
+  /**
+   * Open the existing change log at `path` to append more records to it.
+   * The log should have been replayed in full first.
+   */
+  static std::unique_ptr<ChangeLog> openForAppend(const std::string &path) {
+    return std::unique_ptr<ChangeLog>(new ChangeLog(path, "ab"));
+  }
+
+  /**
+   * Pass each record of the change log at `path` to `apply`, in the order
+   * they were written, if the log belongs to the snapshot with the given
+   * ID. Logs that don't exist or belong to other snapshots are ignored.
+   */
+  static ReplayResult replay(const std::string &path, uint64_t snapshotId,
+                             int numDimensions,
+                             std::function<void(const Record &)> apply) {
+    ReplayResult result;
+    std::unique_ptr<FILE, decltype(&fclose)> handle(fopen(path.c_str(), "rb"),
+                                                    &fclose);
+    if (!handle) {
+      return result;
+    }
+
+    uint32_t magic;
+    int version;
+    uint64_t logSnapshotId;
+    int logNumDimensions;
+    if (!read(handle.get(), magic) || !read(handle.get(), version) ||
+        !read(handle.get(), logSnapshotId) ||
+        !read(handle.get(), logNumDimensions)) {
+      return result;
+    }
+
+    if (magic != MAGIC) {
+      throw std::domain_error("The file at " + path +
+                              " is not a Voyager change log.");
+    }
+    if (version != ser_version) {
+      throw std::domain_error("Unable to read change log with version " +
+                              std::to_string(version) + ".");
+    }
+    if (logSnapshotId != snapshotId) {
+      return result;
+    }
+    if (logNumDimensions != numDimensions) {
+      throw std::domain_error(
+          "The change log at " + path + " contains vectors with " +
+          std::to_string(logNumDimensions) +
+          " dimensions, but its index has " + std::to_string(numDimensions) +
+          " dimensions.");
+    }
+    result.matched = true;
+
+    int64_t recordsStart = tell(handle.get());
+    seek(handle.get(), 0, SEEK_END);
+    int64_t logSize = tell(handle.get());
+    seek(handle.get(), recordsStart, SEEK_SET);
+
+    std::string payload;
+    while (true) {
+      uint32_t length, checksum;
+      int64_t recordStart = tell(handle.get());
+      if (!read(handle.get(), length)) {
+        // Either the end of the log, or a torn record header:
+        result.truncated = recordStart != logSize;
+        break;
+      }
+      if (length > (uint64_t)(logSize - recordStart)) {
+        result.truncated = true;
+        break;
+      }
+      payload.resize(length);
+      if (!read(handle.get(), checksum) ||
+          fread(&payload[0], 1, length, handle.get()) != length ||
+          fnv1a(payload) != checksum) {
+        result.truncated = true;
+        break;
+      }
+
+      Record record;
+      if (!parse(payload, numDimensions, record)) {
+        result.truncated = true;
+        break;
+      }
+      apply(record);
+      result.numChanges +=
+          record.type == AddItems ? record.ids.size() : (size_t)1;
+    }
+    return result;
+  }
+
+  /**
+   * Append a record of vectors (`count` rows of the log's number of
+   * dimensions) having been added to the index under the given IDs. Batches
+   * too large for one record are split across as many as they need.
+   */
+  void appendAddItems(const float *vectors, const hnswlib::labeltype *ids,
+                      size_t count, int numDimensions,
+                      hnswlib::labeltype nextLabel, bool replaceDeleted) {
+    const size_t headerSize = 1 + 1 + 8 + 8;
+    const size_t rowSize = 8 + numDimensions * sizeof(float);
+    const size_t maxRowsPerRecord = (MAX_RECORD_SIZE - headerSize) / rowSize;
+
+    for (size_t start = 0; start < count; start += maxRowsPerRecord) {
+      size_t rows = std::min(count - start, maxRowsPerRecord);
+      std::string payload;
+      payload.reserve(headerSize + rows * rowSize);
+      append(payload, (uint8_t)AddItems);
+      append(payload, (uint8_t)replaceDeleted);
+      append(payload, (uint64_t)nextLabel);
+      append(payload, (uint64_t)rows);
+      for (size_t i = start; i < start + rows; i++) {
+        append(payload, (uint64_t)ids[i]);
+      }
+      payload.append((const char *)(vectors + start * numDimensions),
+                     rows * numDimensions * sizeof(float));
+      appendRecord(payload);
+    }
+  }
+
+  /**
+   * Append a record of the given label having been marked (or unmarked) as
+   * deleted.
+   */
+  void appendLabel(RecordType type, hnswlib::labeltype label) {
+    std::string payload;
+    append(payload, (uint8_t)type);
+    append(payload, (uint64_t)label);
+    appendRecord(payload);
+  }
+
+  /**
+   * A random, non-zero ID for a new snapshot.
+   */
+  static uint64_t newSnapshotId() {
+    std::random_device device;
+    std::mt19937_64 generator(((uint64_t)device() << 32) ^ device());
+    uint64_t id;
+    do {
+      id = generator();
+    } while (id == 0);
+    return id;
+  }
+
+  /**
+   * Ensure the contents of the file at `path` have been written to disk.
+   */
+  static void syncFile(const std::string &path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0 || ::fsync(fd) != 0) {
+      int error = errno;
+      if (fd >= 0)
+        ::close(fd);
+      throw std::runtime_error("Failed to sync file to disk (errno " +
+                               std::to_string(error) + "): " + path);
+    }
+    ::close(fd);
+#endif
+  }
+
+  /**
+   * Move the file at `from` to `to`, replacing whatever was there.
+   */
+  static void replaceFile(const std::string &from, const std::string &to) {
+#ifdef _WIN32
+    // rename() doesn't replace existing files on Windows:
+    std::remove(to.c_str());
+#endif
+    if (std::rename(from.c_str(), to.c_str()) != 0) {
+      throw std::runtime_error("Failed to rename " + from + " to " + to +
+                               " (errno " + std::to_string(errno) + ").");
+    }
+  }
+
+  ~ChangeLog() {
+    if (handle) {
+      fclose(handle);
+    }
+  }
+
+private:
+  FILE *handle = nullptr;
+  std::string path;
+
+  ChangeLog(const std::string &path, const char *mode) : path(path) {
+    errno = 0;
+    handle = fopen(path.c_str(), mode);
+    if (!handle) {
+      throw std::runtime_error("Failed to open change log for writing (errno " +
+                               std::to_string(errno) + "): " + path);
+    }
+  }
+
+  ChangeLog(const ChangeLog &) = delete;
+  ChangeLog &operator=(const ChangeLog &) = delete;
+
+  void appendRecord(const std::string &payload) {
+    if (payload.size() > MAX_RECORD_SIZE) {
+      throw std::length_error("Change log records can't be larger than " +
+                              std::to_string(MAX_RECORD_SIZE) + " bytes.");
+    }
+    std::string record;
+    record.reserve(8 + payload.size());
+    append(record, (uint32_t)payload.size());
+    append(record, fnv1a(payload));
+    record += payload;
+    write(record);
+  }
+
+  void write(const std::string &bytes) {
+    if (fwrite(bytes.data(), 1, bytes.size(), handle) != bytes.size() ||
+        fflush(handle) != 0) {
+      throw std::runtime_error("Failed to write to change log: " + path);
+    }
+  }
+
+  // Files may be larger than a long can address (e.g.: on Windows):
+  static int64_t tell(FILE *handle) {
+#ifdef _WIN32
+    return _ftelli64(handle);
+#else
+    return ftello(handle);
+#endif
+  }
+
+  static void seek(FILE *handle, int64_t offset, int origin) {
+#ifdef _WIN32
+    _fseeki64(handle, offset, origin);
+#else
+    fseeko(handle, offset, origin);
+#endif
+  }
+
+  template <typename T> static void append(std::string &buffer, T value) {
+    buffer.append((const char *)&value, sizeof(T));
+  }
+
+  template <typename T> static bool read(FILE *handle, T &value) {
+    return fread(&value, sizeof(T), 1, handle) == 1;
+  }
+
+  template <typename T>
+  static bool take(const std::string &buffer, size_t &offset, T &value) {
+    if (offset + sizeof(T) > buffer.size()) {
+      return false;
+    }
+    std::memcpy(&value, buffer.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+  }
+
+  static bool parse(const std::string &payload, int numDimensions,
+                    Record &record) {
+    size_t offset = 0;
+    uint8_t type;
+    if (!take(payload, offset, type)) {
+      return false;
+    }
+    record.type = (RecordType)type;
+
+    switch (type) {
+    case AddItems: {
+      uint8_t replaceDeleted;
+      uint64_t nextLabel, count;
+      if (!take(payload, offset, replaceDeleted) ||
+          !take(payload, offset, nextLabel) || !take(payload, offset, count)) {
+        return false;
+      }
+      if (count > payload.size()) {
+        return false;
+      }
+      size_t vectorBytes = count * numDimensions * sizeof(float);
+      if (payload.size() - offset != count * sizeof(uint64_t) + vectorBytes) {
+        return false;
+      }
+      record.replaceDeleted = replaceDeleted;
+      record.nextLabel = nextLabel;
+      record.ids.resize(count);
+      for (size_t i = 0; i < count; i++) {
+        uint64_t id;
+        if (!take(payload, offset, id)) {
+          return false;
+        }
+        record.ids[i] = id;
+      }
+      record.vectors.resize(count * numDimensions);
+      std::memcpy(record.vectors.data(), payload.data() + offset, vectorBytes);
+      return true;
+    }
+    case MarkDeleted:
+    case UnmarkDeleted: {
+      uint64_t label;
+      if (!take(payload, offset, label) || offset != payload.size()) {
+        return false;
+      }
+      record.label = label;
+      return true;
+    }
+    default:
+      return false;
+    }
+  }
+
+  // 32-bit FNV-1a, to detect records that were only partially written.
+  static uint32_t fnv1a(const std::string &bytes) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char byte : bytes) {
+      hash = (hash ^ byte) * 16777619u;
+    }
+    return hash;
+  }
+};
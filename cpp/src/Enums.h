@@ -23,6 +23,11 @@ enum class StorageDataType : unsigned char {
   // four bits for exponent, 3 bits for mantissa,
   // allowing representation of values from 2e-9 to 448.
   E4M3 = 3 << 4,
+
+  // Product quantization: each vector is split into subvectors, each stored
+  // as a single byte (the index of its nearest centroid, learned from the
+  // vectors first added to the index).
+  PQ = 4 << 4,
 };
 
 inline const std::string toString(StorageDataType sdt) {
@@ -33,6 +38,8 @@ inline const std::string toString(StorageDataType sdt) {
     return "Float32";
   case StorageDataType::E4M3:
     return "E4M3";
+  case StorageDataType::PQ:
+    return "PQ";
   default:
     return "Unknown storage data type (value " + std::to_string((int)sdt) + ")";
   }
@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include <functional>
 #include <iostream>
 #include <optional>
 #include <ratio>
@@ -30,6 +31,17 @@
 #include "array_utils.h"
 #include "hnswlib.h"
 
+/**
+ * The results of a batch of range searches. The results for query `i` are
+ * `labels` and `distances` from `offsets[i]` up to `offsets[i + 1]`, nearest
+ * first; `offsets` has one more entry than there were queries.
+ */
+struct RangeSearchResults {
+  std::vector<size_t> offsets;
+  std::vector<hnswlib::labeltype> labels;
+  std::vector<float> distances;
+};
+
 /**
  * A C++ wrapper class for a Voyager index, which accepts
  * and returns floating-point data.
@@ -67,42 +79,115 @@ public:
   virtual void loadIndex(std::shared_ptr<InputStream> inputStream,
                          bool searchOnly = false) = 0;
 
+  virtual void openChangeLog(const std::string &pathToIndex,
+                             size_t checkpointInterval = 0) = 0;
+  virtual void checkpoint() = 0;
+  virtual void closeChangeLog() = 0;
+  virtual bool isLogAware() const = 0;
+
   virtual float getDistance(std::vector<float> a, std::vector<float> b) = 0;
 
   virtual hnswlib::labeltype addItem(std::vector<float> vector,
-                                     std::optional<hnswlib::labeltype> id) = 0;
+                                     std::optional<hnswlib::labeltype> id,
+                                     bool replaceDeleted = false) = 0;
 
   virtual std::vector<hnswlib::labeltype>
   addItems(std::vector<std::vector<float>> input,
-           std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1) = 0;
+           std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+           bool replaceDeleted = false) = 0;
 
   virtual std::vector<hnswlib::labeltype>
   addItems(NDArray<float, 2> input, std::vector<hnswlib::labeltype> ids = {},
-           int numThreads = -1) = 0;
+           int numThreads = -1, bool replaceDeleted = false) = 0;
+
+  // As addItems(), but for `numVectors` vectors of this index's number of
+  // dimensions stored back to back, which may be read without copying them.
+  virtual std::vector<hnswlib::labeltype>
+  addItemsFrom(const float *input, size_t numVectors,
+               std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+               bool replaceDeleted = false) = 0;
+
+  // Add all of the given vectors to this empty index at once, which is much
+  // faster than addItems for large inputs. `progress(numAdded, numTotal)` is
+  // called periodically from the calling thread while the graph is built.
+  virtual std::vector<hnswlib::labeltype>
+  buildFromArray(NDArray<float, 2> input,
+                 std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+                 std::function<void(size_t, size_t)> progress = nullptr) = 0;
+
+  // Train this index's product quantizer on the given sample of vectors, if
+  // it uses PQ storage.
+  virtual void train(NDArray<float, 2> input, int numThreads = -1) = 0;
 
   virtual std::vector<float> getVector(hnswlib::labeltype id) = 0;
   virtual NDArray<float, 2> getVectors(std::vector<hnswlib::labeltype> ids) = 0;
 
   virtual std::vector<hnswlib::labeltype> getIDs() const = 0;
   virtual long long getIDsCount() const = 0;
-  virtual const std::unordered_map<hnswlib::labeltype, hnswlib::tableint> &
-  getIDsMap() const = 0;
+  // A read-only, map-like view from each ID to its position in the index.
+  virtual const hnswlib::LabelLookup &getIDsMap() const = 0;
 
   virtual std::tuple<std::vector<hnswlib::labeltype>, std::vector<float>>
-  query(std::vector<float> queryVector, int k = 1, long queryEf = -1) = 0;
+  query(std::vector<float> queryVector, int k = 1, long queryEf = -1,
+        const hnswlib::BaseFilterFunctor *filter = nullptr,
+        hnswlib::SearchStats *stats = nullptr, int rerank = 0) = 0;
 
   virtual std::tuple<NDArray<hnswlib::labeltype, 2>, NDArray<float, 2>>
   query(std::vector<std::vector<float>> queryVectors, int k = 1,
-        int numThreads = -1, long queryEf = -1) = 0;
+        int numThreads = -1, long queryEf = -1,
+        const hnswlib::BaseFilterFunctor *filter = nullptr,
+        std::vector<hnswlib::SearchStats> *stats = nullptr,
+        int rerank = 0) = 0;
 
   virtual std::tuple<NDArray<hnswlib::labeltype, 2>, NDArray<float, 2>>
   query(NDArray<float, 2> queryVectors, int k = 1, int numThreads = -1,
-        long queryEf = -1) = 0;
+        long queryEf = -1, const hnswlib::BaseFilterFunctor *filter = nullptr,
+        std::vector<hnswlib::SearchStats> *stats = nullptr,
+        int rerank = 0) = 0;
+
+  // As query(), but for `numQueries` vectors stored back to back, writing
+  // `k` results per query to the caller's `labels` and `distances`.
+  virtual void queryInto(const float *queryVectors, size_t numQueries, int k,
+                         hnswlib::labeltype *labels, float *distances,
+                         int numThreads = -1, long queryEf = -1,
+                         const hnswlib::BaseFilterFunctor *filter = nullptr,
+                         std::vector<hnswlib::SearchStats> *stats = nullptr,
+                         int rerank = 0) = 0;
+
+  // As query(), but returns fewer than `k` results (rather than throwing a
+  // RecallError) if that's all that could be found. Returns how many were.
+  virtual size_t queryAtMost(const float *queryVector, int k,
+                             hnswlib::labeltype *labels, float *distances,
+                             long queryEf = -1,
+                             const hnswlib::BaseFilterFunctor *filter = nullptr,
+                             hnswlib::SearchStats *stats = nullptr,
+                             int rerank = 0) = 0;
+
+  // Find every item within `radius` of the query (or only the nearest
+  // `maxResults` of them, if that's nonzero), nearest first.
+  virtual std::tuple<std::vector<hnswlib::labeltype>, std::vector<float>>
+  rangeSearch(std::vector<float> queryVector, float radius,
+              size_t maxResults = 0, long queryEf = -1,
+              const hnswlib::BaseFilterFunctor *filter = nullptr) = 0;
+
+  virtual RangeSearchResults
+  rangeSearch(NDArray<float, 2> queryVectors, float radius,
+              size_t maxResults = 0, int numThreads = -1, long queryEf = -1,
+              const hnswlib::BaseFilterFunctor *filter = nullptr) = 0;
+
+  virtual hnswlib::SearchStats getSearchStats() const = 0;
+  virtual void resetSearchStats() = 0;
 
   virtual void markDeleted(hnswlib::labeltype label) = 0;
   virtual void unmarkDeleted(hnswlib::labeltype label) = 0;
 
   virtual void resizeIndex(size_t newSize) = 0;
+  // Whether adding more items than the index can hold resizes it (the
+  // default), rather than throwing an IndexFullError.
+  virtual void setAutoGrow(bool autoGrow) = 0;
+  virtual bool getAutoGrow() const = 0;
+  virtual size_t compact(int numThreads = -1) = 0;
+  virtual void reorder(int numThreads = -1) = 0;
   virtual size_t getMaxElements() const = 0;
   virtual size_t getNumElements() const = 0;
   virtual size_t getEfConstruction() const = 0;
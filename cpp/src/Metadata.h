@@ -23,6 +23,7 @@
  */
 
 #include "Enums.h"
+#include "ProductQuantizer.h"
 #include "StreamUtils.h"
 
 namespace voyager {
@@ -42,7 +43,7 @@ public:
   V1() {}
   virtual ~V1() {}
 
-  int version() const { return 1; }
+  virtual int version() const { return 1; }
 
   int getNumDimensions() { return numDimensions; }
 
@@ -98,6 +99,93 @@ private:
   bool useOrderPreservingTransform;
 };
 
+/**
+ * @brief Metadata for indices that need more than V1 can store: V1's fields,
+ * followed by whether the index stores a full-precision copy of each vector,
+ * and then the parameters of the storage data type. (For PQ storage, that's
+ * the product quantizer's codebook.)
+ *
+ * Indices that don't need anything more are still saved as V1, so that older
+ * versions of Voyager can keep reading them.
+ */
+class V2 : public V1 {
+public:
+  V2(int numDimensions, SpaceType spaceType, StorageDataType storageDataType,
+     float maxNorm, bool useOrderPreservingTransform,
+     bool storesFullPrecisionVectors,
+     std::shared_ptr<ProductQuantizer> quantizer)
+      : V1(numDimensions, spaceType, storageDataType, maxNorm,
+           useOrderPreservingTransform),
+        storesFullPrecisionVectors(storesFullPrecisionVectors),
+        quantizer(quantizer) {}
+
+  V2() {}
+
+  int version() const override { return 2; }
+
+  bool getStoresFullPrecisionVectors() { return storesFullPrecisionVectors; }
+
+  std::shared_ptr<ProductQuantizer> getQuantizer() { return quantizer; }
+
+  void serializeToStream(std::shared_ptr<OutputStream> stream) override {
+    V1::serializeToStream(stream);
+    writeBinaryPOD(stream, storesFullPrecisionVectors);
+    if (getStorageDataType() == StorageDataType::PQ) {
+      quantizer->serializeToStream(stream);
+    }
+  };
+
+  void loadFromStream(std::shared_ptr<InputStream> stream) override {
+    V1::loadFromStream(stream);
+    readBinaryPOD(stream, storesFullPrecisionVectors);
+    if (getStorageDataType() == StorageDataType::PQ) {
+      quantizer = ProductQuantizer::loadFromStream(stream);
+    }
+  };
+
+private:
+  bool storesFullPrecisionVectors = false;
+  std::shared_ptr<ProductQuantizer> quantizer;
+};
+
+/**
+ * @brief Metadata for a snapshot written while its index had a change log
+ * open (see ChangeLog.h): V2's fields, followed by the ID of this snapshot.
+ * Changes made after the snapshot was written are appended to a log file
+ * next to it, which is only replayed onto the snapshot with the same ID.
+ *
+ * Indices saved without a change log are still saved as V1 or V2.
+ */
+class V3 : public V2 {
+public:
+  V3(int numDimensions, SpaceType spaceType, StorageDataType storageDataType,
+     float maxNorm, bool useOrderPreservingTransform,
+     bool storesFullPrecisionVectors,
+     std::shared_ptr<ProductQuantizer> quantizer, uint64_t snapshotId)
+      : V2(numDimensions, spaceType, storageDataType, maxNorm,
+           useOrderPreservingTransform, storesFullPrecisionVectors, quantizer),
+        snapshotId(snapshotId) {}
+
+  V3() {}
+
+  int version() const override { return 3; }
+
+  uint64_t getSnapshotId() { return snapshotId; }
+
+  void serializeToStream(std::shared_ptr<OutputStream> stream) override {
+    V2::serializeToStream(stream);
+    writeBinaryPOD(stream, snapshotId);
+  };
+
+  void loadFromStream(std::shared_ptr<InputStream> stream) override {
+    V2::loadFromStream(stream);
+    readBinaryPOD(stream, snapshotId);
+  };
+
+private:
+  uint64_t snapshotId = 0;
+};
+
 static std::unique_ptr<Metadata::V1>
 loadFromStream(std::shared_ptr<InputStream> inputStream) {
   uint32_t header = inputStream->peek();
@@ -117,6 +205,16 @@ loadFromStream(std::shared_ptr<InputStream> inputStream) {
     metadata->loadFromStream(inputStream);
     return metadata;
   }
+  case 2: {
+    std::unique_ptr<Metadata::V1> metadata = std::make_unique<Metadata::V2>();
+    metadata->loadFromStream(inputStream);
+    return metadata;
+  }
+  case 3: {
+    std::unique_ptr<Metadata::V1> metadata = std::make_unique<Metadata::V3>();
+    metadata->loadFromStream(inputStream);
+    return metadata;
+  }
   default: {
     std::stringstream stream;
     stream << std::hex << version;
@@ -0,0 +1,344 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "StreamUtils.h"
+#include "std_utils.h"
+
+/**
+ * One byte of a product-quantized vector: the index of the nearest centroid
+ * in one subspace. Vectors stored with StorageDataType::PQ are arrays of
+ * these, one per subvector.
+ */
+struct PQCode {
+  uint8_t centroid;
+};
+
+/**
+ * A product quantizer: splits vectors into numSubvectors contiguous
+ * subvectors, and replaces each subvector with the index of the nearest of
+ * NUM_CENTROIDS centroids learned (with k-means) for that subspace. A vector
+ * of D floats is stored in numSubvectors bytes.
+ *
+ * Queries aren't quantized. Instead, the distances from each query subvector
+ * to every centroid of its subspace are computed once per query (into a
+ * "distance table"), after which the distance to any stored vector is just
+ * the sum of numSubvectors table lookups.
+ *
+ * If D isn't divisible by numSubvectors, the first subvectors are one
+ * dimension shorter than the rest.
+ */
+class ProductQuantizer {
+public:
+  static constexpr int NUM_CENTROIDS = 256;
+
+  // k-means is run on at most this many vectors, chosen evenly from the
+  // training set; more would slow down training without improving the
+  // codebook much.
+  static constexpr size_t MAX_TRAINING_VECTORS = 128 * NUM_CENTROIDS;
+  static constexpr int NUM_TRAINING_ITERATIONS = 15;
+
+  ProductQuantizer(int dimensions, int numSubvectors)
+      : dimensions(dimensions), numSubvectors(numSubvectors),
+        centroids((size_t)NUM_CENTROIDS * std::max(dimensions, 0), 0.0f) {
+    if (numSubvectors < 1 || numSubvectors > dimensions) {
+      throw std::invalid_argument(
+          "The number of PQ subvectors must be between 1 and the number of "
+          "dimensions (" +
+          std::to_string(dimensions) + "), but got " +
+          std::to_string(numSubvectors) + ".");
+    }
+  }
+
+  int getDimensions() const { return dimensions; }
+  int getNumSubvectors() const { return numSubvectors; }
+  bool isTrained() const { return trained; }
+
+  // The first dimension of the given subvector.
+  size_t getSubvectorStart(size_t subvector) const {
+    return subvector * dimensions / numSubvectors;
+  }
+
+  // The number of floats in a distance table.
+  size_t getDistanceTableSize() const {
+    return (size_t)numSubvectors * NUM_CENTROIDS;
+  }
+
+  /**
+   * Learn the centroids of every subspace from the given vectors (each of
+   * getDimensions() floats, back to back).
+   */
+  void train(const float *vectors, size_t numVectors, size_t numThreads = 0,
+             size_t seed = 1) {
+    if (numVectors == 0) {
+      throw std::invalid_argument(
+          "Training a product quantizer requires at least one vector.");
+    }
+
+    std::vector<size_t> sample;
+    size_t numSamples = std::min(numVectors, MAX_TRAINING_VECTORS);
+    for (size_t i = 0; i < numSamples; i++) {
+      sample.push_back(i * numVectors / numSamples);
+    }
+
+    ParallelFor(0, numSubvectors, numThreads,
+                [&](size_t subvector, size_t) {
+                  trainSubspace(subvector, vectors, sample, seed + subvector);
+                });
+    trained = true;
+  }
+
+  /**
+   * Store the index of the nearest centroid of each subvector of `vector` in
+   * `codes` (an array of getNumSubvectors() values).
+   */
+  void encode(const float *vector, PQCode *codes) const {
+    for (int subvector = 0; subvector < numSubvectors; subvector++) {
+      size_t start = getSubvectorStart(subvector);
+      codes[subvector].centroid = (uint8_t)nearestCentroid(
+          getCentroids(subvector), vector + start, getSubvectorSize(subvector));
+    }
+  }
+
+  /**
+   * Reconstruct the (approximate) vector that `codes` represents.
+   */
+  void decode(const PQCode *codes, float *vector) const {
+    for (int subvector = 0; subvector < numSubvectors; subvector++) {
+      size_t size = getSubvectorSize(subvector);
+      const float *centroid =
+          getCentroids(subvector) + codes[subvector].centroid * size;
+      std::copy(centroid, centroid + size,
+                vector + getSubvectorStart(subvector));
+    }
+  }
+
+  /**
+   * Fill `table` (of getDistanceTableSize() floats) with, for each subspace
+   * and centroid, either the squared Euclidean distance or (if innerProduct
+   * is set) the inner product between that centroid and the corresponding
+   * subvector of `query`.
+   */
+  void computeDistanceTable(const float *query, float *table,
+                            bool innerProduct) const {
+    for (int subvector = 0; subvector < numSubvectors; subvector++) {
+      size_t size = getSubvectorSize(subvector);
+      const float *centroid = getCentroids(subvector);
+      const float *querySubvector = query + getSubvectorStart(subvector);
+      float *row = table + (size_t)subvector * NUM_CENTROIDS;
+      for (int c = 0; c < NUM_CENTROIDS; c++, centroid += size) {
+        row[c] = innerProduct ? dot(querySubvector, centroid, size)
+                              : squaredDistance(querySubvector, centroid, size);
+      }
+    }
+  }
+
+  /**
+   * The squared Euclidean distance or (if innerProduct is set) the inner
+   * product between the vectors represented by two sets of codes.
+   */
+  float compareCodes(const PQCode *a, const PQCode *b,
+                     bool innerProduct) const {
+    float result = 0;
+    for (int subvector = 0; subvector < numSubvectors; subvector++) {
+      size_t size = getSubvectorSize(subvector);
+      const float *centroids = getCentroids(subvector);
+      const float *centroidA = centroids + a[subvector].centroid * size;
+      const float *centroidB = centroids + b[subvector].centroid * size;
+      result += innerProduct ? dot(centroidA, centroidB, size)
+                             : squaredDistance(centroidA, centroidB, size);
+    }
+    return result;
+  }
+
+  void serializeToStream(std::shared_ptr<OutputStream> stream) const {
+    writeBinaryPOD(stream, dimensions);
+    writeBinaryPOD(stream, numSubvectors);
+    writeBinaryPOD(stream, trained);
+    stream->write((const char *)centroids.data(),
+                  centroids.size() * sizeof(float));
+  }
+
+  static std::unique_ptr<ProductQuantizer>
+  loadFromStream(std::shared_ptr<InputStream> stream) {
+    int dimensions;
+    int numSubvectors;
+    bool trained;
+    readBinaryPOD(stream, dimensions);
+    readBinaryPOD(stream, numSubvectors);
+    readBinaryPOD(stream, trained);
+    if (dimensions < 1 || numSubvectors < 1 || numSubvectors > dimensions) {
+      throw std::domain_error(
+          "Index seems to be corrupted or unsupported. Product quantizer has " +
+          std::to_string(dimensions) + " dimensions and " +
+          std::to_string(numSubvectors) + " subvectors.");
+    }
+
+    auto quantizer = std::make_unique<ProductQuantizer>(dimensions,
+                                                        numSubvectors);
+    long long numBytes = quantizer->centroids.size() * sizeof(float);
+    if (stream->read((char *)quantizer->centroids.data(), numBytes) !=
+        numBytes) {
+      throw std::runtime_error(
+          "Failed to read " + std::to_string(numBytes) +
+          " bytes of product quantizer centroids from stream!");
+    }
+    quantizer->trained = trained;
+    return quantizer;
+  }
+
+private:
+  size_t getSubvectorSize(size_t subvector) const {
+    return getSubvectorStart(subvector + 1) - getSubvectorStart(subvector);
+  }
+
+  // The NUM_CENTROIDS centroids of the given subspace, back to back.
+  const float *getCentroids(size_t subvector) const {
+    return centroids.data() + NUM_CENTROIDS * getSubvectorStart(subvector);
+  }
+
+  static float squaredDistance(const float *a, const float *b, size_t size) {
+    float result = 0;
+    for (size_t i = 0; i < size; i++) {
+      float difference = a[i] - b[i];
+      result += difference * difference;
+    }
+    return result;
+  }
+
+  static float dot(const float *a, const float *b, size_t size) {
+    float result = 0;
+    for (size_t i = 0; i < size; i++) {
+      result += a[i] * b[i];
+    }
+    return result;
+  }
+
+  static int nearestCentroid(const float *centroids, const float *subvector,
+                             size_t size) {
+    int nearest = 0;
+    float nearestDistance = std::numeric_limits<float>::max();
+    for (int c = 0; c < NUM_CENTROIDS; c++) {
+      float distance = squaredDistance(subvector, centroids + c * size, size);
+      if (distance < nearestDistance) {
+        nearestDistance = distance;
+        nearest = c;
+      }
+    }
+    return nearest;
+  }
+
+  // Run k-means (Lloyd's algorithm) on one subspace of the sampled vectors.
+  void trainSubspace(size_t subvector, const float *vectors,
+                     const std::vector<size_t> &sample, size_t seed) {
+    size_t size = getSubvectorSize(subvector);
+    size_t start = getSubvectorStart(subvector);
+    size_t numPoints = sample.size();
+
+    // Gather this subspace's points into one contiguous array:
+    std::vector<float> points(numPoints * size);
+    for (size_t i = 0; i < numPoints; i++) {
+      const float *source = vectors + sample[i] * dimensions + start;
+      std::copy(source, source + size, points.data() + i * size);
+    }
+
+    // Start from randomly chosen points (repeating them if there are fewer
+    // points than centroids):
+    std::mt19937_64 random(seed);
+    std::vector<size_t> order(numPoints);
+    for (size_t i = 0; i < numPoints; i++) {
+      order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), random);
+
+    float *subspaceCentroids =
+        centroids.data() + NUM_CENTROIDS * getSubvectorStart(subvector);
+    for (int c = 0; c < NUM_CENTROIDS; c++) {
+      const float *point = points.data() + order[c % numPoints] * size;
+      std::copy(point, point + size, subspaceCentroids + c * size);
+    }
+
+    std::vector<int> assignments(numPoints);
+    std::vector<double> sums(NUM_CENTROIDS * size);
+    std::vector<size_t> counts(NUM_CENTROIDS);
+    for (int iteration = 0; iteration < NUM_TRAINING_ITERATIONS; iteration++) {
+      for (size_t i = 0; i < numPoints; i++) {
+        assignments[i] =
+            nearestCentroid(subspaceCentroids, points.data() + i * size, size);
+      }
+
+      std::fill(sums.begin(), sums.end(), 0.0);
+      std::fill(counts.begin(), counts.end(), 0);
+      for (size_t i = 0; i < numPoints; i++) {
+        counts[assignments[i]]++;
+        for (size_t j = 0; j < size; j++) {
+          sums[assignments[i] * size + j] += points[i * size + j];
+        }
+      }
+
+      for (int c = 0; c < NUM_CENTROIDS; c++) {
+        if (counts[c] == 0) {
+          continue;
+        }
+        for (size_t j = 0; j < size; j++) {
+          subspaceCentroids[c * size + j] =
+              (float)(sums[c * size + j] / counts[c]);
+        }
+      }
+
+      // Move the centroids of empty clusters next to the centroid of the
+      // largest cluster, so that it gets split in two on the next iteration:
+      for (int c = 0; c < NUM_CENTROIDS; c++) {
+        if (counts[c] > 0) {
+          continue;
+        }
+        int largest = std::max_element(counts.begin(), counts.end()) -
+                      counts.begin();
+        if (counts[largest] < 2) {
+          break;
+        }
+        std::uniform_real_distribution<float> jitter(-1e-4f, 1e-4f);
+        for (size_t j = 0; j < size; j++) {
+          float value = subspaceCentroids[largest * size + j];
+          subspaceCentroids[c * size + j] =
+              value + jitter(random) * std::max(std::abs(value), 1e-3f);
+        }
+        counts[c] = counts[largest] / 2;
+        counts[largest] -= counts[c];
+      }
+    }
+  }
+
+  int dimensions;
+  int numSubvectors;
+  bool trained = false;
+  std::vector<float> centroids;
+};
@@ -0,0 +1,1078 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Index.h"
+#include "Metadata.h"
+#include "StreamUtils.h"
+#include "TypedIndex.h"
+#include "std_utils.h"
+
+/**
+ * An Index that partitions its items across several independent indices
+ * ("shards"), choosing each item's shard by a hash of its ID. Every shard is
+ * searched for each query (in parallel) and their results are merged, so
+ * queries return the same kind of results as a single index would.
+ *
+ * Each shard is a complete index of its own: shards can be saved, loaded and
+ * replaced individually, which keeps each one small enough to build, copy or
+ * memory-map on its own.
+ */
+class ShardedIndex : public Index {
+public:
+  // The first four bytes of a saved ShardedIndex: "VSHD" on disk.
+  static constexpr uint32_t MAGIC = 'V' | 'S' << 8 | 'H' << 16 | 'D' << 24;
+  static constexpr int ser_version = 1; // serialization version
+
+  /**
+   * Create a ShardedIndex from the given (usually empty) shards, which must
+   * all have the same number of dimensions, space and storage data type. Any
+   * items already in a shard must belong to it (see getShardFor()).
+   */
+  ShardedIndex(std::vector<std::unique_ptr<Index>> shards)
+      : shards(std::move(shards)) {
+    if (this->shards.empty()) {
+      throw std::invalid_argument(
+          "A ShardedIndex must have at least one shard.");
+    }
+    for (size_t i = 0; i < this->shards.size(); i++) {
+      checkShard(i, *this->shards[i]);
+    }
+    numThreadsDefault = std::thread::hardware_concurrency();
+    currentLabel = getNumElements();
+  }
+
+  size_t getNumShards() const { return shards.size(); }
+
+  /**
+   * The shard that the item with the given ID is (or would be) stored in.
+   */
+  size_t getShardFor(hnswlib::labeltype id) const {
+    // The splitmix64 finalizer, so that sequential IDs are spread evenly.
+    uint64_t hash = id;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    hash = hash ^ (hash >> 31);
+    return hash % shards.size();
+  }
+
+  /**
+   * The given shard. The reference is only valid until that shard is
+   * replaced (by setShard() or loadShard()), which destroys it.
+   */
+  const Index &getShard(size_t shard) const {
+    checkShardNumber(shard);
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return *shards[shard];
+  }
+
+  /**
+   * Replace one shard with the given index, which must be compatible with
+   * the others and may only contain items that belong to this shard. Waits
+   * for any searches or updates that are already running to finish first,
+   * and throws if buildFromArray is running.
+   */
+  void setShard(size_t shard, std::unique_ptr<Index> index) {
+    checkShardNumber(shard);
+
+    std::unique_lock<std::shared_mutex> lock(shardsMutex);
+    if (building) {
+      throw std::runtime_error(
+          "Cannot replace a shard while buildFromArray is running.");
+    }
+    checkShard(shard, *index);
+    index->setEF(shards[shard]->getEF());
+    index->setNumThreads(numThreadsDefault);
+    index->setAutoGrow(autoGrow);
+    shards[shard] = std::move(index);
+    version++;
+
+    advanceCurrentLabel(countElements());
+  }
+
+  /**
+   * Save a single shard to the provided file path, in the same format as any
+   * other index.
+   */
+  void saveShard(size_t shard, const std::string &pathToIndex) {
+    checkShardNumber(shard);
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    shards[shard]->saveIndex(pathToIndex);
+  }
+
+  /**
+   * Replace a single shard with the index saved at the provided file path
+   * (i.e.: by saveShard()). If `searchOnly` is set, the shard is served
+   * directly from a memory mapping of the file.
+   */
+  void loadShard(size_t shard, const std::string &pathToIndex,
+                 bool searchOnly = false) {
+    setShard(shard, loadTypedIndexFromFile(pathToIndex, searchOnly));
+  }
+
+  /**
+   * The path that saveIndex(pathToIndex) saves the given shard to.
+   */
+  static std::string getShardPath(const std::string &pathToIndex,
+                                  size_t shard) {
+    return pathToIndex + ".shard" + std::to_string(shard);
+  }
+
+  void setEF(size_t ef) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    for (auto &shard : shards) {
+      shard->setEF(ef);
+    }
+  }
+
+  int getEF() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return shards[0]->getEF();
+  }
+
+  SpaceType getSpace() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return shards[0]->getSpace();
+  }
+  std::string getSpaceName() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return shards[0]->getSpaceName();
+  }
+
+  StorageDataType getStorageDataType() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return shards[0]->getStorageDataType();
+  }
+  std::string getStorageDataTypeName() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return shards[0]->getStorageDataTypeName();
+  }
+
+  int getNumDimensions() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return shards[0]->getNumDimensions();
+  }
+
+  void setNumThreads(int numThreads) {
+    std::unique_lock<std::shared_mutex> lock(shardsMutex);
+    numThreadsDefault = numThreads;
+    for (auto &shard : shards) {
+      shard->setNumThreads(numThreads);
+    }
+  }
+
+  int getNumThreads() {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return numThreadsDefault;
+  }
+
+  /**
+   * Save this index to the provided file path on disk. Only a small
+   * manifest is written to `pathToIndex` itself; each shard is saved next to
+   * it, to getShardPath(pathToIndex, shard), so that shards can be loaded
+   * (or memory-mapped) on their own.
+   */
+  void saveIndex(const std::string &pathToIndex) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    {
+      auto outputStream = std::make_shared<FileOutputStream>(pathToIndex);
+      writeManifest(outputStream, /* shardsInline */ false);
+    }
+    for (size_t i = 0; i < shards.size(); i++) {
+      shards[i]->saveIndex(getShardPath(pathToIndex, i));
+    }
+  }
+
+  /**
+   * Save this index to the provided output stream: a manifest, followed by
+   * each shard's length and then its data.
+   */
+  void saveIndex(std::shared_ptr<OutputStream> outputStream) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    writeManifest(outputStream, /* shardsInline */ true);
+    for (auto &shard : shards) {
+      // Serialize twice: once to find the shard's length, then for real.
+      auto countingStream = std::make_shared<CountingOutputStream>();
+      shard->saveIndex(countingStream);
+      uint64_t length = countingStream->getCount();
+      writeBinaryPOD(outputStream, length);
+      shard->saveIndex(outputStream);
+    }
+  }
+
+  /**
+   * Log changes to each shard next to the file that saveIndex(pathToIndex)
+   * would save it to (see TypedIndex::openChangeLog). The checkpoint
+   * interval applies to each shard separately.
+   */
+  void openChangeLog(const std::string &pathToIndex,
+                     size_t checkpointInterval = 0) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    std::string tmpPath = pathToIndex + ".tmp";
+    {
+      auto outputStream = std::make_shared<FileOutputStream>(tmpPath);
+      writeManifest(outputStream, /* shardsInline */ false);
+    }
+    ChangeLog::replaceFile(tmpPath, pathToIndex);
+    for (size_t i = 0; i < shards.size(); i++) {
+      shards[i]->openChangeLog(getShardPath(pathToIndex, i),
+                               checkpointInterval);
+    }
+  }
+
+  void checkpoint() {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    for (auto &shard : shards) {
+      shard->checkpoint();
+    }
+  }
+
+  void closeChangeLog() {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    for (auto &shard : shards) {
+      shard->closeChangeLog();
+    }
+  }
+
+  bool isLogAware() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    for (auto &shard : shards) {
+      if (shard->isLogAware()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void loadIndex(const std::string &, bool = false) {
+    throw std::runtime_error("Not implemented.");
+  }
+
+  void loadIndex(std::shared_ptr<InputStream>, bool = false) {
+    throw std::runtime_error("Not implemented.");
+  }
+
+  float getDistance(std::vector<float> a, std::vector<float> b) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return shards[0]->getDistance(a, b);
+  }
+
+  hnswlib::labeltype addItem(std::vector<float> vector,
+                             std::optional<hnswlib::labeltype> id,
+                             bool replaceDeleted = false) {
+    hnswlib::labeltype label;
+    if (id) {
+      label = *id;
+      advanceCurrentLabel(label + 1);
+    } else {
+      label = currentLabel.fetch_add(1);
+    }
+
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    shards[getShardFor(label)]->addItem(vector, label, replaceDeleted);
+    version++;
+    return label;
+  }
+
+  std::vector<hnswlib::labeltype>
+  addItems(std::vector<std::vector<float>> vectors,
+           std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+           bool replaceDeleted = false) {
+    return addItems(vectorsToNDArray(vectors), ids, numThreads,
+                    replaceDeleted);
+  }
+
+  /**
+   * Add the given vectors to the index, each to the shard its ID belongs to.
+   * Shards are filled one after another, each using `numThreads` threads.
+   */
+  std::vector<hnswlib::labeltype>
+  addItems(NDArray<float, 2> floatInput,
+           std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+           bool replaceDeleted = false) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    checkInput(floatInput, ids);
+    assignIDs(ids, std::get<0>(floatInput.shape));
+
+    std::vector<std::vector<size_t>> rowsByShard = groupByShard(ids);
+    for (size_t i = 0; i < shards.size(); i++) {
+      if (!rowsByShard[i].empty()) {
+        shards[i]->addItems(selectRows(floatInput, rowsByShard[i]),
+                            selectIDs(ids, rowsByShard[i]), numThreads,
+                            replaceDeleted);
+      }
+    }
+    version++;
+
+    return ids;
+  }
+
+  std::vector<hnswlib::labeltype>
+  addItemsFrom(const float *floatInput, size_t numVectors,
+               std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+               bool replaceDeleted = false) {
+    // Each shard gets a copy of its own rows anyway:
+    int dimensions = getNumDimensions();
+    std::vector<float> data(floatInput, floatInput + numVectors * dimensions);
+    return addItems(
+        NDArray<float, 2>(std::move(data), {(int)numVectors, dimensions}), ids,
+        numThreads, replaceDeleted);
+  }
+
+  /**
+   * Add the given vectors to this empty index in bulk, building each shard
+   * with TypedIndex::buildFromArray in turn. `progress` is called with the
+   * number of vectors added across all shards, without holding this index's
+   * lock; shards can't be replaced until the build is done. If anything
+   * throws, the shards built so far are emptied again.
+   */
+  std::vector<hnswlib::labeltype>
+  buildFromArray(NDArray<float, 2> floatInput,
+                 std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+                 std::function<void(size_t, size_t)> progress = nullptr) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    checkInput(floatInput, ids);
+    if (countElements() > 0) {
+      throw std::runtime_error(
+          "buildFromArray can only be called on an empty index, but this "
+          "index already contains " +
+          std::to_string(countElements()) +
+          " elements. Use addItems to add more vectors to it.");
+    }
+    if (building.exchange(true)) {
+      throw std::runtime_error(
+          "buildFromArray is already running on this index.");
+    }
+
+    size_t rows = std::get<0>(floatInput.shape);
+    hnswlib::labeltype initialLabel = currentLabel;
+    std::vector<std::vector<size_t>> rowsByShard;
+    size_t numBuilt = 0;
+    size_t numAddedToPreviousShards = 0;
+    try {
+      assignIDs(ids, rows);
+      rowsByShard = groupByShard(ids);
+      for (; numBuilt < shards.size(); numBuilt++) {
+        if (rowsByShard[numBuilt].empty()) {
+          continue;
+        }
+
+        std::function<void(size_t, size_t)> shardProgress = nullptr;
+        if (progress) {
+          shardProgress = [&](size_t numAdded, size_t) {
+            lock.unlock();
+            progress(numAddedToPreviousShards + numAdded, rows);
+            lock.lock();
+          };
+        }
+        shards[numBuilt]->buildFromArray(
+            selectRows(floatInput, rowsByShard[numBuilt]),
+            selectIDs(ids, rowsByShard[numBuilt]), numThreads, shardProgress);
+        numAddedToPreviousShards += rowsByShard[numBuilt].size();
+      }
+    } catch (...) {
+      if (!lock.owns_lock()) {
+        lock.lock();
+      }
+      // The shard that failed has already undone its own build. (Any
+      // product quantizer trained by the earlier ones stays trained.)
+      for (size_t i = 0; i < numBuilt; i++) {
+        if (!rowsByShard[i].empty()) {
+          for (hnswlib::labeltype id : selectIDs(ids, rowsByShard[i])) {
+            shards[i]->markDeleted(id);
+          }
+          shards[i]->compact(numThreads);
+        }
+      }
+      currentLabel = initialLabel;
+      building = false;
+      throw;
+    }
+    building = false;
+    version++;
+
+    return ids;
+  }
+
+  /**
+   * Train the product quantizer of every shard on the given vectors. Each
+   * shard only gets a fraction of every batch added, so this avoids the need
+   * for the first batch added to each shard to be big enough to train it.
+   */
+  void train(NDArray<float, 2> floatInput, int numThreads = -1) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    for (auto &shard : shards) {
+      shard->train(floatInput, numThreads);
+    }
+  }
+
+  std::vector<float> getVector(hnswlib::labeltype id) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return shards[getShardFor(id)]->getVector(id);
+  }
+
+  NDArray<float, 2> getVectors(std::vector<hnswlib::labeltype> ids) {
+    int dimensions = getNumDimensions();
+    NDArray<float, 2> output({(int)ids.size(), dimensions});
+
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    for (size_t i = 0; i < ids.size(); i++) {
+      std::vector<float> vector =
+          shards[getShardFor(ids[i])]->getVector(ids[i]);
+      std::copy(vector.begin(), vector.end(),
+                output.data.data() + (i * dimensions));
+    }
+
+    return output;
+  }
+
+  std::vector<hnswlib::labeltype> getIDs() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    std::vector<hnswlib::labeltype> ids;
+    ids.reserve(countIDs());
+    for (auto &shard : shards) {
+      std::vector<hnswlib::labeltype> shardIDs = shard->getIDs();
+      ids.insert(ids.end(), shardIDs.begin(), shardIDs.end());
+    }
+    return ids;
+  }
+
+  long long getIDsCount() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return countIDs();
+  }
+
+  /**
+   * A map from each ID to the number of the shard that holds it. Unlike
+   * TypedIndex's, this is a copy, rebuilt whenever it's requested after the
+   * index has been modified; the reference returned is only valid until
+   * then, so callers that might race with changes to the index should copy
+   * it.
+   */
+  const hnswlib::LabelLookup &getIDsMap() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    std::lock_guard<std::mutex> idsMapLock(idsMapMutex);
+    if (idsMapVersion != version) {
+      idsMapVersion = version;
+      idsMap = hnswlib::LabelLookup();
+      for (size_t i = 0; i < shards.size(); i++) {
+        for (auto const &kv : shards[i]->getIDsMap()) {
+          idsMap.set(kv.first, i);
+        }
+      }
+    }
+    return idsMap;
+  }
+
+  std::tuple<std::vector<hnswlib::labeltype>, std::vector<float>>
+  query(std::vector<float> floatQueryVector, int k = 1, long queryEf = -1,
+        const hnswlib::BaseFilterFunctor *filter = nullptr,
+        hnswlib::SearchStats *stats = nullptr, int rerank = 0) {
+    if ((int)floatQueryVector.size() != getNumDimensions()) {
+      throw std::runtime_error(
+          "Query vector expected to share dimensionality with index.");
+    }
+
+    std::vector<hnswlib::labeltype> labels(k);
+    std::vector<float> distances(k);
+    std::vector<hnswlib::SearchStats> queryStats;
+    queryInto(floatQueryVector.data(), 1, k, labels.data(), distances.data(),
+              -1, queryEf, filter, stats ? &queryStats : nullptr, rerank);
+    if (stats) {
+      *stats = queryStats[0];
+    }
+    return {labels, distances};
+  }
+
+  std::tuple<NDArray<hnswlib::labeltype, 2>, NDArray<float, 2>>
+  query(std::vector<std::vector<float>> floatQueryVectors, int k = 1,
+        int numThreads = -1, long queryEf = -1,
+        const hnswlib::BaseFilterFunctor *filter = nullptr,
+        std::vector<hnswlib::SearchStats> *stats = nullptr, int rerank = 0) {
+    return query(vectorsToNDArray(floatQueryVectors), k, numThreads, queryEf,
+                 filter, stats, rerank);
+  }
+
+  std::tuple<NDArray<hnswlib::labeltype, 2>, NDArray<float, 2>>
+  query(NDArray<float, 2> floatQueryVectors, int k = 1, int numThreads = -1,
+        long queryEf = -1, const hnswlib::BaseFilterFunctor *filter = nullptr,
+        std::vector<hnswlib::SearchStats> *stats = nullptr, int rerank = 0) {
+    int numRows = std::get<0>(floatQueryVectors.shape);
+    int numFeatures = std::get<1>(floatQueryVectors.shape);
+
+    if (numFeatures != getNumDimensions()) {
+      throw std::runtime_error(
+          "Query vectors expected to share dimensionality with index.");
+    }
+
+    NDArray<hnswlib::labeltype, 2> labels({numRows, k});
+    NDArray<float, 2> distances({numRows, k});
+    queryInto(floatQueryVectors.data.data(), numRows, k, labels.data.data(),
+              distances.data.data(), numThreads, queryEf, filter, stats,
+              rerank);
+    return {labels, distances};
+  }
+
+  /**
+   * Find the `k` nearest neighbors of each query by searching every shard
+   * for its own `k` nearest (as one parallel loop over all query and shard
+   * pairs) and keeping the nearest `k` of those. Each query's `stats` are
+   * the sum of the work done in every shard.
+   */
+  void queryInto(const float *floatQueryVectors, size_t numQueries, int k,
+                 hnswlib::labeltype *labels, float *distances,
+                 int numThreads = -1, long queryEf = -1,
+                 const hnswlib::BaseFilterFunctor *filter = nullptr,
+                 std::vector<hnswlib::SearchStats> *stats = nullptr,
+                 int rerank = 0) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    size_t numShards = shards.size();
+    size_t numTasks = numQueries * numShards;
+    int dimensions = shards[0]->getNumDimensions();
+
+    if (numThreads <= 0) {
+      numThreads = numThreadsDefault;
+    }
+    numThreads = std::max<size_t>(1, std::min<size_t>(numThreads, numTasks));
+
+    std::vector<hnswlib::labeltype> shardLabels(numTasks * k);
+    std::vector<float> shardDistances(numTasks * k);
+    std::vector<size_t> numFound(numTasks);
+    std::vector<hnswlib::SearchStats> shardStats(stats ? numTasks : 0);
+    ParallelFor(0, numTasks, numThreads, [&](size_t task, size_t) {
+      size_t row = task / numShards;
+      numFound[task] = shards[task % numShards]->queryAtMost(
+          floatQueryVectors + row * dimensions, k, &shardLabels[task * k],
+          &shardDistances[task * k], queryEf, filter,
+          stats ? &shardStats[task] : nullptr, rerank);
+    });
+
+    if (stats) {
+      stats->assign(numQueries, hnswlib::SearchStats());
+      for (size_t task = 0; task < numTasks; task++) {
+        (*stats)[task / numShards] += shardStats[task];
+      }
+    }
+
+    std::vector<std::vector<std::pair<float, hnswlib::labeltype>>> candidates(
+        std::min<size_t>(numThreads, std::max<size_t>(1, numQueries)));
+    ParallelFor(0, numQueries, candidates.size(),
+                [&](size_t row, size_t threadId) {
+                  size_t first = row * numShards;
+                  size_t found = mergeResults(
+                      &numFound[first], &shardLabels[first * k],
+                      &shardDistances[first * k], k, candidates[threadId],
+                      labels + row * k, distances + row * k);
+                  checkNumFound(found, k);
+                });
+  }
+
+  size_t queryAtMost(const float *floatQueryVector, int k,
+                     hnswlib::labeltype *labels, float *distances,
+                     long queryEf = -1,
+                     const hnswlib::BaseFilterFunctor *filter = nullptr,
+                     hnswlib::SearchStats *stats = nullptr, int rerank = 0) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    size_t numShards = shards.size();
+
+    std::vector<hnswlib::labeltype> shardLabels(numShards * k);
+    std::vector<float> shardDistances(numShards * k);
+    std::vector<size_t> numFound(numShards);
+    std::vector<hnswlib::SearchStats> shardStats(stats ? numShards : 0);
+    ParallelFor(0, numShards, numThreadsDefault,
+                [&](size_t shard, size_t) {
+                  numFound[shard] = shards[shard]->queryAtMost(
+                      floatQueryVector, k, &shardLabels[shard * k],
+                      &shardDistances[shard * k], queryEf, filter,
+                      stats ? &shardStats[shard] : nullptr, rerank);
+                });
+
+    if (stats) {
+      *stats = hnswlib::SearchStats();
+      for (auto &shardStat : shardStats) {
+        *stats += shardStat;
+      }
+    }
+
+    std::vector<std::pair<float, hnswlib::labeltype>> candidates;
+    return mergeResults(numFound.data(), shardLabels.data(),
+                        shardDistances.data(), k, candidates, labels,
+                        distances);
+  }
+
+  std::tuple<std::vector<hnswlib::labeltype>, std::vector<float>>
+  rangeSearch(std::vector<float> floatQueryVector, float radius,
+              size_t maxResults = 0, long queryEf = -1,
+              const hnswlib::BaseFilterFunctor *filter = nullptr) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    std::vector<std::tuple<std::vector<hnswlib::labeltype>, std::vector<float>>>
+        shardResults(shards.size());
+    ParallelFor(0, shards.size(), numThreadsDefault,
+                [&](size_t shard, size_t) {
+                  shardResults[shard] = shards[shard]->rangeSearch(
+                      floatQueryVector, radius, maxResults, queryEf, filter);
+                });
+
+    std::vector<std::pair<float, hnswlib::labeltype>> results;
+    for (auto &[shardLabels, shardDistances] : shardResults) {
+      for (size_t i = 0; i < shardLabels.size(); i++) {
+        results.push_back({shardDistances[i], shardLabels[i]});
+      }
+    }
+    sortAndTruncate(results, maxResults);
+
+    std::vector<hnswlib::labeltype> labels(results.size());
+    std::vector<float> distances(results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+      distances[i] = results[i].first;
+      labels[i] = results[i].second;
+    }
+    return {labels, distances};
+  }
+
+  RangeSearchResults
+  rangeSearch(NDArray<float, 2> floatQueryVectors, float radius,
+              size_t maxResults = 0, int numThreads = -1, long queryEf = -1,
+              const hnswlib::BaseFilterFunctor *filter = nullptr) {
+    size_t numRows = std::get<0>(floatQueryVectors.shape);
+
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    std::vector<RangeSearchResults> shardResults;
+    for (auto &shard : shards) {
+      shardResults.push_back(shard->rangeSearch(floatQueryVectors, radius,
+                                                maxResults, numThreads,
+                                                queryEf, filter));
+    }
+
+    RangeSearchResults results;
+    results.offsets.push_back(0);
+    std::vector<std::pair<float, hnswlib::labeltype>> rowResults;
+    for (size_t row = 0; row < numRows; row++) {
+      rowResults.clear();
+      for (auto &shardResult : shardResults) {
+        for (size_t i = shardResult.offsets[row];
+             i < shardResult.offsets[row + 1]; i++) {
+          rowResults.push_back(
+              {shardResult.distances[i], shardResult.labels[i]});
+        }
+      }
+      sortAndTruncate(rowResults, maxResults);
+
+      for (auto &[distance, label] : rowResults) {
+        results.distances.push_back(distance);
+        results.labels.push_back(label);
+      }
+      results.offsets.push_back(results.labels.size());
+    }
+
+    return results;
+  }
+
+  hnswlib::SearchStats getSearchStats() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    hnswlib::SearchStats stats;
+    for (auto &shard : shards) {
+      stats += shard->getSearchStats();
+    }
+    return stats;
+  }
+
+  void resetSearchStats() {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    for (auto &shard : shards) {
+      shard->resetSearchStats();
+    }
+  }
+
+  void markDeleted(hnswlib::labeltype label) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    shards[getShardFor(label)]->markDeleted(label);
+    version++;
+  }
+
+  void unmarkDeleted(hnswlib::labeltype label) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    shards[getShardFor(label)]->unmarkDeleted(label);
+    version++;
+  }
+
+  /**
+   * Resize every shard to hold an equal part of `newSize` elements (or at
+   * least the elements it already holds, if that's more).
+   */
+  void resizeIndex(size_t newSize) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    size_t shardSize = (newSize + shards.size() - 1) / shards.size();
+    for (auto &shard : shards) {
+      shard->resizeIndex(std::max(shardSize, shard->getNumElements()));
+    }
+  }
+
+  void setAutoGrow(bool newAutoGrow) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    autoGrow = newAutoGrow;
+    for (auto &shard : shards) {
+      shard->setAutoGrow(newAutoGrow);
+    }
+  }
+
+  bool getAutoGrow() const { return autoGrow; }
+
+  size_t compact(int numThreads = -1) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    size_t numRemoved = 0;
+    for (auto &shard : shards) {
+      numRemoved += shard->compact(numThreads);
+    }
+    version++;
+    return numRemoved;
+  }
+
+  void reorder(int numThreads = -1) {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    for (auto &shard : shards) {
+      shard->reorder(numThreads);
+    }
+  }
+
+  size_t getMaxElements() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    size_t maxElements = 0;
+    for (auto &shard : shards) {
+      maxElements += shard->getMaxElements();
+    }
+    return maxElements;
+  }
+
+  size_t getNumElements() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return countElements();
+  }
+
+  size_t getEfConstruction() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return shards[0]->getEfConstruction();
+  }
+
+  size_t getM() const {
+    std::shared_lock<std::shared_mutex> lock(shardsMutex);
+    return shards[0]->getM();
+  }
+
+  /**
+   * Read the manifest at the start of a saved ShardedIndex, returning its
+   * number of shards and whether the shards follow it in the same stream
+   * (rather than being saved in files of their own).
+   */
+  static std::tuple<uint32_t, bool>
+  readManifest(std::shared_ptr<InputStream> inputStream) {
+    uint32_t header;
+    readBinaryPOD(inputStream, header);
+    if (header != MAGIC) {
+      throw std::domain_error("The provided file is not a sharded index.");
+    }
+
+    int version;
+    readBinaryPOD(inputStream, version);
+    if (version != ser_version) {
+      throw std::domain_error(
+          "Unable to parse sharded index file; found unsupported version " +
+          std::to_string(version) + ".");
+    }
+
+    uint32_t numShards;
+    bool shardsInline;
+    readBinaryPOD(inputStream, numShards);
+    readBinaryPOD(inputStream, shardsInline);
+    if (numShards == 0) {
+      throw std::domain_error(
+          "Sharded index seems to be corrupted; it has no shards.");
+    }
+    return {numShards, shardsInline};
+  }
+
+private:
+  std::vector<std::unique_ptr<Index>> shards;
+  // Held exclusively only while a shard is being replaced.
+  mutable std::shared_mutex shardsMutex;
+
+  int numThreadsDefault;
+  std::atomic<bool> autoGrow{true};
+  std::atomic<hnswlib::labeltype> currentLabel;
+  // Set while buildFromArray runs, which releases shardsMutex to report its
+  // progress.
+  std::atomic<bool> building{false};
+
+  // Incremented by every change to the set of IDs, so that idsMap is only
+  // rebuilt when needed.
+  std::atomic<size_t> version = 0;
+  mutable std::mutex idsMapMutex;
+  mutable hnswlib::LabelLookup idsMap;
+  mutable size_t idsMapVersion = -1;
+
+  void checkShardNumber(size_t shard) const {
+    if (shard >= shards.size()) {
+      throw std::out_of_range("Shard " + std::to_string(shard) +
+                              " does not exist; this index has " +
+                              std::to_string(shards.size()) + " shards.");
+    }
+  }
+
+  void checkShard(size_t shard, const Index &index) const {
+    // Compare against any other shard (if there is one):
+    const Index &first = shards.size() < 2 ? index : *shards[shard == 0];
+    if (index.getNumDimensions() != first.getNumDimensions() ||
+        index.getSpace() != first.getSpace() ||
+        index.getStorageDataType() != first.getStorageDataType()) {
+      throw std::invalid_argument(
+          "Shard " + std::to_string(shard) + " (" +
+          std::to_string(index.getNumDimensions()) + " dimensions, " +
+          index.getSpaceName() + ", " + index.getStorageDataTypeName() +
+          ") does not match the other shards (" +
+          std::to_string(first.getNumDimensions()) + " dimensions, " +
+          first.getSpaceName() + ", " + first.getStorageDataTypeName() + ").");
+    }
+
+    for (hnswlib::labeltype id : index.getIDs()) {
+      if (getShardFor(id) != shard) {
+        throw std::invalid_argument(
+            "Shard " + std::to_string(shard) + " contains ID " +
+            std::to_string(id) + ", which belongs in shard " +
+            std::to_string(getShardFor(id)) + ".");
+      }
+    }
+  }
+
+  // As getNumElements(). (shardsMutex must be held.)
+  size_t countElements() const {
+    size_t numElements = 0;
+    for (auto &shard : shards) {
+      numElements += shard->getNumElements();
+    }
+    return numElements;
+  }
+
+  // As getIDsCount(). (shardsMutex must be held.)
+  long long countIDs() const {
+    long long count = 0;
+    for (auto &shard : shards) {
+      count += shard->getIDsCount();
+    }
+    return count;
+  }
+
+  // (shardsMutex must be held.)
+  void checkInput(const NDArray<float, 2> &floatInput,
+                  const std::vector<hnswlib::labeltype> &ids) const {
+    size_t rows = std::get<0>(floatInput.shape);
+    size_t features = std::get<1>(floatInput.shape);
+    int dimensions = shards[0]->getNumDimensions();
+
+    if (features != (size_t)dimensions) {
+      throw std::domain_error(
+          "The provided vector(s) have " + std::to_string(features) +
+          " dimensions, but this index expects vectors with " +
+          std::to_string(dimensions) + " dimensions.");
+    }
+
+    if (!ids.empty() && ids.size() != rows) {
+      throw std::runtime_error(
+          std::to_string(rows) + " vectors were provided, but " +
+          std::to_string(ids.size()) +
+          " IDs were provided. If providing IDs along with vectors, the number "
+          "of provided IDs must match the number of vectors.");
+    }
+  }
+
+  // IDs are assigned here rather than by the shards, so that they're unique
+  // across all shards.
+  void assignIDs(std::vector<hnswlib::labeltype> &ids, size_t rows) {
+    if (ids.empty()) {
+      ids.resize(rows);
+      std::iota(ids.begin(), ids.end(), currentLabel.fetch_add(rows));
+    } else {
+      advanceCurrentLabel(*std::max_element(ids.begin(), ids.end()) + 1);
+    }
+  }
+
+  // Make sure that IDs assigned from now on are at least `label`.
+  void advanceCurrentLabel(hnswlib::labeltype label) {
+    hnswlib::labeltype current = currentLabel;
+    while (current < label &&
+           !currentLabel.compare_exchange_weak(current, label)) {
+    }
+  }
+
+  std::vector<std::vector<size_t>>
+  groupByShard(const std::vector<hnswlib::labeltype> &ids) const {
+    std::vector<std::vector<size_t>> rowsByShard(shards.size());
+    for (size_t row = 0; row < ids.size(); row++) {
+      rowsByShard[getShardFor(ids[row])].push_back(row);
+    }
+    return rowsByShard;
+  }
+
+  static NDArray<float, 2> selectRows(const NDArray<float, 2> &input,
+                                      const std::vector<size_t> &rows) {
+    int columns = std::get<1>(input.shape);
+    NDArray<float, 2> output({(int)rows.size(), columns});
+    for (size_t i = 0; i < rows.size(); i++) {
+      std::memcpy(output.data.data() + i * columns,
+                  input.data.data() + rows[i] * columns,
+                  columns * sizeof(float));
+    }
+    return output;
+  }
+
+  static std::vector<hnswlib::labeltype>
+  selectIDs(const std::vector<hnswlib::labeltype> &ids,
+            const std::vector<size_t> &rows) {
+    std::vector<hnswlib::labeltype> output(rows.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+      output[i] = ids[rows[i]];
+    }
+    return output;
+  }
+
+  /**
+   * Merge one query's results from every shard (`k` slots per shard, of
+   * which `numFound[shard]` are filled) into the nearest `k`, nearest first.
+   * Returns the number of results written.
+   */
+  size_t
+  mergeResults(const size_t *numFound, const hnswlib::labeltype *shardLabels,
+               const float *shardDistances, int k,
+               std::vector<std::pair<float, hnswlib::labeltype>> &candidates,
+               hnswlib::labeltype *labels, float *distances) const {
+    candidates.clear();
+    for (size_t shard = 0; shard < shards.size(); shard++) {
+      for (size_t i = 0; i < numFound[shard]; i++) {
+        candidates.push_back(
+            {shardDistances[shard * k + i], shardLabels[shard * k + i]});
+      }
+    }
+
+    size_t numResults = std::min<size_t>(k, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + numResults,
+                      candidates.end());
+    for (size_t i = 0; i < numResults; i++) {
+      distances[i] = candidates[i].first;
+      labels[i] = candidates[i].second;
+    }
+    return numResults;
+  }
+
+  static void
+  sortAndTruncate(std::vector<std::pair<float, hnswlib::labeltype>> &results,
+                  size_t maxResults) {
+    std::sort(results.begin(), results.end());
+    if (maxResults > 0 && results.size() > maxResults) {
+      results.resize(maxResults);
+    }
+  }
+
+  static void checkNumFound(size_t numFound, int k) {
+    if (numFound != (size_t)k) {
+      throw RecallError(
+          "Fewer than expected results were retrieved; only found " +
+          std::to_string(numFound) + " of " + std::to_string(k) +
+          " requested neighbors. Reconstruct the index with a higher M value "
+          "to increase recall.");
+    }
+  }
+
+  void writeManifest(std::shared_ptr<OutputStream> outputStream,
+                     bool shardsInline) const {
+    writeBinaryPOD(outputStream, MAGIC);
+    writeBinaryPOD(outputStream, ser_version);
+    writeBinaryPOD(outputStream, (uint32_t)shards.size());
+    writeBinaryPOD(outputStream, shardsInline);
+  }
+};
+
+/**
+ * Whether the given stream contains a ShardedIndex (rather than a single
+ * index).
+ */
+bool isShardedIndex(std::shared_ptr<InputStream> inputStream) {
+  return inputStream->peek() == ShardedIndex::MAGIC;
+}
+
+/**
+ * Load a ShardedIndex from the given stream, as written by
+ * ShardedIndex::saveIndex(outputStream).
+ */
+std::unique_ptr<ShardedIndex>
+loadShardedIndexFromStream(std::shared_ptr<InputStream> inputStream) {
+  auto [numShards, shardsInline] = ShardedIndex::readManifest(inputStream);
+  if (!shardsInline) {
+    throw std::domain_error(
+        "This sharded index's shards are saved in separate files; load it "
+        "from its file path instead.");
+  }
+
+  std::vector<std::unique_ptr<Index>> shards;
+  for (uint32_t i = 0; i < numShards; i++) {
+    uint64_t length;
+    readBinaryPOD(inputStream, length);
+    auto shardStream =
+        std::make_shared<InputStreamSlice>(inputStream, (long long)length);
+    shards.push_back(loadTypedIndexFromStream(shardStream));
+    if (!shardStream->skipToEnd()) {
+      throw std::runtime_error("Sharded index seems to be corrupted; shard " +
+                               std::to_string(i) + " was truncated.");
+    }
+  }
+  return std::make_unique<ShardedIndex>(std::move(shards));
+}
+
+/**
+ * Load a ShardedIndex from the file at `pathToIndex`, as written by
+ * ShardedIndex::saveIndex(pathToIndex). If `searchOnly` is set, each shard is
+ * served directly from a memory mapping of its file.
+ */
+std::unique_ptr<ShardedIndex> loadShardedIndex(const std::string &pathToIndex,
+                                               bool searchOnly = false) {
+  std::shared_ptr<InputStream> inputStream =
+      std::make_shared<FileInputStream>(pathToIndex);
+  auto [numShards, shardsInline] = ShardedIndex::readManifest(inputStream);
+  if (shardsInline) {
+    inputStream->setPosition(0);
+    return loadShardedIndexFromStream(inputStream);
+  }
+
+  std::vector<std::unique_ptr<Index>> shards;
+  for (uint32_t i = 0; i < numShards; i++) {
+    shards.push_back(loadTypedIndexFromFile(
+        ShardedIndex::getShardPath(pathToIndex, i), searchOnly));
+  }
+  return std::make_unique<ShardedIndex>(std::move(shards));
+}
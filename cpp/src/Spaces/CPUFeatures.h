@@ -0,0 +1,97 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+#pragma once
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace hnswlib {
+
+/**
+ * The SIMD instruction sets supported by the CPU that we're currently running
+ * on. These may differ from the instruction sets that the compiler was told to
+ * target; SIMD kernels for each instruction set are compiled separately (see
+ * VOYAGER_TARGET) and the spaces use these flags to pick the fastest kernel
+ * that this CPU can actually run.
+ */
+struct CPUFeatures {
+  bool sse = false;
+  bool avx2 = false;
+  bool fma = false;
+  bool f16c = false;
+  bool avx512f = false;
+  bool neon = false;
+
+  static const CPUFeatures &get() {
+    static const CPUFeatures features = detect();
+    return features;
+  }
+
+private:
+  static CPUFeatures detect() {
+    CPUFeatures features;
+#if defined(__aarch64__) || defined(_M_ARM64)
+    // NEON is a mandatory part of ARMv8-A.
+    features.neon = true;
+#elif (defined(__GNUC__) || defined(__clang__)) &&                            \
+    (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    features.sse = __builtin_cpu_supports("sse");
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.fma = __builtin_cpu_supports("fma");
+    features.f16c = __builtin_cpu_supports("f16c");
+    features.avx512f = __builtin_cpu_supports("avx512f");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    features.sse = info[3] & (1 << 25);
+    bool fma = info[2] & (1 << 12);
+    bool osxsave = info[2] & (1 << 27);
+    bool avx = info[2] & (1 << 28);
+    bool f16c = info[2] & (1 << 29);
+
+    bool avx2 = false;
+    bool avx512f = false;
+    if (maxLeaf >= 7) {
+      __cpuidex(info, 7, 0);
+      avx2 = info[1] & (1 << 5);
+      avx512f = info[1] & (1 << 16);
+    }
+
+    // The OS must also save the wider registers on context switches:
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool ymmEnabled = (xcr0 & 0x6) == 0x6;
+    bool zmmEnabled = (xcr0 & 0xe6) == 0xe6;
+
+    features.avx2 = avx && avx2 && ymmEnabled;
+    features.fma = avx && fma && ymmEnabled;
+    features.f16c = avx && f16c && ymmEnabled;
+    features.avx512f = avx512f && zmmEnabled;
+#endif
+    return features;
+  }
+};
+
+} // namespace hnswlib
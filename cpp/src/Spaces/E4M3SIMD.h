@@ -0,0 +1,139 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+#pragma once
+#include "../E4M3.h"
+#include "CPUFeatures.h"
+
+namespace hnswlib {
+
+static_assert(sizeof(E4M3) == 1, "E4M3 values must be stored in one byte.");
+
+/**
+ * A plain function pointer to a distance function between E4M3 vectors; used
+ * to pass SIMD kernels as template arguments.
+ */
+typedef float (*E4M3DistanceKernel)(const E4M3 *, const E4M3 *, const size_t);
+
+/**
+ * The SIMD kernels below decode E4M3 values arithmetically rather than via
+ * ALL_E4M3_VALUES, so that a whole register of values is decoded at once.
+ * Each byte is laid out as 0bMMMEEEES (see E4M3), and holds:
+ *  - (-1)^S * 2^(E - 7) * (1 + M / 8) if E > 0;
+ *  - (-1)^S * 2^-7 * (M / 8) if E == 0 (a subnormal value);
+ *  - NaN if E == 15 and M == 7.
+ * Every E4M3 value is exactly representable as a half-precision float, so we
+ * re-bias the exponent (from 7 to 15) to build the bits of a float16 in each
+ * 16-bit lane, then convert those to float32 in hardware. Subnormals are
+ * decoded as if they were normal (i.e.: with an implicit leading 1) and then
+ * corrected by subtracting 2^-7. The tests check that this matches
+ * ALL_E4M3_VALUES for every byte.
+ */
+static constexpr uint16_t E4M3_TO_FLOAT16_EXPONENT_BIAS = 15 - 7;
+// The bits of the float16 value 2^-7, the implicit leading 1 of a subnormal:
+static constexpr uint16_t FLOAT16_SUBNORMAL_CORRECTION =
+    E4M3_TO_FLOAT16_EXPONENT_BIAS << 10;
+// OR-ing this into the float16 of 2^8 * 1.875 (E = 15, M = 7) makes it a NaN:
+static constexpr uint16_t FLOAT16_NAN_BITS = 0x7E00;
+
+#if defined(USE_AVX)
+
+/**
+ * Decode the 16 E4M3 values at `pVect` into two registers of eight floats.
+ */
+VOYAGER_TARGET("avx2,f16c")
+static inline void loadE4M3x16AVX2(const E4M3 *pVect, __m256 &low,
+                                   __m256 &high) {
+  __m256i bytes = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)pVect));
+  __m256i exponentAndMantissa = _mm256_srli_epi16(bytes, 1);
+  __m256i exponent =
+      _mm256_and_si256(exponentAndMantissa, _mm256_set1_epi16(0xF));
+  __m256i mantissa = _mm256_srli_epi16(bytes, 5);
+  __m256i sign = _mm256_slli_epi16(bytes, 15);
+
+  __m256i half = _mm256_or_si256(
+      sign,
+      _mm256_or_si256(
+          _mm256_slli_epi16(
+              _mm256_add_epi16(exponent,
+                               _mm256_set1_epi16(E4M3_TO_FLOAT16_EXPONENT_BIAS)),
+              10),
+          _mm256_slli_epi16(mantissa, 7)));
+  half = _mm256_or_si256(
+      half, _mm256_and_si256(_mm256_cmpeq_epi16(exponentAndMantissa,
+                                                _mm256_set1_epi16(0x7F)),
+                             _mm256_set1_epi16(FLOAT16_NAN_BITS)));
+  __m256i correction = _mm256_and_si256(
+      _mm256_cmpeq_epi16(exponent, _mm256_setzero_si256()),
+      _mm256_or_si256(sign, _mm256_set1_epi16(FLOAT16_SUBNORMAL_CORRECTION)));
+
+  low = _mm256_sub_ps(_mm256_cvtph_ps(_mm256_castsi256_si128(half)),
+                      _mm256_cvtph_ps(_mm256_castsi256_si128(correction)));
+  high = _mm256_sub_ps(_mm256_cvtph_ps(_mm256_extracti128_si256(half, 1)),
+                       _mm256_cvtph_ps(_mm256_extracti128_si256(correction, 1)));
+}
+
+#endif
+
+#if defined(USE_NEON)
+
+/**
+ * Decode the eight E4M3 values in `bytes` into two registers of four floats.
+ */
+static inline void decodeE4M3x8NEON(uint8x8_t bytes, float32x4_t &low,
+                                    float32x4_t &high) {
+  uint16x8_t wide = vmovl_u8(bytes);
+  uint16x8_t exponentAndMantissa = vshrq_n_u16(wide, 1);
+  uint16x8_t exponent = vandq_u16(exponentAndMantissa, vdupq_n_u16(0xF));
+  uint16x8_t mantissa = vshrq_n_u16(wide, 5);
+  uint16x8_t sign = vshlq_n_u16(wide, 15);
+
+  uint16x8_t half = vorrq_u16(
+      sign, vorrq_u16(vshlq_n_u16(vaddq_u16(exponent,
+                                            vdupq_n_u16(
+                                                E4M3_TO_FLOAT16_EXPONENT_BIAS)),
+                                  10),
+                      vshlq_n_u16(mantissa, 7)));
+  half = vorrq_u16(half, vandq_u16(vceqq_u16(exponentAndMantissa,
+                                             vdupq_n_u16(0x7F)),
+                                   vdupq_n_u16(FLOAT16_NAN_BITS)));
+  uint16x8_t correction =
+      vandq_u16(vceqq_u16(exponent, vdupq_n_u16(0)),
+                vorrq_u16(sign, vdupq_n_u16(FLOAT16_SUBNORMAL_CORRECTION)));
+
+  low = vsubq_f32(vcvt_f32_f16(vreinterpret_f16_u16(vget_low_u16(half))),
+                  vcvt_f32_f16(vreinterpret_f16_u16(vget_low_u16(correction))));
+  high =
+      vsubq_f32(vcvt_f32_f16(vreinterpret_f16_u16(vget_high_u16(half))),
+                vcvt_f32_f16(vreinterpret_f16_u16(vget_high_u16(correction))));
+}
+
+/**
+ * Decode the 16 E4M3 values at `pVect` into four registers of four floats.
+ */
+static inline void loadE4M3x16NEON(const E4M3 *pVect, float32x4_t out[4]) {
+  uint8x16_t bytes = vld1q_u8((const uint8_t *)pVect);
+  decodeE4M3x8NEON(vget_low_u8(bytes), out[0], out[1]);
+  decodeE4M3x8NEON(vget_high_u8(bytes), out[2], out[3]);
+}
+
+#endif
+
+} // namespace hnswlib
@@ -22,8 +22,11 @@
  */
 
 #pragma once
+#include "CPUFeatures.h"
+#include "E4M3SIMD.h"
 #include "Space.h"
 #include <ratio>
+#include <type_traits>
 
 namespace hnswlib {
 /**
@@ -64,9 +67,9 @@ static dist_t L2SqrAtLeast(const data_t *__restrict pVect1,
 
 #if defined(USE_AVX512)
 
-// Favor using AVX512 if available.
-static float L2SqrSIMD16Ext(const float *pVect1, const float *pVect2,
-                            const size_t qty) {
+VOYAGER_TARGET("avx512f")
+static float L2SqrSIMD16ExtAVX512(const float *pVect1, const float *pVect2,
+                                  const size_t qty) {
   float PORTABLE_ALIGN64 TmpRes[16];
   size_t qty16 = qty >> 4;
 
@@ -81,8 +84,7 @@ static float L2SqrSIMD16Ext(const float *pVect1, const float *pVect2,
     v2 = _mm512_loadu_ps(pVect2);
     pVect2 += 16;
     diff = _mm512_sub_ps(v1, v2);
-    // sum = _mm512_fmadd_ps(diff, diff, sum);
-    sum = _mm512_add_ps(sum, _mm512_mul_ps(diff, diff));
+    sum = _mm512_fmadd_ps(diff, diff, sum);
   }
 
   _mm512_store_ps(TmpRes, sum);
@@ -94,11 +96,17 @@ static float L2SqrSIMD16Ext(const float *pVect1, const float *pVect2,
   return (res);
 }
 
-#elif defined(USE_AVX)
+VOYAGER_FIXED_DIMENSION_KERNEL(L2SqrSIMD16ExtAVX512FixedDim,
+                               L2SqrSIMD16ExtAVX512, VOYAGER_TARGET("avx512f"),
+                               float, float)
 
-// Favor using AVX if available.
-static float L2SqrSIMD16Ext(const float *pVect1, const float *pVect2,
-                            const size_t qty) {
+#endif
+
+#if defined(USE_AVX)
+
+VOYAGER_TARGET("avx2,fma")
+static float L2SqrSIMD16ExtAVX2(const float *pVect1, const float *pVect2,
+                                const size_t qty) {
   float PORTABLE_ALIGN32 TmpRes[8];
   size_t qty16 = qty >> 4;
 
@@ -113,14 +121,14 @@ static float L2SqrSIMD16Ext(const float *pVect1, const float *pVect2,
     v2 = _mm256_loadu_ps(pVect2);
     pVect2 += 8;
     diff = _mm256_sub_ps(v1, v2);
-    sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+    sum = _mm256_fmadd_ps(diff, diff, sum);
 
     v1 = _mm256_loadu_ps(pVect1);
     pVect1 += 8;
     v2 = _mm256_loadu_ps(pVect2);
     pVect2 += 8;
     diff = _mm256_sub_ps(v1, v2);
-    sum = _mm256_add_ps(sum, _mm256_mul_ps(diff, diff));
+    sum = _mm256_fmadd_ps(diff, diff, sum);
   }
 
   _mm256_store_ps(TmpRes, sum);
@@ -128,10 +136,16 @@ static float L2SqrSIMD16Ext(const float *pVect1, const float *pVect2,
          TmpRes[6] + TmpRes[7];
 }
 
-#elif defined(USE_SSE)
+VOYAGER_FIXED_DIMENSION_KERNEL(L2SqrSIMD16ExtAVX2FixedDim, L2SqrSIMD16ExtAVX2,
+                               VOYAGER_TARGET("avx2,fma"), float, float)
+
+#endif
+
+#if defined(USE_SSE)
 
-static float L2SqrSIMD16Ext(const float *pVect1, const float *pVect2,
-                            const size_t qty) {
+VOYAGER_TARGET("sse")
+static float L2SqrSIMD16ExtSSE(const float *pVect1, const float *pVect2,
+                               const size_t qty) {
   float PORTABLE_ALIGN32 TmpRes[8];
   size_t qty16 = qty >> 4;
 
@@ -174,24 +188,13 @@ static float L2SqrSIMD16Ext(const float *pVect1, const float *pVect2,
   _mm_store_ps(TmpRes, sum);
   return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
 }
-#endif
 
-#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
-static float L2SqrSIMD16ExtResiduals(const float *pVect1, const float *pVect2,
-                                     const size_t qty) {
-  size_t qty16 = qty >> 4 << 4;
-  float res = L2SqrSIMD16Ext(pVect1, pVect2, qty16);
+VOYAGER_FIXED_DIMENSION_KERNEL(L2SqrSIMD16ExtSSEFixedDim, L2SqrSIMD16ExtSSE,
+                               VOYAGER_TARGET("sse"), float, float)
 
-  size_t qty_left = qty - qty16;
-  float res_tail =
-      L2Sqr<float, float>(pVect1 + qty16, pVect2 + qty16, qty_left);
-  return (res + res_tail);
-}
-#endif
-
-#ifdef USE_SSE
-static float L2SqrSIMD4Ext(const float *pVect1, const float *pVect2,
-                           const size_t qty) {
+VOYAGER_TARGET("sse")
+static float L2SqrSIMD4ExtSSE(const float *pVect1, const float *pVect2,
+                              const size_t qty) {
   float PORTABLE_ALIGN32 TmpRes[8];
   size_t qty4 = qty >> 2;
 
@@ -212,19 +215,274 @@ static float L2SqrSIMD4Ext(const float *pVect1, const float *pVect2,
   return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
 }
 
+#endif
+
+#if defined(USE_NEON)
+
+static float L2SqrSIMD16ExtNEON(const float *pVect1, const float *pVect2,
+                                const size_t qty) {
+  size_t qty16 = qty >> 4;
+
+  const float *pEnd1 = pVect1 + (qty16 << 4);
+
+  float32x4_t sum0 = vdupq_n_f32(0), sum1 = vdupq_n_f32(0);
+  float32x4_t sum2 = vdupq_n_f32(0), sum3 = vdupq_n_f32(0);
+
+  while (pVect1 < pEnd1) {
+    float32x4_t diff0 = vsubq_f32(vld1q_f32(pVect1), vld1q_f32(pVect2));
+    float32x4_t diff1 = vsubq_f32(vld1q_f32(pVect1 + 4), vld1q_f32(pVect2 + 4));
+    float32x4_t diff2 = vsubq_f32(vld1q_f32(pVect1 + 8), vld1q_f32(pVect2 + 8));
+    float32x4_t diff3 =
+        vsubq_f32(vld1q_f32(pVect1 + 12), vld1q_f32(pVect2 + 12));
+    sum0 = vfmaq_f32(sum0, diff0, diff0);
+    sum1 = vfmaq_f32(sum1, diff1, diff1);
+    sum2 = vfmaq_f32(sum2, diff2, diff2);
+    sum3 = vfmaq_f32(sum3, diff3, diff3);
+    pVect1 += 16;
+    pVect2 += 16;
+  }
+
+  return vaddvq_f32(vaddq_f32(vaddq_f32(sum0, sum1), vaddq_f32(sum2, sum3)));
+}
+
+VOYAGER_FIXED_DIMENSION_KERNEL(L2SqrSIMD16ExtNEONFixedDim, L2SqrSIMD16ExtNEON,
+                               , float, float)
+
+static float L2SqrSIMD4ExtNEON(const float *pVect1, const float *pVect2,
+                               const size_t qty) {
+  size_t qty4 = qty >> 2;
+
+  const float *pEnd1 = pVect1 + (qty4 << 2);
+
+  float32x4_t sum = vdupq_n_f32(0);
+
+  while (pVect1 < pEnd1) {
+    float32x4_t diff = vsubq_f32(vld1q_f32(pVect1), vld1q_f32(pVect2));
+    sum = vfmaq_f32(sum, diff, diff);
+    pVect1 += 4;
+    pVect2 += 4;
+  }
+
+  return vaddvq_f32(sum);
+}
+
+#endif
+
+template <FloatDistanceKernel SIMD16Ext>
+static float L2SqrSIMD16ExtResiduals(const float *pVect1, const float *pVect2,
+                                     const size_t qty) {
+  size_t qty16 = qty >> 4 << 4;
+  float res = SIMD16Ext(pVect1, pVect2, qty16);
+
+  size_t qty_left = qty - qty16;
+  float res_tail =
+      L2Sqr<float, float>(pVect1 + qty16, pVect2 + qty16, qty_left);
+  return (res + res_tail);
+}
+
+template <FloatDistanceKernel SIMD4Ext>
 static float L2SqrSIMD4ExtResiduals(const float *pVect1, const float *pVect2,
                                     const size_t qty) {
   size_t qty4 = qty >> 2 << 2;
 
-  float res = L2SqrSIMD4Ext(pVect1, pVect2, qty4);
+  float res = SIMD4Ext(pVect1, pVect2, qty4);
   size_t qty_left = qty - qty4;
 
   float res_tail = L2Sqr<float, float>(pVect1 + qty4, pVect2 + qty4, qty_left);
 
   return (res + res_tail);
 }
+
+/**
+ * Pick the best way to apply a pair of SIMD kernels (processing 16 and 4
+ * elements at a time, respectively) to vectors with `dim` dimensions.
+ * `SIMD16ExtFixedDim` specializes the first kernel for common dimensions.
+ */
+template <FloatDistanceKernel SIMD16Ext, FloatDistanceKernel SIMD4Ext,
+          typename SIMD16ExtFixedDim>
+static DISTFUNC<float> selectL2SqrSIMD(size_t dim) {
+  if (dim % 16 == 0)
+    return selectFixedDimensionKernel<SIMD16ExtFixedDim>(dim, SIMD16Ext);
+  else if (dim % 4 == 0)
+    return SIMD4Ext;
+  else if (dim > 16)
+    return L2SqrSIMD16ExtResiduals<SIMD16Ext>;
+  else if (dim > 4)
+    return L2SqrSIMD4ExtResiduals<SIMD4Ext>;
+  return L2Sqr<float, float>;
+}
+
+#if defined(USE_AVX)
+
+/**
+ * The exact squared L2 distance between the first qty (a multiple of 16)
+ * elements of two int8 vectors. Each element is widened to 16 bits, so
+ * differences and their pairwise sums can't overflow or saturate.
+ */
+VOYAGER_TARGET("avx2")
+static int32_t L2SqrInt8SIMD16ExtAVX2(const int8_t *pVect1,
+                                      const int8_t *pVect2, const size_t qty) {
+  int32_t PORTABLE_ALIGN32 TmpRes[8];
+  const int8_t *pEnd1 = pVect1 + (qty >> 4 << 4);
+
+  __m256i sum = _mm256_setzero_si256();
+
+  while (pVect1 < pEnd1) {
+    __m256i v1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)pVect1));
+    pVect1 += 16;
+    __m256i v2 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)pVect2));
+    pVect2 += 16;
+    __m256i diff = _mm256_sub_epi16(v1, v2);
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(diff, diff));
+  }
+
+  _mm256_store_si256((__m256i *)TmpRes, sum);
+  return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] +
+         TmpRes[6] + TmpRes[7];
+}
+
+VOYAGER_TARGET("avx2,fma,f16c")
+static float L2SqrE4M3SIMD16ExtAVX2(const E4M3 *pVect1, const E4M3 *pVect2,
+                                    const size_t qty) {
+  float PORTABLE_ALIGN32 TmpRes[8];
+  const E4M3 *pEnd1 = pVect1 + (qty >> 4 << 4);
+
+  __m256 v1Low, v1High, v2Low, v2High, diff;
+  __m256 sum = _mm256_set1_ps(0);
+
+  while (pVect1 < pEnd1) {
+    loadE4M3x16AVX2(pVect1, v1Low, v1High);
+    pVect1 += 16;
+    loadE4M3x16AVX2(pVect2, v2Low, v2High);
+    pVect2 += 16;
+
+    diff = _mm256_sub_ps(v1Low, v2Low);
+    sum = _mm256_fmadd_ps(diff, diff, sum);
+    diff = _mm256_sub_ps(v1High, v2High);
+    sum = _mm256_fmadd_ps(diff, diff, sum);
+  }
+
+  _mm256_store_ps(TmpRes, sum);
+  return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] +
+         TmpRes[6] + TmpRes[7];
+}
+
 #endif
 
+#if defined(USE_NEON)
+
+static int32_t L2SqrInt8SIMD16ExtNEON(const int8_t *pVect1,
+                                      const int8_t *pVect2, const size_t qty) {
+  const int8_t *pEnd1 = pVect1 + (qty >> 4 << 4);
+
+  int32x4_t sum0 = vdupq_n_s32(0), sum1 = vdupq_n_s32(0);
+
+  while (pVect1 < pEnd1) {
+    int8x16_t v1 = vld1q_s8(pVect1);
+    int8x16_t v2 = vld1q_s8(pVect2);
+    int16x8_t diffLow = vsubl_s8(vget_low_s8(v1), vget_low_s8(v2));
+    int16x8_t diffHigh = vsubl_high_s8(v1, v2);
+    sum0 = vmlal_s16(sum0, vget_low_s16(diffLow), vget_low_s16(diffLow));
+    sum1 = vmlal_high_s16(sum1, diffLow, diffLow);
+    sum0 = vmlal_s16(sum0, vget_low_s16(diffHigh), vget_low_s16(diffHigh));
+    sum1 = vmlal_high_s16(sum1, diffHigh, diffHigh);
+    pVect1 += 16;
+    pVect2 += 16;
+  }
+
+  return vaddvq_s32(vaddq_s32(sum0, sum1));
+}
+
+static float L2SqrE4M3SIMD16ExtNEON(const E4M3 *pVect1, const E4M3 *pVect2,
+                                    const size_t qty) {
+  const E4M3 *pEnd1 = pVect1 + (qty >> 4 << 4);
+
+  float32x4_t v1[4], v2[4];
+  float32x4_t sum0 = vdupq_n_f32(0), sum1 = vdupq_n_f32(0);
+
+  while (pVect1 < pEnd1) {
+    loadE4M3x16NEON(pVect1, v1);
+    loadE4M3x16NEON(pVect2, v2);
+    float32x4_t diff0 = vsubq_f32(v1[0], v2[0]);
+    float32x4_t diff1 = vsubq_f32(v1[1], v2[1]);
+    float32x4_t diff2 = vsubq_f32(v1[2], v2[2]);
+    float32x4_t diff3 = vsubq_f32(v1[3], v2[3]);
+    sum0 = vfmaq_f32(sum0, diff0, diff0);
+    sum1 = vfmaq_f32(sum1, diff1, diff1);
+    sum0 = vfmaq_f32(sum0, diff2, diff2);
+    sum1 = vfmaq_f32(sum1, diff3, diff3);
+    pVect1 += 16;
+    pVect2 += 16;
+  }
+
+  return vaddvq_f32(vaddq_f32(sum0, sum1));
+}
+
+#endif
+
+template <Int8DistanceKernel SIMD16Ext, typename scalefactor>
+static float L2SqrInt8SIMD16ExtResiduals(const int8_t *pVect1,
+                                         const int8_t *pVect2,
+                                         const size_t qty) {
+  size_t qty16 = qty >> 4 << 4;
+  int32_t res = SIMD16Ext(pVect1, pVect2, qty16);
+
+  for (size_t i = qty16; i < qty; i++) {
+    int32_t diff = (int32_t)pVect1[i] - (int32_t)pVect2[i];
+    res += diff * diff;
+  }
+
+  constexpr float scale = (float)scalefactor::num / (float)scalefactor::den;
+  return res * scale * scale;
+}
+
+template <E4M3DistanceKernel SIMD16Ext, typename scalefactor>
+static float L2SqrE4M3SIMD16ExtResiduals(const E4M3 *pVect1,
+                                         const E4M3 *pVect2,
+                                         const size_t qty) {
+  size_t qty16 = qty >> 4 << 4;
+  float res = SIMD16Ext(pVect1, pVect2, qty16);
+  // Compute the tail without any scaling, then scale the total once:
+  res += L2Sqr<float, E4M3>(pVect1 + qty16, pVect2 + qty16, qty - qty16);
+
+  constexpr float scale = (float)scalefactor::num / (float)scalefactor::den;
+  return res * scale * scale;
+}
+
+/**
+ * Pick a SIMD kernel for int8 or E4M3 vectors with `dim` dimensions, if the
+ * CPU supports one; otherwise, return `fallback`.
+ */
+template <typename data_t, typename scalefactor>
+static DISTFUNC<float, data_t>
+selectQuantizedL2SqrSIMD(size_t dim, DISTFUNC<float, data_t> fallback) {
+  const CPUFeatures &cpu = CPUFeatures::get();
+  if (dim < 16)
+    return fallback;
+
+  if constexpr (std::is_same_v<data_t, int8_t>) {
+#if defined(USE_AVX)
+    if (cpu.avx2)
+      return L2SqrInt8SIMD16ExtResiduals<L2SqrInt8SIMD16ExtAVX2, scalefactor>;
+#endif
+#if defined(USE_NEON)
+    if (cpu.neon)
+      return L2SqrInt8SIMD16ExtResiduals<L2SqrInt8SIMD16ExtNEON, scalefactor>;
+#endif
+  } else if constexpr (std::is_same_v<data_t, E4M3>) {
+#if defined(USE_AVX)
+    if (cpu.avx2 && cpu.fma && cpu.f16c)
+      return L2SqrE4M3SIMD16ExtResiduals<L2SqrE4M3SIMD16ExtAVX2, scalefactor>;
+#endif
+#if defined(USE_NEON)
+    if (cpu.neon)
+      return L2SqrE4M3SIMD16ExtResiduals<L2SqrE4M3SIMD16ExtNEON, scalefactor>;
+#endif
+  }
+  (void)cpu;
+  return fallback;
+}
+
 template <typename dist_t, typename data_t = dist_t,
           typename scalefactor = std::ratio<1, 1>>
 class EuclideanSpace : public Space<dist_t, data_t> {
@@ -261,6 +519,13 @@ public:
       fstdistfunc_ = L2SqrAtLeast<dist_t, data_t, 4, scalefactor>;
     else
       fstdistfunc_ = L2Sqr<dist_t, data_t, 1, scalefactor>;
+
+    if constexpr (std::is_same_v<dist_t, float> &&
+                  (std::is_same_v<data_t, int8_t> ||
+                   std::is_same_v<data_t, E4M3>)) {
+      fstdistfunc_ =
+          selectQuantizedL2SqrSIMD<data_t, scalefactor>(dim, fstdistfunc_);
+    }
   }
 
   size_t get_data_size() { return data_size_; }
@@ -276,15 +541,35 @@ template <>
 EuclideanSpace<float, float>::EuclideanSpace(size_t dim)
     : data_size_(dim * sizeof(float)), dim_(dim) {
   fstdistfunc_ = L2Sqr<float, float>;
-#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
-  if (dim % 16 == 0)
-    fstdistfunc_ = L2SqrSIMD16Ext;
-  else if (dim % 4 == 0)
-    fstdistfunc_ = L2SqrSIMD4Ext;
-  else if (dim > 16)
-    fstdistfunc_ = L2SqrSIMD16ExtResiduals;
-  else if (dim > 4)
-    fstdistfunc_ = L2SqrSIMD4ExtResiduals;
+  const CPUFeatures &cpu = CPUFeatures::get();
+#if defined(USE_AVX512)
+  if (cpu.avx512f) {
+    fstdistfunc_ = selectL2SqrSIMD<L2SqrSIMD16ExtAVX512, L2SqrSIMD4ExtSSE,
+                                   L2SqrSIMD16ExtAVX512FixedDim>(dim);
+    return;
+  }
+#endif
+#if defined(USE_AVX)
+  if (cpu.avx2 && cpu.fma) {
+    fstdistfunc_ = selectL2SqrSIMD<L2SqrSIMD16ExtAVX2, L2SqrSIMD4ExtSSE,
+                                   L2SqrSIMD16ExtAVX2FixedDim>(dim);
+    return;
+  }
+#endif
+#if defined(USE_SSE)
+  if (cpu.sse) {
+    fstdistfunc_ = selectL2SqrSIMD<L2SqrSIMD16ExtSSE, L2SqrSIMD4ExtSSE,
+                                   L2SqrSIMD16ExtSSEFixedDim>(dim);
+    return;
+  }
+#endif
+#if defined(USE_NEON)
+  if (cpu.neon) {
+    fstdistfunc_ = selectL2SqrSIMD<L2SqrSIMD16ExtNEON, L2SqrSIMD4ExtNEON,
+                                   L2SqrSIMD16ExtNEONFixedDim>(dim);
+    return;
+  }
 #endif
+  (void)cpu;
 }
 } // namespace hnswlib
@@ -0,0 +1,76 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+#pragma once
+#include "Space.h"
+#include <memory>
+
+namespace hnswlib {
+/**
+ * A space that stores a full-precision (float) copy of each vector after its
+ * compact representation, so that search results found using the compact
+ * representation can be re-scored exactly.
+ *
+ * All distances used to build and search the graph come from `space`, and
+ * only read the compact representation at the start of each stored vector.
+ * The float copy follows it (aligned to four bytes), and is compared using
+ * `exactSpace`, a space over floats measuring the same distance.
+ */
+template <typename dist_t, typename data_t>
+class FullPrecisionCopySpace : public Space<dist_t, data_t> {
+  std::unique_ptr<Space<dist_t, data_t>> space_;
+  std::unique_ptr<Space<dist_t, float>> exactSpace_;
+  size_t offset_;
+
+public:
+  FullPrecisionCopySpace(std::unique_ptr<Space<dist_t, data_t>> space,
+                         std::unique_ptr<Space<dist_t, float>> exactSpace)
+      : space_(std::move(space)), exactSpace_(std::move(exactSpace)) {
+    offset_ = (space_->get_data_size() + sizeof(float) - 1) / sizeof(float) *
+              sizeof(float);
+  }
+
+  size_t get_data_size() { return offset_ + exactSpace_->get_data_size(); }
+
+  DISTFUNC<dist_t, data_t> get_dist_func() { return space_->get_dist_func(); }
+
+  size_t get_dist_func_param() { return space_->get_dist_func_param(); }
+
+  DISTFUNC<dist_t, data_t> get_query_dist_func() {
+    return space_->get_query_dist_func();
+  }
+
+  size_t get_query_size() { return space_->get_query_size(); }
+
+  // The offset, in bytes, of the float copy within each stored vector.
+  size_t get_full_precision_offset() const { return offset_; }
+
+  // The distance between a float query and a stored vector's float copy.
+  DISTFUNC<dist_t, float> get_full_precision_dist_func() {
+    return exactSpace_->get_dist_func();
+  }
+
+  size_t get_full_precision_dist_func_param() {
+    return exactSpace_->get_dist_func_param();
+  }
+
+  ~FullPrecisionCopySpace() {}
+};
+}; // namespace hnswlib
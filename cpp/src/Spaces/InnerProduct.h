@@ -22,8 +22,11 @@
  */
 
 #pragma once
+#include "CPUFeatures.h"
+#include "E4M3SIMD.h"
 #include "Space.h"
 #include <ratio>
+#include <type_traits>
 
 namespace hnswlib {
 /**
@@ -81,9 +84,9 @@ static dist_t InnerProductAtLeast(const data_t *__restrict pVect1,
 
 #if defined(USE_AVX)
 
-// Favor using AVX if available.
-static float InnerProductSIMD4Ext(const float *pVect1, const float *pVect2,
-                                  const size_t qty) {
+VOYAGER_TARGET("avx2,fma")
+static float InnerProductSIMD4ExtAVX2(const float *pVect1, const float *pVect2,
+                                      const size_t qty) {
   float PORTABLE_ALIGN32 TmpRes[8];
 
   size_t qty16 = qty / 16;
@@ -101,13 +104,13 @@ static float InnerProductSIMD4Ext(const float *pVect1, const float *pVect2,
     pVect1 += 8;
     __m256 v2 = _mm256_loadu_ps(pVect2);
     pVect2 += 8;
-    sum256 = _mm256_add_ps(sum256, _mm256_mul_ps(v1, v2));
+    sum256 = _mm256_fmadd_ps(v1, v2, sum256);
 
     v1 = _mm256_loadu_ps(pVect1);
     pVect1 += 8;
     v2 = _mm256_loadu_ps(pVect2);
     pVect2 += 8;
-    sum256 = _mm256_add_ps(sum256, _mm256_mul_ps(v1, v2));
+    sum256 = _mm256_fmadd_ps(v1, v2, sum256);
   }
 
   __m128 v1, v2;
@@ -119,19 +122,59 @@ static float InnerProductSIMD4Ext(const float *pVect1, const float *pVect2,
     pVect1 += 4;
     v2 = _mm_loadu_ps(pVect2);
     pVect2 += 4;
-    sum_prod = _mm_add_ps(sum_prod, _mm_mul_ps(v1, v2));
+    sum_prod = _mm_fmadd_ps(v1, v2, sum_prod);
   }
 
   _mm_store_ps(TmpRes, sum_prod);
   float sum = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
-  ;
   return 1.0f - sum;
 }
 
-#elif defined(USE_SSE)
+VOYAGER_TARGET("avx2,fma")
+static float InnerProductSIMD16ExtAVX2(const float *pVect1,
+                                       const float *pVect2, const size_t qty) {
+  float PORTABLE_ALIGN32 TmpRes[8];
 
-static float InnerProductSIMD4Ext(const float *pVect1, const float *pVect2,
-                                  const size_t qty) {
+  size_t qty16 = qty / 16;
+
+  const float *pEnd1 = pVect1 + 16 * qty16;
+
+  __m256 sum256 = _mm256_set1_ps(0);
+
+  while (pVect1 < pEnd1) {
+    //_mm_prefetch((char*)(pVect2 + 16), _MM_HINT_T0);
+
+    __m256 v1 = _mm256_loadu_ps(pVect1);
+    pVect1 += 8;
+    __m256 v2 = _mm256_loadu_ps(pVect2);
+    pVect2 += 8;
+    sum256 = _mm256_fmadd_ps(v1, v2, sum256);
+
+    v1 = _mm256_loadu_ps(pVect1);
+    pVect1 += 8;
+    v2 = _mm256_loadu_ps(pVect2);
+    pVect2 += 8;
+    sum256 = _mm256_fmadd_ps(v1, v2, sum256);
+  }
+
+  _mm256_store_ps(TmpRes, sum256);
+  float sum = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] +
+              TmpRes[5] + TmpRes[6] + TmpRes[7];
+
+  return 1.0f - sum;
+}
+
+VOYAGER_FIXED_DIMENSION_KERNEL(InnerProductSIMD16ExtAVX2FixedDim,
+                               InnerProductSIMD16ExtAVX2,
+                               VOYAGER_TARGET("avx2,fma"), float, float)
+
+#endif
+
+#if defined(USE_SSE)
+
+VOYAGER_TARGET("sse")
+static float InnerProductSIMD4ExtSSE(const float *pVect1, const float *pVect2,
+                                     const size_t qty) {
   float PORTABLE_ALIGN32 TmpRes[8];
 
   size_t qty16 = qty / 16;
@@ -183,12 +226,60 @@ static float InnerProductSIMD4Ext(const float *pVect1, const float *pVect2,
   return 1.0f - sum;
 }
 
+VOYAGER_TARGET("sse")
+static float InnerProductSIMD16ExtSSE(const float *pVect1, const float *pVect2,
+                                      const size_t qty) {
+  float PORTABLE_ALIGN32 TmpRes[8];
+  size_t qty16 = qty / 16;
+
+  const float *pEnd1 = pVect1 + 16 * qty16;
+
+  __m128 v1, v2;
+  __m128 sum_prod = _mm_set1_ps(0);
+
+  while (pVect1 < pEnd1) {
+    v1 = _mm_loadu_ps(pVect1);
+    pVect1 += 4;
+    v2 = _mm_loadu_ps(pVect2);
+    pVect2 += 4;
+    sum_prod = _mm_add_ps(sum_prod, _mm_mul_ps(v1, v2));
+
+    v1 = _mm_loadu_ps(pVect1);
+    pVect1 += 4;
+    v2 = _mm_loadu_ps(pVect2);
+    pVect2 += 4;
+    sum_prod = _mm_add_ps(sum_prod, _mm_mul_ps(v1, v2));
+
+    v1 = _mm_loadu_ps(pVect1);
+    pVect1 += 4;
+    v2 = _mm_loadu_ps(pVect2);
+    pVect2 += 4;
+    sum_prod = _mm_add_ps(sum_prod, _mm_mul_ps(v1, v2));
+
+    v1 = _mm_loadu_ps(pVect1);
+    pVect1 += 4;
+    v2 = _mm_loadu_ps(pVect2);
+    pVect2 += 4;
+    sum_prod = _mm_add_ps(sum_prod, _mm_mul_ps(v1, v2));
+  }
+  _mm_store_ps(TmpRes, sum_prod);
+  float sum = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
+
+  return 1.0f - sum;
+}
+
+VOYAGER_FIXED_DIMENSION_KERNEL(InnerProductSIMD16ExtSSEFixedDim,
+                               InnerProductSIMD16ExtSSE, VOYAGER_TARGET("sse"),
+                               float, float)
+
 #endif
 
 #if defined(USE_AVX512)
 
-static float InnerProductSIMD16Ext(const float *pVect1, const float *pVect2,
-                                   const size_t qty) {
+VOYAGER_TARGET("avx512f")
+static float InnerProductSIMD16ExtAVX512(const float *pVect1,
+                                         const float *pVect2,
+                                         const size_t qty) {
   float PORTABLE_ALIGN64 TmpRes[16];
 
   size_t qty16 = qty / 16;
@@ -204,7 +295,7 @@ static float InnerProductSIMD16Ext(const float *pVect1, const float *pVect2,
     pVect1 += 16;
     __m512 v2 = _mm512_loadu_ps(pVect2);
     pVect2 += 16;
-    sum512 = _mm512_add_ps(sum512, _mm512_mul_ps(v1, v2));
+    sum512 = _mm512_fmadd_ps(v1, v2, sum512);
   }
 
   _mm512_store_ps(TmpRes, sum512);
@@ -216,92 +307,65 @@ static float InnerProductSIMD16Ext(const float *pVect1, const float *pVect2,
   return 1.0f - sum;
 }
 
-#elif defined(USE_AVX)
+VOYAGER_FIXED_DIMENSION_KERNEL(InnerProductSIMD16ExtAVX512FixedDim,
+                               InnerProductSIMD16ExtAVX512,
+                               VOYAGER_TARGET("avx512f"), float, float)
 
-static float InnerProductSIMD16Ext(const float *pVect1, const float *pVect2,
-                                   const size_t qty) {
-  float PORTABLE_ALIGN32 TmpRes[8];
+#endif
+
+#if defined(USE_NEON)
 
+static float InnerProductSIMD16ExtNEON(const float *pVect1,
+                                       const float *pVect2, const size_t qty) {
   size_t qty16 = qty / 16;
 
   const float *pEnd1 = pVect1 + 16 * qty16;
 
-  __m256 sum256 = _mm256_set1_ps(0);
+  float32x4_t sum0 = vdupq_n_f32(0), sum1 = vdupq_n_f32(0);
+  float32x4_t sum2 = vdupq_n_f32(0), sum3 = vdupq_n_f32(0);
 
   while (pVect1 < pEnd1) {
-    //_mm_prefetch((char*)(pVect2 + 16), _MM_HINT_T0);
-
-    __m256 v1 = _mm256_loadu_ps(pVect1);
-    pVect1 += 8;
-    __m256 v2 = _mm256_loadu_ps(pVect2);
-    pVect2 += 8;
-    sum256 = _mm256_add_ps(sum256, _mm256_mul_ps(v1, v2));
-
-    v1 = _mm256_loadu_ps(pVect1);
-    pVect1 += 8;
-    v2 = _mm256_loadu_ps(pVect2);
-    pVect2 += 8;
-    sum256 = _mm256_add_ps(sum256, _mm256_mul_ps(v1, v2));
+    sum0 = vfmaq_f32(sum0, vld1q_f32(pVect1), vld1q_f32(pVect2));
+    sum1 = vfmaq_f32(sum1, vld1q_f32(pVect1 + 4), vld1q_f32(pVect2 + 4));
+    sum2 = vfmaq_f32(sum2, vld1q_f32(pVect1 + 8), vld1q_f32(pVect2 + 8));
+    sum3 = vfmaq_f32(sum3, vld1q_f32(pVect1 + 12), vld1q_f32(pVect2 + 12));
+    pVect1 += 16;
+    pVect2 += 16;
   }
 
-  _mm256_store_ps(TmpRes, sum256);
-  float sum = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] +
-              TmpRes[5] + TmpRes[6] + TmpRes[7];
-
+  float sum =
+      vaddvq_f32(vaddq_f32(vaddq_f32(sum0, sum1), vaddq_f32(sum2, sum3)));
   return 1.0f - sum;
 }
 
-#elif defined(USE_SSE)
+VOYAGER_FIXED_DIMENSION_KERNEL(InnerProductSIMD16ExtNEONFixedDim,
+                               InnerProductSIMD16ExtNEON, , float, float)
 
-static float InnerProductSIMD16Ext(const float *pVect1, const float *pVect2,
-                                   const size_t qty) {
-  float PORTABLE_ALIGN32 TmpRes[8];
-  size_t qty16 = qty / 16;
+static float InnerProductSIMD4ExtNEON(const float *pVect1, const float *pVect2,
+                                      const size_t qty) {
+  size_t qty4 = qty / 4;
 
-  const float *pEnd1 = pVect1 + 16 * qty16;
+  const float *pEnd1 = pVect1 + 4 * qty4;
 
-  __m128 v1, v2;
-  __m128 sum_prod = _mm_set1_ps(0);
+  float32x4_t sum_prod = vdupq_n_f32(0);
 
   while (pVect1 < pEnd1) {
-    v1 = _mm_loadu_ps(pVect1);
-    pVect1 += 4;
-    v2 = _mm_loadu_ps(pVect2);
-    pVect2 += 4;
-    sum_prod = _mm_add_ps(sum_prod, _mm_mul_ps(v1, v2));
-
-    v1 = _mm_loadu_ps(pVect1);
-    pVect1 += 4;
-    v2 = _mm_loadu_ps(pVect2);
-    pVect2 += 4;
-    sum_prod = _mm_add_ps(sum_prod, _mm_mul_ps(v1, v2));
-
-    v1 = _mm_loadu_ps(pVect1);
-    pVect1 += 4;
-    v2 = _mm_loadu_ps(pVect2);
-    pVect2 += 4;
-    sum_prod = _mm_add_ps(sum_prod, _mm_mul_ps(v1, v2));
-
-    v1 = _mm_loadu_ps(pVect1);
+    sum_prod = vfmaq_f32(sum_prod, vld1q_f32(pVect1), vld1q_f32(pVect2));
     pVect1 += 4;
-    v2 = _mm_loadu_ps(pVect2);
     pVect2 += 4;
-    sum_prod = _mm_add_ps(sum_prod, _mm_mul_ps(v1, v2));
   }
-  _mm_store_ps(TmpRes, sum_prod);
-  float sum = TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3];
 
-  return 1.0f - sum;
+  return 1.0f - vaddvq_f32(sum_prod);
 }
 
 #endif
 
-#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
+template <FloatDistanceKernel SIMD16Ext>
 static float InnerProductSIMD16ExtResiduals(const float *pVect1,
                                             const float *pVect2,
                                             const size_t qty) {
   size_t qty16 = qty >> 4 << 4;
-  float res = InnerProductSIMD16Ext(pVect1, pVect2, qty16);
+  float res = SIMD16Ext(pVect1, pVect2, qty16);
 
   size_t qty_left = qty - qty16;
   float res_tail =
@@ -309,12 +373,13 @@ static float InnerProductSIMD16ExtResiduals(const float *pVect1,
   return res + res_tail - 1.0f;
 }
 
+template <FloatDistanceKernel SIMD4Ext>
 static float InnerProductSIMD4ExtResiduals(const float *pVect1,
                                            const float *pVect2,
                                            const size_t qty) {
   size_t qty4 = qty >> 2 << 2;
 
-  float res = InnerProductSIMD4Ext(pVect1, pVect2, qty4);
+  float res = SIMD4Ext(pVect1, pVect2, qty4);
   size_t qty_left = qty - qty4;
 
   float res_tail =
@@ -322,8 +387,198 @@ static float InnerProductSIMD4ExtResiduals(const float *pVect1,
 
   return res + res_tail - 1.0f;
 }
+
+/**
+ * Pick the best way to apply a pair of SIMD kernels (processing 16 and 4
+ * elements at a time, respectively) to vectors with `dim` dimensions.
+ * `SIMD16ExtFixedDim` specializes the first kernel for common dimensions.
+ */
+template <FloatDistanceKernel SIMD16Ext, FloatDistanceKernel SIMD4Ext,
+          typename SIMD16ExtFixedDim>
+static DISTFUNC<float> selectInnerProductSIMD(size_t dim) {
+  if (dim % 16 == 0)
+    return selectFixedDimensionKernel<SIMD16ExtFixedDim>(dim, SIMD16Ext);
+  else if (dim % 4 == 0)
+    return SIMD4Ext;
+  else if (dim > 16)
+    return InnerProductSIMD16ExtResiduals<SIMD16Ext>;
+  else if (dim > 4)
+    return InnerProductSIMD4ExtResiduals<SIMD4Ext>;
+  return InnerProduct<float, float>;
+}
+
+#if defined(USE_AVX)
+
+/**
+ * The exact dot product of the first qty (a multiple of 16) elements of two
+ * int8 vectors. Each element is widened to 16 bits first, as _mm256_maddubs
+ * would require one unsigned operand and saturates its pairwise sums.
+ */
+VOYAGER_TARGET("avx2")
+static int32_t InnerProductInt8SIMD16ExtAVX2(const int8_t *pVect1,
+                                             const int8_t *pVect2,
+                                             const size_t qty) {
+  int32_t PORTABLE_ALIGN32 TmpRes[8];
+  const int8_t *pEnd1 = pVect1 + (qty >> 4 << 4);
+
+  __m256i sum = _mm256_setzero_si256();
+
+  while (pVect1 < pEnd1) {
+    __m256i v1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)pVect1));
+    pVect1 += 16;
+    __m256i v2 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)pVect2));
+    pVect2 += 16;
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(v1, v2));
+  }
+
+  _mm256_store_si256((__m256i *)TmpRes, sum);
+  return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] +
+         TmpRes[6] + TmpRes[7];
+}
+
+/**
+ * The dot product of the first qty (a multiple of 16) elements of two E4M3
+ * vectors. Unlike the float kernels, this returns the plain dot product.
+ */
+VOYAGER_TARGET("avx2,fma,f16c")
+static float InnerProductE4M3SIMD16ExtAVX2(const E4M3 *pVect1,
+                                           const E4M3 *pVect2,
+                                           const size_t qty) {
+  float PORTABLE_ALIGN32 TmpRes[8];
+  const E4M3 *pEnd1 = pVect1 + (qty >> 4 << 4);
+
+  __m256 v1Low, v1High, v2Low, v2High;
+  __m256 sum = _mm256_set1_ps(0);
+
+  while (pVect1 < pEnd1) {
+    loadE4M3x16AVX2(pVect1, v1Low, v1High);
+    pVect1 += 16;
+    loadE4M3x16AVX2(pVect2, v2Low, v2High);
+    pVect2 += 16;
+
+    sum = _mm256_fmadd_ps(v1Low, v2Low, sum);
+    sum = _mm256_fmadd_ps(v1High, v2High, sum);
+  }
+
+  _mm256_store_ps(TmpRes, sum);
+  return TmpRes[0] + TmpRes[1] + TmpRes[2] + TmpRes[3] + TmpRes[4] + TmpRes[5] +
+         TmpRes[6] + TmpRes[7];
+}
+
+#endif
+
+#if defined(USE_NEON)
+
+static int32_t InnerProductInt8SIMD16ExtNEON(const int8_t *pVect1,
+                                             const int8_t *pVect2,
+                                             const size_t qty) {
+  const int8_t *pEnd1 = pVect1 + (qty >> 4 << 4);
+
+  int32x4_t sum0 = vdupq_n_s32(0), sum1 = vdupq_n_s32(0);
+
+  while (pVect1 < pEnd1) {
+    int8x16_t v1 = vld1q_s8(pVect1);
+    int8x16_t v2 = vld1q_s8(pVect2);
+    // Products of two int8s always fit into an int16:
+    sum0 = vpadalq_s16(sum0, vmull_s8(vget_low_s8(v1), vget_low_s8(v2)));
+    sum1 = vpadalq_s16(sum1, vmull_high_s8(v1, v2));
+    pVect1 += 16;
+    pVect2 += 16;
+  }
+
+  return vaddvq_s32(vaddq_s32(sum0, sum1));
+}
+
+static float InnerProductE4M3SIMD16ExtNEON(const E4M3 *pVect1,
+                                           const E4M3 *pVect2,
+                                           const size_t qty) {
+  const E4M3 *pEnd1 = pVect1 + (qty >> 4 << 4);
+
+  float32x4_t v1[4], v2[4];
+  float32x4_t sum0 = vdupq_n_f32(0), sum1 = vdupq_n_f32(0);
+
+  while (pVect1 < pEnd1) {
+    loadE4M3x16NEON(pVect1, v1);
+    loadE4M3x16NEON(pVect2, v2);
+    sum0 = vfmaq_f32(sum0, v1[0], v2[0]);
+    sum1 = vfmaq_f32(sum1, v1[1], v2[1]);
+    sum0 = vfmaq_f32(sum0, v1[2], v2[2]);
+    sum1 = vfmaq_f32(sum1, v1[3], v2[3]);
+    pVect1 += 16;
+    pVect2 += 16;
+  }
+
+  return vaddvq_f32(vaddq_f32(sum0, sum1));
+}
+
 #endif
 
+template <Int8DistanceKernel SIMD16Ext, typename scalefactor>
+static float InnerProductInt8SIMD16ExtResiduals(const int8_t *pVect1,
+                                                const int8_t *pVect2,
+                                                const size_t qty) {
+  size_t qty16 = qty >> 4 << 4;
+  int32_t res = SIMD16Ext(pVect1, pVect2, qty16);
+
+  for (size_t i = qty16; i < qty; i++) {
+    res += (int32_t)pVect1[i] * (int32_t)pVect2[i];
+  }
+
+  constexpr float scale = (float)scalefactor::num / (float)scalefactor::den;
+  return 1.0f - res * scale * scale;
+}
+
+template <E4M3DistanceKernel SIMD16Ext, typename scalefactor>
+static float InnerProductE4M3SIMD16ExtResiduals(const E4M3 *pVect1,
+                                                const E4M3 *pVect2,
+                                                const size_t qty) {
+  size_t qty16 = qty >> 4 << 4;
+  float res = SIMD16Ext(pVect1, pVect2, qty16) +
+              InnerProductWithoutScale<float, E4M3>(
+                  pVect1 + qty16, pVect2 + qty16, qty - qty16);
+
+  constexpr float scale = (float)scalefactor::num / (float)scalefactor::den;
+  return 1.0f - res * scale * scale;
+}
+
+/**
+ * Pick a SIMD kernel for int8 or E4M3 vectors with `dim` dimensions, if the
+ * CPU supports one; otherwise, return `fallback`.
+ */
+template <typename data_t, typename scalefactor>
+static DISTFUNC<float, data_t>
+selectQuantizedInnerProductSIMD(size_t dim, DISTFUNC<float, data_t> fallback) {
+  const CPUFeatures &cpu = CPUFeatures::get();
+  if (dim < 16)
+    return fallback;
+
+  if constexpr (std::is_same_v<data_t, int8_t>) {
+#if defined(USE_AVX)
+    if (cpu.avx2)
+      return InnerProductInt8SIMD16ExtResiduals<InnerProductInt8SIMD16ExtAVX2,
+                                                scalefactor>;
+#endif
+#if defined(USE_NEON)
+    if (cpu.neon)
+      return InnerProductInt8SIMD16ExtResiduals<InnerProductInt8SIMD16ExtNEON,
+                                                scalefactor>;
+#endif
+  } else if constexpr (std::is_same_v<data_t, E4M3>) {
+#if defined(USE_AVX)
+    if (cpu.avx2 && cpu.fma && cpu.f16c)
+      return InnerProductE4M3SIMD16ExtResiduals<InnerProductE4M3SIMD16ExtAVX2,
+                                                scalefactor>;
+#endif
+#if defined(USE_NEON)
+    if (cpu.neon)
+      return InnerProductE4M3SIMD16ExtResiduals<InnerProductE4M3SIMD16ExtNEON,
+                                                scalefactor>;
+#endif
+  }
+  (void)cpu;
+  return fallback;
+}
+
 template <typename dist_t, typename data_t = dist_t,
           typename scalefactor = std::ratio<1, 1>>
 class InnerProductSpace : public Space<dist_t, data_t> {
@@ -360,6 +615,13 @@ public:
       fstdistfunc_ = InnerProductAtLeast<dist_t, data_t, 4, scalefactor>;
     else
       fstdistfunc_ = InnerProduct<dist_t, data_t, 1, scalefactor>;
+
+    if constexpr (std::is_same_v<dist_t, float> &&
+                  (std::is_same_v<data_t, int8_t> ||
+                   std::is_same_v<data_t, E4M3>)) {
+      fstdistfunc_ = selectQuantizedInnerProductSIMD<data_t, scalefactor>(
+          dim, fstdistfunc_);
+    }
   }
 
   size_t get_data_size() { return data_size_; }
@@ -374,16 +636,40 @@ template <>
 InnerProductSpace<float, float>::InnerProductSpace(size_t dim)
     : data_size_(dim * sizeof(float)), dim_(dim) {
   fstdistfunc_ = InnerProduct<float, float>;
-#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
-  if (dim % 16 == 0)
-    fstdistfunc_ = InnerProductSIMD16Ext;
-  else if (dim % 4 == 0)
-    fstdistfunc_ = InnerProductSIMD4Ext;
-  else if (dim > 16)
-    fstdistfunc_ = InnerProductSIMD16ExtResiduals;
-  else if (dim > 4)
-    fstdistfunc_ = InnerProductSIMD4ExtResiduals;
+  const CPUFeatures &cpu = CPUFeatures::get();
+#if defined(USE_AVX512)
+  if (cpu.avx512f && cpu.avx2 && cpu.fma) {
+    fstdistfunc_ = selectInnerProductSIMD<
+        InnerProductSIMD16ExtAVX512, InnerProductSIMD4ExtAVX2,
+        InnerProductSIMD16ExtAVX512FixedDim>(dim);
+    return;
+  }
+#endif
+#if defined(USE_AVX)
+  if (cpu.avx2 && cpu.fma) {
+    fstdistfunc_ = selectInnerProductSIMD<
+        InnerProductSIMD16ExtAVX2, InnerProductSIMD4ExtAVX2,
+        InnerProductSIMD16ExtAVX2FixedDim>(dim);
+    return;
+  }
+#endif
+#if defined(USE_SSE)
+  if (cpu.sse) {
+    fstdistfunc_ = selectInnerProductSIMD<
+        InnerProductSIMD16ExtSSE, InnerProductSIMD4ExtSSE,
+        InnerProductSIMD16ExtSSEFixedDim>(dim);
+    return;
+  }
+#endif
+#if defined(USE_NEON)
+  if (cpu.neon) {
+    fstdistfunc_ = selectInnerProductSIMD<
+        InnerProductSIMD16ExtNEON, InnerProductSIMD4ExtNEON,
+        InnerProductSIMD16ExtNEONFixedDim>(dim);
+    return;
+  }
 #endif
+  (void)cpu;
 }
 
 } // namespace hnswlib
@@ -0,0 +1,98 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+#pragma once
+#include "../ProductQuantizer.h"
+#include "Space.h"
+#include <memory>
+
+namespace hnswlib {
+/**
+ * A space over product-quantized vectors (see ProductQuantizer), measuring
+ * either squared Euclidean distance or inner product distance (1 - <a, b>).
+ *
+ * Stored vectors are arrays of PQCodes, but queries are distance tables (as
+ * filled in by ProductQuantizer::computeDistanceTable, and passed in as
+ * PQCode pointers), so the distance from a query to each stored vector takes
+ * one table lookup per subvector and no decoding.
+ */
+class ProductQuantizationSpace : public Space<float, PQCode> {
+  std::shared_ptr<const ProductQuantizer> quantizer_;
+  bool innerProduct_;
+
+public:
+  ProductQuantizationSpace(std::shared_ptr<const ProductQuantizer> quantizer,
+                           bool innerProduct)
+      : quantizer_(quantizer), innerProduct_(innerProduct) {}
+
+  size_t get_data_size() { return quantizer_->getNumSubvectors(); }
+
+  // Distances between two stored vectors, as used while building the graph.
+  DISTFUNC<float, PQCode> get_dist_func() {
+    const ProductQuantizer *quantizer = quantizer_.get();
+    if (innerProduct_) {
+      return [quantizer](const PQCode *a, const PQCode *b, size_t) {
+        return 1.0f - quantizer->compareCodes(a, b, true);
+      };
+    }
+    return [quantizer](const PQCode *a, const PQCode *b, size_t) {
+      return quantizer->compareCodes(a, b, false);
+    };
+  }
+
+  DISTFUNC<float, PQCode> get_query_dist_func() {
+    if (innerProduct_) {
+      return [](const PQCode *query, const PQCode *b, size_t numSubvectors) {
+        return 1.0f - sumDistanceTable((const float *)query, b, numSubvectors);
+      };
+    }
+    return [](const PQCode *query, const PQCode *b, size_t numSubvectors) {
+      return sumDistanceTable((const float *)query, b, numSubvectors);
+    };
+  }
+
+  size_t get_query_size() {
+    return quantizer_->getDistanceTableSize() * sizeof(float);
+  }
+
+  size_t get_dist_func_param() { return quantizer_->getNumSubvectors(); }
+
+  ~ProductQuantizationSpace() {}
+
+private:
+  static float sumDistanceTable(const float *table, const PQCode *codes,
+                                size_t numSubvectors) {
+    const size_t rowSize = ProductQuantizer::NUM_CENTROIDS;
+    // Four independent sums, so consecutive lookups don't wait on each other:
+    float sums[4] = {0, 0, 0, 0};
+    size_t i = 0;
+    for (; i + 4 <= numSubvectors; i += 4) {
+      sums[0] += table[i * rowSize + codes[i].centroid];
+      sums[1] += table[(i + 1) * rowSize + codes[i + 1].centroid];
+      sums[2] += table[(i + 2) * rowSize + codes[i + 2].centroid];
+      sums[3] += table[(i + 3) * rowSize + codes[i + 3].centroid];
+    }
+    for (; i < numSubvectors; i++) {
+      sums[0] += table[i * rowSize + codes[i].centroid];
+    }
+    return (sums[0] + sums[1]) + (sums[2] + sums[3]);
+  }
+};
+}; // namespace hnswlib
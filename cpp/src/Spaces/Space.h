@@ -22,6 +22,7 @@
  */
 
 #pragma once
+#include <cstdint>
 #include <functional>
 
 namespace hnswlib {
@@ -29,6 +30,82 @@ template <typename MTYPE, typename data_t = MTYPE>
 using DISTFUNC =
     std::function<MTYPE(const data_t *, const data_t *, const size_t)>;
 
+/**
+ * A plain function pointer to a distance function between float vectors; used
+ * to pass SIMD kernels as template arguments.
+ */
+typedef float (*FloatDistanceKernel)(const float *, const float *,
+                                     const size_t);
+
+/**
+ * A plain function pointer to a distance function, as wrapped by most
+ * DISTFUNCs.
+ */
+template <typename MTYPE, typename data_t = MTYPE>
+using DistanceKernel = MTYPE (*)(const data_t *, const data_t *, const size_t);
+
+/**
+ * The plain function that `distFunc` wraps, or null if it wraps something
+ * else (like a lambda). Calling the function directly saves the indirection
+ * of calling it through std::function.
+ */
+template <typename MTYPE, typename data_t>
+DistanceKernel<MTYPE, data_t>
+getDistanceKernel(const DISTFUNC<MTYPE, data_t> &distFunc) {
+  const DistanceKernel<MTYPE, data_t> *kernel =
+      distFunc.template target<DistanceKernel<MTYPE, data_t>>();
+  return kernel ? *kernel : nullptr;
+}
+
+/**
+ * Define a struct `name` whose `apply<dim>` calls `kernel` on vectors of
+ * exactly `dim` dimensions. Given the same `target` attribute as the kernel
+ * (if any), `apply` can inline it with a constant length, so the compiler
+ * knows its trip count and can unroll its loop completely.
+ */
+#define VOYAGER_FIXED_DIMENSION_KERNEL(name, kernel, target, result_t, data_t) \
+  struct name {                                                                \
+    template <size_t dim>                                                      \
+    target static result_t apply(const data_t *pVect1, const data_t *pVect2,   \
+                                 const size_t) {                               \
+      return kernel(pVect1, pVect2, dim);                                      \
+    }                                                                          \
+  };
+
+/**
+ * If `dim` is a common number of dimensions for embeddings, return the
+ * `fixed_t` (from VOYAGER_FIXED_DIMENSION_KERNEL) kernel for exactly that
+ * many dimensions; otherwise, return `fallback`.
+ */
+template <typename fixed_t, typename kernel_t>
+static kernel_t selectFixedDimensionKernel(size_t dim, kernel_t fallback) {
+  switch (dim) {
+  case 128:
+    return fixed_t::template apply<128>;
+  case 256:
+    return fixed_t::template apply<256>;
+  case 384:
+    return fixed_t::template apply<384>;
+  case 512:
+    return fixed_t::template apply<512>;
+  case 768:
+    return fixed_t::template apply<768>;
+  case 1024:
+    return fixed_t::template apply<1024>;
+  case 1536:
+    return fixed_t::template apply<1536>;
+  default:
+    return fallback;
+  }
+}
+
+/**
+ * A plain function pointer to a SIMD kernel over int8 vectors. These kernels
+ * return the exact, unscaled integer sum; the caller applies the scale factor.
+ */
+typedef int32_t (*Int8DistanceKernel)(const int8_t *, const int8_t *,
+                                      const size_t);
+
 /**
  * An abstract class representing a type of space to search through,
  * and encapsulating the data required to search that space.
@@ -43,6 +120,19 @@ public:
 
   virtual size_t get_dist_func_param() = 0;
 
+  /**
+   * The distance function used between a query (as passed to searchKnn) and
+   * a stored vector. Spaces whose queries are represented differently from
+   * stored vectors (e.g.: as precomputed distance tables) override this and
+   * get_query_size(); by default, queries are stored vectors too.
+   */
+  virtual DISTFUNC<MTYPE, data_t> get_query_dist_func() {
+    return get_dist_func();
+  }
+
+  // The number of bytes in a query as passed to searchKnn.
+  virtual size_t get_query_size() { return get_data_size(); }
+
   virtual ~Space() {}
 };
 }; // namespace hnswlib
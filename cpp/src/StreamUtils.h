@@ -19,6 +19,8 @@
  */
 
 #pragma once
+#include <algorithm>
+#include <cstring>
 #include <exception>
 #include <iostream>
 #include <memory>
@@ -27,6 +29,14 @@
 #include <string>
 #include <sys/stat.h>
 
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 /**
  * Like std::istream, but custom with fewer methods to implement.
  */
@@ -107,6 +117,182 @@ private:
   long long sizeInBytes = -1;
 };
 
+/**
+ * An InputStream over a read-only memory mapping of a file.
+ *
+ * In addition to the usual stream interface, the mapped bytes can be accessed
+ * directly via data(), which allows a search-only index to be served straight
+ * out of the OS page cache (and shared between processes) rather than being
+ * copied into memory up front. The mapping stays valid for as long as this
+ * object is alive.
+ */
+class MemoryMappedInputStream : public InputStream {
+public:
+  MemoryMappedInputStream(const std::string &filename) : filename(filename) {
+#ifdef _WIN32
+    throw std::runtime_error(
+        "Memory-mapped index loading is not supported on Windows.");
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Failed to open file for reading: " + filename);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG) {
+      close(fd);
+      throw std::runtime_error("Only regular files can be memory-mapped: " +
+                               filename);
+    }
+    sizeInBytes = st.st_size;
+
+    if (sizeInBytes > 0) {
+      void *mapping = mmap(nullptr, sizeInBytes, PROT_READ, MAP_SHARED, fd, 0);
+      if (mapping == MAP_FAILED) {
+        int error = errno;
+        close(fd);
+        throw std::runtime_error("Failed to memory-map file (" +
+                                 std::string(strerror(error)) +
+                                 "): " + filename);
+      }
+
+      // HNSW traversal jumps all over the file, so readahead mostly pulls in
+      // pages that will never be used.
+      madvise(mapping, sizeInBytes, MADV_RANDOM);
+      mapped = static_cast<const char *>(mapping);
+    }
+
+    // The mapping keeps its own reference to the file.
+    close(fd);
+#endif
+  }
+
+  MemoryMappedInputStream(const MemoryMappedInputStream &) = delete;
+  MemoryMappedInputStream &operator=(const MemoryMappedInputStream &) = delete;
+
+  virtual ~MemoryMappedInputStream() {
+#ifndef _WIN32
+    if (mapped) {
+      munmap(const_cast<char *>(mapped), sizeInBytes);
+      mapped = nullptr;
+    }
+#endif
+  }
+
+  /**
+   * The start of the mapped file. Valid for getTotalLength() bytes.
+   */
+  const char *data() const { return mapped; }
+
+  virtual bool isSeekable() { return true; }
+  virtual long long getTotalLength() { return sizeInBytes; }
+
+  virtual long long read(char *buffer, long long bytesToRead) {
+    long long bytesToActuallyRead =
+        std::max(0LL, std::min(bytesToRead, sizeInBytes - position));
+    if (bytesToActuallyRead > 0) {
+      std::memcpy(buffer, mapped + position, bytesToActuallyRead);
+      position += bytesToActuallyRead;
+    }
+    return bytesToActuallyRead;
+  }
+
+  virtual bool isExhausted() { return position >= sizeInBytes; }
+  virtual long long getPosition() { return position; }
+  virtual bool setPosition(long long newPosition) {
+    if (newPosition < 0 || newPosition > sizeInBytes) {
+      return false;
+    }
+    position = newPosition;
+    return true;
+  }
+
+  virtual uint32_t peek() {
+    uint32_t result = 0;
+    if (position + (long long)sizeof(result) > sizeInBytes) {
+      throw std::runtime_error(
+          "Failed to peek " + std::to_string(sizeof(result)) +
+          " bytes from file \"" + filename + "\" at index " +
+          std::to_string(position) + ".");
+    }
+    std::memcpy(&result, mapped + position, sizeof(result));
+    return result;
+  }
+
+private:
+  std::string filename;
+  const char *mapped = nullptr;
+  long long sizeInBytes = 0;
+  long long position = 0;
+};
+
+/**
+ * An InputStream over the next `length` bytes of another stream, which appear
+ * to be the whole of this one. Used to read one of several indices that were
+ * saved back to back, as an index expects to be the last thing in its stream.
+ */
+class InputStreamSlice : public InputStream {
+public:
+  InputStreamSlice(std::shared_ptr<InputStream> parent, long long length)
+      : parent(parent), start(parent->getPosition()), length(length) {}
+
+  virtual bool isSeekable() { return parent->isSeekable(); }
+  virtual long long getTotalLength() { return length; }
+
+  virtual long long read(char *buffer, long long bytesToRead) {
+    long long bytesRead = parent->read(
+        buffer, std::max(0LL, std::min(bytesToRead, length - position)));
+    if (bytesRead > 0) {
+      position += bytesRead;
+    }
+    return bytesRead;
+  }
+
+  virtual bool isExhausted() { return position >= length; }
+  virtual long long getPosition() { return position; }
+  virtual bool setPosition(long long newPosition) {
+    if (newPosition < 0 || newPosition > length ||
+        !parent->setPosition(start + newPosition)) {
+      return false;
+    }
+    position = newPosition;
+    return true;
+  }
+
+  virtual uint32_t peek() {
+    if (position + (long long)sizeof(uint32_t) > length) {
+      throw std::runtime_error("Failed to peek " +
+                               std::to_string(sizeof(uint32_t)) +
+                               " bytes past the end of a stream slice.");
+    }
+    return parent->peek();
+  }
+
+  /**
+   * Move the parent stream to the end of this slice, skipping anything that
+   * hasn't been read yet. Returns false if the parent stream ended first.
+   */
+  bool skipToEnd() {
+    if (parent->isSeekable()) {
+      return setPosition(length);
+    }
+
+    char buffer[4096];
+    while (position < length) {
+      if (read(buffer, sizeof(buffer)) <= 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  std::shared_ptr<InputStream> parent;
+  long long start;
+  long long length;
+  long long position = 0;
+};
+
 /**
  * Like std::ostream, but custom with fewer methods to implement.
  */
@@ -161,6 +347,56 @@ private:
   std::ostringstream outputStream;
 };
 
+/**
+ * Discards everything written to it, but counts the bytes; used to find out
+ * how large a buffer to allocate before serializing into it.
+ */
+class CountingOutputStream : public OutputStream {
+public:
+  virtual bool write(const char *, unsigned long long numBytes) {
+    count += numBytes;
+    return true;
+  }
+
+  virtual void flush() {}
+
+  unsigned long long getCount() const { return count; }
+
+private:
+  unsigned long long count = 0;
+};
+
+/**
+ * Writes into a fixed-size block of memory owned by the caller. Writes that
+ * would run past the end of the block fail, and nothing more is written.
+ */
+class BufferOutputStream : public OutputStream {
+public:
+  BufferOutputStream(char *data, unsigned long long size)
+      : data(data), size(size) {}
+
+  virtual bool write(const char *buffer, unsigned long long numBytes) {
+    if (overflowed || numBytes > size - position) {
+      overflowed = true;
+      return false;
+    }
+    std::memcpy(data + position, buffer, numBytes);
+    position += numBytes;
+    return true;
+  }
+
+  virtual void flush() {}
+
+  // Whether exactly `size` bytes were written, no more and no fewer.
+  bool isFull() const { return !overflowed && position == size; }
+
+private:
+  char *data;
+  unsigned long long size;
+  unsigned long long position = 0;
+  bool overflowed = false;
+};
+
 template <typename T>
 static void writeBinaryPOD(std::shared_ptr<OutputStream> out, const T &podRef) {
   if (!out->write((char *)&podRef, sizeof(T))) {
@@ -25,13 +25,19 @@
 
 #include <atomic>
 #include <iostream>
+#include <mutex>
+#include <numeric>
 #include <optional>
 #include <ratio>
+#include <shared_mutex>
+#include <type_traits>
 
+#include "ChangeLog.h"
 #include "E4M3.h"
 #include "Enums.h"
 #include "Index.h"
 #include "Metadata.h"
+#include "ProductQuantizer.h"
 #include "array_utils.h"
 #include "hnswlib.h"
 #include "std_utils.h"
@@ -53,10 +59,14 @@ template <> const StorageDataType storageDataType<float>() {
 template <> const StorageDataType storageDataType<E4M3>() {
   return StorageDataType::E4M3;
 }
+template <> const StorageDataType storageDataType<PQCode>() {
+  return StorageDataType::PQ;
+}
 
 template <> const std::string storageDataTypeName<int8_t>() { return "Float8"; }
 template <> const std::string storageDataTypeName<float>() { return "Float32"; }
 template <> const std::string storageDataTypeName<E4M3>() { return "E4M3"; }
+template <> const std::string storageDataTypeName<PQCode>() { return "PQ"; }
 
 /**
  * A C++ wrapper class for a typed HNSW index.
@@ -81,44 +91,139 @@ private:
   bool normalize = false;
   bool useOrderPreservingTransform = false;
   int numThreadsDefault;
+  // See setAutoGrow().
+  std::atomic<bool> autoGrow{true};
   std::atomic<hnswlib::labeltype> currentLabel;
   std::unique_ptr<hnswlib::HierarchicalNSW<dist_t, data_t>> algorithmImpl;
   std::unique_ptr<hnswlib::Space<dist_t, data_t>> spaceImpl;
   std::unique_ptr<voyager::Metadata::V1> metadata;
 
+  // With PQ storage, vectors are encoded (and queries are turned into
+  // distance tables) by `quantizer` rather than converted value by value.
+  // It's trained on the first vectors added to the index.
+  static constexpr bool productQuantized = std::is_same_v<data_t, PQCode>;
+  std::shared_ptr<ProductQuantizer> quantizer;
+  std::mutex quantizerTrainingMutex;
+
+  // If the index stores a float copy of each vector (to re-rank search
+  // results with), this is spaceImpl; otherwise it's null.
+  hnswlib::FullPrecisionCopySpace<dist_t, data_t> *fullPrecisionSpace =
+      nullptr;
+  hnswlib::DISTFUNC<dist_t, float> fullPrecisionDistFunc;
+
   mutable std::atomic<float> max_norm = 0.0;
 
+  // Working memory for one query at a time, reused across queries so that
+  // searching doesn't allocate.
+  struct QueryContext {
+    typename hnswlib::HierarchicalNSW<dist_t, data_t>::SearchContext search;
+    std::vector<float> input;
+    std::vector<data_t> converted;
+    std::vector<float> fullPrecisionQuery;
+  };
+  ObjectPool<QueryContext> queryContexts;
+
+  // While a change log is open (see openChangeLog()), every change is
+  // appended to it after being applied. Changes take changeLogMutex
+  // exclusively while a log is open, so they're logged in the order they
+  // were applied, and checkpoints see no changes in progress.
+  std::unique_ptr<ChangeLog> changeLog;
+  std::string changeLogIndexPath;
+  size_t checkpointInterval = 0;
+  size_t changesSinceCheckpoint = 0;
+  mutable std::shared_mutex changeLogMutex;
+
+  // The ID of the log-aware snapshot this index was loaded from or last
+  // checkpointed to (or 0), and whether that snapshot's log has yet to be
+  // replayed onto it.
+  uint64_t snapshotId = 0;
+  bool changeLogNeedsReplay = false;
+
 public:
   /**
-   * Create an empty index with the given parameters.
+   * Create an empty index with the given parameters. `numSubvectors` is only
+   * used with PQ storage: it's the number of bytes used to store each vector
+   * (by default, one per four dimensions).
+   *
+   * If `storeFullPrecisionVectors` is set, a float copy of each vector is
+   * stored alongside its compact representation, so that queries can re-rank
+   * their results exactly (see the `rerank` argument of query()).
    */
   TypedIndex(const SpaceType space, const int dimensions, const size_t M = 12,
              const size_t efConstruction = 200, const size_t randomSeed = 1,
              const size_t maxElements = 1,
-             const bool enableOrderPreservingTransform = true)
+             const bool enableOrderPreservingTransform = true,
+             const int numSubvectors = 0,
+             const bool storeFullPrecisionVectors = false)
       : space(space), dimensions(dimensions),
         metadata(std::make_unique<voyager::Metadata::V1>(
             dimensions, space, getStorageDataType(), 0.0,
             space == InnerProduct)) {
-    switch (space) {
-    case Euclidean:
-      spaceImpl = std::make_unique<
-          hnswlib::EuclideanSpace<dist_t, data_t, scalefactor>>(dimensions);
-      break;
-    case InnerProduct:
-      useOrderPreservingTransform = enableOrderPreservingTransform;
-      spaceImpl = std::make_unique<
-          hnswlib::InnerProductSpace<dist_t, data_t, scalefactor>>(
-          dimensions + (useOrderPreservingTransform ? 1 : 0));
-      break;
-    case Cosine:
-      spaceImpl = std::make_unique<
-          hnswlib::InnerProductSpace<dist_t, data_t, scalefactor>>(dimensions);
-      normalize = true;
-      break;
-    default:
-      throw new std::runtime_error(
-          "Space must be one of Euclidean, InnerProduct, or Cosine.");
+    if constexpr (productQuantized) {
+      if (space != Euclidean && space != InnerProduct && space != Cosine) {
+        throw std::runtime_error(
+            "Space must be one of Euclidean, InnerProduct, or Cosine.");
+      }
+      useOrderPreservingTransform =
+          space == InnerProduct && enableOrderPreservingTransform;
+      normalize = space == Cosine;
+      quantizer = std::make_shared<ProductQuantizer>(
+          getActualDimensions(),
+          numSubvectors > 0 ? numSubvectors
+                            : std::max(1, getActualDimensions() / 4));
+      spaceImpl = std::make_unique<hnswlib::ProductQuantizationSpace>(
+          quantizer, space != Euclidean);
+    } else {
+      switch (space) {
+      case Euclidean:
+        spaceImpl = std::make_unique<
+            hnswlib::EuclideanSpace<dist_t, data_t, scalefactor>>(dimensions);
+        break;
+      case InnerProduct:
+        useOrderPreservingTransform = enableOrderPreservingTransform;
+        spaceImpl = std::make_unique<
+            hnswlib::InnerProductSpace<dist_t, data_t, scalefactor>>(
+            dimensions + (useOrderPreservingTransform ? 1 : 0));
+        break;
+      case Cosine:
+        spaceImpl = std::make_unique<
+            hnswlib::InnerProductSpace<dist_t, data_t, scalefactor>>(
+            dimensions);
+        normalize = true;
+        break;
+      default:
+        throw new std::runtime_error(
+            "Space must be one of Euclidean, InnerProduct, or Cosine.");
+      }
+    }
+
+    if (storeFullPrecisionVectors) {
+      if constexpr (std::is_same_v<data_t, float>) {
+        throw std::invalid_argument(
+            "Float32 indices already store vectors at full precision.");
+      }
+
+      std::unique_ptr<hnswlib::Space<dist_t, float>> exactSpace;
+      if (space == Euclidean) {
+        exactSpace = std::make_unique<hnswlib::EuclideanSpace<dist_t, float>>(
+            getActualDimensions());
+      } else {
+        exactSpace =
+            std::make_unique<hnswlib::InnerProductSpace<dist_t, float>>(
+                getActualDimensions());
+      }
+      auto copySpace =
+          std::make_unique<hnswlib::FullPrecisionCopySpace<dist_t, data_t>>(
+              std::move(spaceImpl), std::move(exactSpace));
+      fullPrecisionSpace = copySpace.get();
+      fullPrecisionDistFunc = copySpace->get_full_precision_dist_func();
+      spaceImpl = std::move(copySpace);
+    }
+
+    if (productQuantized || storeFullPrecisionVectors) {
+      metadata = std::make_unique<voyager::Metadata::V2>(
+          dimensions, space, getStorageDataType(), 0.0, space == InnerProduct,
+          storeFullPrecisionVectors, quantizer);
     }
 
     ep_added = true;
@@ -180,11 +285,30 @@ public:
                    /* M */ 12, /* efConstruction */ 200,
                    /* randomSeed */ 1, /* maxElements */ 1,
                    /* enableOrderPreservingTransform */
-                   metadata->getUseOrderPreservingTransform()) {
+                   metadata->getUseOrderPreservingTransform(),
+                   /* numSubvectors */ getNumSubvectors(metadata.get()),
+                   /* storeFullPrecisionVectors */
+                   getStoresFullPrecisionVectors(metadata.get())) {
+    if constexpr (productQuantized) {
+      auto *v2 = dynamic_cast<voyager::Metadata::V2 *>(metadata.get());
+      if (!v2 || !v2->getQuantizer() ||
+          v2->getQuantizer()->getDimensions() != getActualDimensions()) {
+        throw std::domain_error(
+            "Index seems to be corrupted or unsupported. Its metadata does not "
+            "contain a product quantizer for its vectors.");
+      }
+      // The space holds a pointer to our quantizer, so replace its contents:
+      *quantizer = *v2->getQuantizer();
+    }
     algorithmImpl = std::make_unique<hnswlib::HierarchicalNSW<dist_t, data_t>>(
         spaceImpl.get(), inputStream, 0, searchOnly);
     max_norm = metadata->getMaxNorm();
     currentLabel = algorithmImpl->cur_element_count;
+
+    if (auto *v3 = dynamic_cast<voyager::Metadata::V3 *>(metadata.get())) {
+      snapshotId = v3->getSnapshotId();
+      changeLogNeedsReplay = true;
+    }
   }
 
   int getNumDimensions() const { return dimensions; }
@@ -250,6 +374,103 @@ public:
     algorithmImpl->saveIndex(outputStream);
   }
 
+  /**
+   * Persist this index incrementally at the given path: rather than
+   * re-saving the whole index after every change, append each change to a
+   * log file next to it (see ChangeLog.h). The log is folded into a new
+   * snapshot of the index once `checkpointInterval` items have been
+   * changed (if non-zero), or whenever checkpoint() is called.
+   *
+   * If this index was loaded from a snapshot written by a change log (see
+   * isLogAware()), the changes in its log are replayed first; this should be
+   * done before the index is changed in any other way. Otherwise, a snapshot
+   * of this index is written to the given path right away.
+   */
+  void openChangeLog(const std::string &pathToIndex,
+                     size_t checkpointInterval = 0) {
+    std::unique_lock<std::shared_mutex> lock(changeLogMutex);
+    this->checkpointInterval = checkpointInterval;
+    if (changeLog && changeLogIndexPath == pathToIndex) {
+      return;
+    }
+    changeLog.reset();
+
+    bool needsReplay = changeLogNeedsReplay;
+    changeLogNeedsReplay = false;
+    std::string logPath = ChangeLog::getPath(pathToIndex);
+    if (algorithmImpl->search_only_) {
+      // Search-only indices can't be changed, but can be loaded from a
+      // snapshot with an empty log:
+      if (!needsReplay) {
+        throw std::runtime_error(
+            "Indices loaded in search-only mode can't be changed, so can't "
+            "have change logs.");
+      }
+      auto failToApply = [&](const ChangeLog::Record &) {
+        throw std::domain_error("The change log at " + logPath +
+                                " contains changes, which can't be applied "
+                                "to an index loaded in search-only mode.");
+      };
+      if (ChangeLog::replay(logPath, snapshotId, dimensions, failToApply)
+              .truncated) {
+        throw std::domain_error("The change log at " + logPath +
+                                " is corrupted, and its index was loaded in "
+                                "search-only mode.");
+      }
+      return;
+    }
+
+    changeLogIndexPath = pathToIndex;
+    if (needsReplay) {
+      ChangeLog::ReplayResult result = ChangeLog::replay(
+          logPath, snapshotId, dimensions,
+          [&](const ChangeLog::Record &record) { applyRecord(record); });
+      if (result.matched && !result.truncated) {
+        changeLog = ChangeLog::openForAppend(logPath);
+        changesSinceCheckpoint = result.numChanges;
+        checkpointIfNeeded();
+        return;
+      }
+    }
+
+    // There's no log to append to, or it ends in a partially-written record
+    // that we'd otherwise append after:
+    writeCheckpoint();
+  }
+
+  /**
+   * Write a new snapshot of this index to the path its change log was opened
+   * with, and start a new, empty change log for it.
+   */
+  void checkpoint() {
+    std::unique_lock<std::shared_mutex> lock(changeLogMutex);
+    if (!changeLog) {
+      throw std::runtime_error(
+          "This index has no change log to checkpoint. Call openChangeLog() "
+          "first.");
+    }
+    writeCheckpoint();
+  }
+
+  /**
+   * Stop logging changes to this index. The changes logged so far remain in
+   * the log, and will be replayed when the index is next loaded.
+   */
+  void closeChangeLog() {
+    std::unique_lock<std::shared_mutex> lock(changeLogMutex);
+    changeLog.reset();
+    changeLogIndexPath.clear();
+  }
+
+  /**
+   * Whether changes to this index are being logged, or it was loaded from a
+   * snapshot whose change log has yet to be replayed by openChangeLog().
+   */
+  bool isLogAware() const {
+    std::shared_lock<std::shared_mutex> lock(changeLogMutex);
+    return changeLog || changeLogNeedsReplay;
+  }
+
   float getDistance(std::vector<float> _a, std::vector<float> _b) {
     if ((int)_a.size() != dimensions || (int)_b.size() != dimensions) {
       throw std::runtime_error("Index has " + std::to_string(dimensions) +
@@ -258,11 +479,8 @@ public:
                                std::to_string(_b.size()) + ".");
     }
 
-    int actualDimensions =
-        useOrderPreservingTransform ? dimensions + 1 : dimensions;
-
-    std::vector<data_t> a(actualDimensions);
-    std::vector<data_t> b(actualDimensions);
+    std::vector<data_t> a(getQueryVectorSize());
+    std::vector<data_t> b(getStoredVectorSize());
 
     if (useOrderPreservingTransform) {
       size_t dotFactorA = getDotFactorAndUpdateNorm(_a.data());
@@ -271,45 +489,44 @@ public:
       _b.push_back(dotFactorB);
     }
 
-    if (normalize) {
-      normalizeVector<dist_t, data_t, scalefactor>(_a.data(), a.data(),
-                                                   a.size());
-      normalizeVector<dist_t, data_t, scalefactor>(_b.data(), b.data(),
-                                                   b.size());
-    } else {
-      floatToDataType<data_t, scalefactor>(_a.data(), a.data(), a.size());
-      floatToDataType<data_t, scalefactor>(_b.data(), b.data(), b.size());
-    }
+    toQueryVector(_a.data(), a.data());
+    toStoredVector(_b.data(), b.data());
 
-    return spaceImpl->get_dist_func()(a.data(), b.data(), actualDimensions);
+    return spaceImpl->get_query_dist_func()(a.data(), b.data(),
+                                            spaceImpl->get_dist_func_param());
   }
 
   hnswlib::labeltype addItem(std::vector<float> vector,
-                             std::optional<hnswlib::labeltype> id) {
+                             std::optional<hnswlib::labeltype> id,
+                             bool replaceDeleted = false) {
     std::vector<size_t> ids;
 
     if (id) {
       ids.push_back(*id);
     }
 
-    return addItems(NDArray<float, 2>(vector, {1, (int)vector.size()}), ids)[0];
+    return addItems(NDArray<float, 2>(vector, {1, (int)vector.size()}), ids, -1,
+                    replaceDeleted)[0];
   }
 
   std::vector<hnswlib::labeltype>
   addItems(const std::vector<std::vector<float>> vectors,
-           std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1) {
-    return addItems(vectorsToNDArray(vectors), ids, numThreads);
+           std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+           bool replaceDeleted = false) {
+    return addItems(vectorsToNDArray(vectors), ids, numThreads,
+                    replaceDeleted);
   }
 
+  /**
+   * Add the given vectors to the index. If replaceDeleted is set, new items
+   * are stored in the slots of elements previously marked as deleted where
+   * possible, rather than growing the index.
+   */
   std::vector<hnswlib::labeltype>
   addItems(NDArray<float, 2> floatInput,
-           std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1) {
-    if (numThreads <= 0)
-      numThreads = numThreadsDefault;
-
-    size_t rows = std::get<0>(floatInput.shape);
+           std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+           bool replaceDeleted = false) {
     size_t features = std::get<1>(floatInput.shape);
-
     if (features != (size_t)dimensions) {
       throw std::domain_error(
           "The provided vector(s) have " + std::to_string(features) +
@@ -317,12 +534,44 @@ public:
           std::to_string(dimensions) + " dimensions.");
     }
 
+    return addItemsFrom(floatInput.data.data(), std::get<0>(floatInput.shape),
+                        ids, numThreads, replaceDeleted);
+  }
+
+  /**
+   * As addItems(), but for `numVectors` vectors of this index's number of
+   * dimensions stored back to back at `floatInput`, which are read in place
+   * rather than copied.
+   */
+  std::vector<hnswlib::labeltype>
+  addItemsFrom(const float *floatInput, size_t numVectors,
+               std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+               bool replaceDeleted = false) {
+    return logChange(
+        [&]() {
+          return addItemsUnlogged(floatInput, numVectors, ids, numThreads,
+                                  replaceDeleted);
+        },
+        [&](const std::vector<hnswlib::labeltype> &addedIds) {
+          changeLog->appendAddItems(floatInput, addedIds.data(),
+                                    addedIds.size(), dimensions, currentLabel,
+                                    replaceDeleted);
+          return addedIds.size();
+        });
+  }
+
+  std::vector<hnswlib::labeltype>
+  addItemsUnlogged(const float *floatInput, size_t rows,
+                   std::vector<hnswlib::labeltype> ids, int numThreads,
+                   bool replaceDeleted) {
+    if (numThreads <= 0)
+      numThreads = numThreadsDefault;
+
     std::vector<hnswlib::labeltype> idsToReturn(rows);
 
-    // avoid using threads when the number of searches is small:
-    if (rows <= ((size_t)numThreads * 4)) {
-      numThreads = 1;
-    }
+    // Threads come from a persistent pool, so even small batches are worth
+    // splitting up; there's just no point in using more threads than rows:
+    numThreads = std::max(1, (int)std::min((size_t)numThreads, rows));
 
     if (!ids.empty() && (unsigned long)ids.size() != rows) {
       throw std::runtime_error(
@@ -332,123 +581,255 @@ public:
           "of provided IDs must match the number of vectors.");
     }
 
-    // TODO: Should we always double the number of elements instead? Maybe use
-    // an adaptive algorithm to minimize both reallocations and memory usage?
-    while (getNumElements() + rows > getMaxElements()) {
+    // Rows that will be stored in the slots of deleted elements don't need
+    // any extra space:
+    size_t rowsNeedingSpace = rows;
+    if (replaceDeleted) {
+      rowsNeedingSpace -=
+          std::min(rows, algorithmImpl->getNumReplaceableElements());
+    }
+
+    if (!autoGrow && getNumElements() + rowsNeedingSpace > getMaxElements()) {
+      throw IndexFullError(
+          "Cannot insert " + std::to_string(rowsNeedingSpace) +
+          " elements; this index already contains " +
+          std::to_string(getNumElements()) +
+          " elements, and its maximum size is " +
+          std::to_string(getMaxElements()) +
+          ". Increase the maximum size of the index, or enable autoGrow.");
+    }
+
+    // Growing the index doesn't move any elements or block searches (see
+    // HierarchicalNSW::resizeIndex), so it's cheap to grow it to fit exactly.
+    while (getNumElements() + rowsNeedingSpace > getMaxElements()) {
       try {
-        resizeIndex(getNumElements() + rows);
+        resizeIndex(getNumElements() + rowsNeedingSpace);
       } catch (IndexCannotBeShrunkError &e) {
         // Retry with a larger size; some other thread may have resized
         // behind our back.
       }
     }
 
-    int actualDimensions =
-        useOrderPreservingTransform ? dimensions + 1 : dimensions;
+    trainQuantizerIfNeeded(floatInput, rows, numThreads);
+
+    int actualDimensions = getActualDimensions();
+    int storedVectorSize = getStoredVectorSize();
 
     int start = 0;
     if (!ep_added) {
       size_t id = ids.size() ? ids.at(0) : (currentLabel.fetch_add(1));
       // TODO(psobot): Should inputVector be on the stack instead?
       std::vector<float> inputVector(actualDimensions);
-      std::vector<data_t> convertedVector(actualDimensions);
+      std::vector<data_t> convertedVector(storedVectorSize);
 
-      std::memcpy(inputVector.data(), floatInput[0],
-                  dimensions * sizeof(float));
+      std::memcpy(inputVector.data(), floatInput, dimensions * sizeof(float));
 
       if (useOrderPreservingTransform) {
-        inputVector[dimensions] = getDotFactorAndUpdateNorm(floatInput[0]);
+        inputVector[dimensions] = getDotFactorAndUpdateNorm(floatInput);
       }
 
-      if (normalize) {
-        normalizeVector<dist_t, data_t, scalefactor>(
-            inputVector.data(), convertedVector.data(), convertedVector.size());
-      } else {
-        floatToDataType<data_t, scalefactor>(
-            inputVector.data(), convertedVector.data(), convertedVector.size());
-      }
+      toStoredVector(inputVector.data(), convertedVector.data());
 
-      algorithmImpl->addPoint(convertedVector.data(), (size_t)id);
+      algorithmImpl->addPoint(convertedVector.data(), (size_t)id,
+                              replaceDeleted);
       start = 1;
       ep_added = true;
       idsToReturn[0] = id;
     }
 
-    if (!normalize) {
-      std::vector<float> inputArray(numThreads * actualDimensions);
-      std::vector<data_t> convertedArray(numThreads * actualDimensions);
-      ParallelFor(start, rows, numThreads, [&](size_t row, size_t threadId) {
-        size_t startIndex = threadId * actualDimensions;
-        std::memcpy(&inputArray[startIndex], floatInput[row],
-                    dimensions * sizeof(float));
-
-        if (useOrderPreservingTransform) {
-          inputArray[startIndex + dimensions] =
-              getDotFactorAndUpdateNorm(floatInput[row]);
-        }
+    std::vector<float> inputArray(numThreads * actualDimensions);
+    std::vector<data_t> convertedArray(numThreads * storedVectorSize);
+    ParallelFor(start, rows, numThreads, [&](size_t row, size_t threadId) {
+      float *input = &inputArray[threadId * actualDimensions];
+      data_t *converted = &convertedArray[threadId * storedVectorSize];
+      const float *vector = floatInput + row * dimensions;
+      std::memcpy(input, vector, dimensions * sizeof(float));
+
+      if (useOrderPreservingTransform) {
+        input[dimensions] = getDotFactorAndUpdateNorm(vector);
+      }
 
-        floatToDataType<data_t, scalefactor>(&inputArray[startIndex],
-                                             &convertedArray[startIndex],
-                                             actualDimensions);
-        size_t id = ids.size() ? ids.at(row) : (currentLabel.fetch_add(1));
+      toStoredVector(input, converted);
+      size_t id = ids.size() ? ids.at(row) : (currentLabel.fetch_add(1));
+      while (true) {
         try {
-          algorithmImpl->addPoint(convertedArray.data() + startIndex, id);
+          algorithmImpl->addPoint(converted, id, replaceDeleted);
+          break;
         } catch (IndexFullError &e) {
-          // Resize the index and try again:
-          while (getNumElements() + rows > getMaxElements()) {
-            try {
-              // NOTE: This will resize the index to be at least as large as
-              // the number of elements we're trying to add, but may
-              // allocate more space than necessary.
-              resizeIndex(getNumElements() + rows);
-            } catch (IndexCannotBeShrunkError &e) {
-              // Retry with a larger size; some other thread may have resized
-              // behind our back.
-            }
+          if (!autoGrow)
+            throw;
+        }
+        // Resize the index and try again (as many times as it takes, since a
+        // concurrent compact() may shrink it again in between):
+        while (getNumElements() + rows > getMaxElements()) {
+          try {
+            // NOTE: This will resize the index to be at least as large as
+            // the number of elements we're trying to add, but may
+            // allocate more space than necessary.
+            resizeIndex(getNumElements() + rows);
+          } catch (IndexCannotBeShrunkError &e) {
+            // Retry with a larger size; some other thread may have resized
+            // behind our back.
           }
         }
-        idsToReturn[row] = id;
-      });
-    } else {
-      std::vector<float> inputArray(numThreads * actualDimensions);
-      std::vector<data_t> normalizedArray(numThreads * actualDimensions);
-      ParallelFor(start, rows, numThreads, [&](size_t row, size_t threadId) {
-        size_t startIndex = threadId * actualDimensions;
+      }
+      idsToReturn[row] = id;
+    });
 
-        std::memcpy(&inputArray[startIndex], floatInput[row],
-                    dimensions * sizeof(float));
+    return idsToReturn;
+  }
 
-        if (useOrderPreservingTransform) {
-          inputArray[startIndex + dimensions] =
-              getDotFactorAndUpdateNorm(floatInput[row]);
+  /**
+   * Add the given vectors to this empty index in bulk (see
+   * HierarchicalNSW::addPointsInBulk). The index is resized to fit exactly
+   * this many vectors, if it can't already hold them all.
+   */
+  std::vector<hnswlib::labeltype>
+  buildFromArray(NDArray<float, 2> floatInput,
+                 std::vector<hnswlib::labeltype> ids = {}, int numThreads = -1,
+                 std::function<void(size_t, size_t)> progress = nullptr) {
+    if (numThreads <= 0)
+      numThreads = numThreadsDefault;
+
+    size_t rows = std::get<0>(floatInput.shape);
+    size_t features = std::get<1>(floatInput.shape);
+
+    if (features != (size_t)dimensions) {
+      throw std::domain_error(
+          "The provided vector(s) have " + std::to_string(features) +
+          " dimensions, but this index expects vectors with " +
+          std::to_string(dimensions) + " dimensions.");
+    }
+
+    if (!ids.empty() && (unsigned long)ids.size() != rows) {
+      throw std::runtime_error(
+          std::to_string(rows) + " vectors were provided, but " +
+          std::to_string(ids.size()) +
+          " IDs were provided. If providing IDs along with vectors, the number "
+          "of provided IDs must match the number of vectors.");
+    }
+
+    // Logging every vector would take as long as writing a snapshot, so
+    // building an index with a change log writes a new one instead:
+    std::unique_lock<std::shared_mutex> lock(changeLogMutex);
+    if (getNumElements() > 0) {
+      throw std::runtime_error(
+          "buildFromArray can only be called on an empty index, but this "
+          "index already contains " +
+          std::to_string(getNumElements()) +
+          " elements. Use addItems to add more vectors to it.");
+    }
+
+    if (rows > getMaxElements() && autoGrow) {
+      resizeIndex(rows);
+    }
+
+    // If the build fails, the index is left as empty as it was found (see
+    // HierarchicalNSW::addPointsInBulk), so undo the changes made here too:
+    hnswlib::labeltype initialLabel = currentLabel;
+    float initialMaxNorm = max_norm;
+    std::unique_ptr<ProductQuantizer> initialQuantizer;
+    if constexpr (productQuantized) {
+      initialQuantizer = std::make_unique<ProductQuantizer>(*quantizer);
+    }
+
+    try {
+      if (useOrderPreservingTransform) {
+        // Every vector's extra dimension depends on the largest norm, so find
+        // that first; addItems can only use the largest norm seen so far.
+        std::vector<dist_t> maxNorms(numThreads, 0);
+        ParallelFor(0, rows, numThreads, [&](size_t row, size_t threadId) {
+          maxNorms[threadId] =
+              std::max(maxNorms[threadId], getNorm<dist_t, dist_t, scalefactor>(
+                                               floatInput[row], dimensions));
+        });
+        dist_t norm = *std::max_element(maxNorms.begin(), maxNorms.end());
+        dist_t prevMaxNorm = max_norm;
+        while (prevMaxNorm < norm &&
+               !max_norm.compare_exchange_weak(prevMaxNorm, norm)) {
         }
+      }
 
-        normalizeVector<dist_t, data_t, scalefactor>(
-            &inputArray[startIndex], &normalizedArray[startIndex],
-            actualDimensions);
-        size_t id = ids.size() ? ids.at(row) : (currentLabel.fetch_add(1));
+      trainQuantizerIfNeeded(floatInput.data.data(), rows, numThreads);
 
-        try {
-          algorithmImpl->addPoint(normalizedArray.data() + startIndex, id);
-        } catch (IndexFullError &e) {
-          // Resize the index and try again:
-          while (getNumElements() + rows > getMaxElements()) {
-            try {
-              // NOTE: This will resize the index to be at least as large as
-              // the number of elements we're trying to add, but may
-              // allocate more space than necessary.
-              resizeIndex(getNumElements() + rows);
-            } catch (IndexCannotBeShrunkError &e) {
-              // Retry with a larger size; some other thread may have resized
-              // behind our back.
+      if (ids.empty()) {
+        size_t firstId = currentLabel.fetch_add(rows);
+        ids.resize(rows);
+        std::iota(ids.begin(), ids.end(), firstId);
+      }
+
+      int actualDimensions = getActualDimensions();
+      std::vector<float> inputArray(numThreads * actualDimensions);
+      algorithmImpl->addPointsInBulk(
+          ids.data(), rows,
+          [&](size_t row, size_t threadId, data_t *output) {
+            float *input = &inputArray[threadId * actualDimensions];
+            std::memcpy(input, floatInput[row], dimensions * sizeof(float));
+            if (useOrderPreservingTransform) {
+              input[dimensions] = getDotFactor(
+                  getNorm<dist_t, dist_t, scalefactor>(floatInput[row],
+                                                       dimensions));
             }
-          }
+            toStoredVector(input, output);
+          },
+          numThreads, progress);
+    } catch (...) {
+      currentLabel = initialLabel;
+      max_norm = initialMaxNorm;
+      if constexpr (productQuantized) {
+        std::lock_guard<std::mutex> lock(quantizerTrainingMutex);
+        *quantizer = *initialQuantizer;
+      }
+      throw;
+    }
+    ep_added = rows > 0;
+
+    if (changeLog) {
+      writeCheckpoint();
+    }
+    return ids;
+  }
+
+  /**
+   * Train this index's product quantizer on the given vectors (at least
+   * ProductQuantizer::NUM_CENTROIDS of them), which should resemble the
+   * vectors to be added. Otherwise, it's trained on the first batch of
+   * vectors added, which then has to be at least that large.
+   */
+  void train(NDArray<float, 2> floatInput, int numThreads = -1) {
+    if (numThreads <= 0)
+      numThreads = numThreadsDefault;
+
+    size_t features = std::get<1>(floatInput.shape);
+    if (features != (size_t)dimensions) {
+      throw std::domain_error(
+          "The provided vector(s) have " + std::to_string(features) +
+          " dimensions, but this index expects vectors with " +
+          std::to_string(dimensions) + " dimensions.");
+    }
+
+    if constexpr (productQuantized) {
+      // The trained quantizer is saved with the index, so as with
+      // buildFromArray, a change log gets a new snapshot that includes it:
+      std::unique_lock<std::shared_mutex> lock(changeLogMutex);
+      {
+        std::lock_guard<std::mutex> trainingLock(quantizerTrainingMutex);
+        if (quantizer->isTrained()) {
+          throw std::runtime_error(
+              "This index's product quantizer has already been trained.");
         }
-        idsToReturn[row] = id;
-      });
-    };
+        trainQuantizer(floatInput.data.data(), std::get<0>(floatInput.shape),
+                       numThreads);
+      }
 
-    return idsToReturn;
+      if (changeLog) {
+        writeCheckpoint();
+      }
+    } else {
+      throw std::runtime_error("Only indices with PQ storage can be trained, "
+                               "but this index uses " +
+                               getStorageDataTypeName() + " storage.");
+    }
   }
 
   dist_t getDotFactorAndUpdateNorm(const dist_t *data) {
@@ -478,9 +859,23 @@ public:
   }
 
   std::vector<float> getVector(hnswlib::labeltype id) {
+    if (fullPrecisionSpace) {
+      std::vector<data_t> rawData =
+          algorithmImpl->getDataByLabel(id, getStoredVectorSize());
+      const float *vector = getFullPrecisionVector(rawData.data());
+      return std::vector<float>(vector, vector + dimensions);
+    }
+
     std::vector<data_t> rawData = getRawVector(id);
-    NDArray<data_t, 2> output(rawData.data(), {1, (int)dimensions});
-    return dataTypeToFloat<data_t, scalefactor>(output).data;
+    if constexpr (productQuantized) {
+      std::vector<float> output(getActualDimensions());
+      quantizer->decode(rawData.data(), output.data());
+      output.resize(dimensions);
+      return output;
+    } else {
+      NDArray<data_t, 2> output(rawData.data(), {1, (int)dimensions});
+      return dataTypeToFloat<data_t, scalefactor>(output).data;
+    }
   }
 
   NDArray<float, 2> getVectors(std::vector<hnswlib::labeltype> ids) {
@@ -508,24 +903,31 @@ public:
 
   long long getIDsCount() const { return algorithmImpl->label_lookup_.size(); }
 
-  const std::unordered_map<hnswlib::labeltype, hnswlib::tableint> &
-  getIDsMap() const {
+  const hnswlib::LabelLookup &getIDsMap() const {
     return algorithmImpl->label_lookup_;
   }
 
   std::tuple<NDArray<hnswlib::labeltype, 2>, NDArray<dist_t, 2>>
   query(std::vector<std::vector<float>> floatQueryVectors, int k = 1,
-        int numThreads = -1, long queryEf = -1) {
-    return query(vectorsToNDArray(floatQueryVectors), k, numThreads, queryEf);
+        int numThreads = -1, long queryEf = -1,
+        const hnswlib::BaseFilterFunctor *filter = nullptr,
+        std::vector<hnswlib::SearchStats> *stats = nullptr, int rerank = 0) {
+    return query(vectorsToNDArray(floatQueryVectors), k, numThreads, queryEf,
+                 filter, stats, rerank);
   }
 
+  /**
+   * Find the `k` nearest neighbors of each of the given query vectors. If
+   * `stats` is provided, it's filled with the work done for each query.
+   *
+   * If `rerank` is positive, the index must store full-precision vectors:
+   * each query finds `rerank` candidates using the index's compact storage,
+   * and returns the `k` of them nearest by exact (float) distance.
+   */
   std::tuple<NDArray<hnswlib::labeltype, 2>, NDArray<dist_t, 2>>
   query(NDArray<float, 2> floatQueryVectors, int k = 1, int numThreads = -1,
-        long queryEf = -1) {
-    if (queryEf > 0 && queryEf < k) {
-      throw std::runtime_error("queryEf must be equal to or greater than the "
-                               "requested number of neighbors");
-    }
+        long queryEf = -1, const hnswlib::BaseFilterFunctor *filter = nullptr,
+        std::vector<hnswlib::SearchStats> *stats = nullptr, int rerank = 0) {
     int numRows = std::get<0>(floatQueryVectors.shape);
     int numFeatures = std::get<1>(floatQueryVectors.shape);
 
@@ -534,192 +936,253 @@ public:
           "Query vectors expected to share dimensionality with index.");
     }
 
+    checkQueryArguments(k, queryEf, rerank);
     NDArray<hnswlib::labeltype, 2> labels({numRows, k});
     NDArray<dist_t, 2> distances({numRows, k});
+    queryInto(floatQueryVectors.data.data(), numRows, k, labels.data.data(),
+              distances.data.data(), numThreads, queryEf, filter, stats,
+              rerank);
+    return {labels, distances};
+  }
 
-    hnswlib::labeltype *labelPointer = labels.data.data();
-    dist_t *distancePointer = distances.data.data();
-
-    if (numThreads <= 0) {
-      numThreads = numThreadsDefault;
-    }
-
-    // avoid using threads when the number of searches is small:
-
-    if (numRows <= numThreads * 4) {
-      numThreads = 1;
+  std::tuple<std::vector<hnswlib::labeltype>, std::vector<float>>
+  query(std::vector<float> floatQueryVector, int k = 1, long queryEf = -1,
+        const hnswlib::BaseFilterFunctor *filter = nullptr,
+        hnswlib::SearchStats *stats = nullptr, int rerank = 0) {
+    if ((int)floatQueryVector.size() != dimensions) {
+      throw std::runtime_error(
+          "Query vector expected to share dimensionality with index.");
     }
 
-    int actualDimensions =
-        useOrderPreservingTransform ? dimensions + 1 : dimensions;
-
-    if (normalize == false) {
-      std::vector<float> inputArray(numThreads * actualDimensions);
-      std::vector<data_t> convertedArray(numThreads * actualDimensions);
-      ParallelFor(0, numRows, numThreads, [&](size_t row, size_t threadId) {
-        size_t start_idx = threadId * actualDimensions;
-
-        // Only copy at most `dimensions` from the input; if we're using
-        // the order-preserving transform, the remaining dimension will be 0
-        // anyways.
-        std::memcpy(&inputArray[start_idx], floatQueryVectors[row],
-                    dimensions * sizeof(float));
-
-        floatToDataType<data_t, scalefactor>(&inputArray[start_idx],
-                                             &convertedArray[start_idx],
-                                             actualDimensions);
-
-        std::priority_queue<std::pair<dist_t, hnswlib::labeltype>> result =
-            algorithmImpl->searchKnn((convertedArray.data() + start_idx), k,
-                                     nullptr, queryEf);
-
-        if (result.size() != (unsigned long)k) {
-          throw RecallError(
-              "Fewer than expected results were retrieved; only found " +
-              std::to_string(result.size()) + " of " + std::to_string(k) +
-              " requested neighbors. Reconstruct the index with a higher M "
-              "value to increase recall.");
-        }
-
-        for (int i = k - 1; i >= 0; i--) {
-          auto &result_tuple = result.top();
+    checkQueryArguments(k, queryEf, rerank);
+    std::vector<hnswlib::labeltype> labels(k);
+    std::vector<dist_t> distances(k);
+    auto context = queryContexts.acquire();
+    checkNumFound(searchInto(floatQueryVector.data(), *context, k,
+                             labels.data(), distances.data(), queryEf, filter,
+                             stats, rerank),
+                  k);
+    return {labels, distances};
+  }
 
-          dist_t distance = result_tuple.first;
-          hnswlib::labeltype label = result_tuple.second;
+  /**
+   * As query(), but writes the results to `labels` and `distances`, and
+   * returns fewer than `k` of them (rather than throwing a RecallError) if
+   * that's all that could be found. Returns the number of results.
+   */
+  size_t queryAtMost(const float *floatQueryVector, int k,
+                     hnswlib::labeltype *labels, float *distances,
+                     long queryEf = -1,
+                     const hnswlib::BaseFilterFunctor *filter = nullptr,
+                     hnswlib::SearchStats *stats = nullptr, int rerank = 0) {
+    checkQueryArguments(k, queryEf, rerank);
+    auto context = queryContexts.acquire();
+    return searchInto(floatQueryVector, *context, k, labels, distances,
+                      queryEf, filter, stats, rerank);
+  }
 
-          distancePointer[row * k + i] = distance;
-          labelPointer[row * k + i] = label;
-          result.pop();
-        }
-      });
-    } else {
-      std::vector<float> inputArray(numThreads * actualDimensions);
-      std::vector<data_t> norm_array(numThreads * numFeatures);
-      ParallelFor(0, numRows, numThreads, [&](size_t row, size_t threadId) {
-        size_t start_idx = threadId * actualDimensions;
-
-        // Only copy at most `dimensions` from the input; if we're using
-        // the order-preserving transform, the remaining dimension will be 0
-        // anyways.
-        std::memcpy(&inputArray[start_idx], floatQueryVectors[row],
-                    dimensions * sizeof(float));
-
-        normalizeVector<dist_t, data_t, scalefactor>(
-            &inputArray[start_idx], &norm_array[start_idx], actualDimensions);
-
-        std::priority_queue<std::pair<dist_t, hnswlib::labeltype>> result =
-            algorithmImpl->searchKnn(norm_array.data() + start_idx, k, nullptr,
-                                     queryEf);
-
-        if (result.size() != (unsigned long)k) {
-          throw RecallError(
-              "Fewer than expected results were retrieved; only found " +
-              std::to_string(result.size()) + " of " + std::to_string(k) +
-              " requested neighbors. Reconstruct the index with a higher M "
-              "value to increase recall.");
-        }
+  /**
+   * Find the `k` nearest neighbors of each of the `numQueries` query vectors
+   * stored back to back in `floatQueryVectors`, writing them (nearest first,
+   * `k` per query) to `labels` and `distances`. Queries reuse pooled working
+   * memory, so apart from `stats`, this doesn't allocate once warmed up.
+   *
+   * If `stats` is provided, it's filled with the work done for each query.
+   * If `rerank` is positive, the index must store full-precision vectors:
+   * each query finds `rerank` candidates using the index's compact storage,
+   * and returns the `k` of them nearest by exact (float) distance.
+   */
+  void queryInto(const float *floatQueryVectors, size_t numQueries, int k,
+                 hnswlib::labeltype *labels, float *distances,
+                 int numThreads = -1, long queryEf = -1,
+                 const hnswlib::BaseFilterFunctor *filter = nullptr,
+                 std::vector<hnswlib::SearchStats> *stats = nullptr,
+                 int rerank = 0) {
+    checkQueryArguments(k, queryEf, rerank);
+
+    if (stats) {
+      stats->assign(numQueries, hnswlib::SearchStats());
+    }
 
-        for (int i = k - 1; i >= 0; i--) {
-          auto &result_tuple = result.top();
+    if (numThreads <= 0) {
+      numThreads = numThreadsDefault;
+    }
 
-          dist_t distance = result_tuple.first;
-          hnswlib::labeltype label = result_tuple.second;
+    // Threads come from a persistent pool, so even small batches are worth
+    // splitting up; there's just no point in using more threads than rows:
+    numThreads = std::max<size_t>(1, std::min<size_t>(numThreads, numQueries));
 
-          distancePointer[row * k + i] = distance;
-          labelPointer[row * k + i] = label;
-          result.pop();
-        }
-      });
+    std::vector<typename ObjectPool<QueryContext>::Handle> contexts;
+    contexts.reserve(numThreads);
+    for (int i = 0; i < numThreads; i++) {
+      contexts.push_back(queryContexts.acquire());
     }
 
-    return {labels, distances};
+    ParallelFor(0, numQueries, numThreads, [&](size_t row, size_t threadId) {
+      checkNumFound(searchInto(floatQueryVectors + row * dimensions,
+                               *contexts[threadId], k, labels + row * k,
+                               distances + row * k, queryEf, filter,
+                               stats ? &(*stats)[row] : nullptr, rerank),
+                    k);
+    });
   }
 
+  /**
+   * Find every item within `radius` of the given query vector (by the same
+   * distance that query() returns), nearest first. If `maxResults` is
+   * nonzero, only the nearest `maxResults` of them are returned.
+   */
   std::tuple<std::vector<hnswlib::labeltype>, std::vector<float>>
-  query(std::vector<float> floatQueryVector, int k = 1, long queryEf = -1) {
-    if (queryEf > 0 && queryEf < k) {
-      throw std::runtime_error("queryEf must be equal to or greater than the "
-                               "requested number of neighbors");
-    }
-
-    int numFeatures = floatQueryVector.size();
-
-    if (numFeatures != dimensions) {
+  rangeSearch(std::vector<float> floatQueryVector, float radius,
+              size_t maxResults = 0, long queryEf = -1,
+              const hnswlib::BaseFilterFunctor *filter = nullptr) {
+    if ((int)floatQueryVector.size() != dimensions) {
       throw std::runtime_error(
           "Query vector expected to share dimensionality with index.");
     }
 
-    int actualDimensions = dimensions;
-    if (useOrderPreservingTransform) {
-      actualDimensions = dimensions + 1;
-      floatQueryVector.push_back(0.0);
+    std::vector<float> input;
+    std::vector<data_t> converted;
+    std::priority_queue<std::pair<dist_t, hnswlib::labeltype>> result =
+        algorithmImpl->rangeSearch(
+            prepareQuery(floatQueryVector.data(), input, converted), radius,
+            maxResults, nullptr, queryEf, filter);
+
+    std::vector<hnswlib::labeltype> labels(result.size());
+    std::vector<float> distances(result.size());
+    for (size_t i = result.size(); i > 0; i--) {
+      distances[i - 1] = result.top().first;
+      labels[i - 1] = result.top().second;
+      result.pop();
     }
 
-    std::vector<hnswlib::labeltype> labels(k);
-    std::vector<dist_t> distances(k);
-
-    hnswlib::labeltype *labelPointer = labels.data();
-    dist_t *distancePointer = distances.data();
-
-    if (normalize == false) {
-      const std::vector<data_t> queryVector =
-          floatToDataType<data_t, scalefactor>(floatQueryVector);
-
-      std::priority_queue<std::pair<dist_t, hnswlib::labeltype>> result =
-          algorithmImpl->searchKnn(queryVector.data(), k, nullptr, queryEf);
-
-      if (result.size() != (unsigned long)k) {
-        throw RecallError(
-            "Fewer than expected results were retrieved; only found " +
-            std::to_string(result.size()) + " of " + std::to_string(k) +
-            " requested neighbors. Reconstruct the index with a higher M value "
-            "to increase recall.");
-      }
+    return {labels, distances};
+  }
 
-      for (int i = k - 1; i >= 0; i--) {
-        auto &result_tuple = result.top();
-        distancePointer[i] = result_tuple.first;
-        labelPointer[i] = result_tuple.second;
-        result.pop();
-      }
-    } else {
-      std::vector<data_t> norm_array(numFeatures);
-      normalizeVector<dist_t, data_t, scalefactor>(
-          floatQueryVector.data(), norm_array.data(), actualDimensions);
-
-      std::priority_queue<std::pair<dist_t, hnswlib::labeltype>> result =
-          algorithmImpl->searchKnn(norm_array.data(), k, nullptr, queryEf);
-
-      if (result.size() != (unsigned long)k) {
-        throw RecallError(
-            "Fewer than expected results were retrieved; only found " +
-            std::to_string(result.size()) + " of " + std::to_string(k) +
-            " requested neighbors. Reconstruct the index with a higher M value "
-            "to increase recall.");
-      }
+  /**
+   * Run rangeSearch() for each of the given query vectors, in parallel.
+   */
+  RangeSearchResults
+  rangeSearch(NDArray<float, 2> floatQueryVectors, float radius,
+              size_t maxResults = 0, int numThreads = -1, long queryEf = -1,
+              const hnswlib::BaseFilterFunctor *filter = nullptr) {
+    int numRows = std::get<0>(floatQueryVectors.shape);
+    int numFeatures = std::get<1>(floatQueryVectors.shape);
 
-      for (int i = k - 1; i >= 0; i--) {
-        auto &result_tuple = result.top();
+    if (numFeatures != dimensions) {
+      throw std::runtime_error(
+          "Query vectors expected to share dimensionality with index.");
+    }
 
-        distancePointer[i] = result_tuple.first;
-        labelPointer[i] = result_tuple.second;
+    if (numThreads <= 0) {
+      numThreads = numThreadsDefault;
+    }
+    numThreads = std::max(1, std::min(numThreads, numRows));
+
+    // Each query finds a different number of results, so they're collected
+    // per query and then concatenated.
+    std::vector<std::priority_queue<std::pair<dist_t, hnswlib::labeltype>>>
+        rowResults(numRows);
+
+    std::vector<std::vector<float>> inputs(numThreads);
+    std::vector<std::vector<data_t>> converted(numThreads);
+    ParallelFor(0, numRows, numThreads, [&](size_t row, size_t threadId) {
+      const data_t *queryVector = prepareQuery(
+          floatQueryVectors[row], inputs[threadId], converted[threadId]);
+      rowResults[row] = algorithmImpl->rangeSearch(queryVector, radius,
+                                                   maxResults, nullptr,
+                                                   queryEf, filter);
+    });
+
+    RangeSearchResults results;
+    results.offsets.resize(numRows + 1);
+    for (int row = 0; row < numRows; row++) {
+      results.offsets[row + 1] = results.offsets[row] + rowResults[row].size();
+    }
+    results.labels.resize(results.offsets[numRows]);
+    results.distances.resize(results.offsets[numRows]);
+
+    for (int row = 0; row < numRows; row++) {
+      auto &result = rowResults[row];
+      for (size_t i = results.offsets[row + 1]; i > results.offsets[row]; i--) {
+        results.distances[i - 1] = result.top().first;
+        results.labels[i - 1] = result.top().second;
         result.pop();
       }
     }
 
-    return {labels, distances};
+    return results;
   }
 
+  hnswlib::SearchStats getSearchStats() const {
+    return algorithmImpl->getSearchStats();
+  }
+
+  void resetSearchStats() { algorithmImpl->resetSearchStats(); }
+
   void markDeleted(hnswlib::labeltype label) {
-    algorithmImpl->markDelete(label);
+    logChange(
+        [&]() {
+          algorithmImpl->markDelete(label);
+          return label;
+        },
+        [&](hnswlib::labeltype label) {
+          changeLog->appendLabel(ChangeLog::MarkDeleted, label);
+          return (size_t)1;
+        });
   }
 
   void unmarkDeleted(hnswlib::labeltype label) {
-    algorithmImpl->unmarkDelete(label);
+    logChange(
+        [&]() {
+          algorithmImpl->unmarkDelete(label);
+          return label;
+        },
+        [&](hnswlib::labeltype label) {
+          changeLog->appendLabel(ChangeLog::UnmarkDeleted, label);
+          return (size_t)1;
+        });
   }
 
   void resizeIndex(size_t new_size) { algorithmImpl->resizeIndex(new_size); }
 
+  /**
+   * Set whether adding more vectors than the index can hold grows it to fit
+   * them (the default), or throws an IndexFullError instead, for callers
+   * that want to bound the index's memory usage.
+   */
+  void setAutoGrow(bool newAutoGrow) { autoGrow = newAutoGrow; }
+  bool getAutoGrow() const { return autoGrow; }
+
+  /**
+   * Physically remove all elements marked as deleted, repairing the graph
+   * around them and shrinking the index. Returns the number removed.
+   */
+  size_t compact(int numThreads = -1) {
+    if (numThreads <= 0)
+      numThreads = numThreadsDefault;
+
+    // Later changes can't be replayed onto the old snapshot, so compacting
+    // an index with a change log writes a new one:
+    std::unique_lock<std::shared_mutex> lock(changeLogMutex);
+    size_t numRemoved = algorithmImpl->compact(numThreads);
+    if (changeLog && numRemoved) {
+      writeCheckpoint();
+    }
+    return numRemoved;
+  }
+
+  /**
+   * Renumber the index's elements so that neighbors in the graph are stored
+   * near each other in memory, which speeds up searches of large indices.
+   * Labels and query results are unaffected.
+   */
+  void reorder(int numThreads = -1) {
+    if (numThreads <= 0)
+      numThreads = numThreadsDefault;
+    algorithmImpl->reorder(numThreads);
+  }
+
   size_t getMaxElements() const { return algorithmImpl->max_elements_; }
 
   size_t getNumElements() const { return algorithmImpl->cur_element_count; }
@@ -736,11 +1199,365 @@ public:
   size_t getEfConstruction() const { return algorithmImpl->ef_construction_; }
 
   size_t getM() const { return algorithmImpl->M_; }
+
+private:
+  // The number of dimensions actually indexed, including the extra dimension
+  // added by the order-preserving transform.
+  int getActualDimensions() const {
+    return useOrderPreservingTransform ? dimensions + 1 : dimensions;
+  }
+
+  // The number of data_t values in a stored vector.
+  int getStoredVectorSize() const {
+    return spaceImpl->get_data_size() / sizeof(data_t);
+  }
+
+  // The number of data_t values in a query, as passed to searchKnn.
+  int getQueryVectorSize() const {
+    return spaceImpl->get_query_size() / sizeof(data_t);
+  }
+
+  // The full-precision copy stored at the end of a stored vector.
+  const float *getFullPrecisionVector(const data_t *storedVector) const {
+    return (const float *)((const char *)storedVector +
+                           fullPrecisionSpace->get_full_precision_offset());
+  }
+
+  /**
+   * Write the full-precision form of `input` (of getActualDimensions()
+   * floats) to `output`; queries are re-ranked in this form too.
+   */
+  void toFullPrecisionVector(const float *input, float *output) const {
+    if (normalize) {
+      normalizeVector<dist_t, float>(input, output, getActualDimensions());
+    } else {
+      std::memcpy(output, input, getActualDimensions() * sizeof(float));
+    }
+  }
+
+  /**
+   * Convert `input` (of getActualDimensions() floats, which may be modified)
+   * into the getStoredVectorSize() values to store in the index.
+   */
+  void toStoredVector(float *input, data_t *output) const {
+    if (fullPrecisionSpace) {
+      toFullPrecisionVector(input,
+                            (float *)getFullPrecisionVector(output));
+    }
+
+    if constexpr (productQuantized) {
+      if (normalize) {
+        normalizeVector<dist_t, float, scalefactor>(input, input,
+                                                    getActualDimensions());
+      }
+      quantizer->encode(input, output);
+    } else {
+      // Without PQ, queries and stored vectors use the same representation:
+      toQueryVector(input, output);
+    }
+  }
+
+  /**
+   * Convert `input` (of getActualDimensions() floats, which may be modified)
+   * into the getQueryVectorSize() values to pass to searchKnn. With PQ
+   * storage, that's the query's distance table.
+   */
+  void toQueryVector(float *input, data_t *output) const {
+    if constexpr (productQuantized) {
+      if (normalize) {
+        normalizeVector<dist_t, float, scalefactor>(input, input,
+                                                    getActualDimensions());
+      }
+      quantizer->computeDistanceTable(input, (float *)output,
+                                      space != Euclidean);
+    } else if (normalize) {
+      normalizeVector<dist_t, data_t, scalefactor>(input, output,
+                                                   getActualDimensions());
+    } else {
+      floatToDataType<data_t, scalefactor>(input, output,
+                                           getActualDimensions());
+    }
+  }
+
+  /**
+   * The query vector to pass to searchKnn for `query` (`dimensions` floats),
+   * written to `converted` unless `query` can be searched for as it is.
+   * Without PQ, the query is normalized and converted straight from the
+   * caller's memory rather than copied into `input` first, and Float32
+   * queries that needn't be normalized aren't copied at all.
+   */
+  const data_t *prepareQuery(const float *query, std::vector<float> &input,
+                             std::vector<data_t> &converted) const {
+    converted.resize(getQueryVectorSize());
+    if constexpr (productQuantized) {
+      input.resize(getActualDimensions());
+      std::memcpy(input.data(), query, dimensions * sizeof(float));
+      if (useOrderPreservingTransform) {
+        input[dimensions] = 0;
+      }
+      toQueryVector(input.data(), converted.data());
+      return converted.data();
+    } else {
+      if (normalize) {
+        normalizeVector<dist_t, data_t, scalefactor>(query, converted.data(),
+                                                     dimensions);
+      } else if constexpr (std::is_same_v<data_t, float> &&
+                           scalefactor::num == scalefactor::den) {
+        if (!useOrderPreservingTransform) {
+          return query;
+        }
+        std::memcpy(converted.data(), query, dimensions * sizeof(float));
+      } else {
+        floatToDataType<data_t, scalefactor>(query, converted.data(),
+                                             dimensions);
+      }
+
+      // If we're using the order-preserving transform, the query's extra
+      // dimension is 0.
+      if (useOrderPreservingTransform) {
+        const float zero = 0;
+        floatToDataType<data_t, scalefactor>(&zero,
+                                             converted.data() + dimensions, 1);
+      }
+      return converted.data();
+    }
+  }
+
+  void checkQueryArguments(int k, long queryEf, int rerank) const {
+    if (queryEf > 0 && queryEf < k) {
+      throw std::runtime_error("queryEf must be equal to or greater than the "
+                               "requested number of neighbors");
+    }
+    if (rerank <= 0) {
+      return;
+    }
+    if (!fullPrecisionSpace) {
+      throw std::runtime_error(
+          "Re-ranking requires an index that stores full-precision vectors.");
+    }
+    if (rerank < k) {
+      throw std::runtime_error("rerank must be equal to or greater than the "
+                               "requested number of neighbors");
+    }
+  }
+
+  /**
+   * Search for the `k` nearest neighbors of `query` (`dimensions` floats),
+   * writing them to `labels` and `distances` and using `context` as working
+   * memory. Returns the number found, which may be fewer than `k`.
+   */
+  size_t searchInto(const float *query, QueryContext &context, int k,
+                    hnswlib::labeltype *labels, dist_t *distances,
+                    long queryEf, const hnswlib::BaseFilterFunctor *filter,
+                    hnswlib::SearchStats *stats, int rerank) {
+    size_t numFound;
+    if (rerank <= 0) {
+      numFound = algorithmImpl->searchKnn(
+          prepareQuery(query, context.input, context.converted), k,
+          context.search, labels, distances, queryEf, filter, stats);
+    } else {
+      // If we're using the order-preserving transform, the query's extra
+      // dimension is 0.
+      context.input.resize(getActualDimensions());
+      std::memcpy(context.input.data(), query, dimensions * sizeof(float));
+      if (useOrderPreservingTransform) {
+        context.input[dimensions] = 0;
+      }
+      context.fullPrecisionQuery.resize(getActualDimensions());
+      toFullPrecisionVector(context.input.data(),
+                            context.fullPrecisionQuery.data());
+      const data_t *queryVector =
+          prepareQuery(query, context.input, context.converted);
+      // Captures only two pointers, so it fits in std::function's inline
+      // storage and doesn't allocate either.
+      const float *fullPrecisionQuery = context.fullPrecisionQuery.data();
+      std::function<dist_t(const data_t *)> rescore =
+          [this, fullPrecisionQuery](const data_t *storedVector) {
+            return fullPrecisionDistFunc(
+                fullPrecisionQuery, getFullPrecisionVector(storedVector),
+                fullPrecisionSpace->get_full_precision_dist_func_param());
+          };
+      numFound = algorithmImpl->searchKnn(queryVector, k, context.search,
+                                          labels, distances, queryEf, filter,
+                                          stats, &rescore, rerank);
+    }
+
+    return numFound;
+  }
+
+  /**
+   * Make a change to this index by calling `apply`, then (if a change log is
+   * open) log it by calling `log` with apply's result. `log` returns the
+   * number of items changed, which counts towards the checkpoint interval.
+   */
+  template <typename Apply, typename Log>
+  auto logChange(Apply &&apply, Log &&log) {
+    {
+      std::shared_lock<std::shared_mutex> lock(changeLogMutex);
+      if (!changeLog) {
+        return apply();
+      }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(changeLogMutex);
+    auto result = apply();
+    if (changeLog) {
+      changesSinceCheckpoint += log(result);
+      checkpointIfNeeded();
+    }
+    return result;
+  }
+
+  // Apply a change read from a change log. (changeLogMutex must be held.)
+  void applyRecord(const ChangeLog::Record &record) {
+    switch (record.type) {
+    case ChangeLog::AddItems: {
+      addItemsUnlogged(record.vectors.data(), record.ids.size(), record.ids,
+                       -1, record.replaceDeleted);
+      currentLabel = record.nextLabel;
+      break;
+    }
+    case ChangeLog::MarkDeleted:
+      algorithmImpl->markDelete(record.label);
+      break;
+    case ChangeLog::UnmarkDeleted:
+      algorithmImpl->unmarkDelete(record.label);
+      break;
+    }
+  }
+
+  // (changeLogMutex must be held exclusively.)
+  void checkpointIfNeeded() {
+    if (checkpointInterval && changesSinceCheckpoint >= checkpointInterval) {
+      writeCheckpoint();
+    }
+  }
+
+  /**
+   * Replace the snapshot at changeLogIndexPath with a new one, and start an
+   * empty change log for it. The new snapshot is fully written before it
+   * replaces the old one, and the old log doesn't apply to it, so a crash at
+   * any point leaves a snapshot and log that can be loaded together.
+   * (changeLogMutex must be held exclusively.)
+   */
+  void writeCheckpoint() {
+    uint64_t newSnapshotId = ChangeLog::newSnapshotId();
+    std::string tmpPath = changeLogIndexPath + ".tmp";
+    {
+      auto outputStream = std::make_shared<FileOutputStream>(tmpPath);
+      voyager::Metadata::V3(dimensions, space, getStorageDataType(), max_norm,
+                            useOrderPreservingTransform,
+                            fullPrecisionSpace != nullptr, quantizer,
+                            newSnapshotId)
+          .serializeToStream(outputStream);
+      algorithmImpl->saveIndex(outputStream);
+    }
+    ChangeLog::syncFile(tmpPath);
+
+    changeLog.reset();
+    ChangeLog::replaceFile(tmpPath, changeLogIndexPath);
+    snapshotId = newSnapshotId;
+    changesSinceCheckpoint = 0;
+    changeLog = ChangeLog::create(ChangeLog::getPath(changeLogIndexPath),
+                                  newSnapshotId, dimensions);
+  }
+
+  static void checkNumFound(size_t numFound, int k) {
+    if (numFound != (size_t)k) {
+      throw RecallError(
+          "Fewer than expected results were retrieved; only found " +
+          std::to_string(numFound) + " of " + std::to_string(k) +
+          " requested neighbors. Reconstruct the index with a higher M value "
+          "to increase recall.");
+    }
+  }
+
+  /**
+   * Train the product quantizer on the first vectors added to this index, if
+   * it hasn't been trained yet. (Does nothing if this index doesn't use PQ
+   * storage.) The codebook can't be changed once vectors have been encoded
+   * with it, so a batch too small to learn one from is rejected instead.
+   */
+  void trainQuantizerIfNeeded(const float *floatInput, size_t rows,
+                              int numThreads) {
+    if constexpr (productQuantized) {
+      std::lock_guard<std::mutex> lock(quantizerTrainingMutex);
+      if (!quantizer->isTrained()) {
+        trainQuantizer(floatInput, rows, numThreads);
+      }
+    }
+  }
+
+  // (quantizerTrainingMutex must be held.)
+  void trainQuantizer(const float *floatInput, size_t rows, int numThreads) {
+    if (rows < (size_t)ProductQuantizer::NUM_CENTROIDS) {
+      throw std::runtime_error(
+          "This index's product quantizer must be trained on at least " +
+          std::to_string(ProductQuantizer::NUM_CENTROIDS) +
+          " vectors before any can be added, but only " +
+          std::to_string(rows) +
+          " were provided. Add more vectors at once, or call train() first.");
+    }
+
+    size_t numSamples = std::min(rows, ProductQuantizer::MAX_TRAINING_VECTORS);
+    std::vector<const float *> sampleRows(numSamples);
+    for (size_t i = 0; i < numSamples; i++) {
+      sampleRows[i] = floatInput + (i * rows / numSamples) * dimensions;
+    }
+
+    // As in buildFromArray, the extra dimension of the order-preserving
+    // transform depends on the largest norm; the samples' own norms count
+    // towards it, but aren't recorded in max_norm, as they may never be added.
+    std::vector<dist_t> norms(numSamples, 0);
+    dist_t maxNorm = max_norm;
+    if (useOrderPreservingTransform) {
+      for (size_t i = 0; i < numSamples; i++) {
+        norms[i] =
+            getNorm<dist_t, dist_t, scalefactor>(sampleRows[i], dimensions);
+        maxNorm = std::max(maxNorm, norms[i]);
+      }
+    }
+
+    int actualDimensions = getActualDimensions();
+    std::vector<float> samples(numSamples * actualDimensions, 0.0f);
+    for (size_t i = 0; i < numSamples; i++) {
+      float *sample = &samples[i * actualDimensions];
+      std::memcpy(sample, sampleRows[i], dimensions * sizeof(float));
+      if (useOrderPreservingTransform && norms[i] < maxNorm) {
+        sample[dimensions] =
+            sqrt((maxNorm * maxNorm) - (norms[i] * norms[i]));
+      }
+      if (normalize) {
+        normalizeVector<dist_t, float, scalefactor>(sample, sample,
+                                                    actualDimensions);
+      }
+    }
+    quantizer->train(samples.data(), numSamples, numThreads, seed);
+  }
+
+  static int getNumSubvectors(voyager::Metadata::V1 *metadata) {
+    auto *v2 = dynamic_cast<voyager::Metadata::V2 *>(metadata);
+    if (v2 && v2->getQuantizer()) {
+      return v2->getQuantizer()->getNumSubvectors();
+    }
+    return 0;
+  }
+
+  static bool getStoresFullPrecisionVectors(voyager::Metadata::V1 *metadata) {
+    auto *v2 = dynamic_cast<voyager::Metadata::V2 *>(metadata);
+    return v2 && v2->getStoresFullPrecisionVectors();
+  }
 };
 
+/**
+ * Load a TypedIndex of the type described by the given metadata. If
+ * `searchOnly` is set and `inputStream` is a MemoryMappedInputStream, the
+ * index's data is served directly from the mapped file rather than copied.
+ */
 std::unique_ptr<Index>
 loadTypedIndexFromMetadata(std::unique_ptr<voyager::Metadata::V1> metadata,
-                           std::shared_ptr<InputStream> inputStream) {
+                           std::shared_ptr<InputStream> inputStream,
+                           bool searchOnly = false) {
   if (!metadata) {
     throw std::domain_error(
         "The provided file contains no Voyager parameter metadata. Please "
@@ -754,19 +1571,25 @@ loadTypedIndexFromMetadata(std::unique_ptr<voyager::Metadata::V1> metadata,
       return std::make_unique<TypedIndex<float>>(
           std::unique_ptr<voyager::Metadata::V1>(
               (voyager::Metadata::V1 *)metadata.release()),
-          inputStream);
+          inputStream, searchOnly);
       break;
     case StorageDataType::Float8:
       return std::make_unique<TypedIndex<float, int8_t, std::ratio<1, 127>>>(
           std::unique_ptr<voyager::Metadata::V1>(
               (voyager::Metadata::V1 *)metadata.release()),
-          inputStream);
+          inputStream, searchOnly);
       break;
     case StorageDataType::E4M3:
       return std::make_unique<TypedIndex<float, E4M3>>(
           std::unique_ptr<voyager::Metadata::V1>(
               (voyager::Metadata::V1 *)metadata.release()),
-          inputStream);
+          inputStream, searchOnly);
+      break;
+    case StorageDataType::PQ:
+      return std::make_unique<TypedIndex<float, PQCode>>(
+          std::unique_ptr<voyager::Metadata::V1>(
+              (voyager::Metadata::V1 *)metadata.release()),
+          inputStream, searchOnly);
       break;
     default:
       throw std::domain_error("Unknown storage data type: " +
@@ -782,3 +1605,25 @@ loadTypedIndexFromStream(std::shared_ptr<InputStream> inputStream) {
   return loadTypedIndexFromMetadata(
       voyager::Metadata::loadFromStream(inputStream), inputStream);
 }
+
+/**
+ * Load the index (with metadata) saved in the file at `pathToIndex`,
+ * memory-mapping it if `searchOnly` is set. If the file is a snapshot written
+ * by a change log, the log is replayed and kept open (see
+ * TypedIndex::openChangeLog).
+ */
+std::unique_ptr<Index> loadTypedIndexFromFile(const std::string &pathToIndex,
+                                              bool searchOnly = false) {
+  std::shared_ptr<InputStream> inputStream;
+  if (searchOnly) {
+    inputStream = std::make_shared<MemoryMappedInputStream>(pathToIndex);
+  } else {
+    inputStream = std::make_shared<FileInputStream>(pathToIndex);
+  }
+  std::unique_ptr<Index> index = loadTypedIndexFromMetadata(
+      voyager::Metadata::loadFromStream(inputStream), inputStream, searchOnly);
+  if (index->isLogAware()) {
+    index->openChangeLog(pathToIndex);
+  }
+  return index;
+}
@@ -25,6 +25,7 @@
 #include <cstring>
 #include <limits>
 #include <numeric>
+#include <utility>
 #include <vector>
 
 #include "E4M3.h"
@@ -47,7 +48,7 @@ public:
         shape(shape), strides(computeStrides()) {}
 
   NDArray(std::vector<T> data, std::array<int, Dims> shape)
-      : data(data), shape(shape), strides(computeStrides()) {}
+      : data(std::move(data)), shape(shape), strides(computeStrides()) {}
 
   NDArray(T *inputPointer, std::array<int, Dims> shape)
       : data(computeNumElements(shape)), shape(shape),
@@ -159,8 +160,6 @@ void floatToDataType(const float *inputPointer, data_t *outputPointer,
                                  (float)scalefactor::num /
                                  (float)scalefactor::den;
 
-    std::vector<data_t> output(dimensions);
-
     // Re-scale the input values by multiplying by `scalefactor`:
     for (int i = 0; i < dimensions; i++) {
       if (inputPointer[i] > upperBound || inputPointer[i] < lowerBound) {
@@ -334,5 +333,5 @@ NDArray<float, 2> vectorsToNDArray(std::vector<std::vector<float>> vectors) {
     flatArrayPtr += vector.size(); // Increment the pointer
   }
 
-  return NDArray<float, 2>(flatArray, shape);
+  return NDArray<float, 2>(std::move(flatArray), shape);
 }
@@ -25,16 +25,25 @@
 
 #include "Spaces/Space.h"
 #include "hnswlib.h"
+#include "label_map.h"
+#include "link_list_arena.h"
+#include "segmented_storage.h"
+#include "std_utils.h"
 #include "visited_list_pool.h"
+#include <array>
 #include <assert.h>
 #include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
+#include <deque>
 #include <fstream>
 #include <list>
 #include <random>
 #include <shared_mutex>
 #include <stdlib.h>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -52,12 +61,29 @@ public:
 namespace hnswlib {
 typedef unsigned int tableint;
 typedef unsigned int linklistsizeint;
+typedef LabelMap<labeltype, tableint> LabelLookup;
 
 template <typename dist_t, typename data_t = dist_t>
 class HierarchicalNSW : public AlgorithmInterface<dist_t, data_t> {
 public:
   static const tableint max_update_element_locks = 65536;
 
+  // addPointsInBulk inserts this many elements one at a time before it
+  // starts inserting them in batches...
+  static const size_t BULK_INSERT_SEED_SIZE = 1024;
+  // ...each of which holds at most this fraction of the elements inserted so
+  // far. Elements in the same batch can't find each other as neighbors, so
+  // larger batches trade graph quality for fewer synchronization points.
+  static constexpr double BULK_INSERT_BATCH_FRACTION = 0.02;
+
+  // Searches of indices with at least this many elements track the elements
+  // they've visited in a VisitedHashSet rather than a VisitedList (which
+  // takes 2 bytes per element in the index, per concurrent search)...
+  static const size_t VISITED_HASH_SET_MIN_ELEMENTS = 1 << 22;
+  // ...as long as their ef is at most this, so that they visit only a small
+  // fraction of the index.
+  static const size_t VISITED_HASH_SET_MAX_EF = 512;
+
   HierarchicalNSW(Space<dist_t, data_t> *s,
                   std::shared_ptr<InputStream> inputStream,
                   size_t max_elements = 0, bool search_only = false)
@@ -75,6 +101,8 @@ public:
     num_deleted_ = 0;
     data_size_ = s->get_data_size();
     fstdistfunc_ = s->get_dist_func();
+    fstquerydistfunc_ = s->get_query_dist_func();
+    query_dist_kernel_ = getDistanceKernel(fstquerydistfunc_);
     dist_func_param_ = s->get_dist_func_param();
     M_ = M;
     maxM_ = M_;
@@ -92,23 +120,19 @@ public:
     label_offset_ = size_links_level0_ + data_size_;
     offsetLevel0_ = 0;
 
-    data_level0_memory_ =
-        (char *)malloc(max_elements_ * size_data_per_element_);
-    if (data_level0_memory_ == nullptr)
-      throw std::runtime_error("Not enough memory");
+    data_level0_memory_.reset(size_data_per_element_);
+    data_level0_memory_.adopt(data_level0_memory_.allocateBlock(max_elements_),
+                              max_elements_);
 
     cur_element_count = 0;
 
-    visited_list_pool_ = new VisitedListPool(1, max_elements);
+    visited_list_pool_ = new VisitedListPool(0, max_elements);
 
     // initializations for special treatment of the first node
     enterpoint_node_ = -1;
     maxlevel_ = -1;
 
-    linkLists_ = (char **)malloc(sizeof(void *) * max_elements_);
-    if (linkLists_ == nullptr)
-      throw std::runtime_error(
-          "Not enough memory: HierarchicalNSW failed to allocate linklists");
+    linkLists_.adopt(linkLists_.allocateBlock(max_elements_), max_elements_);
     size_links_per_element_ =
         maxM_ * sizeof(tableint) + sizeof(linklistsizeint);
     mult_ = 1 / log(1.0 * M_);
@@ -123,17 +147,30 @@ public:
     }
   };
 
-  ~HierarchicalNSW() {
-    free(data_level0_memory_);
-    for (tableint i = 0; i < cur_element_count; i++) {
-      if (element_levels_[i] > 0)
-        free(linkLists_[i]);
-    }
-    free(linkLists_);
-    delete visited_list_pool_;
-  }
+  // A max-heap of (distance, element) pairs, as used by searches.
+  typedef std::priority_queue<std::pair<dist_t, tableint>,
+                              std::vector<std::pair<dist_t, tableint>>,
+                              CompareByFirst>
+      CandidateQueue;
 
-  size_t max_elements_;
+  /**
+   * Working memory for searches, which can be reused so that repeated
+   * searches don't allocate. Each context may only be used by one search at a
+   * time; its heaps keep their capacity between searches, and its visited
+   * list is allocated the first time a search needs one.
+   */
+  struct SearchContext {
+    CandidateQueue topCandidates;
+    CandidateQueue candidateSet;
+    CandidateQueue rescored;
+    std::unique_ptr<VisitedList> visitedList;
+    VisitedHashSet visitedHashSet{0};
+  };
+
+  ~HierarchicalNSW() { delete visited_list_pool_; }
+
+  // Atomic, as searches read it while the index grows.
+  std::atomic<size_t> max_elements_;
   size_t cur_element_count;
   size_t size_data_per_element_;
   size_t size_links_per_element_;
@@ -147,64 +184,117 @@ public:
   double mult_, revSize_;
   int maxlevel_;
 
+  // Held exclusively while the index is resized or compacted, and shared
+  // while elements are added or deleted. Searches don't take it: growing the
+  // index doesn't move any elements, so they can carry on while it grows.
   std::shared_mutex resizeLock;
+  // Held exclusively (as well as resizeLock, which is always taken first)
+  // while elements are moved, as by compact() and reorder(), and shared by
+  // searches.
+  std::shared_mutex relocateLock;
+  // Held for the duration of compact(), so that two calls can't interleave.
+  std::mutex compact_guard_;
+  // Set while addPointsInBulk runs. It releases its locks while it reports
+  // progress, so that the progress callback can search the index; anything
+  // that would change the index in the meantime throws instead.
+  std::atomic<bool> bulk_insert_in_progress_{false};
   VisitedListPool *visited_list_pool_;
+  // See VISITED_HASH_SET_MIN_ELEMENTS; only changed by tests.
+  size_t visited_hash_set_min_elements_ = VISITED_HASH_SET_MIN_ELEMENTS;
   std::mutex cur_element_count_guard_;
 
-  std::vector<std::mutex> link_list_locks_;
+  // A deque, so that growing the index only has to construct the new locks.
+  std::deque<std::mutex> link_list_locks_;
 
   // Locks to prevent race condition during update/insert of an element at same
   // time. Note: Locks for additions can also be used to prevent this race
   // condition if the querying of KNN is not exposed along with update/inserts
   // i.e multithread insert/update/query in parallel.
   std::vector<std::mutex> link_list_update_locks_;
+
+  // The internal IDs of elements marked as deleted, whose slots can be reused
+  // by addPoint when replace_deleted is set. Guarded by deleted_elements_lock_,
+  // which also guards num_deleted_ and the delete marks themselves.
+  std::unordered_set<tableint> deleted_elements_;
+  std::mutex deleted_elements_lock_;
   tableint enterpoint_node_;
 
   size_t size_links_level0_;
   size_t offsetData_, offsetLevel0_;
 
-  char *data_level0_memory_;
-  char **linkLists_;
+  // The base layer: each element's level 0 links, vector and label.
+  SegmentedStorage data_level0_memory_;
+  // Each element's links above level 0 (a char *, null at level 0).
+  SegmentedStorage linkLists_{sizeof(char *)};
+  // Owns the blocks that linkLists_ points to, unless memory-mapped.
+  LinkListArena link_list_arena_;
   std::vector<int> element_levels_;
 
   size_t data_size_;
 
   bool search_only_ = false;
 
+  // If set, data_level0_memory_ and the entries of linkLists_ point into this
+  // read-only file mapping rather than into memory owned by this object. Only
+  // used in search-only mode, so nothing ever writes through those pointers.
+  std::shared_ptr<MemoryMappedInputStream> mapped_memory_;
+
   size_t label_offset_;
   DISTFUNC<dist_t, data_t> fstdistfunc_;
+  // The distance from a query (as passed to searchKnn) to a stored element,
+  // which is fstdistfunc_ unless queries are represented differently.
+  DISTFUNC<dist_t, data_t> fstquerydistfunc_;
+  // The plain function that fstquerydistfunc_ wraps, if any, which searches
+  // call directly rather than through std::function.
+  DistanceKernel<dist_t, data_t> query_dist_kernel_ = nullptr;
   size_t dist_func_param_;
-  std::unordered_map<labeltype, tableint> label_lookup_;
+  LabelLookup label_lookup_;
 
   std::default_random_engine level_generator_;
   std::default_random_engine update_probability_generator_;
 
   inline labeltype getExternalLabel(tableint internal_id) const {
     labeltype return_label;
-    memcpy(&return_label,
-           (data_level0_memory_ + internal_id * size_data_per_element_ +
-            label_offset_),
+    memcpy(&return_label, data_level0_memory_[internal_id] + label_offset_,
            sizeof(labeltype));
     return return_label;
   }
 
   inline void setExternalLabel(tableint internal_id, labeltype label) const {
-    memcpy((data_level0_memory_ + internal_id * size_data_per_element_ +
-            label_offset_),
-           &label, sizeof(labeltype));
+    memcpy(data_level0_memory_[internal_id] + label_offset_, &label,
+           sizeof(labeltype));
   }
 
   inline labeltype *getExternalLabeLp(tableint internal_id) const {
-    return (labeltype *)(data_level0_memory_ +
-                         internal_id * size_data_per_element_ + label_offset_);
+    return (labeltype *)(data_level0_memory_[internal_id] + label_offset_);
   }
 
   inline data_t *getDataByInternalId(tableint internal_id) const {
-    return reinterpret_cast<data_t *>(data_level0_memory_ +
-                                      internal_id * size_data_per_element_ +
+    return reinterpret_cast<data_t *>(data_level0_memory_[internal_id] +
                                       offsetData_);
   }
 
+  /**
+   * Ask the CPU to start loading the given element's vector (and the visited
+   * list entry that the search will check first) into cache, so that the
+   * load overlaps with the distance computations that come before it.
+   */
+  template <typename visited_t>
+  inline void prefetchElement(tableint internal_id,
+                              const visited_t &visited) const {
+    VOYAGER_PREFETCH(visited.slotFor(internal_id));
+    const char *vector = (const char *)getDataByInternalId(internal_id);
+    // Only the part of the vector read by the distance function; anything
+    // stored after it (like a full-precision copy) isn't needed to search.
+    const size_t bytesToPrefetch = std::min<size_t>(
+        dist_func_param_ * sizeof(data_t),
+        VOYAGER_PREFETCH_LINES * VOYAGER_CACHE_LINE_SIZE);
+    for (size_t offset = 0; offset < bytesToPrefetch;
+         offset += VOYAGER_CACHE_LINE_SIZE) {
+      VOYAGER_PREFETCH(vector + offset);
+    }
+  }
+
   int getRandomLevel(double reverse_size) {
     std::uniform_real_distribution<double> distribution(0.0, 1.0);
     double r = -log(distribution(level_generator_)) * reverse_size;
@@ -302,37 +392,206 @@ public:
     return top_candidates;
   }
 
-  mutable std::atomic<long> metric_distance_computations;
-  mutable std::atomic<long> metric_hops;
+  // Totals across every search of this index, updated once per query. Each
+  // thread adds to one of several sets of counters (on cache lines of their
+  // own), so that concurrent queries rarely contend on them.
+  struct alignas(64) SearchStatsCounters {
+    std::atomic<size_t> searches{0};
+    std::atomic<size_t> hops{0};
+    std::atomic<size_t> distanceComputations{0};
+    std::atomic<size_t> visitedNodes{0};
+    std::atomic<uint64_t> elapsedNanoseconds{0};
+  };
+  static constexpr size_t NUM_SEARCH_STATS_COUNTERS = 16;
+  mutable std::array<SearchStatsCounters, NUM_SEARCH_STATS_COUNTERS>
+      search_stats_counters_;
+
+  void recordSearchStats(const SearchStats &stats) const {
+    static thread_local size_t counterIndex =
+        std::hash<std::thread::id>()(std::this_thread::get_id()) %
+        NUM_SEARCH_STATS_COUNTERS;
+    SearchStatsCounters &counters = search_stats_counters_[counterIndex];
+    counters.searches.fetch_add(stats.searches, std::memory_order_relaxed);
+    counters.hops.fetch_add(stats.hops, std::memory_order_relaxed);
+    counters.distanceComputations.fetch_add(stats.distanceComputations,
+                                            std::memory_order_relaxed);
+    counters.visitedNodes.fetch_add(stats.visitedNodes,
+                                    std::memory_order_relaxed);
+    if (stats.elapsedSeconds > 0) {
+      counters.elapsedNanoseconds.fetch_add(
+          (uint64_t)(stats.elapsedSeconds * 1e9), std::memory_order_relaxed);
+    }
+  }
 
+  /**
+   * The total work done by every search of this index since it was created
+   * (or since the last call to resetSearchStats()). Only searches that were
+   * asked for their own stats are timed, so only those count towards
+   * `elapsedSeconds`.
+   */
+  SearchStats getSearchStats() const {
+    SearchStats stats;
+    uint64_t elapsedNanoseconds = 0;
+    for (const SearchStatsCounters &counters : search_stats_counters_) {
+      stats.searches += counters.searches.load(std::memory_order_relaxed);
+      stats.hops += counters.hops.load(std::memory_order_relaxed);
+      stats.distanceComputations +=
+          counters.distanceComputations.load(std::memory_order_relaxed);
+      stats.visitedNodes +=
+          counters.visitedNodes.load(std::memory_order_relaxed);
+      elapsedNanoseconds +=
+          counters.elapsedNanoseconds.load(std::memory_order_relaxed);
+    }
+    stats.elapsedSeconds = elapsedNanoseconds / 1e9;
+    return stats;
+  }
+
+  void resetSearchStats() {
+    for (SearchStatsCounters &counters : search_stats_counters_) {
+      counters.searches = 0;
+      counters.hops = 0;
+      counters.distanceComputations = 0;
+      counters.visitedNodes = 0;
+      counters.elapsedNanoseconds = 0;
+    }
+  }
+
+  /**
+   * Whether the element with the given internal ID may be returned from a
+   * search, i.e.: it isn't deleted and (if a filter is provided) its label is
+   * accepted by the filter.
+   */
+  template <bool has_deletions>
+  bool isReturnable(tableint internalId,
+                    const BaseFilterFunctor *filter) const {
+    return (!has_deletions || !isMarkedDeleted(internalId)) &&
+           (!filter || (*filter)(getExternalLabel(internalId)));
+  }
+
+  /**
+   * Greedy search of the base layer. `has_deletions` must be true if any
+   * element may be excluded from the results, either because it has been
+   * marked as deleted or because it's rejected by `filter`. If
+   * `collect_metrics` is true, the work done is added to `stats`.
+   */
   template <bool has_deletions, bool collect_metrics = false>
   std::priority_queue<std::pair<dist_t, tableint>,
                       std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
   searchBaseLayerST(tableint ep_id, const data_t *data_point, size_t ef,
-                    VisitedList *vl = nullptr) const {
-    bool wasPassedVisitedList = vl != nullptr;
-    if (!wasPassedVisitedList) {
-      vl = visited_list_pool_->getFreeVisitedList();
-    } else {
+                    VisitedList *vl = nullptr,
+                    const BaseFilterFunctor *filter = nullptr,
+                    SearchStats *stats = nullptr) const {
+    return withVisitedSet(vl, ef, [&](auto &visited) {
+      CandidateQueue top_candidates;
+      CandidateQueue candidate_set;
+      searchBaseLayerSTWith<has_deletions, collect_metrics>(
+          ep_id, data_point, ef, visited, filter, stats, top_candidates,
+          candidate_set);
+      return top_candidates;
+    });
+  }
+
+  /**
+   * Whether a search with the given ef should track visited elements in a
+   * VisitedHashSet rather than a VisitedList.
+   */
+  bool useVisitedHashSet(size_t ef) const {
+    return max_elements_ >= visited_hash_set_min_elements_ &&
+           ef <= VISITED_HASH_SET_MAX_EF;
+  }
+
+  /**
+   * Call `search(visited)` with an empty set of visited elements, either
+   * `vl` (if given) or one from the pool suited to a search with this ef.
+   */
+  template <typename search_t>
+  auto withVisitedSet(VisitedList *vl, size_t ef, search_t search) const {
+    if (vl) {
       vl->reset();
+      VisitedListRef visited(vl);
+      return search(visited);
     }
 
-    vl_type *visited_array = vl->mass;
-    vl_type visited_array_tag = vl->curV;
+    if (useVisitedHashSet(ef)) {
+      // Each expanded element adds at most maxM0_ new ones, and a search
+      // expands a few times ef of them.
+      VisitedHashSet *set =
+          visited_list_pool_->getFreeVisitedHashSet(ef * maxM0_);
+      VisitedHashSetRef visited(set);
+      auto result = search(visited);
+      visited_list_pool_->releaseVisitedHashSet(set);
+      return result;
+    }
 
-    std::priority_queue<std::pair<dist_t, tableint>,
-                        std::vector<std::pair<dist_t, tableint>>,
-                        CompareByFirst>
-        top_candidates;
-    std::priority_queue<std::pair<dist_t, tableint>,
-                        std::vector<std::pair<dist_t, tableint>>,
-                        CompareByFirst>
-        candidate_set;
+    vl = visited_list_pool_->getFreeVisitedList();
+    VisitedListRef visited(vl);
+    auto result = search(visited);
+    visited_list_pool_->releaseVisitedList(vl);
+    return result;
+  }
+
+  // As above, but using the visited sets of `context`.
+  template <typename search_t>
+  auto withVisitedSet(SearchContext &context, size_t ef,
+                      search_t search) const {
+    if (useVisitedHashSet(ef)) {
+      context.visitedHashSet.reset(ef * maxM0_);
+      VisitedHashSetRef visited(&context.visitedHashSet);
+      return search(visited);
+    }
+
+    // The index may have grown since the list was allocated.
+    if (!context.visitedList ||
+        context.visitedList->numelements < max_elements_) {
+      context.visitedList = std::make_unique<VisitedList>(max_elements_);
+    }
+    context.visitedList->reset();
+    VisitedListRef visited(context.visitedList.get());
+    return search(visited);
+  }
+
+  /**
+   * The body of searchBaseLayerST, which leaves the nearest elements found in
+   * `top_candidates`. Both queues are cleared first, but keep their storage.
+   */
+  template <bool has_deletions, bool collect_metrics, typename visited_t>
+  void searchBaseLayerSTWith(tableint ep_id, const data_t *data_point,
+                             size_t ef, visited_t &visited,
+                             const BaseFilterFunctor *filter,
+                             SearchStats *stats, CandidateQueue &top_candidates,
+                             CandidateQueue &candidate_set) const {
+    if (query_dist_kernel_) {
+      searchBaseLayerSTUsing<has_deletions, collect_metrics>(
+          query_dist_kernel_, ep_id, data_point, ef, visited, filter, stats,
+          top_candidates, candidate_set);
+    } else {
+      searchBaseLayerSTUsing<has_deletions, collect_metrics>(
+          fstquerydistfunc_, ep_id, data_point, ef, visited, filter, stats,
+          top_candidates, candidate_set);
+    }
+  }
+
+  // As above, computing distances to the query with `distance`, which is
+  // equivalent to fstquerydistfunc_.
+  template <bool has_deletions, bool collect_metrics, typename distance_t,
+            typename visited_t>
+  void searchBaseLayerSTUsing(const distance_t &distance, tableint ep_id,
+                              const data_t *data_point, size_t ef,
+                              visited_t &visited,
+                              const BaseFilterFunctor *filter,
+                              SearchStats *stats,
+                              CandidateQueue &top_candidates,
+                              CandidateQueue &candidate_set) const {
+    GetContainerForQueue(top_candidates).clear();
+    GetContainerForQueue(candidate_set).clear();
 
     dist_t lowerBound;
-    if (!has_deletions || !isMarkedDeleted(ep_id)) {
-      dist_t dist = fstdistfunc_(data_point, getDataByInternalId(ep_id),
-                                 dist_func_param_);
+    if (isReturnable<has_deletions>(ep_id, filter)) {
+      dist_t dist =
+          distance(data_point, getDataByInternalId(ep_id), dist_func_param_);
+      if (collect_metrics) {
+        stats->distanceComputations++;
+      }
       lowerBound = dist;
       top_candidates.emplace(dist, ep_id);
       candidate_set.emplace(-dist, ep_id);
@@ -341,7 +600,10 @@ public:
       candidate_set.emplace(-lowerBound, ep_id);
     }
 
-    visited_array[ep_id] = visited_array_tag;
+    visited.insert(ep_id);
+    if (collect_metrics) {
+      stats->visitedNodes++;
+    }
 
     while (!candidate_set.empty()) {
 
@@ -359,23 +621,36 @@ public:
       //                bool cur_node_deleted =
       //                isMarkedDeleted(current_node_id);
       if (collect_metrics) {
-        metric_hops++;
-        metric_distance_computations += size;
+        stats->hops++;
+      }
+
+      if (VOYAGER_PREFETCH_DISTANCE > 0) {
+        size_t toPrefetch = std::min<size_t>(size, VOYAGER_PREFETCH_DISTANCE);
+        for (size_t j = 1; j <= toPrefetch; j++) {
+          prefetchElement(*(data + j), visited);
+        }
       }
 
       for (size_t j = 1; j <= size; j++) {
         int candidate_id = *(data + j);
+        // Neighbors are prefetched whether or not they've been visited, as
+        // checking the visited list would cause the cache miss we're avoiding.
+        if (VOYAGER_PREFETCH_DISTANCE > 0 &&
+            j + VOYAGER_PREFETCH_DISTANCE <= size) {
+          prefetchElement(*(data + j + VOYAGER_PREFETCH_DISTANCE), visited);
+        }
         //                    if (candidate_id == 0) continue;
-        if (!(visited_array[candidate_id] == visited_array_tag)) {
-
-          visited_array[candidate_id] = visited_array_tag;
-
+        if (visited.insert(candidate_id)) {
           data_t *currObj1 = (getDataByInternalId(candidate_id));
-          dist_t dist = fstdistfunc_(data_point, currObj1, dist_func_param_);
+          dist_t dist = distance(data_point, currObj1, dist_func_param_);
+          if (collect_metrics) {
+            stats->visitedNodes++;
+            stats->distanceComputations++;
+          }
 
           if (top_candidates.size() < ef || lowerBound > dist) {
             candidate_set.emplace(-dist, candidate_id);
-            if (!has_deletions || !isMarkedDeleted(candidate_id))
+            if (isReturnable<has_deletions>(candidate_id, filter))
               top_candidates.emplace(dist, candidate_id);
 
             if (top_candidates.size() > ef)
@@ -387,11 +662,6 @@ public:
         }
       }
     }
-
-    if (!wasPassedVisitedList) {
-      visited_list_pool_->releaseVisitedList(vl);
-    }
-    return top_candidates;
   }
 
   void getNeighborsByHeuristic2(
@@ -440,8 +710,7 @@ public:
   }
 
   linklistsizeint *get_linklist0(tableint internal_id) const {
-    return (linklistsizeint *)(data_level0_memory_ +
-                               internal_id * size_data_per_element_ +
+    return (linklistsizeint *)(data_level0_memory_[internal_id] +
                                offsetLevel0_);
   };
 
@@ -452,8 +721,17 @@ public:
                                offsetLevel0_);
   };
 
+  // The block of an element's links above level 0, or null if it has none.
+  inline char *getLinkLists(tableint internal_id) const {
+    return *(char **)linkLists_[internal_id];
+  }
+
+  inline void setLinkLists(tableint internal_id, char *linkLists) {
+    *(char **)linkLists_[internal_id] = linkLists;
+  }
+
   linklistsizeint *get_linklist(tableint internal_id, int level) const {
-    return (linklistsizeint *)(linkLists_[internal_id] +
+    return (linklistsizeint *)(getLinkLists(internal_id) +
                                (level - 1) * size_links_per_element_);
   };
 
@@ -463,6 +741,12 @@ public:
                       : get_linklist(internal_id, level);
   };
 
+  // The size of the block in link_list_arena_ holding the upper layers of an
+  // element at the given level.
+  size_t getLinkListBlockSize(int level) const {
+    return level > 0 ? size_links_per_element_ * level : 0;
+  }
+
   tableint mutuallyConnectNewElement(
       const data_t *data_point, tableint cur_c,
       std::priority_queue<std::pair<dist_t, tableint>,
@@ -608,7 +892,7 @@ public:
     if (cur_element_count == 0)
       return top_candidates;
     tableint currObj = enterpoint_node_;
-    dist_t curdist = fstdistfunc_(
+    dist_t curdist = fstquerydistfunc_(
         query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
 
     for (size_t level = maxlevel_; level > 0; level--) {
@@ -623,8 +907,8 @@ public:
           tableint cand = datal[i];
           if (cand < 0 || cand > max_elements_)
             throw std::runtime_error("cand error");
-          dist_t d = fstdistfunc_(query_data, getDataByInternalId(cand),
-                                  dist_func_param_);
+          dist_t d = fstquerydistfunc_(query_data, getDataByInternalId(cand),
+                                       dist_func_param_);
 
           if (d < curdist) {
             curdist = d;
@@ -635,7 +919,7 @@ public:
       }
     }
 
-    if (num_deleted_) {
+    if (mayContainDeletedElements()) {
       std::priority_queue<std::pair<dist_t, tableint>> top_candidates1 =
           searchBaseLayerST<true>(currObj, query_data, ef_, vl);
       top_candidates.swap(top_candidates1);
@@ -651,11 +935,17 @@ public:
     return top_candidates;
   };
 
+  /**
+   * Change the maximum number of elements the index can hold. Elements can't
+   * be added while this runs, but searches carry on, as growing the index
+   * only allocates new space and never moves the elements already in it.
+   */
   void resizeIndex(size_t new_max_elements) {
     if (search_only_)
       throw std::runtime_error(
           "resizeIndex is not supported in search only mode");
     std::unique_lock<std::shared_mutex> lock(resizeLock);
+    checkNoBulkInsert("resize the index");
 
     if (new_max_elements < cur_element_count)
       throw IndexCannotBeShrunkError(
@@ -663,30 +953,323 @@ public:
           " elements, as this index already contains " +
           std::to_string(cur_element_count) + " elements.");
 
-    delete visited_list_pool_;
-    visited_list_pool_ = new VisitedListPool(1, new_max_elements);
-
+    // Shrinking only frees space beyond the last element, which searches
+    // can't reach.
+    data_level0_memory_.resize(new_max_elements);
+    linkLists_.resize(new_max_elements);
     element_levels_.resize(new_max_elements);
+    resizeLinkListLocks(new_max_elements);
+    visited_list_pool_->setNumElements(new_max_elements);
 
-    std::vector<std::mutex>(new_max_elements).swap(link_list_locks_);
+    max_elements_ = new_max_elements;
+  }
 
-    // Reallocate base layer
-    char *data_level0_memory_new = (char *)realloc(
-        data_level0_memory_, new_max_elements * size_data_per_element_);
-    if (data_level0_memory_new == nullptr)
-      throw std::runtime_error(
-          "Not enough memory: resizeIndex failed to allocate base layer");
-    data_level0_memory_ = data_level0_memory_new;
+  void checkNoBulkInsert(const std::string &action) const {
+    if (bulk_insert_in_progress_) {
+      throw std::runtime_error("Cannot " + action +
+                               " while elements are being added in bulk.");
+    }
+  }
 
-    // Reallocate all other layers
-    char **linkLists_new =
-        (char **)realloc(linkLists_, sizeof(void *) * new_max_elements);
-    if (linkLists_new == nullptr)
-      throw std::runtime_error(
-          "Not enough memory: resizeIndex failed to allocate other layers");
-    linkLists_ = linkLists_new;
+  void resizeLinkListLocks(size_t numLocks) {
+    while (link_list_locks_.size() < numLocks) {
+      link_list_locks_.emplace_back();
+    }
+    while (link_list_locks_.size() > numLocks) {
+      link_list_locks_.pop_back();
+    }
+  }
 
-    max_elements_ = new_max_elements;
+  /**
+   * Physically remove every element that has been marked as deleted, and
+   * return the number of elements removed.
+   *
+   * First, every remaining element that links to a deleted element is given
+   * new neighbors: its existing non-deleted neighbors, plus the non-deleted
+   * neighbors of the deleted elements it linked to, pruned to M with
+   * getNeighborsByHeuristic2. This runs on `numThreads` threads, and searches
+   * can continue while it does. Then, searches are briefly blocked while the
+   * remaining elements are copied into a new, smaller allocation and given
+   * new internal IDs in the range [0, getNumElements()).
+   *
+   * After compaction, the index's maximum size is its number of elements.
+   * Adding, deleting or undeleting elements waits until compaction is done,
+   * as the repairs rely on the same elements staying deleted throughout.
+   */
+  size_t compact(int numThreads = 1) {
+    if (search_only_)
+      throw std::runtime_error("compact is not supported in search only mode");
+    std::unique_lock<std::mutex> compactLock(compact_guard_);
+
+    std::unique_lock<std::shared_mutex> lock(resizeLock);
+    checkNoBulkInsert("compact the index");
+    if (num_deleted_ == 0)
+      return 0;
+
+    ParallelFor(0, cur_element_count, numThreads,
+                [&](size_t internalId, size_t) {
+                  if (isMarkedDeleted(internalId))
+                    return;
+                  for (int level = 0; level <= element_levels_[internalId];
+                       level++) {
+                    repairConnectionsToDeletedElements(internalId, level);
+                  }
+                });
+
+    std::unique_lock<std::shared_mutex> relocate(relocateLock);
+    return removeDeletedElements(numThreads);
+  }
+
+  /**
+   * If the non-deleted element `internalId` links to any deleted elements at
+   * the given level, replace its neighbors at that level with the closest of
+   * its non-deleted neighbors and those of the deleted elements (or, if those
+   * are deleted too, their neighbors, up to ef_construction_ candidates).
+   */
+  void repairConnectionsToDeletedElements(tableint internalId, int level) {
+    // Deleted elements' lists are only read, and their locks are only ever
+    // taken while holding the lock of a non-deleted element, so this can't
+    // deadlock with another repair.
+    std::unique_lock<std::mutex> lock(link_list_locks_[internalId]);
+    linklistsizeint *ll_cur = get_linklist_at_level(internalId, level);
+    size_t size = getListCount(ll_cur);
+    tableint *data = (tableint *)(ll_cur + 1);
+
+    bool linksToDeletedElements = false;
+    for (size_t j = 0; j < size; j++) {
+      if (isMarkedDeleted(data[j])) {
+        linksToDeletedElements = true;
+        break;
+      }
+    }
+    if (!linksToDeletedElements)
+      return;
+
+    std::unordered_set<tableint> seen = {internalId};
+    std::vector<tableint> candidates;
+    std::vector<tableint> deletedElements;
+    auto addCandidate = [&](tableint neighbor) {
+      if (!seen.insert(neighbor).second)
+        return;
+      if (isMarkedDeleted(neighbor))
+        deletedElements.push_back(neighbor);
+      else
+        candidates.push_back(neighbor);
+    };
+
+    for (size_t j = 0; j < size; j++) {
+      addCandidate(data[j]);
+    }
+    for (size_t i = 0; i < deletedElements.size() && i < ef_construction_ &&
+                       candidates.size() < ef_construction_;
+         i++) {
+      tableint deletedId = deletedElements[i];
+      if (element_levels_[deletedId] < level)
+        continue;
+      std::unique_lock<std::mutex> deletedLock(link_list_locks_[deletedId]);
+      linklistsizeint *ll_deleted = get_linklist_at_level(deletedId, level);
+      size_t deletedSize = getListCount(ll_deleted);
+      tableint *deletedData = (tableint *)(ll_deleted + 1);
+      for (size_t j = 0; j < deletedSize; j++) {
+        addCandidate(deletedData[j]);
+      }
+    }
+
+    std::priority_queue<std::pair<dist_t, tableint>,
+                        std::vector<std::pair<dist_t, tableint>>,
+                        CompareByFirst>
+        topCandidates;
+    const data_t *dataPoint = getDataByInternalId(internalId);
+    for (tableint candidate : candidates) {
+      topCandidates.emplace(fstdistfunc_(dataPoint,
+                                         getDataByInternalId(candidate),
+                                         dist_func_param_),
+                            candidate);
+    }
+    getNeighborsByHeuristic2(topCandidates, level ? maxM_ : maxM0_);
+
+    setListCount(ll_cur, topCandidates.size());
+    for (size_t j = 0; !topCandidates.empty(); j++) {
+      data[j] = topCandidates.top().second;
+      topCandidates.pop();
+    }
+  }
+
+  /**
+   * Give every element a new internal ID in breadth-first order of the base
+   * layer, starting from the entry point, so that elements that are close in
+   * the graph are also close in memory. Searches touch fewer cache lines and
+   * pages as a result, particularly on indices much larger than the CPU's
+   * caches. Labels, links and deleted marks are unchanged; only the layout of
+   * the index is. Searches, additions and deletions wait while this runs.
+   */
+  void reorder(int numThreads = 1) {
+    if (search_only_)
+      throw std::runtime_error("reorder is not supported in search only mode");
+    std::unique_lock<std::mutex> compactLock(compact_guard_);
+    std::unique_lock<std::shared_mutex> lock(resizeLock);
+    std::unique_lock<std::shared_mutex> relocate(relocateLock);
+    checkNoBulkInsert("reorder the index");
+    if (cur_element_count < 2)
+      return;
+
+    const tableint unvisited = std::numeric_limits<tableint>::max();
+    std::vector<tableint> newIds(cur_element_count, unvisited);
+    std::vector<tableint> queue;
+    queue.reserve(cur_element_count);
+
+    // Elements that can't be reached from the entry point start new searches
+    // of their own, in their existing order.
+    tableint nextUnvisited = 0;
+    tableint root = enterpoint_node_;
+    while (queue.size() < cur_element_count) {
+      while (newIds[root] != unvisited)
+        root = nextUnvisited++;
+      newIds[root] = queue.size();
+      queue.push_back(root);
+
+      for (size_t head = queue.size() - 1; head < queue.size(); head++) {
+        linklistsizeint *ll = get_linklist0(queue[head]);
+        size_t size = getListCount(ll);
+        tableint *data = (tableint *)(ll + 1);
+        for (size_t j = 0; j < size; j++) {
+          if (newIds[data[j]] == unvisited) {
+            newIds[data[j]] = queue.size();
+            queue.push_back(data[j]);
+          }
+        }
+      }
+    }
+
+    renumberElements(newIds, cur_element_count, max_elements_, numThreads);
+  }
+
+  /**
+   * Drop all deleted elements, renumbering the rest densely (in their
+   * existing order) and removing any remaining links to deleted elements.
+   * The caller must hold relocateLock and resizeLock exclusively.
+   */
+  size_t removeDeletedElements(int numThreads) {
+    std::vector<tableint> newIds(cur_element_count, REMOVED_ELEMENT);
+    size_t newElementCount = 0;
+    for (tableint i = 0; i < cur_element_count; i++) {
+      if (!isMarkedDeleted(i))
+        newIds[i] = newElementCount++;
+    }
+    size_t numRemoved = cur_element_count - newElementCount;
+    if (numRemoved == 0)
+      return 0;
+
+    renumberElements(newIds, newElementCount,
+                     std::max<size_t>(newElementCount, 1), numThreads);
+    return numRemoved;
+  }
+
+  // Marks elements to be dropped by renumberElements.
+  static constexpr tableint REMOVED_ELEMENT =
+      std::numeric_limits<tableint>::max();
+
+  /**
+   * Move element i to internal ID newIds[i] (or drop it, if newIds[i] is
+   * REMOVED_ELEMENT), rewriting the base layer and the upper layers' links
+   * to match and rebuilding label_lookup_, and reallocate the index to hold
+   * newMaxElements.
+   * The new IDs must be a permutation of [0, newElementCount). The caller
+   * must hold relocateLock and resizeLock exclusively.
+   */
+  void renumberElements(const std::vector<tableint> &newIds,
+                        size_t newElementCount, size_t newMaxElements,
+                        int numThreads) {
+    SegmentedStorage::Block newDataLevel0Block =
+        data_level0_memory_.allocateBlock(newMaxElements);
+    SegmentedStorage::Block newLinkListsBlock =
+        linkLists_.allocateBlock(newMaxElements);
+    char *newDataLevel0Memory = newDataLevel0Block.get();
+    char **newLinkLists = (char **)newLinkListsBlock.get();
+    std::vector<int> newElementLevels(newMaxElements);
+
+    auto remapLinks = [&](linklistsizeint *ll) {
+      size_t size = getListCount(ll);
+      tableint *data = (tableint *)(ll + 1);
+      size_t numKept = 0;
+      for (size_t j = 0; j < size; j++) {
+        if (newIds[data[j]] != REMOVED_ELEMENT)
+          data[numKept++] = newIds[data[j]];
+      }
+      setListCount(ll, numKept);
+    };
+
+    ParallelFor(0, cur_element_count, numThreads,
+                [&](size_t oldId, size_t) {
+                  int level = element_levels_[oldId];
+                  tableint newId = newIds[oldId];
+                  if (newId == REMOVED_ELEMENT)
+                    return;
+
+                  memcpy(newDataLevel0Memory + newId * size_data_per_element_,
+                         data_level0_memory_[oldId], size_data_per_element_);
+                  remapLinks(get_linklist0(newId, newDataLevel0Memory));
+
+                  newElementLevels[newId] = level;
+                  newLinkLists[newId] =
+                      level > 0 ? getLinkLists(oldId) : nullptr;
+                  for (int l = 1; l <= level; l++) {
+                    remapLinks(get_linklist(oldId, l));
+                  }
+                });
+
+    // Copy the remaining upper layers into a new arena, in their new order,
+    // leaving behind the space used by any removed elements:
+    LinkListArena newLinkListArena;
+    size_t upperLayersSize = 0;
+    for (tableint i = 0; i < newElementCount; i++) {
+      upperLayersSize += getLinkListBlockSize(newElementLevels[i]);
+    }
+    newLinkListArena.reserve(upperLayersSize);
+    for (tableint i = 0; i < newElementCount; i++) {
+      if (newElementLevels[i] > 0) {
+        size_t blockSize = getLinkListBlockSize(newElementLevels[i]);
+        char *block = newLinkListArena.allocate(blockSize);
+        memcpy(block, newLinkLists[i], blockSize);
+        newLinkLists[i] = block;
+      }
+    }
+
+    if (newIds[enterpoint_node_] != REMOVED_ELEMENT) {
+      enterpoint_node_ = newIds[enterpoint_node_];
+    } else {
+      enterpoint_node_ = -1;
+      maxlevel_ = -1;
+      for (tableint i = 0; i < newElementCount; i++) {
+        if (newElementLevels[i] > maxlevel_) {
+          enterpoint_node_ = i;
+          maxlevel_ = newElementLevels[i];
+        }
+      }
+    }
+
+    std::unordered_set<tableint> newDeletedElements;
+    for (tableint oldId : deleted_elements_) {
+      if (newIds[oldId] != REMOVED_ELEMENT)
+        newDeletedElements.insert(newIds[oldId]);
+    }
+    deleted_elements_.swap(newDeletedElements);
+    num_deleted_ = deleted_elements_.size();
+
+    data_level0_memory_.adopt(std::move(newDataLevel0Block), newMaxElements);
+    linkLists_.adopt(std::move(newLinkListsBlock), newMaxElements);
+    link_list_arena_.swap(newLinkListArena);
+    element_levels_ = std::move(newElementLevels);
+    cur_element_count = newElementCount;
+    label_lookup_ = LabelLookup::build(
+        cur_element_count, [&](size_t i) { return getExternalLabel(i); },
+        numThreads);
+
+    if (newMaxElements != max_elements_) {
+      max_elements_ = newMaxElements;
+      visited_list_pool_->setNumElements(newMaxElements);
+      resizeLinkListLocks(newMaxElements);
+    }
   }
 
   void saveIndex(const std::string &filename) {
@@ -695,7 +1278,7 @@ public:
 
   void saveIndex(std::shared_ptr<OutputStream> output) {
     writeBinaryPOD(output, offsetLevel0_);
-    writeBinaryPOD(output, max_elements_);
+    writeBinaryPOD(output, (size_t)max_elements_);
     writeBinaryPOD(output, cur_element_count);
     writeBinaryPOD(output, size_data_per_element_);
     writeBinaryPOD(output, label_offset_);
@@ -709,8 +1292,9 @@ public:
     writeBinaryPOD(output, mult_);
     writeBinaryPOD(output, ef_construction_);
 
-    output->write(data_level0_memory_,
-                  cur_element_count * size_data_per_element_);
+    data_level0_memory_.forEachRun(
+        cur_element_count,
+        [&](const char *data, size_t size) { output->write(data, size); });
 
     for (size_t i = 0; i < cur_element_count; i++) {
       unsigned int linkListSize =
@@ -718,7 +1302,7 @@ public:
                                  : 0;
       writeBinaryPOD(output, linkListSize);
       if (linkListSize)
-        output->write(linkLists_[i], linkListSize);
+        output->write(getLinkLists(i), linkListSize);
     }
   }
 
@@ -737,12 +1321,13 @@ public:
                               std::to_string(totalFileSize) + ").");
     }
 
-    readBinaryPOD(inputStream, max_elements_);
+    size_t saved_max_elements;
+    readBinaryPOD(inputStream, saved_max_elements);
     readBinaryPOD(inputStream, cur_element_count);
 
     size_t max_elements = max_elements_i;
     if (max_elements < cur_element_count)
-      max_elements = max_elements_;
+      max_elements = saved_max_elements;
     max_elements_ = max_elements;
     readBinaryPOD(inputStream, size_data_per_element_);
     readBinaryPOD(inputStream, label_offset_);
@@ -767,6 +1352,8 @@ public:
 
     data_size_ = s->get_data_size();
     fstdistfunc_ = s->get_dist_func();
+    fstquerydistfunc_ = s->get_query_dist_func();
+    query_dist_kernel_ = getDistanceKernel(fstquerydistfunc_);
     dist_func_param_ = s->get_dist_func_param();
 
     size_links_per_element_ =
@@ -831,16 +1418,24 @@ public:
       inputStream->setPosition(position);
     }
 
-    data_level0_memory_ = (char *)malloc(max_elements * size_data_per_element_);
-    if (data_level0_memory_ == nullptr) {
-      throw std::runtime_error(
-          "Not enough memory: loadIndex failed to allocate level0 (" +
-          std::to_string(max_elements * size_data_per_element_) + " bytes)");
+    if (search_only_) {
+      mapped_memory_ =
+          std::dynamic_pointer_cast<MemoryMappedInputStream>(inputStream);
     }
 
-    {
+    data_level0_memory_.reset(size_data_per_element_);
+    if (mapped_memory_) {
+      // Serve the base layer straight out of the mapped file. (The size of
+      // the mapping was validated against the link lists above.)
+      data_level0_memory_.adoptUnowned(mapped_memory_->data() + position,
+                                       cur_element_count);
+      inputStream->advanceBy(cur_element_count * size_data_per_element_);
+    } else {
+      SegmentedStorage::Block block =
+          data_level0_memory_.allocateBlock(max_elements);
       size_t bytes_to_read = cur_element_count * size_data_per_element_;
-      size_t bytes_read = inputStream->read(data_level0_memory_, bytes_to_read);
+      size_t bytes_read = inputStream->read(block.get(), bytes_to_read);
+      data_level0_memory_.adopt(std::move(block), max_elements);
       if (bytes_read != bytes_to_read) {
         throw std::runtime_error("Tried to read " +
                                  std::to_string(bytes_to_read) +
@@ -849,15 +1444,14 @@ public:
       }
     }
 
-    linkLists_ = (char **)malloc(sizeof(void *) * max_elements);
-    if (linkLists_ == nullptr)
-      throw std::runtime_error(
-          "Not enough memory: loadIndex failed to allocate linklists (" +
-          std::to_string(sizeof(void *) * max_elements) + " bytes)");
+    linkLists_.adopt(linkLists_.allocateBlock(max_elements), max_elements);
 
-    size_t linkListBufferSize = sizeof(void *) * max_elements;
-    std::vector<char> linkListBuffer(linkListBufferSize);
-    {
+    std::vector<char> linkListBuffer;
+    const char *linkListData;
+    if (mapped_memory_) {
+      linkListData = mapped_memory_->data() + inputStream->getPosition();
+    } else {
+      linkListBuffer.resize(sizeof(void *) * max_elements);
       size_t bytes_read = 0;
 
       while (true) {
@@ -896,49 +1490,84 @@ public:
           break;
         }
       }
+      linkListData = linkListBuffer.data();
     }
 
     if (!search_only_) {
-      std::vector<std::mutex>(max_elements).swap(link_list_locks_);
+      std::deque<std::mutex>(max_elements).swap(link_list_locks_);
       std::vector<std::mutex>(max_update_element_locks)
           .swap(link_list_update_locks_);
     }
 
-    visited_list_pool_ = new VisitedListPool(1, max_elements);
+    visited_list_pool_ = new VisitedListPool(0, max_elements);
 
     element_levels_ = std::vector<int>(max_elements);
     revSize_ = 1.0 / mult_;
     ef_ = 10;
 
+    // The link lists are stored back to back, each preceded by its size, so
+    // find where each one starts with a (cheap) sequential scan, then copy
+    // them in parallel into one block of the arena:
+    size_t numThreads = std::thread::hardware_concurrency();
+    size_t linkListDataSize = linkListBuffer.size();
+    if (mapped_memory_)
+      linkListDataSize =
+          mapped_memory_->getTotalLength() - inputStream->getPosition();
+    std::vector<size_t> upperLayerOffsets(cur_element_count + 1);
     size_t indexInLinkListBuffer = 0;
     for (size_t i = 0; i < cur_element_count; i++) {
-      if (!search_only_)
-        label_lookup_[getExternalLabel(i)] = i;
       unsigned int linkListSize;
+      if (indexInLinkListBuffer + sizeof(int) > linkListDataSize) {
+        throw std::runtime_error(
+            "Index seems to be corrupted or unsupported. Expected " +
+            std::to_string(cur_element_count) +
+            " linked lists, but the index data ended after " +
+            std::to_string(i) + ".");
+      }
+      linkListSize = *((int *)(linkListData + indexInLinkListBuffer));
+      indexInLinkListBuffer += sizeof(int) + linkListSize;
+      element_levels_[i] = linkListSize / size_links_per_element_;
+      upperLayerOffsets[i + 1] = upperLayerOffsets[i] + linkListSize;
+    }
+    if (indexInLinkListBuffer > linkListDataSize) {
+      throw std::runtime_error(
+          "Index seems to be corrupted or unsupported. The linked lists need " +
+          std::to_string(indexInLinkListBuffer) + " bytes, but only " +
+          std::to_string(linkListDataSize) + " bytes of index data remain.");
+    }
 
-      linkListSize = *((int *)(linkListBuffer.data() + indexInLinkListBuffer));
-      indexInLinkListBuffer += sizeof(int);
-
-      if (linkListSize == 0) {
-        element_levels_[i] = 0;
-
-        linkLists_[i] = nullptr;
-      } else {
-        element_levels_[i] = linkListSize / size_links_per_element_;
-        linkLists_[i] = (char *)malloc(linkListSize);
-        if (linkLists_[i] == nullptr)
-          throw std::runtime_error(
-              "Not enough memory: loadIndex failed to allocate linklist");
+    char *upperLayers = nullptr;
+    size_t upperLayersSize = upperLayerOffsets[cur_element_count];
+    if (!mapped_memory_ && upperLayersSize > 0) {
+      upperLayers = link_list_arena_.allocate(upperLayersSize);
+    }
 
-        std::memcpy(linkLists_[i],
-                    (linkListBuffer.data() + indexInLinkListBuffer),
-                    linkListSize);
-        indexInLinkListBuffer += linkListSize;
+    // Group elements into large chunks so that each thread copies a long,
+    // contiguous run of the buffer:
+    const size_t LOAD_CHUNK_SIZE = 65536;
+    size_t numChunks =
+        (cur_element_count + LOAD_CHUNK_SIZE - 1) / LOAD_CHUNK_SIZE;
+    ParallelFor(0, numChunks, numThreads, [&](size_t chunk, size_t) {
+      size_t chunkEnd =
+          std::min<size_t>(cur_element_count, (chunk + 1) * LOAD_CHUNK_SIZE);
+      for (size_t i = chunk * LOAD_CHUNK_SIZE; i < chunkEnd; i++) {
+        size_t linkListSize = upperLayerOffsets[i + 1] - upperLayerOffsets[i];
+        // Skip past the sizes of this and all previous lists:
+        const char *source =
+            linkListData + upperLayerOffsets[i] + (i + 1) * sizeof(int);
+        if (linkListSize == 0) {
+          setLinkLists(i, nullptr);
+        } else if (mapped_memory_) {
+          setLinkLists(i, const_cast<char *>(source));
+        } else {
+          setLinkLists(i, upperLayers + upperLayerOffsets[i]);
+          std::memcpy(getLinkLists(i), source, linkListSize);
+        }
       }
-    }
+    });
 
     if (enterpoint_node_ > 0 && enterpoint_node_ != (tableint)-1 &&
-        !linkLists_[enterpoint_node_]) {
+        !getLinkLists(enterpoint_node_)) {
       throw std::runtime_error(
           "Index seems to be corrupted or unsupported. "
           "Entry point into HNSW data structure was at element index " +
@@ -946,9 +1575,26 @@ public:
           ", but no linked list was present at that index.");
     }
 
-    for (size_t i = 0; i < cur_element_count; i++) {
-      if (isMarkedDeleted(i))
-        num_deleted_ += 1;
+    if (!search_only_) {
+      label_lookup_ = LabelLookup::build(
+          cur_element_count, [&](size_t i) { return getExternalLabel(i); },
+          numThreads);
+    }
+
+    if (!mapped_memory_) {
+      std::vector<std::vector<tableint>> deletedByChunk(numChunks);
+      ParallelFor(0, numChunks, numThreads, [&](size_t chunk, size_t) {
+        size_t chunkEnd =
+            std::min<size_t>(cur_element_count, (chunk + 1) * LOAD_CHUNK_SIZE);
+        for (size_t i = chunk * LOAD_CHUNK_SIZE; i < chunkEnd; i++) {
+          if (isMarkedDeleted(i))
+            deletedByChunk[chunk].push_back(i);
+        }
+      });
+      for (const std::vector<tableint> &deleted : deletedByChunk) {
+        num_deleted_ += deleted.size();
+        deleted_elements_.insert(deleted.begin(), deleted.end());
+      }
     }
 
     return;
@@ -956,7 +1602,20 @@ public:
 
   size_t getDimensionality() { return dist_func_param_; }
 
-  std::vector<data_t> getDataByLabel(labeltype label) const {
+  /**
+   * Whether searches need to check for elements marked as deleted. Deleted
+   * elements aren't counted when an index is memory-mapped (as that would
+   * touch every page of the file), so assume that they could be present.
+   */
+  bool mayContainDeletedElements() const {
+    return num_deleted_ > 0 || mapped_memory_;
+  }
+
+  /**
+   * Copy the stored data of the given label: `size` values, or (by default)
+   * just the values read by the distance function.
+   */
+  std::vector<data_t> getDataByLabel(labeltype label, size_t size = 0) const {
     if (search_only_)
       throw std::runtime_error(
           "getDataByLabel is not supported in search only mode");
@@ -970,7 +1629,7 @@ public:
     label_c = search->second;
 
     data_t *data_ptr = getDataByInternalId(label_c);
-    size_t dim = dist_func_param_;
+    size_t dim = size ? size : dist_func_param_;
     std::vector<data_t> data;
     for (unsigned long i = 0; i < dim; i++) {
       data.push_back(*data_ptr);
@@ -1019,12 +1678,13 @@ public:
     if (search_only_)
       throw std::runtime_error(
           "markDelete is not supported in search only mode");
+    std::shared_lock<std::shared_mutex> lock(resizeLock);
+    checkNoBulkInsert("delete elements");
 
-    auto search = label_lookup_.find(label);
-    if (search == label_lookup_.end()) {
+    tableint internalId = label_lookup_.get(label);
+    if (internalId == LabelLookup::EMPTY) {
       throw std::runtime_error("Label not found");
     }
-    tableint internalId = search->second;
     markDeletedInternal(internalId);
   }
 
@@ -1036,10 +1696,12 @@ public:
    */
   void markDeletedInternal(tableint internalId) {
     assert(internalId < cur_element_count);
+    std::unique_lock<std::mutex> lock_deleted(deleted_elements_lock_);
     if (!isMarkedDeleted(internalId)) {
       unsigned char *ll_cur = ((unsigned char *)get_linklist0(internalId)) + 2;
       *ll_cur |= DELETE_MARK;
       num_deleted_ += 1;
+      deleted_elements_.insert(internalId);
     } else {
       throw std::runtime_error(
           "The requested to delete element is already deleted");
@@ -1052,11 +1714,12 @@ public:
    * @param label
    */
   void unmarkDelete(labeltype label) {
-    auto search = label_lookup_.find(label);
-    if (search == label_lookup_.end()) {
+    std::shared_lock<std::shared_mutex> lock(resizeLock);
+    checkNoBulkInsert("undelete elements");
+    tableint internalId = label_lookup_.get(label);
+    if (internalId == LabelLookup::EMPTY) {
       throw std::runtime_error("Label not found");
     }
-    tableint internalId = search->second;
     unmarkDeletedInternal(internalId);
   }
 
@@ -1066,10 +1729,12 @@ public:
    */
   void unmarkDeletedInternal(tableint internalId) {
     assert(internalId < cur_element_count);
+    std::unique_lock<std::mutex> lock_deleted(deleted_elements_lock_);
     if (isMarkedDeleted(internalId)) {
       unsigned char *ll_cur = ((unsigned char *)get_linklist0(internalId)) + 2;
       *ll_cur &= ~DELETE_MARK;
       num_deleted_ -= 1;
+      deleted_elements_.erase(internalId);
     } else {
       throw std::runtime_error(
           "The requested to undelete element is not deleted");
@@ -1095,13 +1760,73 @@ public:
     *((unsigned short int *)(ptr)) = *((unsigned short int *)&size);
   }
 
-  void addPoint(const data_t *data_point, labeltype label) {
+  /**
+   * Add a point to the index, or update the point with the same label if one
+   * exists. If replace_deleted is set and the label is new, the slot of an
+   * element marked as deleted is reused (if there is one) instead of taking
+   * up a new slot; the deleted element's label is forgotten.
+   */
+  void addPoint(const data_t *data_point, labeltype label,
+                bool replace_deleted = false) {
     if (search_only_)
       throw std::runtime_error("addPoint is not supported in search only mode");
 
+    if (replace_deleted && replaceDeletedElement(data_point, label))
+      return;
+
     addPoint(data_point, label, -1);
   }
 
+  /**
+   * The number of slots held by deleted elements, which addPoint can reuse
+   * when replace_deleted is set.
+   */
+  size_t getNumReplaceableElements() {
+    std::unique_lock<std::mutex> lock_deleted(deleted_elements_lock_);
+    return deleted_elements_.size();
+  }
+
+  /**
+   * Store data_point under a new label in the slot of a deleted element,
+   * reconnecting the slot to its new neighbours with updatePoint. Returns
+   * false without changing anything if the label is already in the index or
+   * if there are no deleted elements to replace.
+   */
+  bool replaceDeletedElement(const data_t *data_point, labeltype label) {
+    std::shared_lock<std::shared_mutex> lock(resizeLock);
+    checkNoBulkInsert("add elements");
+    tableint internalId;
+    {
+      // Hold cur_element_count_guard_ while claiming the slot, so that a
+      // concurrent addPoint with the same label can't also insert it.
+      std::unique_lock<std::mutex> templock_curr(cur_element_count_guard_);
+      if (label_lookup_.count(label))
+        return false;
+
+      {
+        std::unique_lock<std::mutex> lock_deleted(deleted_elements_lock_);
+        if (deleted_elements_.empty())
+          return false;
+        internalId = *deleted_elements_.begin();
+        // Still marked as deleted until updatePoint has finished, so that
+        // searches skip it, but no longer available to other callers.
+        deleted_elements_.erase(deleted_elements_.begin());
+      }
+
+      labeltype oldLabel = getExternalLabel(internalId);
+      if (label_lookup_.get(oldLabel) == internalId)
+        label_lookup_.erase(oldLabel);
+      label_lookup_.set(label, internalId);
+      setExternalLabel(internalId, label);
+    }
+
+    std::unique_lock<std::mutex> lock_el_update(
+        link_list_update_locks_[(internalId & (max_update_element_locks - 1))]);
+    updatePoint(data_point, internalId, 1.0);
+    unmarkDeletedInternal(internalId);
+    return true;
+  }
+
   void updatePoint(const data_t *dataPoint, tableint internalId,
                    float updateNeighborProbability) {
     // update the feature vector associated with existing point with new vector
@@ -1279,6 +2004,7 @@ public:
 
   tableint addPoint(const data_t *data_point, labeltype label, int level) {
     std::shared_lock<std::shared_mutex> lock(resizeLock);
+    checkNoBulkInsert("add elements");
     tableint cur_c = 0;
     {
       // Checking if the element with the same label already exists
@@ -1312,7 +2038,7 @@ public:
 
       cur_c = cur_element_count;
       cur_element_count++;
-      label_lookup_[label] = cur_c;
+      label_lookup_.set(label, cur_c);
     }
 
     // Take update lock to prevent race conditions on an element with
@@ -1333,20 +2059,16 @@ public:
     tableint currObj = enterpoint_node_;
     tableint enterpoint_copy = enterpoint_node_;
 
-    memset(data_level0_memory_ + cur_c * size_data_per_element_ + offsetLevel0_,
-           0, size_data_per_element_);
+    memset(data_level0_memory_[cur_c] + offsetLevel0_, 0,
+           size_data_per_element_);
 
     // Initialisation of the data and label
     memcpy(getExternalLabeLp(cur_c), &label, sizeof(labeltype));
     memcpy(getDataByInternalId(cur_c), data_point, data_size_);
 
     if (curlevel) {
-      linkLists_[cur_c] =
-          (char *)malloc(size_links_per_element_ * curlevel + 1);
-      if (linkLists_[cur_c] == nullptr)
-        throw std::runtime_error(
-            "Not enough memory: addPoint failed to allocate linklist");
-      memset(linkLists_[cur_c], 0, size_links_per_element_ * curlevel + 1);
+      setLinkLists(cur_c,
+                   link_list_arena_.allocate(getLinkListBlockSize(curlevel)));
     }
 
     if ((signed)currObj != -1) {
@@ -1382,15 +2104,15 @@ public:
         }
       }
 
+      // Find the new element's neighbors on each level from the top down,
+      // but link it in from the bottom up: a search that reached it on one
+      // level before it had links on the levels below would get stuck there.
       bool epDeleted = isMarkedDeleted(enterpoint_copy);
-      for (int level = std::min(curlevel, maxlevelcopy); level >= 0; level--) {
-        if (level > maxlevelcopy || level < 0) // possible?
-          throw std::runtime_error("Level error");
-
-        std::priority_queue<std::pair<dist_t, tableint>,
-                            std::vector<std::pair<dist_t, tableint>>,
-                            CompareByFirst>
-            top_candidates = searchBaseLayer(currObj, data_point, level);
+      int topLevel = std::min(curlevel, maxlevelcopy);
+      std::vector<CandidateQueue> candidatesByLevel(topLevel + 1);
+      for (int level = topLevel; level >= 0; level--) {
+        CandidateQueue &top_candidates = candidatesByLevel[level];
+        top_candidates = searchBaseLayer(currObj, data_point, level);
         if (epDeleted) {
           top_candidates.emplace(
               fstdistfunc_(data_point, getDataByInternalId(enterpoint_copy),
@@ -1399,8 +2121,15 @@ public:
           if (top_candidates.size() > ef_construction_)
             top_candidates.pop();
         }
-        currObj = mutuallyConnectNewElement(data_point, cur_c, top_candidates,
-                                            level, false);
+        // The nearest candidate, which mutuallyConnectNewElement always
+        // links to:
+        const auto &candidates = GetContainerForQueue(top_candidates);
+        currObj =
+            std::min_element(candidates.begin(), candidates.end())->second;
+      }
+      for (int level = 0; level <= topLevel; level++) {
+        mutuallyConnectNewElement(data_point, cur_c, candidatesByLevel[level],
+                                  level, false);
       }
 
     } else {
@@ -1417,17 +2146,324 @@ public:
     return cur_c;
   };
 
-  std::priority_queue<std::pair<dist_t, labeltype>>
-  searchKnn(const data_t *query_data, size_t k, VisitedList *vl = nullptr,
-            long queryEf = -1) {
-    std::shared_lock<std::shared_mutex> lock(resizeLock);
-    std::priority_queue<std::pair<dist_t, labeltype>> result;
-    if (cur_element_count == 0)
-      return result;
+  // A link from `source`, which addPointsInBulk is inserting, that still has
+  // to be added to the neighbor list of `target` at `level`.
+  struct PendingLink {
+    tableint target;
+    int level;
+    tableint source;
+
+    bool operator<(const PendingLink &other) const {
+      return std::tie(target, level, source) <
+             std::tie(other.target, other.level, other.source);
+    }
+  };
+
+  /**
+   * Link the (already initialized) element `cur_c` to its neighbors on each
+   * of its levels, queueing the links back to it in `pendingLinks` instead
+   * of adding them. Only reads the rest of the graph, so any number of
+   * elements can be connected this way at once.
+   */
+  void connectNewElementDeferred(tableint cur_c,
+                                 std::vector<PendingLink> &pendingLinks) {
+    const data_t *dataPoint = getDataByInternalId(cur_c);
+    int curlevel = element_levels_[cur_c];
+
+    tableint currObj = enterpoint_node_;
+    dist_t curdist = fstdistfunc_(dataPoint, getDataByInternalId(currObj),
+                                  dist_func_param_);
+    for (int level = maxlevel_; level > curlevel; level--) {
+      bool changed = true;
+      while (changed) {
+        changed = false;
+        linklistsizeint *data = get_linklist(currObj, level);
+        int size = getListCount(data);
+        tableint *datal = (tableint *)(data + 1);
+        for (int i = 0; i < size; i++) {
+          dist_t d = fstdistfunc_(dataPoint, getDataByInternalId(datal[i]),
+                                  dist_func_param_);
+          if (d < curdist) {
+            curdist = d;
+            currObj = datal[i];
+            changed = true;
+          }
+        }
+      }
+    }
+
+    for (int level = std::min(curlevel, maxlevel_); level >= 0; level--) {
+      std::priority_queue<std::pair<dist_t, tableint>,
+                          std::vector<std::pair<dist_t, tableint>>,
+                          CompareByFirst>
+          topCandidates = searchBaseLayer(currObj, dataPoint, level);
+      getNeighborsByHeuristic2(topCandidates, M_);
+
+      linklistsizeint *ll_cur =
+          level == 0 ? get_linklist0(cur_c) : get_linklist(cur_c, level);
+      tableint *data = (tableint *)(ll_cur + 1);
+      size_t size = 0;
+      // The closest neighbor comes out last, and is where the search on the
+      // next level down starts:
+      while (!topCandidates.empty()) {
+        currObj = topCandidates.top().second;
+        topCandidates.pop();
+        data[size++] = currObj;
+        pendingLinks.push_back({currObj, level, cur_c});
+      }
+      setListCount(ll_cur, size);
+    }
+  }
+
+  /**
+   * Add the links queued by connectNewElementDeferred to their targets'
+   * neighbor lists, pruning lists that overflow with the same heuristic as
+   * mutuallyConnectNewElement. Each list is updated by a single thread and
+   * only once, however many links it receives.
+   */
+  void applyPendingLinks(std::vector<std::vector<PendingLink>> &pendingLinks,
+                         int numThreads) {
+    std::vector<PendingLink> links;
+    for (std::vector<PendingLink> &threadLinks : pendingLinks) {
+      links.insert(links.end(), threadLinks.begin(), threadLinks.end());
+      threadLinks.clear();
+    }
+    std::sort(links.begin(), links.end());
+
+    std::vector<size_t> groupStarts;
+    for (size_t i = 0; i < links.size(); i++) {
+      if (i == 0 || links[i].target != links[i - 1].target ||
+          links[i].level != links[i - 1].level) {
+        groupStarts.push_back(i);
+      }
+    }
+    groupStarts.push_back(links.size());
+
+    ParallelFor(0, groupStarts.size() - 1, numThreads, [&](size_t group,
+                                                          size_t) {
+      const PendingLink *begin = links.data() + groupStarts[group];
+      const PendingLink *end = links.data() + groupStarts[group + 1];
+      tableint target = begin->target;
+      int level = begin->level;
+      size_t Mcurmax = level ? maxM_ : maxM0_;
+
+      linklistsizeint *ll_other =
+          level == 0 ? get_linklist0(target) : get_linklist(target, level);
+      size_t size = getListCount(ll_other);
+      tableint *data = (tableint *)(ll_other + 1);
 
+      if (size + (end - begin) <= Mcurmax) {
+        for (const PendingLink *link = begin; link != end; link++) {
+          data[size++] = link->source;
+        }
+        setListCount(ll_other, size);
+        return;
+      }
+
+      const data_t *targetData = getDataByInternalId(target);
+      std::priority_queue<std::pair<dist_t, tableint>,
+                          std::vector<std::pair<dist_t, tableint>>,
+                          CompareByFirst>
+          candidates;
+      for (size_t j = 0; j < size; j++) {
+        candidates.emplace(fstdistfunc_(getDataByInternalId(data[j]),
+                                        targetData, dist_func_param_),
+                           data[j]);
+      }
+      for (const PendingLink *link = begin; link != end; link++) {
+        candidates.emplace(fstdistfunc_(getDataByInternalId(link->source),
+                                        targetData, dist_func_param_),
+                           link->source);
+      }
+
+      getNeighborsByHeuristic2(candidates, Mcurmax);
+
+      int indx = 0;
+      while (candidates.size() > 0) {
+        data[indx] = candidates.top().second;
+        candidates.pop();
+        indx++;
+      }
+      setListCount(ll_other, indx);
+    });
+  }
+
+  /**
+   * Insert `count` elements into this empty index at once, which is much
+   * faster than calling addPoint for each of them from several threads.
+   *
+   * `writeElement(i, threadId, dest)` must write the data of the i-th element
+   * (labelled `labels[i]`) to `dest`. It's called exactly once per element,
+   * concurrently from up to `numThreads` threads. `progress(numInserted,
+   * count)`, if given, is called from the calling thread as elements are
+   * connected into the graph.
+   *
+   * Every element's level is chosen up front, and the element with the
+   * highest level is inserted first, so the entry point never changes
+   * afterwards. The first elements are then inserted one at a time. The
+   * rest are inserted in batches, each a small fraction of the size of the
+   * graph so far: every element in a batch searches the graph built by the
+   * previous batches in parallel, without writing to it, and the reverse
+   * links to the whole batch are applied afterwards, with each neighbor
+   * list updated by a single thread. The result only depends on the input
+   * and the random seed, not on the number of threads.
+   *
+   * `progress` is called without holding any of the index's locks, so it
+   * may search the (partially built) index. Changing the index in any other
+   * way throws until addPointsInBulk returns. If anything throws (including
+   * `progress`), the index is left empty.
+   */
+  void addPointsInBulk(
+      const labeltype *labels, size_t count,
+      const std::function<void(size_t, size_t, data_t *)> &writeElement,
+      int numThreads = -1,
+      const std::function<void(size_t, size_t)> &progress = nullptr) {
+    if (search_only_)
+      throw std::runtime_error(
+          "addPointsInBulk is not supported in search only mode");
+
+    std::unique_lock<std::shared_mutex> lock(resizeLock);
+    std::unique_lock<std::shared_mutex> relocate(relocateLock);
+    checkNoBulkInsert("add elements");
+    if (cur_element_count != 0) {
+      throw std::runtime_error(
+          "Elements can only be added in bulk to an empty index, but this "
+          "index already contains " +
+          std::to_string(cur_element_count) + " elements.");
+    }
+    if (count > max_elements_) {
+      throw IndexFullError(
+          "Cannot insert " + std::to_string(count) +
+          " elements; the maximum size of this index is " +
+          std::to_string(max_elements_) +
+          ". Call resizeIndex first to increase the maximum size of the "
+          "index.");
+    }
+    if (count == 0) {
+      return;
+    }
+    if (numThreads <= 0) {
+      numThreads = std::thread::hardware_concurrency();
+    }
+
+    // Write every element's data first, as that's the only step that can
+    // fail on bad input; nothing else has been changed if it does.
+    ParallelFor(0, count, numThreads, [&](size_t i, size_t threadId) {
+      memset(data_level0_memory_[i] + offsetLevel0_, 0,
+             size_data_per_element_);
+      setExternalLabel(i, labels[i]);
+      writeElement(i, threadId, getDataByInternalId(i));
+    });
+
+    // Saved so that if the insertion fails, retrying it builds the same
+    // graph:
+    std::default_random_engine initialLevelGenerator = level_generator_;
+    bulk_insert_in_progress_ = true;
+    auto reportProgress = [&](size_t numInserted) {
+      relocate.unlock();
+      lock.unlock();
+      progress(numInserted, count);
+      lock.lock();
+      relocate.lock();
+    };
+    try {
+      label_lookup_.reserve(count);
+      for (size_t i = 0; i < count; i++) {
+        if (label_lookup_.find(labels[i]) != label_lookup_.end()) {
+          throw std::invalid_argument(
+              "Elements added in bulk must have unique labels, but label " +
+              std::to_string(labels[i]) + " was provided more than once.");
+        }
+        label_lookup_.set(labels[i], i);
+      }
+
+      tableint entryPoint = 0;
+      for (size_t i = 0; i < count; i++) {
+        element_levels_[i] = getRandomLevel(mult_);
+        if (element_levels_[i]) {
+          setLinkLists(i, link_list_arena_.allocate(
+                              getLinkListBlockSize(element_levels_[i])));
+        }
+        if (element_levels_[i] > element_levels_[entryPoint]) {
+          entryPoint = i;
+        }
+      }
+
+      cur_element_count = count;
+      enterpoint_node_ = entryPoint;
+      maxlevel_ = element_levels_[entryPoint];
+
+      // Insert the entry point first, then everything else in input order:
+      std::vector<tableint> insertionOrder;
+      insertionOrder.reserve(count);
+      insertionOrder.push_back(entryPoint);
+      for (size_t i = 0; i < count; i++) {
+        if (i != entryPoint) {
+          insertionOrder.push_back(i);
+        }
+      }
+
+      std::vector<std::vector<PendingLink>> pendingLinks(numThreads);
+      size_t numInserted = 1;
+      while (numInserted < count) {
+        size_t batchSize = 1;
+        if (numInserted >= BULK_INSERT_SEED_SIZE) {
+          batchSize = (size_t)(numInserted * BULK_INSERT_BATCH_FRACTION);
+        }
+        batchSize =
+            std::min(std::max<size_t>(batchSize, 1), count - numInserted);
+
+        ParallelFor(numInserted, numInserted + batchSize, numThreads,
+                    [&](size_t position, size_t threadId) {
+                      connectNewElementDeferred(insertionOrder[position],
+                                                pendingLinks[threadId]);
+                    });
+        applyPendingLinks(pendingLinks, numThreads);
+
+        numInserted += batchSize;
+        if (progress && numInserted < count &&
+            (batchSize > 1 || numInserted % BULK_INSERT_SEED_SIZE == 0)) {
+          reportProgress(numInserted);
+        }
+      }
+
+      if (progress) {
+        reportProgress(count);
+      }
+    } catch (...) {
+      if (!lock.owns_lock()) {
+        // progress threw, but nothing else changed the index while it ran.
+        lock.lock();
+        relocate.lock();
+      }
+      // Leave the index empty, as it was, rather than half-built. No element
+      // may keep pointing into the link lists freed here:
+      for (size_t i = 0; i < count; i++) {
+        element_levels_[i] = 0;
+        setLinkLists(i, nullptr);
+      }
+      cur_element_count = 0;
+      enterpoint_node_ = -1;
+      maxlevel_ = -1;
+      level_generator_ = initialLevelGenerator;
+      label_lookup_.clear();
+      link_list_arena_.clear();
+      bulk_insert_in_progress_ = false;
+      throw;
+    }
+    bulk_insert_in_progress_ = false;
+  }
+
+  /**
+   * Greedily descend from the entry point through the upper layers towards
+   * `query_data`, returning the element to start the base layer search from.
+   */
+  tableint searchUpperLayers(const data_t *query_data,
+                             SearchStats &stats) const {
     tableint currObj = enterpoint_node_;
-    dist_t curdist = fstdistfunc_(
+    dist_t curdist = fstquerydistfunc_(
         query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
+    stats.distanceComputations++;
 
     for (int level = maxlevel_; level > 0; level--) {
       bool changed = true;
@@ -1437,16 +2473,16 @@ public:
 
         data = (unsigned int *)get_linklist(currObj, level);
         int size = getListCount(data);
-        metric_hops++;
-        metric_distance_computations += size;
+        stats.hops++;
+        stats.distanceComputations += size;
 
         tableint *datal = (tableint *)(data + 1);
         for (int i = 0; i < size; i++) {
           tableint cand = datal[i];
           if (cand < 0 || cand > max_elements_)
             throw std::runtime_error("cand error");
-          dist_t d = fstdistfunc_(query_data, getDataByInternalId(cand),
-                                  dist_func_param_);
+          dist_t d = fstquerydistfunc_(query_data, getDataByInternalId(cand),
+                                       dist_func_param_);
 
           if (d < curdist) {
             curdist = d;
@@ -1456,23 +2492,232 @@ public:
         }
       }
     }
+    return currObj;
+  }
+
+  /**
+   * Search the base layer for the elements within `radius` of `data_point`,
+   * keeping only the nearest `maxResults` of them if that's nonzero. This
+   * starts out like searchBaseLayerST with the given `ef`, but keeps
+   * expanding candidates for as long as the nearest unexpanded one is within
+   * range, so the search follows the graph through the whole neighborhood
+   * instead of stopping after `ef` elements.
+   */
+  template <bool has_deletions>
+  std::priority_queue<std::pair<dist_t, tableint>,
+                      std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+  rangeSearchBaseLayer(tableint ep_id, const data_t *data_point, dist_t radius,
+                       size_t ef, size_t maxResults, VisitedList *vl,
+                       const BaseFilterFunctor *filter,
+                       SearchStats &stats) const {
+    return withVisitedSet(vl, ef, [&](auto &visited) {
+      return rangeSearchBaseLayerWith<has_deletions>(
+          ep_id, data_point, radius, ef, maxResults, visited, filter, stats);
+    });
+  }
 
+  template <bool has_deletions, typename visited_t>
+  std::priority_queue<std::pair<dist_t, tableint>,
+                      std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
+  rangeSearchBaseLayerWith(tableint ep_id, const data_t *data_point,
+                           dist_t radius, size_t ef, size_t maxResults,
+                           visited_t &visited, const BaseFilterFunctor *filter,
+                           SearchStats &stats) const {
     std::priority_queue<std::pair<dist_t, tableint>,
                         std::vector<std::pair<dist_t, tableint>>,
                         CompareByFirst>
         top_candidates;
+    std::priority_queue<std::pair<dist_t, tableint>,
+                        std::vector<std::pair<dist_t, tableint>>,
+                        CompareByFirst>
+        candidate_set;
+    std::priority_queue<std::pair<dist_t, tableint>,
+                        std::vector<std::pair<dist_t, tableint>>,
+                        CompareByFirst>
+        results;
+
+    // The distance beyond which nothing can be added to the results (which
+    // shrinks once there are maxResults of them).
+    auto resultBound = [&]() {
+      return maxResults && results.size() == maxResults ? results.top().first
+                                                        : radius;
+    };
+    auto addResult = [&](dist_t dist, tableint id) {
+      if (dist <= resultBound()) {
+        results.emplace(dist, id);
+        if (maxResults && results.size() > maxResults) {
+          results.pop();
+        }
+      }
+    };
+
+    dist_t lowerBound;
+    if (isReturnable<has_deletions>(ep_id, filter)) {
+      dist_t dist = fstquerydistfunc_(
+          data_point, getDataByInternalId(ep_id), dist_func_param_);
+      stats.distanceComputations++;
+      lowerBound = dist;
+      top_candidates.emplace(dist, ep_id);
+      candidate_set.emplace(-dist, ep_id);
+      addResult(dist, ep_id);
+    } else {
+      lowerBound = std::numeric_limits<dist_t>::max();
+      candidate_set.emplace(-lowerBound, ep_id);
+    }
+
+    visited.insert(ep_id);
+    stats.visitedNodes++;
+
+    while (!candidate_set.empty()) {
+      std::pair<dist_t, tableint> current_node_pair = candidate_set.top();
+      dist_t current_dist = -current_node_pair.first;
+
+      if (current_dist > lowerBound &&
+          (top_candidates.size() == ef || has_deletions == false) &&
+          current_dist > resultBound()) {
+        break;
+      }
+      candidate_set.pop();
+
+      tableint current_node_id = current_node_pair.second;
+      int *data = (int *)get_linklist0(current_node_id);
+      size_t size = getListCount((linklistsizeint *)data);
+      stats.hops++;
+
+      if (VOYAGER_PREFETCH_DISTANCE > 0) {
+        size_t toPrefetch = std::min<size_t>(size, VOYAGER_PREFETCH_DISTANCE);
+        for (size_t j = 1; j <= toPrefetch; j++) {
+          prefetchElement(*(data + j), visited);
+        }
+      }
+
+      for (size_t j = 1; j <= size; j++) {
+        int candidate_id = *(data + j);
+        if (VOYAGER_PREFETCH_DISTANCE > 0 &&
+            j + VOYAGER_PREFETCH_DISTANCE <= size) {
+          prefetchElement(*(data + j + VOYAGER_PREFETCH_DISTANCE), visited);
+        }
+        if (!visited.insert(candidate_id)) {
+          continue;
+        }
+
+        dist_t dist = fstquerydistfunc_(
+            data_point, getDataByInternalId(candidate_id), dist_func_param_);
+        stats.visitedNodes++;
+        stats.distanceComputations++;
+
+        if (top_candidates.size() < ef || lowerBound > dist ||
+            dist <= resultBound()) {
+          candidate_set.emplace(-dist, candidate_id);
+          if (isReturnable<has_deletions>(candidate_id, filter)) {
+            top_candidates.emplace(dist, candidate_id);
+            if (top_candidates.size() > ef)
+              top_candidates.pop();
+            addResult(dist, candidate_id);
+          }
+
+          if (!top_candidates.empty())
+            lowerBound = top_candidates.top().first;
+        }
+      }
+    }
+
+    return results;
+  }
+
+  /**
+   * Find the elements within `radius` of `query_data`, or if `maxResults`
+   * is nonzero, at most that many of the nearest of them. `queryEf` sets
+   * how hard the search looks for the first elements in range, as in
+   * searchKnn; once found, their whole neighborhood is searched regardless.
+   */
+  std::priority_queue<std::pair<dist_t, labeltype>>
+  rangeSearch(const data_t *query_data, dist_t radius, size_t maxResults = 0,
+              VisitedList *vl = nullptr, long queryEf = -1,
+              const BaseFilterFunctor *filter = nullptr,
+              SearchStats *stats = nullptr) {
+    std::shared_lock<std::shared_mutex> lock(relocateLock);
+    std::priority_queue<std::pair<dist_t, labeltype>> result;
+    if (stats) {
+      *stats = SearchStats();
+    }
+    if (cur_element_count == 0)
+      return result;
+
+    // Reading the clock costs as much as a few distance computations, so
+    // only searches that report their stats are timed:
+    std::chrono::steady_clock::time_point startTime;
+    if (stats) {
+      startTime = std::chrono::steady_clock::now();
+    }
+    SearchStats queryStats;
+    queryStats.searches = 1;
+
+    tableint currObj = searchUpperLayers(query_data, queryStats);
+
     size_t effective_ef = queryEf > 0 ? queryEf : ef_;
-    if (num_deleted_) {
-      top_candidates = searchBaseLayerST<true, true>(
-          currObj, query_data, std::max(effective_ef, k), vl);
+    std::priority_queue<std::pair<dist_t, tableint>,
+                        std::vector<std::pair<dist_t, tableint>>,
+                        CompareByFirst>
+        results;
+    if (mayContainDeletedElements() || filter) {
+      results = rangeSearchBaseLayer<true>(currObj, query_data, radius,
+                                           effective_ef, maxResults, vl,
+                                           filter, queryStats);
     } else {
-      top_candidates = searchBaseLayerST<false, true>(
-          currObj, query_data, std::max(effective_ef, k), vl);
+      results = rangeSearchBaseLayer<false>(currObj, query_data, radius,
+                                            effective_ef, maxResults, vl,
+                                            nullptr, queryStats);
     }
 
-    while (top_candidates.size() > k) {
-      top_candidates.pop();
+    if (stats) {
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - startTime;
+      queryStats.elapsedSeconds = elapsed.count();
+    }
+    recordSearchStats(queryStats);
+    if (stats) {
+      *stats = queryStats;
+    }
+
+    while (!results.empty()) {
+      result.emplace(results.top().first, getExternalLabel(results.top().second));
+      results.pop();
     }
+    return result;
+  }
+
+  /**
+   * Find the `k` nearest neighbors of `query_data`. If `rescore` is provided,
+   * the `numRescored` nearest candidates are found first, and the `k` of them
+   * with the lowest `rescore` distances (computed from each candidate's
+   * stored data) are returned instead.
+   */
+  std::priority_queue<std::pair<dist_t, labeltype>>
+  searchKnn(const data_t *query_data, size_t k, VisitedList *vl = nullptr,
+            long queryEf = -1, const BaseFilterFunctor *filter = nullptr,
+            SearchStats *stats = nullptr,
+            const std::function<dist_t(const data_t *)> *rescore = nullptr,
+            size_t numRescored = 0) {
+    std::shared_lock<std::shared_mutex> lock(relocateLock);
+    std::priority_queue<std::pair<dist_t, labeltype>> result;
+    if (stats) {
+      *stats = SearchStats();
+    }
+    if (cur_element_count == 0)
+      return result;
+
+    CandidateQueue top_candidates;
+    CandidateQueue candidate_set;
+    CandidateQueue rescored;
+    size_t ef = getKnnSearchEf(k, queryEf, rescore, numRescored);
+    withVisitedSet(vl, ef, [&](auto &visited) {
+      searchKnnCandidates(query_data, k, ef, visited, filter, stats, rescore,
+                          numRescored, top_candidates, candidate_set,
+                          rescored);
+      return true;
+    });
+
     while (top_candidates.size() > 0) {
       std::pair<dist_t, tableint> rez = top_candidates.top();
       result.push(std::pair<dist_t, labeltype>(rez.first,
@@ -1482,6 +2727,119 @@ public:
     return result;
   };
 
+  /**
+   * As searchKnn, but without allocating memory: the search uses the working
+   * memory in `context`, and writes its results to `labels` and `distances`
+   * (each of room for `k` values), nearest first. Returns the number of
+   * results, which is less than `k` only if not enough elements were found.
+   */
+  size_t searchKnn(const data_t *query_data, size_t k, SearchContext &context,
+                   labeltype *labels, dist_t *distances, long queryEf = -1,
+                   const BaseFilterFunctor *filter = nullptr,
+                   SearchStats *stats = nullptr,
+                   const std::function<dist_t(const data_t *)> *rescore =
+                       nullptr,
+                   size_t numRescored = 0) {
+    std::shared_lock<std::shared_mutex> lock(relocateLock);
+    if (stats) {
+      *stats = SearchStats();
+    }
+    if (cur_element_count == 0)
+      return 0;
+
+    size_t ef = getKnnSearchEf(k, queryEf, rescore, numRescored);
+    withVisitedSet(context, ef, [&](auto &visited) {
+      searchKnnCandidates(query_data, k, ef, visited, filter, stats, rescore,
+                          numRescored, context.topCandidates,
+                          context.candidateSet, context.rescored);
+      return true;
+    });
+
+    CandidateQueue &top_candidates = context.topCandidates;
+    size_t numResults = top_candidates.size();
+    for (size_t i = numResults; i > 0; i--) {
+      distances[i - 1] = top_candidates.top().first;
+      labels[i - 1] = getExternalLabel(top_candidates.top().second);
+      top_candidates.pop();
+    }
+    return numResults;
+  }
+
+  // The ef that a searchKnn call actually searches with.
+  size_t getKnnSearchEf(size_t k, long queryEf,
+                        const std::function<dist_t(const data_t *)> *rescore,
+                        size_t &numRescored) const {
+    size_t ef = queryEf > 0 ? queryEf : ef_;
+    if (rescore) {
+      numRescored = std::max(numRescored, k);
+      ef = std::max(ef, numRescored);
+    }
+    return std::max(ef, k);
+  }
+
+  /**
+   * The body of both searchKnn overloads, which leaves the (up to) `k`
+   * nearest elements in `top_candidates`, farthest on top. The caller must
+   * hold relocateLock.
+   */
+  template <typename visited_t>
+  void searchKnnCandidates(
+      const data_t *query_data, size_t k, size_t ef, visited_t &visited,
+      const BaseFilterFunctor *filter, SearchStats *stats,
+      const std::function<dist_t(const data_t *)> *rescore,
+      size_t numRescored, CandidateQueue &top_candidates,
+      CandidateQueue &candidate_set, CandidateQueue &rescored) const {
+    // Reading the clock costs as much as a few distance computations, so
+    // only searches that report their stats are timed:
+    std::chrono::steady_clock::time_point startTime;
+    if (stats) {
+      startTime = std::chrono::steady_clock::now();
+    }
+    SearchStats queryStats;
+    queryStats.searches = 1;
+
+    tableint currObj = searchUpperLayers(query_data, queryStats);
+
+    if (mayContainDeletedElements() || filter) {
+      searchBaseLayerSTWith<true, true>(currObj, query_data, ef, visited,
+                                        filter, &queryStats, top_candidates,
+                                        candidate_set);
+    } else {
+      searchBaseLayerSTWith<false, true>(currObj, query_data, ef, visited,
+                                         nullptr, &queryStats, top_candidates,
+                                         candidate_set);
+    }
+
+    if (rescore) {
+      while (top_candidates.size() > numRescored) {
+        top_candidates.pop();
+      }
+      GetContainerForQueue(rescored).clear();
+      while (!top_candidates.empty()) {
+        tableint candidate = top_candidates.top().second;
+        rescored.emplace((*rescore)(getDataByInternalId(candidate)),
+                         candidate);
+        top_candidates.pop();
+      }
+      queryStats.distanceComputations += rescored.size();
+      top_candidates.swap(rescored);
+    }
+
+    if (stats) {
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - startTime;
+      queryStats.elapsedSeconds = elapsed.count();
+    }
+    recordSearchStats(queryStats);
+    if (stats) {
+      *stats = queryStats;
+    }
+
+    while (top_candidates.size() > k) {
+      top_candidates.pop();
+    }
+  }
+
   void checkIntegrity() {
     int connections_checked = 0;
     std::vector<int> inbound_connections_num(cur_element_count, 0);
@@ -23,14 +23,17 @@
 
 #pragma once
 #ifndef NO_MANUAL_VECTORIZATION
-#ifdef __SSE__
+// SIMD kernels for every supported instruction set are compiled in, no matter
+// which instruction set the compiler targets by default; the spaces pick the
+// fastest one supported by the CPU at runtime (see CPUFeatures). This allows
+// one portable binary to use AVX2 or AVX-512 where they're available.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||            \
+    defined(_M_IX86)
 #define USE_SSE
-#ifdef __AVX__
 #define USE_AVX
-#ifdef __AVX512F__
 #define USE_AVX512
-#endif
-#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define USE_NEON
 #endif
 #endif
 
@@ -55,8 +58,55 @@
 #endif
 #endif
 
+#if defined(USE_NEON)
+#include <arm_neon.h>
+#endif
+
+// Compile a single function for the given instruction set(s), even if the
+// rest of the binary targets an older one. Such functions must only be called
+// after checking CPUFeatures. (MSVC allows any intrinsic to be used anywhere.)
+#if defined(__GNUC__) || defined(__clang__)
+#define VOYAGER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define VOYAGER_TARGET(isa)
+#endif
+
+// Hint to the CPU that the cache line at `address` will be read soon.
+#if defined(__GNUC__) || defined(__clang__)
+#define VOYAGER_PREFETCH(address) __builtin_prefetch((const void *)(address))
+#elif defined(USE_SSE)
+#define VOYAGER_PREFETCH(address)                                              \
+  _mm_prefetch((const char *)(address), _MM_HINT_T0)
+#else
+#define VOYAGER_PREFETCH(address) ((void)(address))
+#endif
+
+// The size of a cache line, used to decide how many prefetches are needed to
+// cover a vector. Apple's ARM chips use 128-byte lines; most others use 64.
+#ifndef VOYAGER_CACHE_LINE_SIZE
+#if defined(__APPLE__) && defined(__aarch64__)
+#define VOYAGER_CACHE_LINE_SIZE 128
+#else
+#define VOYAGER_CACHE_LINE_SIZE 64
+#endif
+#endif
+
+// When searching, how many neighbors ahead of the current one to prefetch
+// (0 disables prefetching), and how many cache lines of each neighbor's vector
+// to prefetch. Lines beyond these are left to the hardware prefetcher, which
+// picks up sequential reads on its own once the first few lines have missed.
+// Both can be tuned for a specific CPU by defining them when compiling.
+#ifndef VOYAGER_PREFETCH_DISTANCE
+#define VOYAGER_PREFETCH_DISTANCE 2
+#endif
+#ifndef VOYAGER_PREFETCH_LINES
+#define VOYAGER_PREFETCH_LINES 8
+#endif
+
 #include "StreamUtils.h"
 #include "visited_list_pool.h"
+#include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <memory>
@@ -72,12 +122,92 @@ public:
   bool operator()(const T &p1, const T &p2) { return p1.first > p2.first; }
 };
 
+/**
+ * Restricts a search to a subset of labels. Elements rejected by a filter are
+ * still traversed (so that the rest of the graph stays reachable) but are
+ * never returned, in the same way as elements that have been marked as
+ * deleted. Filters may be called from several threads at once.
+ */
+class BaseFilterFunctor {
+public:
+  virtual ~BaseFilterFunctor() = default;
+  virtual bool operator()(labeltype label) const = 0;
+};
+
+/**
+ * Allows only the labels contained in the given set.
+ */
+class SortedLabelFilter : public BaseFilterFunctor {
+public:
+  SortedLabelFilter(std::vector<labeltype> labels) : labels(std::move(labels)) {
+    if (!std::is_sorted(this->labels.begin(), this->labels.end())) {
+      std::sort(this->labels.begin(), this->labels.end());
+    }
+  }
+
+  bool operator()(labeltype label) const {
+    return std::binary_search(labels.begin(), labels.end(), label);
+  }
+
+private:
+  std::vector<labeltype> labels;
+};
+
+/**
+ * Allows only the labels whose bits are set in the given bitmap, where label
+ * `i` corresponds to bit `i % 8` (counting from the least significant bit) of
+ * byte `i / 8`. Labels beyond the end of the bitmap are rejected.
+ */
+class LabelBitmapFilter : public BaseFilterFunctor {
+public:
+  LabelBitmapFilter(std::vector<uint8_t> bitmap) : bitmap(std::move(bitmap)) {}
+
+  bool operator()(labeltype label) const {
+    size_t byte = label / 8;
+    return byte < bitmap.size() && (bitmap[byte] >> (label % 8)) & 1;
+  }
+
+private:
+  std::vector<uint8_t> bitmap;
+};
+
+/**
+ * Counters describing the work done by one search, or (when accumulated) by
+ * many. These can be used to tune `ef` against a budget of distance
+ * computations or latency.
+ */
+struct SearchStats {
+  // The number of searches counted.
+  size_t searches = 0;
+  // The number of nodes whose neighbors were examined, across all layers.
+  size_t hops = 0;
+  // The number of distances computed between the query and stored vectors.
+  size_t distanceComputations = 0;
+  // The number of distinct nodes visited while searching the base layer.
+  size_t visitedNodes = 0;
+  // The wall-clock time spent searching, in seconds.
+  double elapsedSeconds = 0;
+
+  SearchStats &operator+=(const SearchStats &other) {
+    searches += other.searches;
+    hops += other.hops;
+    distanceComputations += other.distanceComputations;
+    visitedNodes += other.visitedNodes;
+    elapsedSeconds += other.elapsedSeconds;
+    return *this;
+  }
+};
+
 template <typename dist_t, typename data_t = dist_t> class AlgorithmInterface {
 public:
-  virtual void addPoint(const data_t *datapoint, labeltype label) = 0;
+  virtual void addPoint(const data_t *datapoint, labeltype label,
+                        bool replace_deleted = false) = 0;
   virtual std::priority_queue<std::pair<dist_t, labeltype>>
   searchKnn(const data_t *, size_t, VisitedList *a = nullptr,
-            long queryEf = -1) = 0;
+            long queryEf = -1, const BaseFilterFunctor *filter = nullptr,
+            SearchStats *stats = nullptr,
+            const std::function<dist_t(const data_t *)> *rescore = nullptr,
+            size_t numRescored = 0) = 0;
 
   // Return k nearest neighbor in the order of closer fist
   virtual std::vector<std::pair<dist_t, labeltype>>
@@ -110,5 +240,7 @@ AlgorithmInterface<dist_t, data_t>::searchKnnCloserFirst(
 } // namespace hnswlib
 
 #include "Spaces/Euclidean.h"
+#include "Spaces/FullPrecisionCopy.h"
 #include "Spaces/InnerProduct.h"
+#include "Spaces/ProductQuantization.h"
 #include "hnswalg.h"
@@ -0,0 +1,361 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+#pragma once
+
+#include "std_utils.h"
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace hnswlib {
+
+/**
+ * A hash map from integer keys (labels) to integer values (internal IDs),
+ * using open addressing with linear probing. Keys and values are stored in two
+ * flat arrays, so each entry costs 12 to 24 bytes (with labels of 8 bytes and
+ * IDs of 4) rather than the ~40-byte node of an std::unordered_map, and
+ * lookups stay within one or two cache lines.
+ *
+ * The maximum value of value_t is reserved to mark empty slots. Erasing
+ * shifts later entries back rather than leaving tombstones, so lookups don't
+ * slow down as entries are erased and reinserted.
+ *
+ * Like std::unordered_map, this is not thread-safe; callers must synchronize
+ * writes with any concurrent reads.
+ */
+template <typename key_t, typename value_t> class LabelMap {
+public:
+  static constexpr value_t EMPTY = std::numeric_limits<value_t>::max();
+
+  /**
+   * A forward iterator over the (key, value) pairs in the map, in no
+   * particular order. Dereferencing it returns a copy of the pair, so values
+   * can't be modified through it; use set() instead.
+   */
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::pair<key_t, value_t>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
+    const_iterator(const LabelMap *map, size_t slot) : map(map), slot(slot) {
+      load();
+    }
+
+    reference operator*() const { return current; }
+    pointer operator->() const { return &current; }
+
+    const_iterator &operator++() {
+      slot++;
+      skipEmptySlots();
+      load();
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator previous = *this;
+      ++(*this);
+      return previous;
+    }
+
+    bool operator==(const const_iterator &other) const {
+      return slot == other.slot;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return slot != other.slot;
+    }
+
+  private:
+    friend class LabelMap;
+
+    void skipEmptySlots() {
+      while (slot < map->values.size() && map->values[slot] == EMPTY)
+        slot++;
+    }
+
+    void load() {
+      if (slot < map->values.size())
+        current = {map->keys[slot], map->values[slot]};
+    }
+
+    const LabelMap *map;
+    size_t slot;
+    value_type current;
+  };
+
+  LabelMap() = default;
+
+  size_t size() const { return numEntries; }
+  bool empty() const { return numEntries == 0; }
+
+  const_iterator begin() const {
+    const_iterator it(this, 0);
+    it.skipEmptySlots();
+    it.load();
+    return it;
+  }
+  const_iterator end() const { return const_iterator(this, values.size()); }
+
+  const_iterator find(key_t key) const {
+    size_t slot = findSlot(key);
+    return slot == NOT_FOUND ? end() : const_iterator(this, slot);
+  }
+
+  size_t count(key_t key) const { return findSlot(key) != NOT_FOUND; }
+
+  /**
+   * Return the value stored for the given key, or EMPTY if there is none.
+   */
+  value_t get(key_t key) const {
+    size_t slot = findSlot(key);
+    return slot == NOT_FOUND ? EMPTY : values[slot];
+  }
+
+  /**
+   * Store the given value for the given key, replacing any existing value.
+   */
+  void set(key_t key, value_t value) {
+    if (numEntries + 1 > maxEntries())
+      rehash(capacity() ? capacity() * 2 : MIN_CAPACITY);
+
+    for (size_t slot = homeSlot(key);; slot = (slot + 1) & mask()) {
+      if (values[slot] == EMPTY) {
+        keys[slot] = key;
+        values[slot] = value;
+        numEntries++;
+        return;
+      }
+      if (keys[slot] == key) {
+        values[slot] = value;
+        return;
+      }
+    }
+  }
+
+  /**
+   * Remove the entry for the given key, returning whether there was one.
+   */
+  bool erase(key_t key) {
+    size_t hole = findSlot(key);
+    if (hole == NOT_FOUND)
+      return false;
+
+    // Move back any later entries in the same run that could no longer be
+    // found once this slot is empty (i.e.: whose home slot isn't between the
+    // hole and their current slot).
+    for (size_t slot = (hole + 1) & mask(); values[slot] != EMPTY;
+         slot = (slot + 1) & mask()) {
+      size_t home = homeSlot(keys[slot]);
+      bool reachable = hole <= slot ? (hole < home && home <= slot)
+                                    : (hole < home || home <= slot);
+      if (reachable)
+        continue;
+      keys[hole] = keys[slot];
+      values[hole] = values[slot];
+      hole = slot;
+    }
+    values[hole] = EMPTY;
+    numEntries--;
+    return true;
+  }
+
+  void clear() {
+    std::vector<key_t>().swap(keys);
+    std::vector<value_t>().swap(values);
+    numEntries = 0;
+    capacityBits = 0;
+  }
+
+  /**
+   * Make room for at least numEntries entries without growing again.
+   */
+  void reserve(size_t numEntries) {
+    size_t newCapacity = MIN_CAPACITY;
+    while (newCapacity / 4 * 3 < numEntries)
+      newCapacity *= 2;
+    if (newCapacity > capacity())
+      rehash(newCapacity);
+  }
+
+  /**
+   * The number of bytes of memory used by this map's tables.
+   */
+  size_t getMemoryUsage() const {
+    return capacity() * (sizeof(key_t) + sizeof(value_t));
+  }
+
+  /**
+   * Build a map from keyOf(i) to i for every i in [0, numValues), using up to
+   * numThreads threads. If several values have the same key, the largest one
+   * is kept, as if they had been inserted in order with set().
+   *
+   * Entries are grouped by the region of the table in which their home slot
+   * falls, and each region is filled in by one thread. Entries that would
+   * spill over the end of their region are inserted afterwards, so the result
+   * is the same as if it had been built sequentially.
+   */
+  template <typename KeyFunction>
+  static LabelMap build(size_t numValues, KeyFunction keyOf,
+                        size_t numThreads) {
+    LabelMap map;
+    map.reserve(numValues);
+
+    size_t numRegions =
+        std::min<size_t>(map.capacity() / MIN_REGION_SIZE, MAX_REGIONS);
+    if (numThreads == 1 || numRegions < 2) {
+      for (size_t i = 0; i < numValues; i++) {
+        map.set(keyOf(i), (value_t)i);
+      }
+      return map;
+    }
+    int regionShift = map.capacityBits;
+    while ((size_t(1) << (map.capacityBits - regionShift)) < numRegions)
+      regionShift--;
+    auto regionOf = [&](size_t i) {
+      return map.homeSlot(keyOf(i)) >> regionShift;
+    };
+
+    // Sort the values by region (stably, to keep the last of any duplicates),
+    // counting each chunk's values per region first:
+    size_t numChunks = numRegions;
+    size_t chunkSize = (numValues + numChunks - 1) / numChunks;
+    std::vector<size_t> offsets(numChunks * numRegions, 0);
+    ParallelFor(0, numChunks, numThreads, [&](size_t chunk, size_t) {
+      size_t *counts = &offsets[chunk * numRegions];
+      size_t chunkEnd = std::min(numValues, (chunk + 1) * chunkSize);
+      for (size_t i = chunk * chunkSize; i < chunkEnd; i++) {
+        counts[regionOf(i)]++;
+      }
+    });
+
+    std::vector<size_t> regionStarts(numRegions + 1, 0);
+    size_t total = 0;
+    for (size_t region = 0; region < numRegions; region++) {
+      regionStarts[region] = total;
+      for (size_t chunk = 0; chunk < numChunks; chunk++) {
+        size_t count = offsets[chunk * numRegions + region];
+        offsets[chunk * numRegions + region] = total;
+        total += count;
+      }
+    }
+    regionStarts[numRegions] = total;
+
+    std::vector<value_t> valuesByRegion(numValues);
+    ParallelFor(0, numChunks, numThreads, [&](size_t chunk, size_t) {
+      size_t *nextOffsets = &offsets[chunk * numRegions];
+      size_t chunkEnd = std::min(numValues, (chunk + 1) * chunkSize);
+      for (size_t i = chunk * chunkSize; i < chunkEnd; i++) {
+        valuesByRegion[nextOffsets[regionOf(i)]++] = (value_t)i;
+      }
+    });
+
+    std::vector<std::vector<value_t>> spilledValues(numRegions);
+    std::vector<size_t> numInserted(numRegions, 0);
+    ParallelFor(0, numRegions, numThreads, [&](size_t region, size_t) {
+      size_t regionEnd = (region + 1) << regionShift;
+      for (size_t j = regionStarts[region]; j < regionStarts[region + 1]; j++) {
+        value_t value = valuesByRegion[j];
+        key_t key = keyOf(value);
+        size_t slot = map.homeSlot(key);
+        while (slot < regionEnd && map.values[slot] != EMPTY &&
+               map.keys[slot] != key) {
+          slot++;
+        }
+
+        if (slot == regionEnd) {
+          spilledValues[region].push_back(value);
+        } else {
+          if (map.values[slot] == EMPTY)
+            numInserted[region]++;
+          map.keys[slot] = key;
+          map.values[slot] = value;
+        }
+      }
+    });
+
+    for (size_t count : numInserted) {
+      map.numEntries += count;
+    }
+    for (const std::vector<value_t> &spilled : spilledValues) {
+      for (value_t value : spilled) {
+        map.set(keyOf(value), value);
+      }
+    }
+    return map;
+  }
+
+private:
+  static constexpr size_t NOT_FOUND = std::numeric_limits<size_t>::max();
+  static constexpr size_t MIN_CAPACITY = 16;
+  static constexpr size_t MIN_REGION_SIZE = 4096;
+  static constexpr size_t MAX_REGIONS = 256;
+
+  size_t capacity() const { return values.size(); }
+  size_t mask() const { return capacity() - 1; }
+  size_t maxEntries() const { return capacity() / 4 * 3; }
+
+  /**
+   * Fibonacci hashing: labels are often sequential, so spread them out by
+   * multiplying by 2^64 / phi and taking the top bits of the result.
+   */
+  size_t homeSlot(key_t key) const {
+    return (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >>
+                    (64 - capacityBits));
+  }
+
+  size_t findSlot(key_t key) const {
+    if (numEntries == 0)
+      return NOT_FOUND;
+    for (size_t slot = homeSlot(key); values[slot] != EMPTY;
+         slot = (slot + 1) & mask()) {
+      if (keys[slot] == key)
+        return slot;
+    }
+    return NOT_FOUND;
+  }
+
+  void rehash(size_t newCapacity) {
+    std::vector<key_t> oldKeys(newCapacity);
+    std::vector<value_t> oldValues(newCapacity, EMPTY);
+    oldKeys.swap(keys);
+    oldValues.swap(values);
+    capacityBits = 0;
+    while ((size_t(1) << capacityBits) < newCapacity)
+      capacityBits++;
+
+    numEntries = 0;
+    for (size_t slot = 0; slot < oldValues.size(); slot++) {
+      if (oldValues[slot] != EMPTY)
+        set(oldKeys[slot], oldValues[slot]);
+    }
+  }
+
+  std::vector<key_t> keys;
+  std::vector<value_t> values;
+  size_t numEntries = 0;
+  int capacityBits = 0;
+};
+
+} // namespace hnswlib
@@ -0,0 +1,133 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace hnswlib {
+
+/**
+ * Storage for the link lists of the upper layers of an index. Each element
+ * above level 0 needs one small block (of a few hundred bytes at most), which
+ * is carved out of large chunks rather than allocated with malloc. This saves
+ * malloc's per-block overhead and fragmentation, and lets the whole arena be
+ * freed at once. Blocks are never freed individually; to reclaim the space of
+ * removed elements, copy the remaining blocks into a new arena.
+ *
+ * allocate() is thread-safe.
+ */
+class LinkListArena {
+public:
+  // Blocks hold arrays of 32-bit integers, so this is all the alignment that
+  // they need.
+  static constexpr size_t ALIGNMENT = 4;
+  static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+
+  LinkListArena() = default;
+  LinkListArena(const LinkListArena &) = delete;
+  LinkListArena &operator=(const LinkListArena &) = delete;
+
+  /**
+   * Return a new, zero-initialized block of the given size.
+   */
+  char *allocate(size_t size) {
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (chunks.empty() || chunkUsed + size > chunkSize) {
+      addChunk(std::max(size, DEFAULT_CHUNK_SIZE));
+    }
+    char *block = chunks.back().get() + chunkUsed;
+    chunkUsed += size;
+    allocatedBytes += size;
+    return block;
+  }
+
+  /**
+   * Make sure that the next allocations, up to totalSize bytes (including
+   * padding for alignment) in total, come from a single chunk.
+   */
+  void reserve(size_t totalSize) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (chunks.empty() || chunkUsed + totalSize > chunkSize) {
+      addChunk(std::max(totalSize, DEFAULT_CHUNK_SIZE));
+    }
+  }
+
+  /**
+   * Free every block at once.
+   */
+  void clear() {
+    std::unique_lock<std::mutex> lock(mutex);
+    chunks.clear();
+    chunkUsed = 0;
+    chunkSize = 0;
+    allocatedBytes = 0;
+    reservedBytes = 0;
+  }
+
+  void swap(LinkListArena &other) {
+    std::scoped_lock lock(mutex, other.mutex);
+    chunks.swap(other.chunks);
+    std::swap(chunkUsed, other.chunkUsed);
+    std::swap(chunkSize, other.chunkSize);
+    std::swap(allocatedBytes, other.allocatedBytes);
+    std::swap(reservedBytes, other.reservedBytes);
+  }
+
+  // The number of bytes handed out by allocate().
+  size_t getAllocatedBytes() const { return allocatedBytes; }
+
+  // The number of bytes of memory used by all chunks.
+  size_t getReservedBytes() const { return reservedBytes; }
+
+private:
+  struct FreeDeleter {
+    void operator()(char *chunk) const { free(chunk); }
+  };
+
+  void addChunk(size_t size) {
+    char *chunk = (char *)calloc(size, 1);
+    if (chunk == nullptr)
+      throw std::runtime_error(
+          "Not enough memory: failed to allocate " + std::to_string(size) +
+          " bytes for linklists");
+    chunks.emplace_back(chunk);
+    chunkUsed = 0;
+    chunkSize = size;
+    reservedBytes += size;
+  }
+
+  std::mutex mutex;
+  std::vector<std::unique_ptr<char, FreeDeleter>> chunks;
+  // How much of the last chunk has been handed out already.
+  size_t chunkUsed = 0;
+  size_t chunkSize = 0;
+  size_t allocatedBytes = 0;
+  size_t reservedBytes = 0;
+};
+
+} // namespace hnswlib
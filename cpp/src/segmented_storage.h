@@ -0,0 +1,218 @@
+/*-
+ * -\-\-
+ * voyager
+ * --
+ * Copyright (C) 2016 - 2023 Spotify AB
+ * --
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ * -/-/-
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace hnswlib {
+
+/**
+ * Storage for an array of fixed-size records (like the elements of an
+ * index's base layer), split into segments of a fixed, power-of-two number of
+ * records each. Growing the array allocates new segments rather than
+ * reallocating the existing ones, so records never move, and can be read
+ * while the array grows.
+ *
+ * Records are found through a directory of segments. When the directory
+ * fills up, it's replaced by one twice the size rather than modified in
+ * place; old directories are only freed along with the storage, so readers
+ * never see one freed from under them.
+ *
+ * The first segments may be one contiguous block: allocated up front, or a
+ * block of records loaded (or memory-mapped) from a file.
+ *
+ * Records can be read from any thread while the storage is resized, but
+ * other methods must not run at the same time as each other, and only
+ * resize() may run at the same time as anything that reads records.
+ */
+class SegmentedStorage {
+public:
+  // Segments hold as many records as fit in this many bytes (rounded down to
+  // a power of two), but at least one.
+  static constexpr size_t TARGET_SEGMENT_SIZE = 1 << 16;
+
+  struct FreeDeleter {
+    void operator()(char *block) const { free(block); }
+  };
+  typedef std::unique_ptr<char, FreeDeleter> Block;
+
+  explicit SegmentedStorage(size_t recordSize = 1) { reset(recordSize); }
+
+  SegmentedStorage(const SegmentedStorage &) = delete;
+  SegmentedStorage &operator=(const SegmentedStorage &) = delete;
+
+  inline char *operator[](size_t i) const {
+    char *const *segments = directory.load(std::memory_order_acquire);
+    return segments[i >> shift] + (i & mask) * recordSize;
+  }
+
+  /**
+   * Free every record, and start storing records of the given size.
+   */
+  void reset(size_t newRecordSize) {
+    block.reset();
+    segments.clear();
+    numSegments = 0;
+    numBlockSegments = 0;
+    recordSize = newRecordSize;
+    shift = 0;
+    while (((size_t)2 << shift) * recordSize <= TARGET_SEGMENT_SIZE) {
+      shift++;
+    }
+    mask = ((size_t)1 << shift) - 1;
+  }
+
+  size_t getRecordSize() const { return recordSize; }
+  size_t getRecordsPerSegment() const { return mask + 1; }
+
+  // The number of records that can be stored without resizing.
+  size_t getCapacity() const { return numSegments << shift; }
+
+  /**
+   * Allocate a contiguous block big enough for `numRecords` records, rounded
+   * up to a whole number of segments, to be passed to adopt().
+   */
+  Block allocateBlock(size_t numRecords) const {
+    size_t size = std::max<size_t>(getNumSegments(numRecords), 1) *
+                  getRecordsPerSegment() * recordSize;
+    Block block((char *)malloc(size));
+    if (!block) {
+      throw std::runtime_error("Not enough memory: failed to allocate " +
+                               std::to_string(size) + " bytes for elements");
+    }
+    return block;
+  }
+
+  /**
+   * Replace the storage's contents with the given block (from
+   * allocateBlock()) holding the first `numRecords` records.
+   */
+  void adopt(Block newBlock, size_t numRecords) {
+    adoptUnowned(newBlock.get(), numRecords);
+    block = std::move(newBlock);
+  }
+
+  /**
+   * Replace the storage's contents with the records at `records`, which
+   * must remain valid for as long as they're used. The storage can't be
+   * made any bigger than `numRecords` records afterwards.
+   */
+  void adoptUnowned(const char *records, size_t numRecords) {
+    block.reset();
+    segments.clear();
+    numBlockSegments = getNumSegments(numRecords);
+    reserveDirectory(numBlockSegments);
+    char **entries = directory.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < numBlockSegments; i++) {
+      entries[i] = const_cast<char *>(records) +
+                   i * getRecordsPerSegment() * recordSize;
+    }
+    numSegments = numBlockSegments;
+  }
+
+  /**
+   * Make room for at least `numRecords` records, allocating or freeing
+   * segments after the first block as needed. Records that are kept don't
+   * move. (Records beyond `numRecords` may be freed, so they must no longer
+   * be read by then.)
+   */
+  void resize(size_t numRecords) {
+    size_t newNumSegments =
+        std::max(getNumSegments(numRecords), numBlockSegments);
+    if (newNumSegments > numSegments) {
+      reserveDirectory(newNumSegments);
+      char **entries = directory.load(std::memory_order_relaxed);
+      while (numSegments < newNumSegments) {
+        segments.push_back(allocateBlock(getRecordsPerSegment()));
+        entries[numSegments++] = segments.back().get();
+      }
+    } else {
+      while (numSegments > newNumSegments) {
+        segments.pop_back();
+        numSegments--;
+      }
+    }
+  }
+
+  /**
+   * Call `write(data, size)` with each contiguous run of bytes holding the
+   * first `numRecords` records, in order.
+   */
+  template <typename write_t>
+  void forEachRun(size_t numRecords, write_t write) const {
+    size_t recordsPerSegment = getRecordsPerSegment();
+    size_t blockRecords =
+        std::min(numRecords, numBlockSegments * recordsPerSegment);
+    if (blockRecords > 0) {
+      write((*this)[0], blockRecords * recordSize);
+    }
+    for (size_t start = blockRecords; start < numRecords;
+         start += recordsPerSegment) {
+      write((*this)[start],
+            std::min(recordsPerSegment, numRecords - start) * recordSize);
+    }
+  }
+
+private:
+  size_t getNumSegments(size_t numRecords) const {
+    return (numRecords + mask) >> shift;
+  }
+
+  void reserveDirectory(size_t numEntries) {
+    if (numEntries <= directoryCapacity) {
+      return;
+    }
+    size_t newCapacity = std::max<size_t>(
+        {numEntries, directoryCapacity * 2, (size_t)16});
+    std::unique_ptr<char *[]> newDirectory(new char *[newCapacity]());
+    if (numSegments > 0) {
+      std::copy(directories.back().get(),
+                directories.back().get() + numSegments, newDirectory.get());
+    }
+    directory.store(newDirectory.get(), std::memory_order_release);
+    directories.push_back(std::move(newDirectory));
+    directoryCapacity = newCapacity;
+  }
+
+  size_t recordSize;
+  size_t shift = 0;
+  size_t mask = 0;
+
+  std::atomic<char **> directory{nullptr};
+  // Every directory ever used, the current one last.
+  std::vector<std::unique_ptr<char *[]>> directories;
+  size_t directoryCapacity = 0;
+
+  size_t numSegments = 0;
+  // The first numBlockSegments segments are in `block` (or in memory owned
+  // by someone else, if `block` is null); the rest are in `segments`.
+  Block block;
+  size_t numBlockSegments = 0;
+  std::vector<Block> segments;
+};
+
+} // namespace hnswlib
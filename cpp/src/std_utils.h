@@ -23,74 +23,267 @@
 
 #pragma once
 
+#include <algorithm>
 #include <assert.h>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <ratio>
 #include <set>
 #include <stdlib.h>
 #include <thread>
+#include <vector>
 
-/*
- * replacement for the openmp '#pragma omp parallel for' directive
- * only handles a subset of functionality (no reductions etc)
- * Process ids from start (inclusive) to end (EXCLUSIVE)
+/**
+ * A fixed-size set of long-lived worker threads that execute parallel loops.
+ *
+ * Each call to `parallelFor` publishes a job to the pool, and the calling
+ * thread works on that job alongside any idle workers. Rather than splitting
+ * the range up front, every participant claims one index at a time from a
+ * shared counter, so threads that finish early keep taking work from slower
+ * ones until the whole range has been processed.
  *
- * The method is borrowed from nmslib
+ * Several threads may call `parallelFor` at once (e.g.: multiple async
+ * queries running on libuv's threadpool); their jobs share the same workers
+ * rather than each spawning their own threads, which bounds the number of
+ * busy threads to the pool's size plus the number of calling threads.
  */
-template <class Function>
-inline void ParallelFor(size_t start, size_t end, size_t numThreads,
-                        Function fn) {
-  if (numThreads <= 0) {
-    numThreads = std::thread::hardware_concurrency();
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t numThreads) { startWorkers(numThreads); }
+
+  ~ThreadPool() { stopWorkers(); }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * The process-wide pool used by ParallelFor. By default, it has one fewer
+   * worker than the number of hardware threads, as the calling thread also
+   * participates in every loop.
+   */
+  static ThreadPool &global() {
+    static ThreadPool pool(defaultNumThreads());
+    return pool;
   }
 
-  if (numThreads == 1) {
-    for (size_t id = start; id < end; id++) {
-      fn(id, 0);
+  static size_t defaultNumThreads() {
+    size_t hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+  }
+
+  size_t getNumThreads() const {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    return workers.size();
+  }
+
+  /**
+   * Change the number of worker threads. Loops that are already running are
+   * finished by the threads that remain (including their callers).
+   */
+  void setNumThreads(size_t numThreads) {
+    std::unique_lock<std::mutex> resizeLock(resizeMutex);
+    stopWorkers();
+    startWorkers(numThreads);
+  }
+
+  /**
+   * Call `fn(id, threadId)` for each id from `start` (inclusive) to `end`
+   * (exclusive), using at most `numThreads` threads including the caller.
+   * `threadId` is unique among the threads running this loop and is always
+   * less than `numThreads`, so it can be used to index per-thread buffers.
+   *
+   * If `fn` throws, no further ids are started and the exception is rethrown
+   * from this call once all threads have stopped.
+   */
+  template <class Function>
+  void parallelFor(size_t start, size_t end, size_t numThreads, Function fn) {
+    if (numThreads <= 1 || end <= start + 1) {
+      for (size_t id = start; id < end; id++) {
+        fn(id, 0);
+      }
+      return;
     }
-  } else {
-    std::vector<std::thread> threads;
-    std::atomic<size_t> current(start);
 
-    // keep track of exceptions in threads
-    // https://stackoverflow.com/a/32428427/1713196
-    std::exception_ptr lastException = nullptr;
-    std::mutex lastExceptMutex;
+    auto job = std::make_shared<Job>(start, end, numThreads, fn);
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      jobs.push_back(job);
+    }
+    for (size_t i = 1; i < numThreads; i++) {
+      jobAvailable.notify_one();
+    }
 
-    for (size_t threadId = 0; threadId < numThreads; ++threadId) {
-      threads.push_back(std::thread([&, threadId] {
-        while (true) {
-          size_t id = current.fetch_add(1);
+    job->run(0);
 
-          if ((id >= end)) {
-            break;
-          }
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      auto position = std::find(jobs.begin(), jobs.end(), job);
+      if (position != jobs.end()) {
+        jobs.erase(position);
+      }
+    }
+
+    job->wait();
+  }
+
+private:
+  struct Job {
+    Job(size_t start, size_t end, size_t maxThreads,
+        std::function<void(size_t, size_t)> fn)
+        : fn(std::move(fn)), current(start), end(end), maxThreads(maxThreads),
+          nextThreadId(1), activeThreads(1) {}
+
+    /**
+     * Try to reserve a slot in this job for another thread, returning false
+     * if the job already has as many threads as it's allowed, or has no work
+     * left to hand out.
+     */
+    bool join(size_t &threadId) {
+      if (current.load() >= end) {
+        return false;
+      }
+      threadId = nextThreadId.fetch_add(1);
+      if (threadId >= maxThreads) {
+        return false;
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      activeThreads++;
+      return true;
+    }
+
+    bool isFull() const {
+      return nextThreadId.load() >= maxThreads || current.load() >= end;
+    }
+
+    void run(size_t threadId) {
+      while (true) {
+        size_t id = current.fetch_add(1);
+
+        if ((id >= end)) {
+          break;
+        }
 
-          try {
-            fn(id, threadId);
-          } catch (...) {
-            std::unique_lock<std::mutex> lastExcepLock(lastExceptMutex);
+        try {
+          fn(id, threadId);
+        } catch (...) {
+          std::unique_lock<std::mutex> lastExcepLock(mutex);
+          if (!lastException) {
             lastException = std::current_exception();
-            /*
-             * This will work even when current is the largest value that
-             * size_t can fit, because fetch_add returns the previous value
-             * before the increment (what will result in overflow
-             * and produce 0 instead of current + 1).
-             */
-            current = end;
-            break;
           }
+          /*
+           * This will work even when current is the largest value that
+           * size_t can fit, because fetch_add returns the previous value
+           * before the increment (what will result in overflow
+           * and produce 0 instead of current + 1).
+           */
+          current = end;
+          break;
         }
-      }));
+      }
+
+      std::unique_lock<std::mutex> lock(mutex);
+      if (--activeThreads == 0) {
+        finished.notify_all();
+      }
+    }
+
+    /**
+     * Wait for every thread that joined this job to finish, then rethrow the
+     * first exception thrown by `fn`, if any.
+     */
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex);
+      finished.wait(lock, [this] { return activeThreads == 0; });
+      if (lastException) {
+        std::rethrow_exception(lastException);
+      }
     }
-    for (auto &thread : threads) {
-      thread.join();
+
+    std::function<void(size_t, size_t)> fn;
+    std::atomic<size_t> current;
+    const size_t end;
+    const size_t maxThreads;
+    std::atomic<size_t> nextThreadId;
+    size_t activeThreads;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::exception_ptr lastException = nullptr;
+  };
+
+  void startWorkers(size_t numThreads) {
+    std::unique_lock<std::mutex> lock(queueMutex);
+    stopping = false;
+    for (size_t i = 0; i < numThreads; i++) {
+      workers.emplace_back([this] { workerLoop(); });
     }
-    if (lastException) {
-      std::rethrow_exception(lastException);
+  }
+
+  void stopWorkers() {
+    std::vector<std::thread> stoppedWorkers;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      stopping = true;
+      stoppedWorkers.swap(workers);
+    }
+    jobAvailable.notify_all();
+    for (auto &worker : stoppedWorkers) {
+      worker.join();
+    }
+  }
+
+  void workerLoop() {
+    while (true) {
+      std::shared_ptr<Job> job;
+      size_t threadId = 0;
+      {
+        std::unique_lock<std::mutex> lock(queueMutex);
+        jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (stopping) {
+          return;
+        }
+
+        job = jobs.front();
+        bool joined = job->join(threadId);
+        if (job->isFull()) {
+          jobs.pop_front();
+        }
+        if (!joined) {
+          continue;
+        }
+      }
+      job->run(threadId);
     }
   }
+
+  mutable std::mutex queueMutex;
+  std::mutex resizeMutex;
+  std::condition_variable jobAvailable;
+  std::deque<std::shared_ptr<Job>> jobs;
+  std::vector<std::thread> workers;
+  bool stopping = false;
+};
+
+/*
+ * replacement for the openmp '#pragma omp parallel for' directive
+ * only handles a subset of functionality (no reductions etc)
+ * Process ids from start (inclusive) to end (EXCLUSIVE)
+ *
+ * Runs on the process-wide ThreadPool rather than creating new threads.
+ */
+template <class Function>
+inline void ParallelFor(size_t start, size_t end, size_t numThreads,
+                        Function fn) {
+  if (numThreads <= 0) {
+    numThreads = std::thread::hardware_concurrency();
+  }
+
+  ThreadPool::global().parallelFor(start, end, numThreads, fn);
 }
 
 /**
@@ -140,3 +333,42 @@ void mergePriorityQueues(
   while (dest.size() > maxElements)
     dest.pop();
 }
+
+/**
+ * A thread-safe pool of reusable objects, for working memory that's too
+ * expensive to allocate on every call. Objects are created on demand, and
+ * acquire()'s handle returns its object to the pool when it's destroyed, so
+ * the pool must outlive every handle.
+ */
+template <typename T> class ObjectPool {
+public:
+  struct Releaser {
+    ObjectPool *pool;
+    void operator()(T *object) const { pool->release(object); }
+  };
+  typedef std::unique_ptr<T, Releaser> Handle;
+
+  Handle acquire() {
+    std::unique_ptr<T> object;
+    {
+      std::unique_lock<std::mutex> lock(guard);
+      if (!available.empty()) {
+        object = std::move(available.back());
+        available.pop_back();
+      }
+    }
+    if (!object) {
+      object = std::make_unique<T>();
+    }
+    return Handle(object.release(), Releaser{this});
+  }
+
+private:
+  void release(T *object) {
+    std::unique_lock<std::mutex> lock(guard);
+    available.emplace_back(object);
+  }
+
+  std::mutex guard;
+  std::vector<std::unique_ptr<T>> available;
+};
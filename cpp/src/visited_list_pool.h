@@ -23,9 +23,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <deque>
+#include <memory>
 #include <mutex>
 #include <string.h>
+#include <vector>
 
 namespace hnswlib {
 typedef unsigned short int vl_type;
@@ -52,6 +55,157 @@ public:
 
   ~VisitedList() { delete[] mass; }
 };
+
+/**
+ * A set of visited element IDs whose size is proportional to the number of
+ * elements visited, rather than to the size of the index like VisitedList:
+ * an open-addressing hash table that doubles in size whenever it's half full.
+ * Each slot is tagged with the search it belongs to, so like VisitedList, it
+ * can be reset without clearing its memory.
+ */
+class VisitedHashSet {
+public:
+  VisitedHashSet(size_t expectedSize) { reserve(expectedSize); }
+
+  // Empty the set, making room for at least `expectedSize` elements.
+  void reset(size_t expectedSize) {
+    size = 0;
+    curV++;
+    if (curV == 0) {
+      std::fill(slots.begin(), slots.end(), Slot());
+      curV++;
+    }
+    if (expectedSize * 2 > slots.size()) {
+      reserve(expectedSize);
+    }
+  }
+
+  // Add `id` to the set, returning false if it was already there.
+  inline bool insert(unsigned int id) {
+    size_t i = slotIndex(id);
+    while (slots[i].tag == curV) {
+      if (slots[i].id == id) {
+        return false;
+      }
+      i = (i + 1) & mask;
+    }
+    slots[i] = {id, curV};
+    if (++size * 2 > slots.size()) {
+      grow();
+    }
+    return true;
+  }
+
+  // The address that insert(id) will look at first, for prefetching.
+  inline const void *slotFor(unsigned int id) const {
+    return &slots[slotIndex(id)];
+  }
+
+private:
+  struct Slot {
+    unsigned int id = 0;
+    unsigned int tag = 0;
+  };
+
+  std::vector<Slot> slots;
+  size_t mask = 0;
+  int shift = 0;
+  size_t size = 0;
+  unsigned int curV = 1;
+
+  // Fibonacci hashing: the top bits of the product are well mixed even for
+  // the consecutive IDs that neighbors often have.
+  inline size_t slotIndex(unsigned int id) const {
+    return (size_t)((id * 0x9E3779B97F4A7C15ULL) >> shift) & mask;
+  }
+
+  void reserve(size_t expectedSize) {
+    size_t capacity = 16;
+    while (capacity < expectedSize * 2) {
+      capacity *= 2;
+    }
+    slots.assign(capacity, Slot());
+    mask = capacity - 1;
+    shift = 64;
+    for (size_t c = capacity; c > 1; c >>= 1) {
+      shift--;
+    }
+    curV = 1;
+  }
+
+  void grow() {
+    std::vector<Slot> oldSlots;
+    oldSlots.swap(slots);
+    unsigned int oldV = curV;
+    reserve(oldSlots.size());
+    for (const Slot &slot : oldSlots) {
+      if (slot.tag == oldV) {
+        size_t i = slotIndex(slot.id);
+        while (slots[i].tag == curV) {
+          i = (i + 1) & mask;
+        }
+        slots[i] = {slot.id, curV};
+      }
+    }
+  }
+};
+
+/**
+ * VisitedList and VisitedHashSet, behind the same interface, so that a search
+ * can be written once for both.
+ */
+class VisitedListRef {
+public:
+  VisitedListRef(VisitedList *vl)
+      : mass(vl->mass), curV(vl->curV), numelements(vl->numelements) {}
+
+  // Mark `id` as visited, returning false if it already was.
+  inline bool insert(unsigned int id) {
+    if (id >= numelements) {
+      return insertBeyondList(id);
+    }
+    if (mass[id] == curV) {
+      return false;
+    }
+    mass[id] = curV;
+    return true;
+  }
+
+  inline const void *slotFor(unsigned int id) const {
+    return mass + (id < numelements ? id : 0);
+  }
+
+private:
+  vl_type *mass;
+  vl_type curV;
+  unsigned int numelements;
+  // IDs too big for the list (of elements added to an index that grew while
+  // it was being searched), which are tracked separately so that the search
+  // still visits them and their neighbors.
+  std::unique_ptr<VisitedHashSet> beyondList;
+
+  bool insertBeyondList(unsigned int id) {
+    if (!beyondList) {
+      beyondList = std::make_unique<VisitedHashSet>(16);
+    }
+    return beyondList->insert(id);
+  }
+};
+
+class VisitedHashSetRef {
+public:
+  VisitedHashSetRef(VisitedHashSet *set) : set(set) {}
+
+  inline bool insert(unsigned int id) { return set->insert(id); }
+
+  inline const void *slotFor(unsigned int id) const {
+    return set->slotFor(id);
+  }
+
+private:
+  VisitedHashSet *set;
+};
+
 ///////////////////////////////////////////////////////////
 //
 // Class for multi-threaded pool-management of VisitedLists
@@ -60,6 +214,7 @@ public:
 
 class VisitedListPool {
   std::deque<VisitedList *> pool;
+  std::deque<VisitedHashSet *> hashSetPool;
   std::mutex poolguard;
   int numelements;
 
@@ -71,31 +226,74 @@ public:
   }
 
   VisitedList *getFreeVisitedList() {
-    VisitedList *rez;
+    VisitedList *rez = nullptr;
+    unsigned int size;
     {
       std::unique_lock<std::mutex> lock(poolguard);
+      size = numelements;
       if (pool.size() > 0) {
         rez = pool.front();
         pool.pop_front();
-      } else {
-        rez = new VisitedList(numelements);
       }
     }
+    // Lists from before the index grew are too small to reuse.
+    if (rez && rez->numelements < size) {
+      delete rez;
+      rez = nullptr;
+    }
+    if (!rez) {
+      rez = new VisitedList(size);
+    }
     rez->reset();
     return rez;
   };
 
+  // Make the lists handed out from now on big enough for `numelements1`
+  // elements. Lists already handed out keep their size.
+  void setNumElements(int numelements1) {
+    std::unique_lock<std::mutex> lock(poolguard);
+    numelements = numelements1;
+  }
+
   void releaseVisitedList(VisitedList *vl) {
     std::unique_lock<std::mutex> lock(poolguard);
     pool.push_front(vl);
   };
 
+  // As getFreeVisitedList, but for a search expected to visit about
+  // `expectedSize` elements.
+  VisitedHashSet *getFreeVisitedHashSet(size_t expectedSize) {
+    VisitedHashSet *rez = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(poolguard);
+      if (hashSetPool.size() > 0) {
+        rez = hashSetPool.front();
+        hashSetPool.pop_front();
+      }
+    }
+    if (rez) {
+      rez->reset(expectedSize);
+    } else {
+      rez = new VisitedHashSet(expectedSize);
+    }
+    return rez;
+  }
+
+  void releaseVisitedHashSet(VisitedHashSet *set) {
+    std::unique_lock<std::mutex> lock(poolguard);
+    hashSetPool.push_front(set);
+  }
+
   ~VisitedListPool() {
     while (pool.size()) {
       VisitedList *rez = pool.front();
       pool.pop_front();
       delete rez;
     }
+    while (hashSetPool.size()) {
+      delete hashSetPool.front();
+      hashSetPool.pop_front();
+    }
   };
 };
 } // namespace hnswlib
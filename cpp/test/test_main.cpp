@@ -1,9 +1,13 @@
 #include "doctest.h"
 
+#include "ShardedIndex.h"
 #include "TypedIndex.h"
 #include "test_utils.cpp"
+#include <filesystem>
+#include <set>
 #include <tuple>
 #include <type_traits>
+#include <unordered_set>
 
 template <typename dist_t, typename data_t = dist_t,
           typename scalefactor = std::ratio<1, 1>>
@@ -178,6 +182,21 @@ TEST_CASE("Test combinations of different instantiations. Test that each "
   }
 }
 
+TEST_CASE("Test queries of common embedding sizes find each vector itself") {
+  // These sizes use distance kernels specialized for them, and (without
+  // normalization) Float32 queries are searched for without being copied:
+  for (int numDimensions : {384, 768}) {
+    for (SpaceType spaceType :
+         {SpaceType::Euclidean, SpaceType::InnerProduct, SpaceType::Cosine}) {
+      CAPTURE(numDimensions);
+      CAPTURE(spaceType);
+      auto index = TypedIndex<float>(spaceType, numDimensions);
+      testQuery(index, 200, numDimensions, spaceType, StorageDataType::Float32,
+                false, 0.00001f, 1);
+    }
+  }
+}
+
 TEST_CASE(
     "Test vectorsToNDArray converts 2D vector of float to NDArray<float,2>") {
   std::vector<std::vector<float>> vectors = {{1.0f, 2.0f, 3.0f, 4.0f},
@@ -216,3 +235,1723 @@ TEST_CASE(
       {1.0f}, {5.0f, 6.0f, 7.0f}, {9.0f, 10.0f, 11.0f}};
   REQUIRE_THROWS_AS(vectorsToNDArray(vectors2), std::invalid_argument);
 }
+
+TEST_CASE("Test memory-mapped search-only indices return the same results as "
+          "fully-loaded indices") {
+  int numDimensions = 16;
+  int numVectors = 500;
+  std::string path =
+      (std::filesystem::temp_directory_path() /
+       ("voyager_mmap_test_" + std::to_string(rand()) + ".voy"))
+          .string();
+
+  auto index = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  index.addItems(inputData);
+  index.markDeleted(0);
+  index.saveIndex(path);
+
+  auto fileStream = std::make_shared<FileInputStream>(path);
+  std::unique_ptr<Index> loaded = loadTypedIndexFromMetadata(
+      voyager::Metadata::loadFromStream(fileStream), fileStream);
+
+  auto mappedStream = std::make_shared<MemoryMappedInputStream>(path);
+  std::unique_ptr<Index> mapped = loadTypedIndexFromMetadata(
+      voyager::Metadata::loadFromStream(mappedStream), mappedStream,
+      /* searchOnly */ true);
+
+  REQUIRE(mapped->getNumElements() == loaded->getNumElements());
+  REQUIRE(mapped->getNumDimensions() == numDimensions);
+
+  auto [expectedLabels, expectedDistances] = loaded->query(inputData, 5);
+  auto [labels, distances] = mapped->query(inputData, 5);
+  REQUIRE(labels.data == expectedLabels.data);
+  REQUIRE(distances.data == expectedDistances.data);
+
+  // The deleted element must still be skipped, even though deletions aren't
+  // counted when loading from a mapped file:
+  auto [singleLabels, singleDistances] = mapped->query(inputData[0], 1);
+  REQUIRE(singleLabels[0] != 0);
+
+  REQUIRE_THROWS_AS(mapped->addItem(inputData[0], std::nullopt),
+                    std::runtime_error);
+
+  mapped.reset();
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Test filtered queries only return allowed labels") {
+  int numDimensions = 8;
+  int numVectors = 1000;
+  auto index = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  index.addItems(inputData);
+
+  std::vector<hnswlib::labeltype> evenLabels;
+  for (int i = numVectors - 2; i >= 0; i -= 2) {
+    evenLabels.push_back(i);
+  }
+  hnswlib::SortedLabelFilter evenFilter(evenLabels);
+
+  auto [labels, distances] = index.query(inputData, 10, -1, -1, &evenFilter);
+  for (hnswlib::labeltype label : labels.data) {
+    REQUIRE(label % 2 == 0);
+  }
+  for (int i = 0; i < numVectors; i += 2) {
+    REQUIRE(labels[i][0] == (hnswlib::labeltype)i);
+  }
+
+  std::vector<uint8_t> bitmap(100 / 8 + 1, 0);
+  for (int i = 0; i < 100; i++) {
+    bitmap[i / 8] |= 1 << (i % 8);
+  }
+  hnswlib::LabelBitmapFilter bitmapFilter(bitmap);
+
+  auto [singleLabels, singleDistances] =
+      index.query(inputData[500], 10, -1, &bitmapFilter);
+  for (hnswlib::labeltype label : singleLabels) {
+    REQUIRE(label < 100);
+  }
+
+  // Requesting more neighbors than there are allowed labels can't succeed:
+  hnswlib::SortedLabelFilter tinyFilter({1, 2, 3});
+  REQUIRE_THROWS_AS(index.query(inputData[0], 5, -1, &tinyFilter), RecallError);
+}
+
+TEST_CASE("Test per-query search stats add up to the index's totals") {
+  int numDimensions = 8;
+  int numVectors = 1000;
+  auto index = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  index.addItems(inputData);
+  index.resetSearchStats();
+  REQUIRE(index.getSearchStats().searches == 0);
+
+  std::vector<hnswlib::SearchStats> queryStats;
+  index.query(inputData, 10, -1, 50, nullptr, &queryStats);
+  REQUIRE(queryStats.size() == (size_t)numVectors);
+
+  hnswlib::SearchStats sum;
+  for (const hnswlib::SearchStats &stats : queryStats) {
+    REQUIRE(stats.searches == 1);
+    REQUIRE(stats.hops > 0);
+    REQUIRE(stats.visitedNodes >= 50);
+    REQUIRE(stats.distanceComputations >= stats.visitedNodes);
+    REQUIRE(stats.visitedNodes <= (size_t)numVectors);
+    sum += stats;
+  }
+
+  hnswlib::SearchStats single;
+  index.query(inputData[0], 10, 50, nullptr, &single);
+  REQUIRE(single.searches == 1);
+  sum += single;
+
+  hnswlib::SearchStats totals = index.getSearchStats();
+  REQUIRE(totals.searches == sum.searches);
+  REQUIRE(totals.hops == sum.hops);
+  REQUIRE(totals.distanceComputations == sum.distanceComputations);
+  REQUIRE(totals.visitedNodes == sum.visitedNodes);
+  REQUIRE(totals.elapsedSeconds > 0);
+
+  index.resetSearchStats();
+  REQUIRE(index.getSearchStats().distanceComputations == 0);
+
+  // Searches are counted even if they aren't asked for their stats, but
+  // they aren't timed:
+  index.query(inputData[0], 10);
+  REQUIRE(index.getSearchStats().searches == 1);
+  REQUIRE(index.getSearchStats().hops > 0);
+  REQUIRE(index.getSearchStats().elapsedSeconds == 0);
+}
+
+TEST_CASE("Test range searches find the items within the radius") {
+  int numDimensions = 8;
+  int numVectors = 2000;
+  int numQueries = 50;
+  auto index = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  index.addItems(inputData);
+
+  // Pick a radius that includes around 1% of the items for a typical query:
+  std::vector<float> allDistances;
+  for (int i = 0; i < numVectors; i++) {
+    allDistances.push_back(index.getDistance(inputData[0], inputData[i]));
+  }
+  std::sort(allDistances.begin(), allDistances.end());
+  float radius = allDistances[numVectors / 100];
+
+  std::vector<std::vector<float>> queries(inputData.begin(),
+                                          inputData.begin() + numQueries);
+  RangeSearchResults batch =
+      index.rangeSearch(vectorsToNDArray(queries), radius);
+  REQUIRE(batch.offsets.size() == (size_t)numQueries + 1);
+  REQUIRE(batch.labels.size() == batch.offsets.back());
+
+  size_t expectedTotal = 0;
+  size_t foundTotal = 0;
+  for (int q = 0; q < numQueries; q++) {
+    std::set<hnswlib::labeltype> expected;
+    for (int i = 0; i < numVectors; i++) {
+      if (index.getDistance(queries[q], inputData[i]) <= radius) {
+        expected.insert(i);
+      }
+    }
+
+    auto [labels, distances] = index.rangeSearch(queries[q], radius);
+    REQUIRE(labels.size() == batch.offsets[q + 1] - batch.offsets[q]);
+    for (size_t i = 0; i < labels.size(); i++) {
+      REQUIRE(labels[i] == batch.labels[batch.offsets[q] + i]);
+      REQUIRE(distances[i] == batch.distances[batch.offsets[q] + i]);
+      REQUIRE(distances[i] <= radius);
+      if (i > 0) {
+        REQUIRE(distances[i - 1] <= distances[i]);
+      }
+      REQUIRE(expected.count(labels[i]) == 1);
+    }
+    // Every query is an item in the index, so it always finds itself:
+    REQUIRE(labels[0] == (hnswlib::labeltype)q);
+
+    expectedTotal += expected.size();
+    foundTotal += labels.size();
+  }
+  REQUIRE(foundTotal >= expectedTotal * 0.95);
+
+  // With maxResults, the nearest items are returned:
+  auto [limitedLabels, limitedDistances] =
+      index.rangeSearch(queries[0], radius, 5);
+  auto [nearestLabels, nearestDistances] = index.query(queries[0], 5);
+  REQUIRE(limitedLabels.size() == 5);
+  REQUIRE(limitedLabels == nearestLabels);
+
+  // Filters apply to range searches too:
+  std::vector<hnswlib::labeltype> evenLabels;
+  for (int i = numVectors - 2; i >= 0; i -= 2) {
+    evenLabels.push_back(i);
+  }
+  hnswlib::SortedLabelFilter evenFilter(evenLabels);
+  auto [evenResults, evenDistances] =
+      index.rangeSearch(queries[0], radius, 0, -1, &evenFilter);
+  REQUIRE(!evenResults.empty());
+  for (hnswlib::labeltype label : evenResults) {
+    REQUIRE(label % 2 == 0);
+  }
+
+  // A radius smaller than any distance finds nothing:
+  auto [noLabels, noDistances] = index.rangeSearch(queries[1], -1.0f);
+  REQUIRE(noLabels.empty());
+
+  REQUIRE_THROWS(index.rangeSearch(std::vector<float>(3), radius));
+}
+
+TEST_CASE("Test compact removes deleted elements and keeps recall") {
+  int numDimensions = 16;
+  int numVectors = 2000;
+  auto index = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  index.addItems(inputData);
+
+  // Delete every third element, including the entry point's neighborhood:
+  std::vector<std::vector<float>> remainingData;
+  std::vector<hnswlib::labeltype> remainingLabels;
+  for (int i = 0; i < numVectors; i++) {
+    if (i % 3 == 0) {
+      index.markDeleted(i);
+    } else {
+      remainingData.push_back(inputData[i]);
+      remainingLabels.push_back(i);
+    }
+  }
+
+  REQUIRE(index.compact() == (size_t)(numVectors + 2) / 3);
+  REQUIRE(index.getNumElements() == remainingData.size());
+  REQUIRE(index.getMaxElements() == remainingData.size());
+  REQUIRE(index.getIDsCount() == (long long)remainingData.size());
+  REQUIRE(index.compact() == 0);
+
+  std::vector<hnswlib::labeltype> ids = index.getIDs();
+  std::sort(ids.begin(), ids.end());
+  REQUIRE(ids == remainingLabels);
+  REQUIRE_THROWS(index.getVector(0));
+  REQUIRE(index.getVector(1) == inputData[1]);
+
+  auto [labels, distances] = index.query(remainingData, 1);
+  int numFound = 0;
+  for (size_t i = 0; i < remainingData.size(); i++) {
+    numFound += labels[i][0] == remainingLabels[i];
+  }
+  REQUIRE(numFound >= 0.99 * remainingData.size());
+
+  // The compacted index can still grow and be reloaded:
+  index.addItem(inputData[0], 0);
+  REQUIRE(std::get<0>(index.query(inputData[0], 1))[0] == 0);
+  std::string path =
+      (std::filesystem::temp_directory_path() /
+       ("voyager_compact_test_" + std::to_string(rand()) + ".voy"))
+          .string();
+  index.saveIndex(path);
+  auto fileStream = std::make_shared<FileInputStream>(path);
+  std::unique_ptr<Index> reloaded = loadTypedIndexFromMetadata(
+      voyager::Metadata::loadFromStream(fileStream), fileStream);
+  REQUIRE(reloaded->getNumElements() == remainingData.size() + 1);
+  auto [reloadedLabels, reloadedDistances] = reloaded->query(remainingData, 1);
+  REQUIRE(reloadedLabels.data == labels.data);
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Test compact waits for concurrent additions and deletions") {
+  int numDimensions = 16;
+  int numVectors = 2000;
+  int numAdded = 200;
+  auto index = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors + numAdded, numDimensions);
+  index.addItems(std::vector<std::vector<float>>(
+      inputData.begin(), inputData.begin() + numVectors));
+  for (int i = 0; i < numVectors / 2; i += 2) {
+    index.markDeleted(i);
+  }
+
+  // Delete and add more elements while the first deletions are compacted:
+  std::thread writer([&]() {
+    for (int i = numVectors / 2; i < numVectors; i += 2) {
+      index.markDeleted(i);
+    }
+    for (int i = numVectors; i < numVectors + numAdded; i++) {
+      index.addItem(inputData[i], i);
+    }
+  });
+  size_t numRemoved = index.compact(4);
+  writer.join();
+  numRemoved += index.compact(4);
+
+  REQUIRE(numRemoved == (size_t)numVectors / 2);
+  REQUIRE(index.getNumElements() == (size_t)(numVectors / 2 + numAdded));
+  std::vector<std::vector<float>> remainingData;
+  std::vector<hnswlib::labeltype> remainingLabels;
+  for (int i = 1; i < numVectors + numAdded; i += i < numVectors ? 2 : 1) {
+    remainingData.push_back(inputData[i]);
+    remainingLabels.push_back(i);
+  }
+  auto [labels, distances] = index.query(remainingData, 1);
+  int numFound = 0;
+  for (size_t i = 0; i < remainingData.size(); i++) {
+    numFound += labels[i][0] == remainingLabels[i];
+  }
+  REQUIRE(numFound >= 0.99 * remainingData.size());
+}
+
+TEST_CASE("Test replaceDeleted reuses the slots of deleted elements") {
+  int numDimensions = 16;
+  int numVectors = 2000;
+  auto index = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  index.addItems(inputData);
+  size_t maxElements = index.getMaxElements();
+
+  int numDeleted = numVectors / 4;
+  for (int i = 0; i < numDeleted; i++) {
+    index.markDeleted(i);
+  }
+
+  // New labels take the slots of the deleted elements instead of growing:
+  std::vector<std::vector<float>> newData =
+      randomVectors(numDeleted, numDimensions);
+  std::vector<hnswlib::labeltype> newLabels;
+  for (int i = 0; i < numDeleted; i++) {
+    newLabels.push_back(numVectors + i);
+  }
+  index.addItems(newData, newLabels, 2, true);
+  REQUIRE(index.getNumElements() == (size_t)numVectors);
+  REQUIRE(index.getMaxElements() == maxElements);
+  REQUIRE(index.getIDsCount() == numVectors);
+  for (int i = 0; i < numDeleted; i++) {
+    REQUIRE_THROWS(index.getVector(i));
+    REQUIRE(index.getVector(numVectors + i) == newData[i]);
+  }
+
+  auto [labels, distances] = index.query(newData, 1);
+  int numFound = 0;
+  for (int i = 0; i < numDeleted; i++) {
+    numFound += labels[i][0] == newLabels[i];
+  }
+  REQUIRE(numFound >= 0.99 * numDeleted);
+
+  std::vector<std::vector<float>> keptData(inputData.begin() + numDeleted,
+                                           inputData.end());
+  auto [keptLabels, keptDistances] = index.query(keptData, 1);
+  numFound = 0;
+  for (size_t i = 0; i < keptData.size(); i++) {
+    numFound += keptLabels[i][0] == (hnswlib::labeltype)(numDeleted + i);
+  }
+  REQUIRE(numFound >= 0.99 * keptData.size());
+
+  // Without free slots, replaceDeleted falls back to appending:
+  index.addItem(inputData[0], 0, true);
+  REQUIRE(index.getNumElements() == (size_t)numVectors + 1);
+  REQUIRE(std::get<0>(index.query(inputData[0], 1))[0] == 0);
+}
+
+TEST_CASE("Test reorder keeps labels and query results") {
+  int numDimensions = 16;
+  int numVectors = 2000;
+  auto index = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  index.addItems(inputData);
+  for (int i = 0; i < numVectors; i += 10) {
+    index.markDeleted(i);
+  }
+
+  auto [labels, distances] = index.query(inputData, 5);
+  index.reorder();
+  auto [reorderedLabels, reorderedDistances] = index.query(inputData, 5);
+  REQUIRE(reorderedLabels.data == labels.data);
+  REQUIRE(reorderedDistances.data == distances.data);
+
+  REQUIRE(index.getNumElements() == (size_t)numVectors);
+  REQUIRE(index.getIDsCount() == numVectors);
+  REQUIRE_THROWS(index.getVector(0));
+  REQUIRE(index.getVector(1) == inputData[1]);
+
+  // Deleted elements are still known by their new IDs:
+  REQUIRE(index.compact() == (size_t)numVectors / 10);
+  REQUIRE(index.getNumElements() == (size_t)(numVectors - numVectors / 10));
+  index.addItem(inputData[0], 0, true);
+  REQUIRE(std::get<0>(index.query(inputData[0], 1))[0] == 0);
+}
+
+TEST_CASE("Test loading restores labels, links and deleted elements") {
+  // More elements than fit in one chunk of the parallel load:
+  int numDimensions = 4;
+  int numVectors = 70000;
+  auto index = TypedIndex<float>(SpaceType::Euclidean, numDimensions, 8, 20);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  std::vector<hnswlib::labeltype> labels;
+  for (int i = 0; i < numVectors; i++) {
+    labels.push_back(i * 3 + 1);
+  }
+  index.addItems(inputData, labels);
+  for (int i = 0; i < numVectors; i += 7) {
+    index.markDeleted(labels[i]);
+  }
+
+  std::string path =
+      (std::filesystem::temp_directory_path() /
+       ("voyager_load_test_" + std::to_string(rand()) + ".voy"))
+          .string();
+  index.saveIndex(path);
+  auto fileStream = std::make_shared<FileInputStream>(path);
+  std::unique_ptr<Index> reloaded = loadTypedIndexFromMetadata(
+      voyager::Metadata::loadFromStream(fileStream), fileStream);
+  std::remove(path.c_str());
+
+  REQUIRE(reloaded->getNumElements() == (size_t)numVectors);
+  REQUIRE(reloaded->getIDsCount() == numVectors);
+  std::vector<std::vector<float>> queries(inputData.begin(),
+                                          inputData.begin() + 1000);
+  auto [expectedLabels, expectedDistances] = index.query(queries, 5);
+  auto [actualLabels, actualDistances] = reloaded->query(queries, 5);
+  REQUIRE(actualLabels.data == expectedLabels.data);
+  REQUIRE(reloaded->getVector(labels[1]) == inputData[1]);
+  REQUIRE_THROWS(reloaded->getVector(labels[0]));
+  REQUIRE(reloaded->compact() == (size_t)(numVectors + 6) / 7);
+}
+
+TEST_CASE("Test buildFromArray is deterministic and keeps recall") {
+  // More elements than are inserted one at a time, so batches are used too:
+  int numDimensions = 16;
+  int numVectors = 5000;
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  NDArray<float, 2> input = vectorsToNDArray(inputData);
+
+  auto singleThreaded = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  std::vector<std::pair<size_t, size_t>> progress;
+  std::vector<hnswlib::labeltype> ids = singleThreaded.buildFromArray(
+      input, {}, 1, [&](size_t numAdded, size_t numTotal) {
+        progress.push_back({numAdded, numTotal});
+      });
+  REQUIRE(ids.size() == (size_t)numVectors);
+  REQUIRE(ids[numVectors - 1] == (hnswlib::labeltype)(numVectors - 1));
+  REQUIRE(singleThreaded.getNumElements() == (size_t)numVectors);
+  REQUIRE(singleThreaded.getMaxElements() == (size_t)numVectors);
+  REQUIRE(!progress.empty());
+  REQUIRE(progress.back() ==
+          std::make_pair((size_t)numVectors, (size_t)numVectors));
+  for (size_t i = 1; i < progress.size(); i++) {
+    REQUIRE(progress[i].first > progress[i - 1].first);
+  }
+
+  auto [labels, distances] = singleThreaded.query(inputData, 5);
+  int numFound = 0;
+  for (int i = 0; i < numVectors; i++) {
+    numFound += labels[i][0] == (hnswlib::labeltype)i;
+  }
+  REQUIRE(numFound >= 0.99 * numVectors);
+
+  // The graph doesn't depend on the number of threads used to build it:
+  auto multiThreaded = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  multiThreaded.buildFromArray(input, {}, 4);
+  auto [multiThreadedLabels, multiThreadedDistances] =
+      multiThreaded.query(inputData, 5);
+  REQUIRE(multiThreadedLabels.data == labels.data);
+  REQUIRE(multiThreadedDistances.data == distances.data);
+
+  // Bulk-built indices can still grow:
+  std::vector<float> extra = randomVectors(1, numDimensions)[0];
+  singleThreaded.addItem(extra, numVectors);
+  REQUIRE(std::get<0>(singleThreaded.query(extra, 1))[0] ==
+          (hnswlib::labeltype)numVectors);
+  REQUIRE_THROWS(singleThreaded.buildFromArray(input));
+
+  // Duplicate labels are rejected without adding anything:
+  auto duplicates = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  REQUIRE_THROWS_AS(duplicates.buildFromArray(vectorsToNDArray({inputData[0],
+                                                                inputData[1]}),
+                                              {7, 7}),
+                    std::invalid_argument);
+  REQUIRE(duplicates.getNumElements() == 0);
+  duplicates.buildFromArray(vectorsToNDArray({inputData[0], inputData[1]}),
+                            {7, 8});
+  REQUIRE(std::get<0>(duplicates.query(inputData[1], 1))[0] == 8);
+
+  // So is a build that fails part of the way through:
+  auto cancelled = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  REQUIRE_THROWS_AS(cancelled.buildFromArray(input, {}, 2,
+                                             [](size_t numAdded, size_t) {
+                                               if (numAdded > 2000) {
+                                                 throw std::runtime_error(
+                                                     "Cancelled");
+                                               }
+                                             }),
+                    std::runtime_error);
+  REQUIRE(cancelled.getNumElements() == 0);
+  REQUIRE(cancelled.getIDsCount() == 0);
+  // ...and retrying it assigns the same IDs and builds the same graph:
+  REQUIRE(cancelled.buildFromArray(input, {}, 2) == ids);
+  auto [retriedLabels, retriedDistances] = cancelled.query(inputData, 5);
+  REQUIRE(retriedLabels.data == labels.data);
+  REQUIRE(retriedDistances.data == distances.data);
+
+  // The progress callback can search the index while it's being built, but
+  // can't change it:
+  auto searched = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  size_t numSearches = 0;
+  searched.buildFromArray(input, {}, 2, [&](size_t numAdded, size_t numTotal) {
+    auto [progressLabels, progressDistances] = searched.query(inputData[0], 1);
+    numSearches++;
+    if (numAdded == numTotal) {
+      REQUIRE(progressLabels[0] == 0);
+    }
+    REQUIRE_THROWS(searched.resizeIndex(2 * numVectors));
+  });
+  REQUIRE(numSearches == progress.size());
+  REQUIRE(searched.getMaxElements() == (size_t)numVectors);
+}
+
+TEST_CASE("Test serializing into an exactly-sized buffer") {
+  int numDimensions = 8;
+  auto index = TypedIndex<float>(SpaceType::Cosine, numDimensions);
+  index.addItems(randomVectors(500, numDimensions));
+
+  auto countingStream = std::make_shared<CountingOutputStream>();
+  index.saveIndex(countingStream);
+  auto memoryStream = std::make_shared<MemoryOutputStream>();
+  index.saveIndex(memoryStream);
+  std::string expected = memoryStream->getValue();
+  REQUIRE(countingStream->getCount() == expected.size());
+
+  std::vector<char> buffer(expected.size());
+  auto bufferStream =
+      std::make_shared<BufferOutputStream>(buffer.data(), buffer.size());
+  index.saveIndex(bufferStream);
+  REQUIRE(bufferStream->isFull());
+  REQUIRE(std::string(buffer.begin(), buffer.end()) == expected);
+
+  // Writes past the end fail rather than overrunning the buffer:
+  auto smallStream =
+      std::make_shared<BufferOutputStream>(buffer.data(), buffer.size() - 1);
+  try {
+    index.saveIndex(smallStream);
+  } catch (const std::runtime_error &) {
+  }
+  REQUIRE(!smallStream->isFull());
+}
+
+TEST_CASE("Test PQ distance tables match distances to decoded vectors") {
+  int numDimensions = 13;
+  ProductQuantizer quantizer(numDimensions, 4);
+  std::vector<std::vector<float>> inputData = randomVectors(1000, 13);
+  NDArray<float, 2> input = vectorsToNDArray(inputData);
+  quantizer.train(input.data.data(), inputData.size());
+  REQUIRE(quantizer.isTrained());
+
+  std::vector<float> query = randomVectors(1, numDimensions)[0];
+  std::vector<float> table(quantizer.getDistanceTableSize());
+  std::vector<PQCode> queryCodes(4);
+  quantizer.encode(query.data(), queryCodes.data());
+  std::vector<float> decodedQuery(numDimensions);
+  quantizer.decode(queryCodes.data(), decodedQuery.data());
+
+  for (bool innerProduct : {false, true}) {
+    quantizer.computeDistanceTable(query.data(), table.data(), innerProduct);
+    for (int i = 0; i < 50; i++) {
+      std::vector<PQCode> codes(4);
+      quantizer.encode(inputData[i].data(), codes.data());
+      std::vector<float> decoded(numDimensions);
+      quantizer.decode(codes.data(), decoded.data());
+
+      float expected = 0;
+      float expectedBetweenCodes = 0;
+      for (int j = 0; j < numDimensions; j++) {
+        expected += innerProduct ? query[j] * decoded[j]
+                                 : (query[j] - decoded[j]) *
+                                       (query[j] - decoded[j]);
+        expectedBetweenCodes +=
+            innerProduct ? decodedQuery[j] * decoded[j]
+                         : (decodedQuery[j] - decoded[j]) *
+                               (decodedQuery[j] - decoded[j]);
+      }
+      float actual = 0;
+      for (int m = 0; m < 4; m++) {
+        actual +=
+            table[m * ProductQuantizer::NUM_CENTROIDS + codes[m].centroid];
+      }
+      REQUIRE(std::abs(actual - expected) <= 1e-4);
+      REQUIRE(std::abs(quantizer.compareCodes(queryCodes.data(), codes.data(),
+                                              innerProduct) -
+                       expectedBetweenCodes) <= 1e-4);
+    }
+  }
+}
+
+TEST_CASE("Test PQ indices find near neighbors and can be reloaded") {
+  int numDimensions = 32;
+  int numVectors = 2000;
+  for (SpaceType spaceType :
+       {SpaceType::Euclidean, SpaceType::InnerProduct, SpaceType::Cosine}) {
+    SUBCASE("Test PQ index") {
+      CAPTURE(spaceType);
+      auto index = TypedIndex<float, PQCode>(spaceType, numDimensions, 16, 200,
+                                             1, 1, true, 16);
+      testIndexProperties(index, spaceType, numDimensions, StorageDataType::PQ);
+      std::vector<std::vector<float>> inputData =
+          randomVectors(numVectors, numDimensions);
+      index.addItems(inputData);
+      auto floatIndex = TypedIndex<float>(spaceType, numDimensions);
+      floatIndex.addItems(inputData);
+
+      // The exact nearest neighbor should usually be among the approximate
+      // nearest neighbors:
+      std::vector<std::vector<float>> queries = randomVectors(200, 32);
+      index.setEF(100);
+      floatIndex.setEF(100);
+      auto [labels, distances] = index.query(queries, 10);
+      auto [exactLabels, exactDistances] = floatIndex.query(queries, 1);
+      int found = 0;
+      for (int i = 0; i < 200; i++) {
+        for (int j = 0; j < 10; j++) {
+          found += labels.data[i * 10 + j] == exactLabels.data[i];
+        }
+      }
+      REQUIRE(found > 150);
+
+      // Distances and vectors are approximate:
+      std::vector<float> vector = index.getVector(0);
+      REQUIRE(vector.size() == (size_t)numDimensions);
+      if (spaceType == SpaceType::Euclidean) {
+        float distance = index.getDistance(inputData[0], inputData[1]);
+        float exact = floatIndex.getDistance(inputData[0], inputData[1]);
+        REQUIRE(std::abs(distance - exact) <= 0.2 * exact);
+        REQUIRE(index.getDistance(vector, vector) < 0.5);
+      }
+
+      std::string path =
+          (std::filesystem::temp_directory_path() /
+           ("voyager_pq_test_" + std::to_string(rand()) + ".voy"))
+              .string();
+      index.saveIndex(path);
+      auto fileStream = std::make_shared<FileInputStream>(path);
+      std::unique_ptr<voyager::Metadata::V1> metadata =
+          voyager::Metadata::loadFromStream(fileStream);
+      REQUIRE(metadata->version() == 2);
+      std::unique_ptr<Index> reloaded =
+          loadTypedIndexFromMetadata(std::move(metadata), fileStream);
+      std::remove(path.c_str());
+
+      REQUIRE(reloaded->getStorageDataType() == StorageDataType::PQ);
+      reloaded->setEF(100);
+      auto [reloadedLabels, reloadedDistances] = reloaded->query(queries, 10);
+      REQUIRE(reloadedLabels.data == labels.data);
+      REQUIRE(reloadedDistances.data == distances.data);
+      REQUIRE(reloaded->getVector(0) == vector);
+    }
+  }
+}
+
+TEST_CASE("Test PQ indices need enough vectors to train their quantizer") {
+  int numDimensions = 16;
+  auto index = TypedIndex<float, PQCode>(SpaceType::InnerProduct,
+                                         numDimensions, 16, 200, 1, 1, true, 8);
+
+  // A single vector isn't enough to learn a codebook from:
+  REQUIRE_THROWS(index.addItem(randomVectors(1, numDimensions)[0], {}));
+  REQUIRE_THROWS(index.train(vectorsToNDArray(randomVectors(
+      ProductQuantizer::NUM_CENTROIDS - 1, numDimensions))));
+  REQUIRE(index.getNumElements() == 0);
+
+  // Training doesn't count towards the largest norm of the vectors added:
+  std::vector<std::vector<float>> trainingData =
+      randomVectors(ProductQuantizer::NUM_CENTROIDS, numDimensions);
+  for (auto &vector : trainingData) {
+    for (float &value : vector) {
+      value *= 10;
+    }
+  }
+  index.train(vectorsToNDArray(trainingData));
+  REQUIRE_THROWS(index.train(vectorsToNDArray(trainingData)));
+
+  // Once trained, vectors can be added one at a time:
+  std::vector<std::vector<float>> inputData = randomVectors(10, numDimensions);
+  for (auto &vector : inputData) {
+    index.addItem(vector, {});
+  }
+  REQUIRE(index.getNumElements() == 10);
+  // (The nearest neighbor by inner product isn't necessarily the query.)
+  auto [labels, distances] = index.query(inputData[3], 1);
+  REQUIRE(labels[0] < 10);
+
+  std::string path =
+      (std::filesystem::temp_directory_path() /
+       ("voyager_pq_train_test_" + std::to_string(rand()) + ".voy"))
+          .string();
+  index.saveIndex(path);
+  std::unique_ptr<voyager::Metadata::V1> metadata =
+      voyager::Metadata::loadFromStream(
+          std::make_shared<FileInputStream>(path));
+  std::remove(path.c_str());
+  float maxNorm = 0;
+  for (auto &vector : inputData) {
+    maxNorm = std::max(maxNorm, getNorm<float, float, std::ratio<1, 1>>(
+                                    vector.data(), numDimensions));
+  }
+  REQUIRE(std::abs(metadata->getMaxNorm() - maxNorm) <= 1e-4);
+
+  // A failed build doesn't leave the quantizer trained:
+  auto failed = TypedIndex<float, PQCode>(
+      SpaceType::InnerProduct, numDimensions, 16, 200, 1, 1, true, 8);
+  std::vector<hnswlib::labeltype> duplicateIds(trainingData.size(), 7);
+  REQUIRE_THROWS(
+      failed.buildFromArray(vectorsToNDArray(trainingData), duplicateIds));
+  REQUIRE_THROWS(failed.addItem(inputData[0], {}));
+  failed.train(vectorsToNDArray(trainingData));
+
+  // Only PQ indices have a quantizer to train:
+  auto floatIndex = TypedIndex<float>(SpaceType::Euclidean, numDimensions);
+  REQUIRE_THROWS(floatIndex.train(vectorsToNDArray(trainingData)));
+}
+
+template <typename data_t, typename scalefactor = std::ratio<1, 1>>
+void testRerank(SpaceType spaceType) {
+  int numDimensions = 32;
+  int numVectors = 2000;
+  int k = 10;
+  auto index = TypedIndex<float, data_t, scalefactor>(
+      spaceType, numDimensions, 12, 200, 1, 1, true, 0,
+      /* storeFullPrecisionVectors */ true);
+  auto floatIndex = TypedIndex<float>(spaceType, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  index.addItems(inputData);
+  floatIndex.addItems(inputData);
+  std::vector<std::vector<float>> queries = randomVectors(100, numDimensions);
+  auto exactDistance = [&](const std::vector<float> &a,
+                           const std::vector<float> &b) {
+    float distance = 0, dot = 0, normA = 0, normB = 0;
+    for (int i = 0; i < numDimensions; i++) {
+      distance += (a[i] - b[i]) * (a[i] - b[i]);
+      dot += a[i] * b[i];
+      normA += a[i] * a[i];
+      normB += b[i] * b[i];
+    }
+    if (spaceType == SpaceType::Euclidean) {
+      return distance;
+    } else if (spaceType == SpaceType::InnerProduct) {
+      return 1 - dot;
+    }
+    return 1 - dot / std::sqrt(normA * normB);
+  };
+
+  auto [labels, distances] = index.query(queries, k, -1, 100);
+  auto [rerankedLabels, rerankedDistances] =
+      index.query(queries, k, -1, 100, nullptr, nullptr, /* rerank */ 50);
+  auto [exactLabels, exactDistances] = floatIndex.query(queries, k, -1, 100);
+
+  // Re-ranked distances are exact, and at least as accurate as before:
+  int found = 0;
+  int rerankedFound = 0;
+  for (int i = 0; i < 100; i++) {
+    for (int j = 0; j < k; j++) {
+      float exact = exactDistance(
+          queries[i], inputData[rerankedLabels.data[i * k + j]]);
+      REQUIRE(std::abs(rerankedDistances.data[i * k + j] - exact) <= 1e-4);
+      if (j > 0) {
+        REQUIRE(rerankedDistances.data[i * k + j] >=
+                rerankedDistances.data[i * k + j - 1]);
+      }
+    }
+    found += labels.data[i * k] == exactLabels.data[i * k];
+    rerankedFound += rerankedLabels.data[i * k] == exactLabels.data[i * k];
+  }
+  REQUIRE(rerankedFound >= found);
+  REQUIRE(rerankedFound >= 95);
+
+  // The single-query interface gives the same results:
+  auto [singleLabels, singleDistances] =
+      index.query(queries[0], k, 100, nullptr, nullptr, /* rerank */ 50);
+  for (int j = 0; j < k; j++) {
+    REQUIRE(singleLabels[j] == rerankedLabels.data[j]);
+  }
+
+  // Stored vectors are returned at full precision:
+  if (spaceType != SpaceType::Cosine) {
+    REQUIRE(index.getVector(7) == inputData[7]);
+  }
+
+  // ...and survive saving and loading:
+  std::string path =
+      (std::filesystem::temp_directory_path() /
+       ("voyager_rerank_test_" + std::to_string(rand()) + ".voy"))
+          .string();
+  index.saveIndex(path);
+  auto fileStream = std::make_shared<FileInputStream>(path);
+  std::unique_ptr<voyager::Metadata::V1> metadata =
+      voyager::Metadata::loadFromStream(fileStream);
+  REQUIRE(metadata->version() == 2);
+  std::unique_ptr<Index> reloaded =
+      loadTypedIndexFromMetadata(std::move(metadata), fileStream);
+  std::remove(path.c_str());
+  auto [reloadedLabels, reloadedDistances] =
+      reloaded->query(queries, k, -1, 100, nullptr, nullptr, 50);
+  REQUIRE(reloadedLabels.data == rerankedLabels.data);
+  REQUIRE(reloadedDistances.data == rerankedDistances.data);
+  REQUIRE(reloaded->getVector(7) == index.getVector(7));
+}
+
+TEST_CASE("Test re-ranking with full-precision vectors gives exact "
+          "distances") {
+  for (SpaceType spaceType :
+       {SpaceType::Euclidean, SpaceType::InnerProduct, SpaceType::Cosine}) {
+    SUBCASE("Test re-ranking") {
+      CAPTURE(spaceType);
+      testRerank<E4M3>(spaceType);
+      testRerank<int8_t, std::ratio<1, 127>>(spaceType);
+      testRerank<PQCode>(spaceType);
+    }
+  }
+}
+
+TEST_CASE("Test re-ranking requires full-precision vectors") {
+  auto index = TypedIndex<float, E4M3>(SpaceType::Euclidean, 8);
+  index.addItems(randomVectors(100, 8));
+  REQUIRE_THROWS(index.query(randomVectors(1, 8), 1, -1, -1, nullptr,
+                             nullptr, /* rerank */ 10));
+
+  auto rerankable = TypedIndex<float, E4M3>(SpaceType::Euclidean, 8, 12, 200,
+                                            1, 1, true, 0, true);
+  rerankable.addItems(randomVectors(100, 8));
+  REQUIRE_THROWS(rerankable.query(randomVectors(1, 8), 5, -1, -1, nullptr,
+                                  nullptr, /* rerank */ 4));
+
+  REQUIRE_THROWS(TypedIndex<float>(SpaceType::Euclidean, 8, 12, 200, 1, 1,
+                                   true, 0, true));
+}
+
+TEST_CASE("Test indices without PQ storage still use V1 metadata") {
+  auto index = TypedIndex<float, E4M3>(SpaceType::Cosine, 8);
+  index.addItems(randomVectors(100, 8));
+  std::string path =
+      (std::filesystem::temp_directory_path() /
+       ("voyager_v1_test_" + std::to_string(rand()) + ".voy"))
+          .string();
+  index.saveIndex(path);
+  auto fileStream = std::make_shared<FileInputStream>(path);
+  REQUIRE(voyager::Metadata::loadFromStream(fileStream)->version() == 1);
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Test LabelMap matches std::unordered_map") {
+  std::mt19937 rng(1234);
+  hnswlib::LabelLookup map;
+  std::unordered_map<hnswlib::labeltype, hnswlib::tableint> expected;
+  for (int i = 0; i < 200000; i++) {
+    // A small key range, so that keys are often overwritten and erased:
+    hnswlib::labeltype key = rng() % 50000;
+    if (rng() % 3 == 0) {
+      REQUIRE(map.erase(key) == (bool)expected.erase(key));
+    } else {
+      map.set(key, i);
+      expected[key] = i;
+    }
+  }
+
+  REQUIRE(map.size() == expected.size());
+  for (auto const &kv : expected) {
+    REQUIRE(map.get(kv.first) == kv.second);
+  }
+  size_t numIterated = 0;
+  for (auto const &kv : map) {
+    REQUIRE(expected.at(kv.first) == kv.second);
+    numIterated++;
+  }
+  REQUIRE(numIterated == expected.size());
+  REQUIRE(map.find(50000) == map.end());
+  REQUIRE(map.get(50000) == hnswlib::LabelLookup::EMPTY);
+}
+
+TEST_CASE("Test VisitedHashSet matches std::unordered_set") {
+  std::mt19937 rng(1234);
+  hnswlib::VisitedHashSet set(4);
+  for (int search = 0; search < 50; search++) {
+    // Start small, so that the set has to grow:
+    set.reset(search % 5);
+    std::unordered_set<unsigned int> expected;
+    int numInserts = rng() % 5000;
+    for (int i = 0; i < numInserts; i++) {
+      unsigned int id = rng() % 20000;
+      REQUIRE(set.insert(id) == expected.insert(id).second);
+    }
+  }
+}
+
+TEST_CASE("Test searches give the same results with either visited set") {
+  int numDimensions = 8;
+  int numVectors = 2000;
+  hnswlib::EuclideanSpace<float, float> space(numDimensions);
+  hnswlib::HierarchicalNSW<float> index(&space, numVectors, 12, 100);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  for (int i = 0; i < numVectors; i++) {
+    index.addPoint(inputData[i].data(), i);
+  }
+
+  auto search = [&](const std::vector<float> &query) {
+    auto result = index.searchKnn(query.data(), 10, nullptr, 50);
+    std::vector<std::pair<float, hnswlib::labeltype>> neighbors;
+    for (; !result.empty(); result.pop()) {
+      neighbors.push_back(result.top());
+    }
+    auto inRange = index.rangeSearch(query.data(), 0.5f);
+    for (; !inRange.empty(); inRange.pop()) {
+      neighbors.push_back(inRange.top());
+    }
+    return neighbors;
+  };
+
+  for (int i = 0; i < 100; i++) {
+    index.visited_hash_set_min_elements_ = numVectors + 1;
+    REQUIRE(!index.useVisitedHashSet(50));
+    auto withVisitedList = search(inputData[i]);
+
+    index.visited_hash_set_min_elements_ = 0;
+    REQUIRE(index.useVisitedHashSet(50));
+    REQUIRE(search(inputData[i]) == withVisitedList);
+  }
+  REQUIRE(!index.useVisitedHashSet(
+      hnswlib::HierarchicalNSW<float>::VISITED_HASH_SET_MAX_EF + 1));
+}
+
+TEST_CASE("Test searching with a reused context matches searchKnn") {
+  int numDimensions = 8;
+  int numVectors = 2000;
+  size_t k = 10;
+  hnswlib::EuclideanSpace<float, float> space(numDimensions);
+  hnswlib::HierarchicalNSW<float> index(&space, numVectors, 12, 100);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  for (int i = 0; i < numVectors; i++) {
+    index.addPoint(inputData[i].data(), i);
+  }
+  index.markDelete(3);
+
+  hnswlib::HierarchicalNSW<float>::SearchContext context;
+  std::vector<hnswlib::labeltype> labels(k);
+  std::vector<float> distances(k);
+  for (int i = 0; i < 200; i++) {
+    // Alternate between visited lists and hash sets, which share the context:
+    index.visited_hash_set_min_elements_ = i % 2 ? 0 : numVectors + 1;
+
+    auto expected = index.searchKnn(inputData[i].data(), k, nullptr, 40);
+    REQUIRE(index.searchKnn(inputData[i].data(), k, context, labels.data(),
+                            distances.data(), 40) == k);
+    for (size_t j = k; j > 0; j--, expected.pop()) {
+      REQUIRE(labels[j - 1] == expected.top().second);
+      REQUIRE(distances[j - 1] == expected.top().first);
+    }
+  }
+
+  // The context's heaps keep their storage between searches:
+  REQUIRE(GetContainerForQueue(context.candidateSet).capacity() > 0);
+
+  // The index can grow while a context is in use:
+  index.resizeIndex(numVectors * 2);
+  for (int i = 0; i < 10; i++) {
+    index.addPoint(inputData[i].data(), numVectors + i);
+  }
+  index.visited_hash_set_min_elements_ = numVectors * 4;
+  REQUIRE(index.searchKnn(inputData[0].data(), 2, context, labels.data(),
+                          distances.data()) == 2);
+  REQUIRE(distances[0] == 0);
+  REQUIRE(distances[1] == 0);
+}
+
+TEST_CASE("Test queryInto matches query") {
+  int numDimensions = 16;
+  int numVectors = 1000;
+  int k = 5;
+  auto index = TypedIndex<float, int8_t, std::ratio<1, 127>>(
+      SpaceType::Cosine, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  index.addItems(inputData);
+
+  auto [expectedLabels, expectedDistances] = index.query(inputData, k, 4);
+  std::vector<float> flat;
+  for (const auto &vector : inputData) {
+    flat.insert(flat.end(), vector.begin(), vector.end());
+  }
+  std::vector<hnswlib::labeltype> labels(numVectors * k);
+  std::vector<float> distances(numVectors * k);
+  index.queryInto(flat.data(), numVectors, k, labels.data(), distances.data(),
+                  4);
+  REQUIRE(labels == expectedLabels.data);
+  REQUIRE(distances == expectedDistances.data);
+
+  auto [singleLabels, singleDistances] = index.query(inputData[7], k);
+  for (int j = 0; j < k; j++) {
+    REQUIRE(singleLabels[j] == labels[7 * k + j]);
+  }
+
+  REQUIRE_THROWS_AS(index.queryInto(flat.data(), 1, numVectors + 1,
+                                    labels.data(), distances.data()),
+                    RecallError);
+}
+
+std::unique_ptr<ShardedIndex> makeShardedIndex(int numShards,
+                                               int numDimensions) {
+  std::vector<std::unique_ptr<Index>> shards;
+  for (int i = 0; i < numShards; i++) {
+    shards.push_back(std::make_unique<TypedIndex<float>>(
+        SpaceType::Euclidean, numDimensions, 12, 200, 1 + i));
+  }
+  return std::make_unique<ShardedIndex>(std::move(shards));
+}
+
+TEST_CASE("Test sharded indices route items by ID and merge query results") {
+  int numDimensions = 8;
+  int numVectors = 2000;
+  int k = 5;
+  auto index = makeShardedIndex(4, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  std::vector<hnswlib::labeltype> ids = index->addItems(inputData);
+  index->addItem(randomVectors(1, numDimensions)[0], std::nullopt);
+
+  REQUIRE(index->getNumElements() == (size_t)numVectors + 1);
+  REQUIRE(index->getIDsMap().size() == (size_t)numVectors + 1);
+  for (size_t shard = 0; shard < index->getNumShards(); shard++) {
+    // Every shard gets a fair share of the items:
+    REQUIRE(index->getShard(shard).getNumElements() > (size_t)numVectors / 8);
+  }
+  for (int i = 0; i < numVectors; i++) {
+    REQUIRE(ids[i] == (hnswlib::labeltype)i);
+    REQUIRE(index->getShard(index->getShardFor(i)).getIDsMap().count(i));
+  }
+  REQUIRE(index->getVector(17) == inputData[17]);
+
+  // Each item's nearest neighbor is itself, whichever shard it's in, and the
+  // merged results are sorted by distance:
+  std::vector<hnswlib::SearchStats> stats;
+  auto [labels, distances] =
+      index->query(inputData, k, -1, -1, nullptr, &stats);
+  int numCorrect = 0;
+  for (int i = 0; i < numVectors; i++) {
+    numCorrect += labels.data[i * k] == (hnswlib::labeltype)i;
+    REQUIRE(std::is_sorted(distances.data.begin() + i * k,
+                           distances.data.begin() + (i + 1) * k));
+    REQUIRE(stats[i].searches == index->getNumShards());
+  }
+  REQUIRE(numCorrect > numVectors * 0.99);
+
+  auto [singleLabels, singleDistances] = index->query(inputData[3], k);
+  for (int j = 0; j < k; j++) {
+    REQUIRE(singleLabels[j] == labels.data[3 * k + j]);
+  }
+
+  index->markDeleted(3);
+  auto [deletedLabels, deletedDistances] = index->query(inputData[3], k);
+  REQUIRE(std::find(deletedLabels.begin(), deletedLabels.end(), 3) ==
+          deletedLabels.end());
+
+  auto [rangeLabels, rangeDistances] =
+      index->rangeSearch(inputData[5], singleDistances[k - 1]);
+  REQUIRE(std::is_sorted(rangeDistances.begin(), rangeDistances.end()));
+  REQUIRE(rangeLabels[0] == 5);
+
+  // Asking for more neighbors than there are items finds all of them:
+  std::vector<hnswlib::labeltype> allLabels(numVectors + 10);
+  std::vector<float> allDistances(numVectors + 10);
+  REQUIRE(index->queryAtMost(inputData[0].data(), numVectors + 10,
+                             allLabels.data(), allDistances.data(),
+                             numVectors + 10) == (size_t)numVectors);
+  REQUIRE_THROWS_AS(index->query(inputData[0], numVectors + 10), RecallError);
+
+  // IDs assigned after explicit ones don't collide with them:
+  index->addItem(inputData[0], numVectors + 100);
+  index->addItems(NDArray<float, 2>(inputData[1], {1, numDimensions}),
+                  {(hnswlib::labeltype)numVectors + 200});
+  REQUIRE(index->addItem(inputData[2], std::nullopt) ==
+          (hnswlib::labeltype)numVectors + 201);
+}
+
+TEST_CASE("Test sharded buildFromArray reports progress and undoes failures") {
+  int numDimensions = 8;
+  int numVectors = 2000;
+  auto index = makeShardedIndex(4, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  NDArray<float, 2> input = vectorsToNDArray(inputData);
+
+  // Progress is reported without holding the index's lock, so shards can't
+  // be replaced while the build runs (rather than deadlocking):
+  bool replaced = false;
+  REQUIRE_THROWS_AS(
+      index->buildFromArray(input, {}, -1,
+                            [&](size_t, size_t) {
+                              index->setShard(
+                                  0, std::make_unique<TypedIndex<float>>(
+                                         SpaceType::Euclidean, numDimensions));
+                              replaced = true;
+                            }),
+      std::runtime_error);
+  REQUIRE(!replaced);
+  REQUIRE(index->getNumElements() == 0);
+
+  // A failure in a later shard empties the shards already built:
+  REQUIRE_THROWS(index->buildFromArray(input, {}, -1, [&](size_t numAdded,
+                                                          size_t) {
+    if (numAdded > (size_t)numVectors / 2) {
+      throw std::runtime_error("Cancelled");
+    }
+  }));
+  REQUIRE(index->getNumElements() == 0);
+  for (size_t shard = 0; shard < index->getNumShards(); shard++) {
+    REQUIRE(index->getShard(shard).getIDsCount() == 0);
+  }
+
+  std::vector<hnswlib::labeltype> ids = index->buildFromArray(input);
+  REQUIRE(ids.front() == 0);
+  REQUIRE(index->getNumElements() == (size_t)numVectors);
+  auto [labels, distances] = index->query(inputData[7], 1);
+  REQUIRE(labels[0] == 7);
+}
+
+TEST_CASE("Test sharded indices can be saved and loaded whole or shard by "
+          "shard") {
+  int numDimensions = 8;
+  int numVectors = 1000;
+  auto index = makeShardedIndex(3, numDimensions);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  index->addItems(inputData);
+  auto [expectedLabels, expectedDistances] = index->query(inputData, 5);
+
+  std::string path =
+      (std::filesystem::temp_directory_path() /
+       ("voyager_sharded_test_" + std::to_string(rand()) + ".voy"))
+          .string();
+
+  SUBCASE("Each shard in its own file") {
+    index->saveIndex(path);
+    for (bool searchOnly : {false, true}) {
+      std::unique_ptr<ShardedIndex> loaded =
+          loadShardedIndex(path, searchOnly);
+      REQUIRE(loaded->getNumShards() == 3);
+      REQUIRE(loaded->getNumElements() == (size_t)numVectors);
+      auto [labels, distances] = loaded->query(inputData, 5);
+      REQUIRE(labels.data == expectedLabels.data);
+      REQUIRE(distances.data == expectedDistances.data);
+    }
+
+    // Shards can be swapped out individually:
+    std::string shardPath = path + ".replacement";
+    auto updated = loadShardedIndex(path);
+    updated->markDeleted(0);
+    size_t shard = updated->getShardFor(0);
+    updated->saveShard(shard, shardPath);
+
+    auto loaded = loadShardedIndex(path);
+    loaded->loadShard(shard, shardPath);
+    auto [labels, distances] = loaded->query(inputData[0], 1);
+    REQUIRE(labels[0] != 0);
+    REQUIRE(loaded->addItem(inputData[0], std::nullopt) ==
+            (hnswlib::labeltype)numVectors);
+
+    // ...but only with shards that hold the right items:
+    REQUIRE_THROWS_AS(loaded->loadShard((shard + 1) % 3, shardPath),
+                      std::invalid_argument);
+
+    std::remove(shardPath.c_str());
+    for (size_t i = 0; i < 3; i++) {
+      std::remove(ShardedIndex::getShardPath(path, i).c_str());
+    }
+  }
+
+  SUBCASE("All shards in one stream") {
+    index->saveIndex(std::make_shared<FileOutputStream>(path));
+    auto inputStream = std::make_shared<FileInputStream>(path);
+    REQUIRE(isShardedIndex(inputStream));
+    std::unique_ptr<ShardedIndex> loaded =
+        loadShardedIndexFromStream(inputStream);
+    REQUIRE(inputStream->getPosition() == inputStream->getTotalLength());
+    auto [labels, distances] = loaded->query(inputData, 5);
+    REQUIRE(labels.data == expectedLabels.data);
+
+    // Loading by path works too:
+    REQUIRE(loadShardedIndex(path)->getNumElements() == (size_t)numVectors);
+  }
+
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Test change logs replay changes made since the last snapshot") {
+  int numDimensions = 8;
+  std::vector<std::vector<float>> inputData = randomVectors(300, numDimensions);
+  std::vector<std::vector<float>> firstData(inputData.begin(),
+                                            inputData.begin() + 200);
+  std::vector<std::vector<float>> laterData(inputData.begin() + 200,
+                                            inputData.end());
+  std::string path =
+      (std::filesystem::temp_directory_path() /
+       ("voyager_change_log_test_" + std::to_string(rand()) + ".voy"))
+          .string();
+  std::string logPath = ChangeLog::getPath(path);
+
+  auto index = std::make_unique<TypedIndex<float>>(Euclidean, numDimensions);
+  index->setEF(50);
+  index->addItems(firstData);
+  REQUIRE(!index->isLogAware());
+  index->openChangeLog(path);
+  REQUIRE(index->isLogAware());
+  REQUIRE(std::filesystem::file_size(logPath) == 20);
+
+  index->addItems(laterData);
+  index->markDeleted(5);
+  index->markDeleted(6);
+  index->unmarkDeleted(6);
+  std::vector<float> updated = randomVectors(1, numDimensions)[0];
+  index->addItem(updated, 3);
+  REQUIRE(std::filesystem::file_size(logPath) > 20);
+
+  // Drop the index without saving it, as if the process had crashed:
+  index.reset();
+
+  auto requireChangesReplayed = [&](Index &loaded) {
+    REQUIRE(loaded.getVector(3) == updated);
+    REQUIRE(std::get<0>(loaded.query(inputData[5], 1))[0] != 5);
+    REQUIRE(std::get<0>(loaded.query(inputData[6], 1))[0] == 6);
+    REQUIRE(std::get<0>(loaded.query(inputData[250], 1))[0] == 250);
+  };
+
+  {
+    std::unique_ptr<Index> loaded = loadTypedIndexFromFile(path);
+    REQUIRE(loaded->isLogAware());
+    REQUIRE(loaded->getNumElements() == 300);
+    requireChangesReplayed(*loaded);
+
+    // The log stays open, and new IDs follow on from the replayed ones:
+    REQUIRE(loaded->addItem(inputData[0], std::nullopt) == 300);
+  }
+
+  // Search-only indices can't replay changes:
+  REQUIRE_THROWS_AS(loadTypedIndexFromFile(path, true), std::domain_error);
+
+  // A partially-written record is dropped, along with everything after it:
+  {
+    FILE *log = fopen(logPath.c_str(), "ab");
+    fwrite("\x10\x00\x00", 1, 3, log);
+    fclose(log);
+
+    std::unique_ptr<Index> loaded = loadTypedIndexFromFile(path);
+    requireChangesReplayed(*loaded);
+    REQUIRE(loaded->getNumElements() == 301);
+    // ...and the snapshot is rewritten, so nothing is appended after it:
+    REQUIRE(std::filesystem::file_size(logPath) == 20);
+  }
+
+  // Checkpoints fold the log into a new snapshot:
+  {
+    std::unique_ptr<Index> loaded = loadTypedIndexFromFile(path);
+    loaded->markDeleted(7);
+    std::filesystem::copy_file(
+        logPath, logPath + ".old",
+        std::filesystem::copy_options::overwrite_existing);
+    loaded->checkpoint();
+    REQUIRE(std::filesystem::file_size(logPath) == 20);
+
+    auto inputStream = std::make_shared<FileInputStream>(path);
+    REQUIRE(voyager::Metadata::loadFromStream(inputStream)->version() == 3);
+
+    // ...as do enough changes, if a checkpoint interval is set:
+    loaded->openChangeLog(path, 10);
+    loaded->markDeleted(8);
+    REQUIRE(std::filesystem::file_size(logPath) > 20);
+    loaded->addItems(std::vector<std::vector<float>>(
+        inputData.begin() + 20, inputData.begin() + 30));
+    REQUIRE(std::filesystem::file_size(logPath) == 20);
+
+    // Indices saved without a change log don't have log-aware metadata:
+    std::string plainPath = path + ".plain";
+    loaded->saveIndex(plainPath);
+    inputStream = std::make_shared<FileInputStream>(plainPath);
+    REQUIRE(voyager::Metadata::loadFromStream(inputStream)->version() == 1);
+    REQUIRE(!loadTypedIndexFromFile(plainPath)->isLogAware());
+    std::remove(plainPath.c_str());
+  }
+
+  // A log left over from an older snapshot isn't replayed onto a newer one:
+  std::filesystem::copy_file(logPath + ".old", logPath,
+                             std::filesystem::copy_options::overwrite_existing);
+  {
+    // (Search-only indices would refuse to replay any of its changes.)
+    std::unique_ptr<Index> loaded = loadTypedIndexFromFile(path, true);
+    REQUIRE(loaded->getNumElements() == 311);
+    REQUIRE(std::get<0>(loaded->query(inputData[7], 1))[0] != 7);
+    REQUIRE(std::get<0>(loaded->query(inputData[8], 1))[0] != 8);
+  }
+
+  std::remove((logPath + ".old").c_str());
+  std::remove(logPath.c_str());
+  std::remove(path.c_str());
+}
+
+TEST_CASE("Test SegmentedStorage keeps records in place as it grows") {
+  hnswlib::SegmentedStorage storage(24);
+  REQUIRE(storage.getRecordsPerSegment() * 24 <=
+          hnswlib::SegmentedStorage::TARGET_SEGMENT_SIZE);
+  storage.adopt(storage.allocateBlock(10), 10);
+  size_t numRecords = storage.getRecordsPerSegment() * 40 + 5;
+
+  std::vector<char *> addresses;
+  for (size_t size = 10; size <= numRecords; size = size * 3 / 2 + 1) {
+    storage.resize(size);
+    REQUIRE(storage.getCapacity() >= size);
+    for (size_t i = addresses.size(); i < size; i++) {
+      addresses.push_back(storage[i]);
+      std::memcpy(storage[i], &i, sizeof(i));
+    }
+  }
+  for (size_t i = 0; i < addresses.size(); i++) {
+    REQUIRE(storage[i] == addresses[i]);
+    size_t value;
+    std::memcpy(&value, storage[i], sizeof(value));
+    REQUIRE(value == i);
+  }
+
+  // The runs cover the records in order, without gaps:
+  size_t numBytes = 0;
+  storage.forEachRun(addresses.size(), [&](const char *data, size_t size) {
+    REQUIRE(data == addresses[numBytes / 24]);
+    numBytes += size;
+  });
+  REQUIRE(numBytes == addresses.size() * 24);
+
+  // Shrinking keeps the records that remain where they were:
+  storage.resize(100);
+  REQUIRE(storage.getCapacity() < addresses.size());
+  for (size_t i = 0; i < 100; i++) {
+    REQUIRE(storage[i] == addresses[i]);
+  }
+}
+
+TEST_CASE("Test visited lists track IDs beyond their size") {
+  // Elements added after a list was taken still count as unvisited once:
+  hnswlib::VisitedList list(10);
+  list.reset();
+  hnswlib::VisitedListRef visited(&list);
+  for (unsigned int id : {3u, 9u, 10u, 500u}) {
+    REQUIRE(visited.insert(id));
+    REQUIRE(!visited.insert(id));
+  }
+}
+
+TEST_CASE("Test indices can grow while being searched") {
+  int numDimensions = 8;
+  int initialSize = 100;
+  int numVectors = 5000;
+  hnswlib::EuclideanSpace<float, float> space(numDimensions);
+  hnswlib::HierarchicalNSW<float> index(&space, initialSize, 12, 100);
+  std::vector<std::vector<float>> inputData =
+      randomVectors(numVectors, numDimensions);
+  for (int i = 0; i < initialSize; i++) {
+    index.addPoint(inputData[i].data(), i);
+  }
+
+  // Searches run throughout, reading elements as they're added and the index
+  // grows. Searches that started before the index grew must still follow
+  // links to the elements added since. (A search that runs alongside
+  // insertions may still rarely miss, by reading a neighbor list while it's
+  // being rewritten.)
+  std::atomic<bool> done{false};
+  std::atomic<int> numSearches{0};
+  std::atomic<int> numFound{0};
+  std::atomic<int> numInvalid{0};
+  std::thread searcher([&]() {
+    hnswlib::HierarchicalNSW<float>::SearchContext context;
+    hnswlib::labeltype label;
+    float distance;
+    for (int i = 0; !done || numSearches < 100; i++) {
+      int target = i % initialSize;
+      auto result = index.searchKnn(inputData[target].data(), 1);
+      if (index.searchKnn(inputData[target].data(), 1, context, &label,
+                          &distance) != 1 ||
+          result.empty() || label >= (hnswlib::labeltype)numVectors) {
+        numInvalid++;
+      } else if (result.top().first == 0 && distance == 0) {
+        numFound++;
+      }
+      numSearches++;
+    }
+  });
+
+  for (int i = initialSize; i < numVectors; i++) {
+    if ((size_t)i == index.max_elements_) {
+      index.resizeIndex(i + 100);
+    }
+    index.addPoint(inputData[i].data(), i);
+  }
+  done = true;
+  searcher.join();
+  REQUIRE(numInvalid == 0);
+  REQUIRE(numFound >= numSearches * 0.99);
+
+  for (int i = 0; i < numVectors; i += 97) {
+    auto result = index.searchKnn(inputData[i].data(), 1);
+    REQUIRE(result.top().second == (hnswlib::labeltype)i);
+  }
+
+  // Saving writes every segment:
+  std::string path =
+      (std::filesystem::temp_directory_path() /
+       ("voyager_growth_test_" + std::to_string(rand()) + ".hnsw"))
+          .string();
+  index.saveIndex(path);
+  hnswlib::HierarchicalNSW<float> reloaded(
+      &space, std::make_shared<FileInputStream>(path));
+  std::remove(path.c_str());
+  REQUIRE(reloaded.cur_element_count == (size_t)numVectors);
+  for (int i = 0; i < numVectors; i += 97) {
+    auto result = reloaded.searchKnn(inputData[i].data(), 1);
+    REQUIRE(result.top().second == (hnswlib::labeltype)i);
+  }
+}
+
+TEST_CASE("Test indices only grow automatically if autoGrow is set") {
+  int numDimensions = 4;
+  auto index = TypedIndex<float>(SpaceType::Euclidean, numDimensions, 8, 20,
+                                 1, /* maxElements */ 10);
+  std::vector<std::vector<float>> inputData = randomVectors(30, numDimensions);
+  REQUIRE(index.getAutoGrow());
+  index.addItems(std::vector<std::vector<float>>(inputData.begin(),
+                                                 inputData.begin() + 20));
+  REQUIRE(index.getNumElements() == 20);
+  REQUIRE(index.getMaxElements() >= 20);
+
+  index.setAutoGrow(false);
+  index.resizeIndex(25);
+  REQUIRE_THROWS_AS(
+      index.addItems(std::vector<std::vector<float>>(inputData.begin() + 20,
+                                                     inputData.end())),
+      IndexFullError);
+  REQUIRE(index.getNumElements() == 20);
+  index.addItems(std::vector<std::vector<float>>(inputData.begin() + 20,
+                                                 inputData.begin() + 25));
+  REQUIRE(index.getNumElements() == 25);
+  REQUIRE(index.getMaxElements() == 25);
+}
+
+TEST_CASE("Test LabelMap::build matches building sequentially") {
+  for (size_t numValues : {0, 10, 100000, 1000000}) {
+    // Sequential labels, random labels and many duplicate labels:
+    for (int pattern = 0; pattern < 3; pattern++) {
+      std::vector<hnswlib::labeltype> labels(numValues);
+      std::mt19937_64 rng(numValues + pattern);
+      for (size_t i = 0; i < numValues; i++) {
+        labels[i] = pattern == 0   ? i
+                    : pattern == 1 ? rng()
+                                   : rng() % (numValues / 4 + 1);
+      }
+
+      auto keyOf = [&](size_t i) { return labels[i]; };
+      hnswlib::LabelLookup parallel =
+          hnswlib::LabelLookup::build(numValues, keyOf, 4);
+      hnswlib::LabelLookup sequential =
+          hnswlib::LabelLookup::build(numValues, keyOf, 1);
+      REQUIRE(parallel.size() == sequential.size());
+      for (auto const &kv : sequential) {
+        REQUIRE(parallel.get(kv.first) == kv.second);
+      }
+    }
+  }
+}
+
+TEST_CASE("Test ThreadPool visits each index exactly once") {
+  ThreadPool pool(3);
+  REQUIRE(pool.getNumThreads() == 3);
+
+  for (size_t numThreads : {1, 2, 4, 16}) {
+    std::vector<std::atomic<int>> visits(1000);
+    std::atomic<bool> threadIdInRange(true);
+    pool.parallelFor(10, visits.size(), numThreads,
+                     [&](size_t id, size_t threadId) {
+                       visits[id]++;
+                       if (threadId >= numThreads) {
+                         threadIdInRange = false;
+                       }
+                     });
+    for (size_t i = 0; i < visits.size(); i++) {
+      REQUIRE(visits[i] == (i < 10 ? 0 : 1));
+    }
+    REQUIRE(threadIdInRange);
+  }
+
+  // Loops may be nested and may run concurrently from several threads:
+  std::atomic<size_t> total(0);
+  std::vector<std::thread> callers;
+  for (int i = 0; i < 4; i++) {
+    callers.emplace_back([&] {
+      pool.parallelFor(0, 8, 4, [&](size_t, size_t) {
+        pool.parallelFor(0, 8, 4, [&](size_t, size_t) { total++; });
+      });
+    });
+  }
+  for (auto &caller : callers) {
+    caller.join();
+  }
+  REQUIRE(total == 4 * 8 * 8);
+
+  pool.setNumThreads(0);
+  REQUIRE(pool.getNumThreads() == 0);
+  total = 0;
+  pool.parallelFor(0, 100, 4, [&](size_t, size_t) { total++; });
+  REQUIRE(total == 100);
+}
+
+TEST_CASE("Test ThreadPool rethrows exceptions from the loop body") {
+  ThreadPool pool(2);
+  std::atomic<int> calls(0);
+  auto failAtTen = [&](size_t id, size_t) {
+    calls++;
+    if (id == 10) {
+      throw std::runtime_error("failed");
+    }
+  };
+  REQUIRE_THROWS_AS(pool.parallelFor(0, 1000, 3, failAtTen),
+                    std::runtime_error);
+
+  // How many other ids get started on other threads depends on timing, but
+  // on one thread, the loop stops right away:
+  calls = 0;
+  REQUIRE_THROWS_AS(pool.parallelFor(0, 1000, 1, failAtTen),
+                    std::runtime_error);
+  REQUIRE(calls == 11);
+
+  // The pool must still be usable afterwards:
+  calls = 0;
+  pool.parallelFor(0, 1000, 3, [&](size_t, size_t) { calls++; });
+  REQUIRE(calls == 1000);
+}
+
+TEST_CASE("Test every SIMD kernel supported by this CPU matches the scalar "
+          "distance functions") {
+  using namespace hnswlib;
+  typedef std::pair<DISTFUNC<float>, DISTFUNC<float>> KernelPair;
+  const CPUFeatures &cpu = CPUFeatures::get();
+
+  // For each instruction set, the L2 and inner product kernels to use for a
+  // given number of dimensions, starting with whichever the spaces pick:
+  std::vector<std::function<KernelPair(size_t)>> kernelsForDimensions = {
+      [](size_t dim) {
+        return KernelPair(EuclideanSpace<float, float>(dim).get_dist_func(),
+                          InnerProductSpace<float, float>(dim).get_dist_func());
+      }};
+#if defined(USE_SSE)
+  if (cpu.sse) {
+    kernelsForDimensions.push_back([](size_t dim) {
+      return KernelPair(
+          selectL2SqrSIMD<L2SqrSIMD16ExtSSE, L2SqrSIMD4ExtSSE,
+                          L2SqrSIMD16ExtSSEFixedDim>(dim),
+          selectInnerProductSIMD<InnerProductSIMD16ExtSSE,
+                                 InnerProductSIMD4ExtSSE,
+                                 InnerProductSIMD16ExtSSEFixedDim>(dim));
+    });
+  }
+#endif
+#if defined(USE_AVX)
+  if (cpu.avx2 && cpu.fma) {
+    kernelsForDimensions.push_back([](size_t dim) {
+      return KernelPair(
+          selectL2SqrSIMD<L2SqrSIMD16ExtAVX2, L2SqrSIMD4ExtSSE,
+                          L2SqrSIMD16ExtAVX2FixedDim>(dim),
+          selectInnerProductSIMD<InnerProductSIMD16ExtAVX2,
+                                 InnerProductSIMD4ExtAVX2,
+                                 InnerProductSIMD16ExtAVX2FixedDim>(dim));
+    });
+  }
+#endif
+#if defined(USE_AVX512)
+  if (cpu.avx512f && cpu.avx2 && cpu.fma) {
+    kernelsForDimensions.push_back([](size_t dim) {
+      return KernelPair(
+          selectL2SqrSIMD<L2SqrSIMD16ExtAVX512, L2SqrSIMD4ExtSSE,
+                          L2SqrSIMD16ExtAVX512FixedDim>(dim),
+          selectInnerProductSIMD<InnerProductSIMD16ExtAVX512,
+                                 InnerProductSIMD4ExtAVX2,
+                                 InnerProductSIMD16ExtAVX512FixedDim>(dim));
+    });
+  }
+#endif
+#if defined(USE_NEON)
+  if (cpu.neon) {
+    kernelsForDimensions.push_back([](size_t dim) {
+      return KernelPair(
+          selectL2SqrSIMD<L2SqrSIMD16ExtNEON, L2SqrSIMD4ExtNEON,
+                          L2SqrSIMD16ExtNEONFixedDim>(dim),
+          selectInnerProductSIMD<InnerProductSIMD16ExtNEON,
+                                 InnerProductSIMD4ExtNEON,
+                                 InnerProductSIMD16ExtNEONFixedDim>(dim));
+    });
+  }
+#endif
+  (void)cpu;
+
+  // Every small size, plus the sizes with their own fixed-dimension kernels:
+  std::vector<size_t> dimensions;
+  for (size_t dim = 1; dim <= 200; dim++) {
+    dimensions.push_back(dim);
+  }
+  for (size_t dim : {256, 384, 512, 768, 1024, 1536}) {
+    dimensions.push_back(dim);
+  }
+
+  for (size_t dim : dimensions) {
+    std::vector<std::vector<float>> vectors = randomVectors(2, dim);
+    const float *a = vectors[0].data();
+    const float *b = vectors[1].data();
+    float expectedL2 = L2Sqr<float, float>(a, b, dim);
+    float expectedIP = hnswlib::InnerProduct<float, float>(a, b, dim);
+
+    // SIMD kernels sum in a different order (and may use FMA), so allow for
+    // some rounding error:
+    float tolerance = 1e-5f * dim;
+    for (auto &kernelsFor : kernelsForDimensions) {
+      KernelPair kernels = kernelsFor(dim);
+      REQUIRE(std::abs(kernels.first(a, b, dim) - expectedL2) <= tolerance);
+      REQUIRE(std::abs(kernels.second(a, b, dim) - expectedIP) <= tolerance);
+    }
+  }
+}
+
+TEST_CASE("Test searches call plain distance functions directly") {
+  using namespace hnswlib;
+  // Float32 spaces use plain functions (which searches call without going
+  // through std::function), whether or not they're specialized for the
+  // number of dimensions:
+  for (size_t dim : {7, 100, 384}) {
+    CAPTURE(dim);
+    REQUIRE(getDistanceKernel(EuclideanSpace<float, float>(dim)
+                                  .get_dist_func()) != nullptr);
+    REQUIRE(getDistanceKernel(InnerProductSpace<float, float>(dim)
+                                  .get_dist_func()) != nullptr);
+  }
+
+  DISTFUNC<float> lambda = [](const float *, const float *, const size_t) {
+    return 0.0f;
+  };
+  REQUIRE(getDistanceKernel(lambda) == nullptr);
+}
+
+TEST_CASE("Test SIMD kernels for int8 and E4M3 vectors match the scalar "
+          "distance functions") {
+  using namespace hnswlib;
+  typedef std::ratio<1, 127> Float8Scale;
+  std::mt19937 gen(1234);
+
+  for (size_t dim = 1; dim <= 200; dim++) {
+    std::uniform_int_distribution<int> int8Values(-128, 127);
+    std::vector<int8_t> a(dim), b(dim);
+    for (size_t i = 0; i < dim; i++) {
+      a[i] = int8Values(gen);
+      b[i] = int8Values(gen);
+    }
+
+    // Integer sums are exact, so only the final scaling can differ:
+    float expectedL2 = L2Sqr<float, int8_t, 1, Float8Scale>(a.data(), b.data(),
+                                                             dim);
+    float expectedIP = hnswlib::InnerProduct<float, int8_t, 1, Float8Scale>(
+        a.data(), b.data(), dim);
+    REQUIRE(std::abs(EuclideanSpace<float, int8_t, Float8Scale>(dim)
+                         .get_dist_func()(a.data(), b.data(), dim) -
+                     expectedL2) <= 1e-5f * std::max(1.0f, expectedL2));
+    REQUIRE(std::abs(InnerProductSpace<float, int8_t, Float8Scale>(dim)
+                         .get_dist_func()(a.data(), b.data(), dim) -
+                     expectedIP) <= 1e-5f * std::max(1.0f, expectedIP));
+
+    // Every E4M3 value other than NaN (bytes 254 and 255):
+    std::uniform_int_distribution<int> e4m3Values(0, 253);
+    std::vector<E4M3> c(dim), d(dim), zeros(dim);
+    for (size_t i = 0; i < dim; i++) {
+      uint8_t cByte = e4m3Values(gen), dByte = e4m3Values(gen);
+      std::memcpy(&c[i], &cByte, 1);
+      std::memcpy(&d[i], &dByte, 1);
+    }
+
+    // SIMD kernels sum in a different order (and may use FMA), so allow for
+    // some relative rounding error:
+    float expectedE4M3L2 = L2Sqr<float, E4M3>(c.data(), d.data(), dim);
+    float expectedE4M3IP =
+        hnswlib::InnerProduct<float, E4M3>(c.data(), d.data(), dim);
+    float e4m3Magnitude = L2Sqr<float, E4M3>(c.data(), zeros.data(), dim) +
+                          L2Sqr<float, E4M3>(d.data(), zeros.data(), dim) + 1.0f;
+    REQUIRE(std::abs(EuclideanSpace<float, E4M3>(dim).get_dist_func()(
+                         c.data(), d.data(), dim) -
+                     expectedE4M3L2) <= 1e-5f * dim * e4m3Magnitude);
+    REQUIRE(std::abs(InnerProductSpace<float, E4M3>(dim).get_dist_func()(
+                         c.data(), d.data(), dim) -
+                     expectedE4M3IP) <= 1e-5f * dim * e4m3Magnitude);
+  }
+
+  // The SIMD kernels decode E4M3 arithmetically; make sure that every byte
+  // decodes to the same value as the lookup table:
+  EuclideanSpace<float, E4M3> space(16);
+  std::vector<E4M3> zeros(16);
+  for (int byte = 0; byte < 256; byte++) {
+    std::vector<E4M3> onlyByte = zeros;
+    uint8_t value = byte;
+    std::memcpy(&onlyByte[0], &value, 1);
+    float expected = ALL_E4M3_VALUES[byte] * ALL_E4M3_VALUES[byte];
+    float actual = space.get_dist_func()(onlyByte.data(), zeros.data(), 16);
+    if (std::isnan(expected)) {
+      REQUIRE(std::isnan(actual));
+    } else {
+      REQUIRE(actual == expected);
+    }
+  }
+}
@@ -0,0 +1,193 @@
+// Measures the per-call overhead of the Node binding: how long converting
+// inputs (nested number arrays vs. Float32Arrays) and outputs (ResultType.Array
+// vs. ResultType.TypedArray) takes on top of the search itself.
+//
+// The index is kept small and queried with k = 1 so that the native work is
+// cheap and the marshalling cost dominates. Data is generated from a fixed
+// seed, and each measurement reports the median of several repetitions.
+//
+// Usage: npm run bench [-- --dimensions 128 --calls 20000 --repetitions 5]
+
+import {
+  Index,
+  ResultType,
+  Space,
+} from "../src/voyager-node.ts";
+
+interface BenchOptions {
+  dimensions: number;
+  numItems: number;
+  calls: number;
+  batchSize: number;
+  repetitions: number;
+}
+
+function parseOptions(args: string[]): BenchOptions {
+  const options: BenchOptions = {
+    dimensions: 128,
+    numItems: 1000,
+    calls: 20000,
+    batchSize: 256,
+    repetitions: 5,
+  };
+  for (let i = 0; i < args.length; i += 2) {
+    const value = Number(args[i + 1]);
+    switch (args[i]) {
+      case "--dimensions":
+        options.dimensions = value;
+        break;
+      case "--items":
+        options.numItems = value;
+        break;
+      case "--calls":
+        options.calls = value;
+        break;
+      case "--batch-size":
+        options.batchSize = value;
+        break;
+      case "--repetitions":
+        options.repetitions = value;
+        break;
+      default:
+        throw new Error(`Unknown option: ${args[i]}`);
+    }
+  }
+  return options;
+}
+
+// Small deterministic PRNG (mulberry32), so that every run uses the same data.
+function seededRandom(seed: number): () => number {
+  return () => {
+    seed = (seed + 0x6d2b79f5) | 0;
+    let t = Math.imul(seed ^ (seed >>> 15), 1 | seed);
+    t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t;
+    return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+  };
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number,
+  random: () => number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function flatten(data: number[][]): Float32Array {
+  const numDimensions = data.length > 0 ? data[0].length : 0;
+  const flat = new Float32Array(data.length * numDimensions);
+  data.forEach((vector, i) => flat.set(vector, i * numDimensions));
+  return flat;
+}
+
+// Runs fn() `calls` times per repetition and returns the median time per
+// call, in microseconds.
+function measure(calls: number, repetitions: number, fn: (i: number) => void) {
+  // Warm up, so that the first repetition isn't penalized by JIT compilation.
+  for (let i = 0; i < Math.min(calls, 1000); i++) {
+    fn(i);
+  }
+
+  const times: number[] = [];
+  for (let r = 0; r < repetitions; r++) {
+    const start = process.hrtime.bigint();
+    for (let i = 0; i < calls; i++) {
+      fn(i);
+    }
+    times.push(Number(process.hrtime.bigint() - start) / 1000 / calls);
+  }
+  times.sort((a, b) => a - b);
+  return times[Math.floor(times.length / 2)];
+}
+
+function report(name: string, microseconds: number): void {
+  console.log(`${name.padEnd(48)}${microseconds.toFixed(3).padStart(12)} us`);
+}
+
+function main(): void {
+  const options = parseOptions(process.argv.slice(2));
+  const { dimensions, numItems, calls, batchSize, repetitions } = options;
+  const random = seededRandom(42);
+
+  const items = generateRandomData(numItems, dimensions, random);
+  const queries = generateRandomData(1000, dimensions, random);
+  const flatQueries = queries.map((vector) => Float32Array.from(vector));
+  const batch = queries.slice(0, batchSize);
+  const flatBatch = flatten(batch);
+
+  const index = new Index({ space: Space.Euclidean, numDimensions: dimensions });
+  index.addItems(flatten(items));
+
+  console.log(
+    `${numItems} items, ${dimensions} dimensions, median of ${repetitions} ` +
+      `repetitions, ${calls} calls each`
+  );
+
+  console.log("\nSingle-vector query() (k = 1), time per call:");
+  report("number[] -> Array", measure(calls, repetitions, (i) => {
+    index.query(queries[i % queries.length], 1);
+  }));
+  report("Float32Array -> Array", measure(calls, repetitions, (i) => {
+    index.query(flatQueries[i % flatQueries.length], 1);
+  }));
+  report("number[] -> TypedArray", measure(calls, repetitions, (i) => {
+    index.query(queries[i % queries.length], 1, -1, -1, {
+      resultType: ResultType.TypedArray,
+    });
+  }));
+  report("Float32Array -> TypedArray", measure(calls, repetitions, (i) => {
+    index.query(flatQueries[i % flatQueries.length], 1, -1, -1, {
+      resultType: ResultType.TypedArray,
+    });
+  }));
+  report("Float32Array -> BigIntTypedArray", measure(calls, repetitions, (i) => {
+    index.query(flatQueries[i % flatQueries.length], 1, -1, -1, {
+      resultType: ResultType.BigIntTypedArray,
+    });
+  }));
+
+  const batchCalls = Math.max(1, Math.floor(calls / batchSize));
+  console.log(
+    `\nBatch query() of ${batch.length} vectors (k = 10), time per vector:`
+  );
+  report("number[][] -> Array", measure(batchCalls, repetitions, () => {
+    index.query(batch, 10);
+  }) / batch.length);
+  report("Float32Array -> Array", measure(batchCalls, repetitions, () => {
+    index.query(flatBatch, 10);
+  }) / batch.length);
+  report("Float32Array -> TypedArray", measure(batchCalls, repetitions, () => {
+    index.query(flatBatch, 10, -1, -1, { resultType: ResultType.TypedArray });
+  }) / batch.length);
+
+  // Adding items also inserts them into the graph, so these use fresh indices
+  // and fewer calls; the difference between the two input types is the
+  // conversion cost.
+  const addCalls = Math.min(calls, 5000);
+  const newIndex = () =>
+    new Index({
+      space: Space.Euclidean,
+      numDimensions: dimensions,
+      maxElements: addCalls + 1000,
+    });
+  console.log("\nSingle-vector addItem(), time per call:");
+  let addIndex = newIndex();
+  report("number[]", measure(addCalls, repetitions, (i) => {
+    if (i === 0) addIndex = newIndex();
+    addIndex.addItem(queries[i % queries.length]);
+  }));
+  report("Float32Array", measure(addCalls, repetitions, (i) => {
+    if (i === 0) addIndex = newIndex();
+    addIndex.addItem(flatQueries[i % flatQueries.length]);
+  }));
+}
+
+main();
@@ -1,8 +1,17 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
 #include <cstring>
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <napi.h>
 #include <optional>
 #include <sstream>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 // These are in either ../cpp/src (in dev mode) or ./voyager_src after prepack
@@ -10,31 +19,34 @@
 #include "Enums.h"
 #include "Index.h"
 #include "Metadata.h"
+#include "ShardedIndex.h"
 #include "StreamUtils.h"
 #include "TypedIndex.h"
 
-// Local MemoryInputStream implementation for Node.js bindings
+// Local MemoryInputStream implementation for Node.js bindings. Reads straight
+// from memory owned by the caller (e.g.: a Buffer), which must outlive it.
 class MemoryInputStream : public InputStream {
 public:
-  MemoryInputStream(const std::string &data) : data(data), position(0) {}
+  MemoryInputStream(const char *data, size_t size)
+      : data(data), size(size), position(0) {}
 
   virtual bool isSeekable() { return true; }
-  virtual long long getTotalLength() { return data.size(); }
+  virtual long long getTotalLength() { return size; }
 
   virtual long long read(char *buffer, long long bytesToRead) {
-    long long bytesAvailable = data.size() - position;
+    long long bytesAvailable = size - position;
     long long bytesToActuallyRead = std::min(bytesToRead, bytesAvailable);
     if (bytesToActuallyRead > 0) {
-      std::memcpy(buffer, data.data() + position, bytesToActuallyRead);
+      std::memcpy(buffer, data + position, bytesToActuallyRead);
       position += bytesToActuallyRead;
     }
     return bytesToActuallyRead;
   }
 
-  virtual bool isExhausted() { return position >= data.size(); }
+  virtual bool isExhausted() { return position >= (long long)size; }
   virtual long long getPosition() { return position; }
   virtual bool setPosition(long long newPosition) {
-    if (newPosition < 0 || newPosition > (long long)data.size()) {
+    if (newPosition < 0 || newPosition > (long long)size) {
       return false;
     }
     position = newPosition;
@@ -42,687 +54,2836 @@ public:
   }
 
   virtual uint32_t peek() {
-    if (position + sizeof(uint32_t) > data.size()) {
+    if (position + sizeof(uint32_t) > size) {
       throw std::runtime_error("Failed to peek " +
                                std::to_string(sizeof(uint32_t)) +
                                " bytes from memory stream at index " +
                                std::to_string(position) + ".");
     }
     uint32_t result = 0;
-    std::memcpy(&result, data.data() + position, sizeof(uint32_t));
+    std::memcpy(&result, data + position, sizeof(uint32_t));
     return result;
   }
 
 private:
-  std::string data;
+  const char *data;
+  size_t size;
   long long position;
 };
 
-// Wrapper class for Index that works with Node-API
-class IndexWrapper : public Napi::ObjectWrap<IndexWrapper> {
+// Describe a JS value that a Promise was rejected with (usually an Error).
+std::string DescribeError(const Napi::Value &error) {
+  try {
+    if (error.IsObject()) {
+      Napi::Value message = error.As<Napi::Object>().Get("message");
+      if (message.IsString()) {
+        return message.As<Napi::String>().Utf8Value();
+      }
+    }
+    return error.ToString().Utf8Value();
+  } catch (const Napi::Error &e) {
+    return "Unknown error";
+  }
+}
+
+// Call `function` (which should return a Promise) and pass the value that it
+// resolves to to `onResolved`, or a description of the error to `onRejected`
+// if it throws or the Promise is rejected. Must be called on the main thread.
+void CallPromiseFunction(
+    Napi::Env env, Napi::Function function,
+    const std::vector<napi_value> &args,
+    std::function<void(const Napi::Value &)> onResolved,
+    std::function<void(const std::string &)> onRejected) {
+  try {
+    Napi::Value result = function.Call(args);
+    if (!result.IsPromise()) {
+      onRejected("Expected a Promise to be returned.");
+      return;
+    }
+
+    Napi::Function resolve = Napi::Function::New(
+        env, [onResolved](const Napi::CallbackInfo &info) {
+          onResolved(info[0]);
+        });
+    Napi::Function reject = Napi::Function::New(
+        env, [onRejected](const Napi::CallbackInfo &info) {
+          onRejected(DescribeError(info[0]));
+        });
+    Napi::Object promise = result.As<Napi::Object>();
+    promise.Get("then").As<Napi::Function>().Call(promise, {resolve, reject});
+  } catch (const Napi::Error &e) {
+    onRejected(e.Message());
+  }
+}
+
+// An input stream that pulls its data from JavaScript (e.g.: from a Node.js
+// Readable) while an index is loaded on a worker thread. `pull` is called on
+// the main thread and returns a Promise of the next few chunks of data (as an
+// array of Uint8Arrays), or of null once there is no more data.
+//
+// Up to READ_AHEAD_BYTES are requested ahead of the reader, so the source is
+// never read much faster than the index is loaded, but the many small reads
+// of the index header are served from memory rather than each waiting on the
+// main thread.
+class JSReadableInputStream : public InputStream {
 public:
-  static Napi::Object Init(Napi::Env env, Napi::Object exports);
-  IndexWrapper(const Napi::CallbackInfo &info);
+  static constexpr size_t READ_AHEAD_BYTES = 4 * 1024 * 1024;
+
+  JSReadableInputStream(Napi::ThreadSafeFunction pull)
+      : pull(pull), state(std::make_shared<State>()) {}
+  ~JSReadableInputStream() { pull.Release(); }
+
+  virtual bool isSeekable() { return false; }
+  virtual long long getTotalLength() { return -1; }
+  virtual long long getPosition() { return position; }
+
+  virtual long long read(char *buffer, long long bytesToRead) {
+    return consume(buffer, bytesToRead);
+  }
+
+  virtual bool advanceBy(long long numBytes) {
+    return consume(nullptr, numBytes) == numBytes;
+  }
+
+  virtual bool setPosition(long long newPosition) {
+    return newPosition >= position && advanceBy(newPosition - position);
+  }
+
+  virtual bool isExhausted() {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    waitForBytes(lock, 1);
+    return state->bufferedBytes == 0;
+  }
+
+  virtual uint32_t peek() {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    waitForBytes(lock, sizeof(uint32_t));
+    if (state->bufferedBytes < sizeof(uint32_t)) {
+      throw std::runtime_error("Failed to peek " +
+                               std::to_string(sizeof(uint32_t)) +
+                               " bytes from stream at index " +
+                               std::to_string(position) + ".");
+    }
+
+    // The bytes may be split across chunks:
+    uint32_t result = 0;
+    size_t bytesCopied = 0;
+    size_t offset = state->offsetInFirstChunk;
+    for (const std::vector<char> &chunk : state->chunks) {
+      size_t bytesToCopy =
+          std::min(sizeof(uint32_t) - bytesCopied, chunk.size() - offset);
+      std::memcpy((char *)&result + bytesCopied, chunk.data() + offset,
+                  bytesToCopy);
+      bytesCopied += bytesToCopy;
+      offset = 0;
+      if (bytesCopied == sizeof(uint32_t)) {
+        break;
+      }
+    }
+    return result;
+  }
 
 private:
-  static Napi::FunctionReference constructor;
+  // Shared with the callbacks that run on the main thread, which may outlive
+  // the stream itself.
+  struct State {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::vector<char>> chunks;
+    size_t offsetInFirstChunk = 0;
+    size_t bufferedBytes = 0;
+    bool requestPending = false;
+    bool ended = false;
+    std::string error;
+  };
+
+  // Called on the main thread with the value that `pull` resolved to.
+  static void receive(std::shared_ptr<State> state, const Napi::Value &value) {
+    std::deque<std::vector<char>> received;
+    std::string error;
+    bool ended = value.IsNull() || value.IsUndefined();
+    if (!ended && !value.IsArray()) {
+      error = "Expected an array of chunks or null.";
+    } else if (!ended) {
+      Napi::Array array = value.As<Napi::Array>();
+      for (uint32_t i = 0; i < array.Length() && error.empty(); i++) {
+        Napi::Value element = array.Get(i);
+        if (!element.IsTypedArray() ||
+            element.As<Napi::TypedArray>().TypedArrayType() !=
+                napi_uint8_array) {
+          error = "Expected the stream to produce Buffers or Uint8Arrays.";
+          break;
+        }
+        Napi::Uint8Array chunk = element.As<Napi::Uint8Array>();
+        if (chunk.ByteLength() > 0) {
+          received.emplace_back(chunk.Data(),
+                                chunk.Data() + chunk.ByteLength());
+        }
+      }
+    }
 
-  std::shared_ptr<Index> index_;
+    std::unique_lock<std::mutex> lock(state->mutex);
+    for (std::vector<char> &chunk : received) {
+      state->bufferedBytes += chunk.size();
+      state->chunks.push_back(std::move(chunk));
+    }
+    state->requestPending = false;
+    state->ended = state->ended || ended;
+    if (state->error.empty()) {
+      state->error = error;
+    }
+    state->changed.notify_all();
+  }
 
-  // Methods matching Python API
-  Napi::Value AddItem(const Napi::CallbackInfo &info);
-  Napi::Value AddItems(const Napi::CallbackInfo &info);
-  Napi::Value Query(const Napi::CallbackInfo &info);
-  Napi::Value GetVector(const Napi::CallbackInfo &info);
-  Napi::Value GetVectors(const Napi::CallbackInfo &info);
-  Napi::Value MarkDeleted(const Napi::CallbackInfo &info);
-  Napi::Value UnmarkDeleted(const Napi::CallbackInfo &info);
-  Napi::Value Resize(const Napi::CallbackInfo &info);
-  Napi::Value SaveIndex(const Napi::CallbackInfo &info);
-  static Napi::Value LoadIndex(const Napi::CallbackInfo &info);
-  Napi::Value GetDistance(const Napi::CallbackInfo &info);
+  static void fail(std::shared_ptr<State> state, const std::string &error) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->requestPending = false;
+    if (state->error.empty()) {
+      state->error = "Failed to read from stream: " + error;
+    }
+    state->changed.notify_all();
+  }
 
-  // New methods for Buffer/Stream support
-  Napi::Value ToBuffer(const Napi::CallbackInfo &info);
-  static Napi::Value FromBuffer(const Napi::CallbackInfo &info);
-  Napi::Value Has(const Napi::CallbackInfo &info);
-  Napi::Value ToString(const Napi::CallbackInfo &info);
+  // Ask the main thread for more data. Must be called with the lock held.
+  void requestMoreData() {
+    state->requestPending = true;
+    std::shared_ptr<State> state = this->state;
+    napi_status status = pull.NonBlockingCall(
+        [state](Napi::Env env, Napi::Function pull) {
+          CallPromiseFunction(
+              env, pull, {},
+              [state](const Napi::Value &value) { receive(state, value); },
+              [state](const std::string &error) { fail(state, error); });
+        });
+    if (status != napi_ok) {
+      state->requestPending = false;
+      state->error = "Failed to read from stream: the environment is closing.";
+    }
+  }
 
-  // Property getters/setters
-  Napi::Value GetSpace(const Napi::CallbackInfo &info);
-  Napi::Value GetNumDimensions(const Napi::CallbackInfo &info);
-  Napi::Value GetM(const Napi::CallbackInfo &info);
-  Napi::Value GetEfConstruction(const Napi::CallbackInfo &info);
-  Napi::Value GetMaxElements(const Napi::CallbackInfo &info);
-  Napi::Value GetStorageDataType(const Napi::CallbackInfo &info);
-  Napi::Value GetNumElements(const Napi::CallbackInfo &info);
-  Napi::Value GetIds(const Napi::CallbackInfo &info);
-  Napi::Value GetEf(const Napi::CallbackInfo &info);
-  Napi::Value GetLength(const Napi::CallbackInfo &info);
-  void SetEf(const Napi::CallbackInfo &info, const Napi::Value &value);
-  void SetMaxElements(const Napi::CallbackInfo &info, const Napi::Value &value);
+  // Wait until at least numBytes are buffered, or the end of the data has
+  // been reached, requesting more data if there is room for it.
+  void waitForBytes(std::unique_lock<std::mutex> &lock, size_t numBytes) {
+    while (true) {
+      if (!state->error.empty()) {
+        throw std::runtime_error(state->error);
+      }
+      if (!state->ended && !state->requestPending &&
+          state->bufferedBytes < READ_AHEAD_BYTES) {
+        requestMoreData();
+        continue;
+      }
+      if (state->bufferedBytes >= numBytes || state->ended) {
+        return;
+      }
+      state->changed.wait(lock);
+    }
+  }
 
-  // Helper methods
-  std::vector<float> ArrayToVector(const Napi::Array &arr);
-  Napi::Array VectorToArray(Napi::Env env, const std::vector<float> &vec);
+  // Remove up to numBytes from the front of the stream, copying them into
+  // `buffer` unless it's null, and return how many bytes were removed.
+  long long consume(char *buffer, long long numBytes) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    long long bytesConsumed = 0;
+    while (bytesConsumed < numBytes) {
+      waitForBytes(lock, 1);
+      if (state->bufferedBytes == 0) {
+        break;
+      }
+
+      std::vector<char> &chunk = state->chunks.front();
+      size_t bytesFromChunk =
+          std::min<size_t>(numBytes - bytesConsumed,
+                           chunk.size() - state->offsetInFirstChunk);
+      if (buffer) {
+        std::memcpy(buffer + bytesConsumed,
+                    chunk.data() + state->offsetInFirstChunk, bytesFromChunk);
+      }
+      bytesConsumed += bytesFromChunk;
+      state->bufferedBytes -= bytesFromChunk;
+      state->offsetInFirstChunk += bytesFromChunk;
+      if (state->offsetInFirstChunk == chunk.size()) {
+        state->chunks.pop_front();
+        state->offsetInFirstChunk = 0;
+      }
+    }
+    position += bytesConsumed;
+    return bytesConsumed;
+  }
+
+  Napi::ThreadSafeFunction pull;
+  std::shared_ptr<State> state;
+  long long position = 0;
 };
 
-Napi::FunctionReference IndexWrapper::constructor;
+// An output stream that pushes its data out to JavaScript (e.g.: to a Node.js
+// Writable) while an index is saved on a worker thread. Writes are collected
+// into chunks of CHUNK_SIZE bytes, each of which is passed as a Buffer to
+// `write` on the main thread; `write` returns a Promise that resolves once the
+// destination is ready for more. At most MAX_CHUNKS_IN_FLIGHT chunks are
+// outstanding at a time, so a slow destination holds back the writer rather
+// than the whole index being buffered in memory.
+class JSWritableOutputStream : public OutputStream {
+public:
+  static constexpr size_t CHUNK_SIZE = 4 * 1024 * 1024;
+  static constexpr size_t MAX_CHUNKS_IN_FLIGHT = 2;
 
-Napi::Object IndexWrapper::Init(Napi::Env env, Napi::Object exports) {
-  Napi::HandleScope scope(env);
+  JSWritableOutputStream(Napi::ThreadSafeFunction writeChunk)
+      : writeChunk(writeChunk), state(std::make_shared<State>()) {
+    buffer.reserve(CHUNK_SIZE);
+  }
+  ~JSWritableOutputStream() { writeChunk.Release(); }
+
+  virtual bool write(const char *ptr, unsigned long long numBytes) {
+    while (numBytes > 0) {
+      size_t bytesToCopy =
+          std::min<unsigned long long>(numBytes, CHUNK_SIZE - buffer.size());
+      buffer.insert(buffer.end(), ptr, ptr + bytesToCopy);
+      ptr += bytesToCopy;
+      numBytes -= bytesToCopy;
+      if (buffer.size() == CHUNK_SIZE) {
+        sendBuffer();
+      }
+    }
+    return true;
+  }
 
-  Napi::Function func = DefineClass(
-      env, "Index",
-      {InstanceMethod("addItem", &IndexWrapper::AddItem),
-       InstanceMethod("addItems", &IndexWrapper::AddItems),
-       InstanceMethod("query", &IndexWrapper::Query),
-       InstanceMethod("getVector", &IndexWrapper::GetVector),
-       InstanceMethod("getVectors", &IndexWrapper::GetVectors),
-       InstanceMethod("markDeleted", &IndexWrapper::MarkDeleted),
-       InstanceMethod("unmarkDeleted", &IndexWrapper::UnmarkDeleted),
-       InstanceMethod("resize", &IndexWrapper::Resize),
-       InstanceMethod("saveIndex", &IndexWrapper::SaveIndex),
-       StaticMethod("loadIndex", &IndexWrapper::LoadIndex),
-       InstanceMethod("getDistance", &IndexWrapper::GetDistance),
+  // Send any remaining data, and wait until all of it has been accepted.
+  virtual void flush() {
+    if (!buffer.empty()) {
+      sendBuffer();
+    }
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->changed.wait(lock, [&] {
+      return state->chunksInFlight == 0 || !state->error.empty();
+    });
+    if (!state->error.empty()) {
+      throw std::runtime_error(state->error);
+    }
+  }
 
-       // New methods for Buffer/Stream support
-       InstanceMethod("toBuffer", &IndexWrapper::ToBuffer),
-       StaticMethod("fromBuffer", &IndexWrapper::FromBuffer),
-       InstanceMethod("has", &IndexWrapper::Has),
-       InstanceMethod("toString", &IndexWrapper::ToString),
+private:
+  // Shared with the callbacks that run on the main thread, which may outlive
+  // the stream itself.
+  struct State {
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t chunksInFlight = 0;
+    std::string error;
+  };
+
+  static void finished(std::shared_ptr<State> state,
+                       const std::string &error) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->chunksInFlight--;
+    if (!error.empty() && state->error.empty()) {
+      state->error = "Failed to write to stream: " + error;
+    }
+    state->changed.notify_all();
+  }
 
-       // Property accessors
-       InstanceAccessor("space", &IndexWrapper::GetSpace, nullptr),
-       InstanceAccessor("numDimensions", &IndexWrapper::GetNumDimensions,
-                        nullptr),
-       InstanceAccessor("M", &IndexWrapper::GetM, nullptr),
-       InstanceAccessor("efConstruction", &IndexWrapper::GetEfConstruction,
-                        nullptr),
-       InstanceAccessor("maxElements", &IndexWrapper::GetMaxElements,
-                        &IndexWrapper::SetMaxElements),
-       InstanceAccessor("storageDataType", &IndexWrapper::GetStorageDataType,
-                        nullptr),
-       InstanceAccessor("numElements", &IndexWrapper::GetNumElements, nullptr),
-       InstanceAccessor("ids", &IndexWrapper::GetIds, nullptr),
-       InstanceAccessor("ef", &IndexWrapper::GetEf, &IndexWrapper::SetEf),
-       InstanceAccessor("length", &IndexWrapper::GetLength, nullptr)});
+  void sendBuffer() {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->changed.wait(lock, [&] {
+      return state->chunksInFlight < MAX_CHUNKS_IN_FLIGHT ||
+             !state->error.empty();
+    });
+    if (!state->error.empty()) {
+      throw std::runtime_error(state->error);
+    }
 
-  constructor = Napi::Persistent(func);
-  constructor.SuppressDestruct();
+    std::shared_ptr<std::vector<char>> chunk =
+        std::make_shared<std::vector<char>>();
+    chunk->swap(buffer);
+    buffer.reserve(CHUNK_SIZE);
+
+    std::shared_ptr<State> state = this->state;
+    napi_status status = writeChunk.NonBlockingCall(
+        [state, chunk](Napi::Env env, Napi::Function write) {
+          Napi::Buffer<char> data =
+              Napi::Buffer<char>::Copy(env, chunk->data(), chunk->size());
+          CallPromiseFunction(
+              env, write, {data},
+              [state](const Napi::Value &) { finished(state, ""); },
+              [state](const std::string &error) { finished(state, error); });
+        });
+    if (status != napi_ok) {
+      throw std::runtime_error(
+          "Failed to write to stream: the environment is closing.");
+    }
+    state->chunksInFlight++;
+  }
 
-  exports.Set("Index", func);
-  return exports;
+  Napi::ThreadSafeFunction writeChunk;
+  std::shared_ptr<State> state;
+  std::vector<char> buffer;
+};
+
+// Passes the progress of a build on a worker thread to a JS callback. A report
+// is dropped if the previous one hasn't reached the main thread yet, but the
+// final one always waits until it has been handled. (The index's locks are
+// released before each report, so the callback can search the index.) If the
+// callback throws, the next report throws too, which abandons the build.
+class JSProgressReporter {
+public:
+  JSProgressReporter(Napi::ThreadSafeFunction onProgress)
+      : onProgress(onProgress), state(std::make_shared<State>()) {}
+  ~JSProgressReporter() { onProgress.Release(); }
+
+  void report(size_t numAdded, size_t numTotal) {
+    bool isFinal = numAdded == numTotal;
+    std::unique_lock<std::mutex> lock(state->mutex);
+    if (!state->error.empty()) {
+      throw std::runtime_error(state->error);
+    }
+    if (state->reportsInFlight > 0 && !isFinal) {
+      return;
+    }
+
+    std::shared_ptr<State> state = this->state;
+    napi_status status = onProgress.NonBlockingCall(
+        [state, numAdded, numTotal](Napi::Env env, Napi::Function callback) {
+          std::string error;
+          try {
+            callback.Call({Napi::Number::New(env, numAdded),
+                           Napi::Number::New(env, numTotal)});
+          } catch (const Napi::Error &e) {
+            error = e.Message();
+          }
+          std::unique_lock<std::mutex> lock(state->mutex);
+          state->reportsInFlight--;
+          if (!error.empty() && state->error.empty()) {
+            state->error = error;
+          }
+          state->changed.notify_all();
+        });
+    if (status != napi_ok) {
+      throw std::runtime_error(
+          "Failed to report progress: the environment is closing.");
+    }
+    state->reportsInFlight++;
+
+    if (isFinal) {
+      state->changed.wait(lock, [&] { return state->reportsInFlight == 0; });
+      if (!state->error.empty()) {
+        throw std::runtime_error(state->error);
+      }
+    }
+  }
+
+private:
+  // Shared with the callbacks that run on the main thread, which may outlive
+  // the reporter itself.
+  struct State {
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t reportsInFlight = 0;
+    std::string error;
+  };
+
+  Napi::ThreadSafeFunction onProgress;
+  std::shared_ptr<State> state;
+};
+
+// Options accepted by loadIndex() and fromBuffer(). The first three are only
+// required for legacy indices without metadata; if the index does contain
+// metadata, any provided options are validated against it.
+struct LoadIndexOptions {
+  std::optional<SpaceType> space;
+  std::optional<int> numDimensions;
+  std::optional<StorageDataType> storageDataType;
+  // Memory-map the index file and open it in search-only mode
+  bool mmap = false;
+};
+
+LoadIndexOptions ParseLoadIndexOptions(const Napi::Value &value) {
+  LoadIndexOptions result;
+  if (!value.IsObject()) {
+    return result;
+  }
+
+  Napi::Object options = value.As<Napi::Object>();
+  if (options.Has("space")) {
+    result.space = static_cast<SpaceType>(
+        options.Get("space").As<Napi::Number>().Uint32Value());
+  }
+  if (options.Has("numDimensions")) {
+    result.numDimensions =
+        options.Get("numDimensions").As<Napi::Number>().Int32Value();
+  }
+  if (options.Has("storageDataType")) {
+    result.storageDataType = static_cast<StorageDataType>(
+        options.Get("storageDataType").As<Napi::Number>().Uint32Value());
+  }
+  if (options.Has("mmap")) {
+    result.mmap = options.Get("mmap").ToBoolean().Value();
+  }
+  return result;
 }
 
-IndexWrapper::IndexWrapper(const Napi::CallbackInfo &info)
-    : Napi::ObjectWrap<IndexWrapper>(info) {
-  Napi::Env env = info.Env();
+// Read the replaceDeleted flag from the options of addItem()/addItems().
+bool ParseReplaceDeleted(const Napi::Object &options) {
+  return options.Has("replaceDeleted") &&
+         options.Get("replaceDeleted").ToBoolean().Value();
+}
+
+// Throw if any of the given options don't match the index being loaded.
+void CheckLoadIndexOptions(const LoadIndexOptions &options,
+                           StorageDataType storageDataType, SpaceType space,
+                           int numDimensions) {
+  if (options.storageDataType && storageDataType != *options.storageDataType) {
+    throw std::domain_error(
+        "Provided storage data type (" + toString(*options.storageDataType) +
+        ") does not match the data type used in this file (" +
+        toString(storageDataType) + ").");
+  }
+  if (options.space && space != *options.space) {
+    throw std::domain_error("Provided space type (" + toString(*options.space) +
+                            ") does not match the space type used in this "
+                            "file (" +
+                            toString(space) + ").");
+  }
+  if (options.numDimensions && numDimensions != *options.numDimensions) {
+    throw std::domain_error(
+        "Provided number of dimensions (" +
+        std::to_string(*options.numDimensions) +
+        ") does not match the number of dimensions used in this file (" +
+        std::to_string(numDimensions) + ").");
+  }
+}
+
+// Load an index from the given stream. This doesn't touch any JS values, so
+// it's safe to call from a worker thread. `source` is used in error messages
+// (i.e.: "file" or "buffer").
+std::shared_ptr<Index>
+LoadIndexFromStream(std::shared_ptr<InputStream> inputStream,
+                    const LoadIndexOptions &options,
+                    const std::string &source) {
+  if (isShardedIndex(inputStream)) {
+    std::shared_ptr<Index> index = loadShardedIndexFromStream(inputStream);
+    CheckLoadIndexOptions(options, index->getStorageDataType(),
+                          index->getSpace(), index->getNumDimensions());
+    return index;
+  }
+
+  // Try to load with metadata first
+  std::unique_ptr<voyager::Metadata::V1> metadata =
+      voyager::Metadata::loadFromStream(inputStream);
+
+  if (metadata) {
+    // Modern index with metadata - validate if options were provided
+    CheckLoadIndexOptions(options, metadata->getStorageDataType(),
+                          metadata->getSpaceType(),
+                          metadata->getNumDimensions());
+    return loadTypedIndexFromMetadata(std::move(metadata), inputStream,
+                                      options.mmap);
+  }
+
+  // Legacy index without metadata - need explicit parameters
+  if (!options.numDimensions || *options.numDimensions <= 0) {
+    throw std::invalid_argument(
+        "Index " + source +
+        " has no metadata. Please provide space, numDimensions, and "
+        "storageDataType options.");
+  }
+
+  SpaceType space = options.space.value_or(SpaceType::Euclidean);
+  int numDimensions = *options.numDimensions;
+  switch (options.storageDataType.value_or(StorageDataType::Float32)) {
+  case StorageDataType::Float32:
+    return std::make_shared<TypedIndex<float>>(inputStream, space,
+                                               numDimensions, options.mmap);
+  case StorageDataType::Float8:
+    return std::make_shared<TypedIndex<float, int8_t, std::ratio<1, 127>>>(
+        inputStream, space, numDimensions, options.mmap);
+  case StorageDataType::E4M3:
+    return std::make_shared<TypedIndex<float, E4M3>>(
+        inputStream, space, numDimensions, options.mmap);
+  default:
+    throw std::invalid_argument("Unknown storage data type received.");
+  }
+}
+
+// Load an index from the file at `path`, either by reading it into memory or
+// (if requested) by serving it directly from a read-only memory mapping.
+std::shared_ptr<Index> LoadIndexFromFile(const std::string &path,
+                                         const LoadIndexOptions &options) {
+  std::shared_ptr<InputStream> inputStream;
+  if (options.mmap) {
+    inputStream = std::make_shared<MemoryMappedInputStream>(path);
+  } else {
+    inputStream = std::make_shared<FileInputStream>(path);
+  }
+
+  // A sharded index's shards may be saved in files of their own, next to
+  // this one.
+  if (isShardedIndex(inputStream)) {
+    inputStream.reset();
+    std::shared_ptr<Index> index = loadShardedIndex(path, options.mmap);
+    CheckLoadIndexOptions(options, index->getStorageDataType(),
+                          index->getSpace(), index->getNumDimensions());
+    return index;
+  }
+
+  // Snapshots written by a change log are brought up to date by replaying it.
+  std::shared_ptr<Index> index =
+      LoadIndexFromStream(inputStream, options, "file");
+  if (index->isLogAware()) {
+    index->openChangeLog(path);
+  }
+  return index;
+}
+
+// One or more vectors converted out of JS values, stored flat in row-major
+// order so that they can be moved straight into an NDArray without another
+// copy.
+struct FloatMatrix {
+  std::vector<float> data;
+  // If set, the vectors are read in place from a Float32Array instead of
+  // `data` (see ReadFlatMatrix). That's only valid until the JS call that
+  // parsed them returns, so anything that uses them later (i.e.: an async
+  // worker) must call Own() first.
+  const float *borrowed = nullptr;
+  int numRows = 0;
+  int numColumns = 0;
+
+  const float *Data() const { return borrowed ? borrowed : data.data(); }
+
+  // Copy any borrowed vectors into `data`.
+  void Own() {
+    if (borrowed) {
+      data.assign(borrowed, borrowed + (size_t)numRows * numColumns);
+      borrowed = nullptr;
+    }
+  }
+};
+
+NDArray<float, 2> ToNDArray(FloatMatrix &&matrix) {
+  matrix.Own();
+  return NDArray<float, 2>(std::move(matrix.data),
+                           {matrix.numRows, matrix.numColumns});
+}
+
+std::vector<float> ToVector(FloatMatrix &&matrix) {
+  matrix.Own();
+  return std::move(matrix.data);
+}
+
+bool IsFloat32Array(const Napi::Value &value) {
+  return value.IsTypedArray() &&
+         value.As<Napi::TypedArray>().TypedArrayType() == napi_float32_array;
+}
+
+// Append the contents of a JS array of numbers or a Float32Array to `out`,
+// returning the number of elements appended.
+size_t AppendVector(const Napi::Value &value, std::vector<float> &out) {
+  if (IsFloat32Array(value)) {
+    Napi::Float32Array array = value.As<Napi::Float32Array>();
+    out.insert(out.end(), array.Data(), array.Data() + array.ElementLength());
+    return array.ElementLength();
+  }
+
+  Napi::Array array = value.As<Napi::Array>();
+  uint32_t length = array.Length();
+  for (uint32_t i = 0; i < length; i++) {
+    out.push_back(array.Get(i).As<Napi::Number>().FloatValue());
+  }
+  return length;
+}
+
+// Append a single row to `matrix`, using the first row as the reference
+// dimensionality. Return false (with a pending JS exception) if the row has a
+// different number of elements than the rows before it.
+bool AppendRow(Napi::Env env, const Napi::Value &row, FloatMatrix &matrix) {
+  int length = AppendVector(row, matrix.data);
+  if (matrix.numRows == 0) {
+    matrix.numColumns = length;
+  } else if (length != matrix.numColumns) {
+    Napi::Error::New(env, "All vectors must be of the same size, but "
+                          "received vectors of size: " +
+                              std::to_string(matrix.numColumns) + " and " +
+                              std::to_string(length) + ".")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  matrix.numRows++;
+  return true;
+}
+
+// Interpret a flat Float32Array as rows of `numColumns` elements each, stored
+// back to back, borrowing its contents rather than copying them. Return false
+// (with a pending JS exception) if the length of the array isn't a multiple
+// of `numColumns`.
+bool ReadFlatMatrix(Napi::Env env, const Napi::Float32Array &array,
+                    int numColumns, const std::string &methodName,
+                    FloatMatrix &matrix) {
+  size_t length = array.ElementLength();
+  if (numColumns <= 0 || length % numColumns != 0) {
+    Napi::TypeError::New(env, methodName + "() expected a Float32Array whose "
+                                           "length (" +
+                                  std::to_string(length) +
+                                  ") is a multiple of the number of "
+                                  "dimensions (" +
+                                  std::to_string(numColumns) + ")")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  matrix.data.clear();
+  matrix.borrowed = array.Data();
+  matrix.numRows = length / numColumns;
+  matrix.numColumns = numColumns;
+  return true;
+}
+
+// How query() and getVectors() hand their results back to JS. This mirrors
+// the ResultType enum in voyager-node.ts.
+enum class ResultType : int {
+  // Plain (nested) JS arrays of numbers.
+  Array = 0,
+  // Flat, row-major typed arrays: Float64Array neighbor IDs and Float32Array
+  // distances or vectors.
+  TypedArray = 1,
+  // As TypedArray, but with BigUint64Array neighbor IDs.
+  BigIntTypedArray = 2,
+};
+
+ResultType ParseResultType(const Napi::Value &value) {
+  if (!value.IsNumber()) {
+    return ResultType::Array;
+  }
+  int resultType = value.As<Napi::Number>().Int32Value();
+  if (resultType < static_cast<int>(ResultType::Array) ||
+      resultType > static_cast<int>(ResultType::BigIntTypedArray)) {
+    throw std::invalid_argument("Unknown result type: " +
+                                std::to_string(resultType));
+  }
+  return static_cast<ResultType>(resultType);
+}
+
+// Hand ownership of `values` to a new JS typed array. Unless the runtime
+// forbids external buffers, the vector's storage is wrapped in place and freed
+// once the typed array is garbage collected; otherwise it's copied.
+template <typename T, typename S>
+Napi::TypedArrayOf<T> ToTypedArray(Napi::Env env, std::vector<S> &&values) {
+  static_assert(sizeof(T) == sizeof(S) && std::is_arithmetic_v<S>,
+                "Typed array elements must have the same layout as the "
+                "vector's elements.");
+
+  size_t length = values.size();
+#ifndef NODE_API_NO_EXTERNAL_BUFFERS_ALLOWED
+  if (length > 0) {
+    auto *storage = new std::vector<S>(std::move(values));
+    Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(
+        env, storage->data(), length * sizeof(S),
+        [](Napi::Env, void *, std::vector<S> *storage) { delete storage; },
+        storage);
+    return Napi::TypedArrayOf<T>::New(env, length, buffer, 0);
+  }
+#endif
+
+  Napi::TypedArrayOf<T> result = Napi::TypedArrayOf<T>::New(env, length);
+  if (length > 0) {
+    std::memcpy(result.Data(), values.data(), length * sizeof(S));
+  }
+  return result;
+}
+
+// Convert a list of IDs (an array of numbers, a Uint32Array, a Float64Array
+// or a BigUint64Array) into a filter that only allows those IDs. The IDs are
+// copied, so the filter stays valid after the JS value is garbage collected.
+std::shared_ptr<const hnswlib::BaseFilterFunctor>
+ParseAllowedIds(const Napi::Value &value) {
+  std::vector<hnswlib::labeltype> labels;
+  if (value.IsTypedArray()) {
+    Napi::TypedArray array = value.As<Napi::TypedArray>();
+    switch (array.TypedArrayType()) {
+    case napi_uint32_array: {
+      const uint32_t *data = value.As<Napi::Uint32Array>().Data();
+      labels.assign(data, data + array.ElementLength());
+      break;
+    }
+    case napi_float64_array: {
+      const double *data = value.As<Napi::Float64Array>().Data();
+      labels.assign(data, data + array.ElementLength());
+      break;
+    }
+    case napi_biguint64_array: {
+      const uint64_t *data = value.As<Napi::BigUint64Array>().Data();
+      labels.assign(data, data + array.ElementLength());
+      break;
+    }
+    default:
+      throw std::invalid_argument(
+          "allowedIds must be an array of numbers, a Uint32Array, a "
+          "Float64Array or a BigUint64Array");
+    }
+  } else if (value.IsArray()) {
+    Napi::Array array = value.As<Napi::Array>();
+    labels.reserve(array.Length());
+    for (uint32_t i = 0; i < array.Length(); i++) {
+      labels.push_back(array.Get(i).As<Napi::Number>().Int64Value());
+    }
+  } else {
+    throw std::invalid_argument(
+        "allowedIds must be an array of numbers, a Uint32Array, a "
+        "Float64Array or a BigUint64Array");
+  }
+  return std::make_shared<hnswlib::SortedLabelFilter>(std::move(labels));
+}
+
+// Convert a Uint8Array bitmap (bit i % 8 of byte i / 8 set if ID i is allowed)
+// into a filter. As with ParseAllowedIds, the bitmap is copied.
+std::shared_ptr<const hnswlib::BaseFilterFunctor>
+ParseAllowedIdsBitmap(const Napi::Value &value) {
+  if (!value.IsTypedArray() ||
+      value.As<Napi::TypedArray>().TypedArrayType() != napi_uint8_array) {
+    throw std::invalid_argument("allowedIdsBitmap must be a Uint8Array");
+  }
+  Napi::Uint8Array array = value.As<Napi::Uint8Array>();
+  return std::make_shared<hnswlib::LabelBitmapFilter>(std::vector<uint8_t>(
+      array.Data(), array.Data() + array.ElementLength()));
+}
+
+// Convert the allowedIds or allowedIdsBitmap option of query()/rangeSearch()
+// into a filter, or return null if neither is given.
+std::shared_ptr<const hnswlib::BaseFilterFunctor>
+ParseFilterOptions(const Napi::Object &options) {
+  Napi::Value allowedIds = options.Get("allowedIds");
+  Napi::Value allowedIdsBitmap = options.Get("allowedIdsBitmap");
+  if (!allowedIds.IsUndefined() && !allowedIdsBitmap.IsUndefined()) {
+    throw std::invalid_argument(
+        "accepts either allowedIds or allowedIdsBitmap, not both");
+  }
+  if (!allowedIds.IsUndefined()) {
+    return ParseAllowedIds(allowedIds);
+  } else if (!allowedIdsBitmap.IsUndefined()) {
+    return ParseAllowedIdsBitmap(allowedIdsBitmap);
+  }
+  return nullptr;
+}
+
+// Query arguments, converted out of JS values so that the search itself can
+// run without touching the JS heap.
+struct QueryInput {
+  bool isSingleVector = false;
+  FloatMatrix vectors;
+  int k = 1;
+  int numThreads = -1;
+  long queryEf = -1;
+  ResultType resultType = ResultType::Array;
+  // If set, only these IDs may be returned.
+  std::shared_ptr<const hnswlib::BaseFilterFunctor> filter;
+  // Whether to return the work done by each query alongside its results.
+  bool includeStats = false;
+  // If positive, the number of candidates to re-rank at full precision.
+  int rerank = 0;
+};
+
+// Query results in a flat, row-major layout (numRows x k).
+struct QueryOutput {
+  bool isSingleVector = false;
+  ResultType resultType = ResultType::Array;
+  size_t numRows = 0;
+  size_t k = 0;
+  std::vector<hnswlib::labeltype> neighbors;
+  std::vector<float> distances;
+  // One entry per query vector, or empty if stats weren't requested.
+  std::vector<hnswlib::SearchStats> stats;
+};
+
+QueryOutput RunQuery(Index &index, QueryInput &&input) {
+  QueryOutput output;
+  output.isSingleVector = input.isSingleVector;
+  output.resultType = input.resultType;
+  output.k = input.k;
+
+  if (input.vectors.borrowed) {
+    // A Float32Array of the index's number of dimensions (i.e.: passed to a
+    // synchronous call), which can be searched in place:
+    output.numRows = input.vectors.numRows;
+    output.neighbors.resize(output.numRows * input.k);
+    output.distances.resize(output.numRows * input.k);
+    index.queryInto(input.vectors.Data(), output.numRows, input.k,
+                    output.neighbors.data(), output.distances.data(),
+                    input.numThreads, input.queryEf, input.filter.get(),
+                    input.includeStats ? &output.stats : nullptr,
+                    input.rerank);
+  } else if (input.isSingleVector) {
+    if (input.includeStats) {
+      output.stats.resize(1);
+    }
+    auto [neighborIds, distances] =
+        index.query(ToVector(std::move(input.vectors)), input.k, input.queryEf,
+                    input.filter.get(),
+                    input.includeStats ? &output.stats[0] : nullptr,
+                    input.rerank);
+    output.numRows = 1;
+    output.neighbors = std::move(neighborIds);
+    output.distances = std::move(distances);
+  } else {
+    auto [neighborIds, distances] =
+        index.query(ToNDArray(std::move(input.vectors)), input.k,
+                    input.numThreads, input.queryEf, input.filter.get(),
+                    input.includeStats ? &output.stats : nullptr,
+                    input.rerank);
+    output.numRows = neighborIds.shape[0];
+    output.neighbors = std::move(neighborIds.data);
+    output.distances = std::move(distances.data);
+  }
+  return output;
+}
+
+// Convert search stats into a plain JS object, mirroring SearchStats in
+// voyager-node.ts; `searches` is only included for totals across queries.
+Napi::Object SearchStatsToObject(Napi::Env env,
+                                 const hnswlib::SearchStats &stats,
+                                 bool includeSearches = false) {
+  Napi::Object result = Napi::Object::New(env);
+  if (includeSearches) {
+    result.Set("searches", Napi::Number::New(env, stats.searches));
+  }
+  result.Set("hops", Napi::Number::New(env, stats.hops));
+  result.Set("distanceComputations",
+             Napi::Number::New(env, stats.distanceComputations));
+  result.Set("visitedNodes", Napi::Number::New(env, stats.visitedNodes));
+  result.Set("elapsedMs", Napi::Number::New(env, stats.elapsedSeconds * 1e3));
+  return result;
+}
+
+Napi::Array SearchStatsToArray(Napi::Env env,
+                               const std::vector<hnswlib::SearchStats> &stats) {
+  Napi::Array result = Napi::Array::New(env, stats.size());
+  for (size_t i = 0; i < stats.size(); i++) {
+    result[i] = SearchStatsToObject(env, stats[i]);
+  }
+  return result;
+}
+
+Napi::Object QueryOutputToObject(Napi::Env env, QueryOutput &&output) {
+  bool includeStats = !output.stats.empty();
+  if (output.resultType != ResultType::Array) {
+    // Single and batch results share the same flat layout here; batch results
+    // are laid out row-major, k entries per query vector.
+    Napi::Object result = Napi::Object::New(env);
+    if (output.resultType == ResultType::BigIntTypedArray) {
+      result.Set("neighbors", ToTypedArray<uint64_t>(
+                                  env, std::move(output.neighbors)));
+    } else {
+      Napi::Float64Array neighbors =
+          Napi::Float64Array::New(env, output.neighbors.size());
+      std::copy(output.neighbors.begin(), output.neighbors.end(),
+                neighbors.Data());
+      result.Set("neighbors", neighbors);
+    }
+    result.Set("distances",
+               ToTypedArray<float>(env, std::move(output.distances)));
+    if (includeStats) {
+      result.Set("stats", SearchStatsToArray(env, output.stats));
+    }
+    return result;
+  }
+
+  if (output.isSingleVector) {
+    Napi::Array result = Napi::Array::New(env);
+    Napi::Array neighbors = Napi::Array::New(env, output.k);
+    Napi::Array distances = Napi::Array::New(env, output.k);
+    for (size_t j = 0; j < output.k; j++) {
+      neighbors[j] = Napi::Number::New(env, output.neighbors[j]);
+      distances[j] = Napi::Number::New(env, output.distances[j]);
+    }
+    result.Set("neighbors", neighbors);
+    result.Set("distances", distances);
+    if (includeStats) {
+      result.Set("stats", SearchStatsToObject(env, output.stats[0]));
+    }
+    return result;
+  }
+
+  // Convert 2D results to nested JavaScript arrays
+  Napi::Object result = Napi::Object::New(env);
+  Napi::Array neighborsResult = Napi::Array::New(env, output.numRows);
+  Napi::Array distancesResult = Napi::Array::New(env, output.numRows);
+
+  for (size_t i = 0; i < output.numRows; i++) {
+    Napi::Array neighborRow = Napi::Array::New(env, output.k);
+    Napi::Array distanceRow = Napi::Array::New(env, output.k);
+
+    for (size_t j = 0; j < output.k; j++) {
+      neighborRow[j] =
+          Napi::Number::New(env, output.neighbors[i * output.k + j]);
+      distanceRow[j] =
+          Napi::Number::New(env, output.distances[i * output.k + j]);
+    }
+
+    neighborsResult[i] = neighborRow;
+    distancesResult[i] = distanceRow;
+  }
+
+  result.Set("neighbors", neighborsResult);
+  result.Set("distances", distancesResult);
+  if (includeStats) {
+    result.Set("stats", SearchStatsToArray(env, output.stats));
+  }
+  return result;
+}
+
+// rangeSearch() arguments, converted out of JS values like QueryInput.
+struct RangeSearchInput {
+  bool isSingleVector = false;
+  FloatMatrix vectors;
+  float radius = 0;
+  // If nonzero, only the nearest this many results are returned per query.
+  size_t maxResults = 0;
+  int numThreads = -1;
+  long queryEf = -1;
+  ResultType resultType = ResultType::TypedArray;
+  std::shared_ptr<const hnswlib::BaseFilterFunctor> filter;
+};
+
+struct RangeSearchOutput {
+  bool isSingleVector = false;
+  ResultType resultType = ResultType::TypedArray;
+  RangeSearchResults results;
+};
+
+RangeSearchOutput RunRangeSearch(Index &index, RangeSearchInput &&input) {
+  RangeSearchOutput output;
+  output.isSingleVector = input.isSingleVector;
+  output.resultType = input.resultType;
+
+  if (input.isSingleVector) {
+    auto [neighborIds, distances] = index.rangeSearch(
+        ToVector(std::move(input.vectors)), input.radius, input.maxResults,
+        input.queryEf, input.filter.get());
+    output.results.offsets = {0, neighborIds.size()};
+    output.results.labels = std::move(neighborIds);
+    output.results.distances = std::move(distances);
+  } else {
+    output.results = index.rangeSearch(
+        ToNDArray(std::move(input.vectors)), input.radius, input.maxResults,
+        input.numThreads, input.queryEf, input.filter.get());
+  }
+  return output;
+}
+
+// Convert range search results into typed arrays. Each query finds a different
+// number of results, so batch results also include `offsets`: the results of
+// query i are at indices [offsets[i], offsets[i + 1]).
+Napi::Object RangeSearchOutputToObject(Napi::Env env,
+                                       RangeSearchOutput &&output) {
+  Napi::Object result = Napi::Object::New(env);
+  RangeSearchResults &results = output.results;
+  if (!output.isSingleVector) {
+    Napi::Uint32Array offsets =
+        Napi::Uint32Array::New(env, results.offsets.size());
+    std::copy(results.offsets.begin(), results.offsets.end(), offsets.Data());
+    result.Set("offsets", offsets);
+  }
+  if (output.resultType == ResultType::BigIntTypedArray) {
+    result.Set("neighbors",
+               ToTypedArray<uint64_t>(env, std::move(results.labels)));
+  } else {
+    Napi::Float64Array neighbors =
+        Napi::Float64Array::New(env, results.labels.size());
+    std::copy(results.labels.begin(), results.labels.end(), neighbors.Data());
+    result.Set("neighbors", neighbors);
+  }
+  result.Set("distances", ToTypedArray<float>(env, std::move(results.distances)));
+  return result;
+}
+
+Napi::Array IdsToArray(Napi::Env env,
+                       const std::vector<hnswlib::labeltype> &ids) {
+  Napi::Array result = Napi::Array::New(env, ids.size());
+  for (size_t i = 0; i < ids.size(); i++) {
+    result[i] = Napi::Number::New(env, ids[i]);
+  }
+  return result;
+}
+
+// Indices that have been shared with other threads (i.e.: worker_threads)
+// via Index.share(), keyed by the handle that Index.attach() takes. Every
+// thread in the process shares one native heap, so attaching an index just
+// gives another isolate a reference to the same memory. Entries are weak: a
+// shared index is freed as soon as no Index object on any thread uses it.
+class SharedIndices {
+public:
+  static int64_t Add(std::shared_ptr<Index> index) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = indices.begin(); it != indices.end();) {
+      if (it->second.expired()) {
+        it = indices.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    int64_t handle = nextHandle++;
+    indices[handle] = index;
+    return handle;
+  }
+
+  // Returns nullptr if no live index was shared with this handle.
+  static std::shared_ptr<Index> Get(int64_t handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = indices.find(handle);
+    return it == indices.end() ? nullptr : it->second.lock();
+  }
+
+private:
+  static inline std::mutex mutex;
+  static inline std::unordered_map<int64_t, std::weak_ptr<Index>> indices;
+  static inline int64_t nextHandle = 1;
+};
+
+// Wrapper class for Index that works with Node-API
+class IndexWrapper : public Napi::ObjectWrap<IndexWrapper> {
+public:
+  static Napi::Object Init(Napi::Env env, Napi::Object exports);
+  IndexWrapper(const Napi::CallbackInfo &info);
+
+  // Wrap an already-constructed native index in a new JS Index object
+  static Napi::Object NewInstance(Napi::Env env, std::shared_ptr<Index> index);
+
+private:
+  std::shared_ptr<Index> index_;
+
+  // The handle returned by share() (or passed to attach()), or 0 if this
+  // index has never been shared. Shared indices can only be searched, by the
+  // thread that shared them as well as those that attached them, as any of
+  // them may be querying the index at the same time.
+  int64_t sharedHandle_ = 0;
+
+  // Whether this index was attached from another thread (rather than being
+  // the one that called share()).
+  bool attached_ = false;
+
+  // The number of async calls that modify the index (e.g.: addItemsAsync())
+  // still running, which share() waits for.
+  std::shared_ptr<int> pendingWrites_ = std::make_shared<int>(0);
+
+  // Methods matching Python API
+  Napi::Value AddItem(const Napi::CallbackInfo &info);
+  Napi::Value AddItems(const Napi::CallbackInfo &info);
+  Napi::Value Query(const Napi::CallbackInfo &info);
+  Napi::Value RangeSearch(const Napi::CallbackInfo &info);
+  Napi::Value GetVector(const Napi::CallbackInfo &info);
+  Napi::Value GetVectors(const Napi::CallbackInfo &info);
+  Napi::Value MarkDeleted(const Napi::CallbackInfo &info);
+  Napi::Value UnmarkDeleted(const Napi::CallbackInfo &info);
+  Napi::Value Resize(const Napi::CallbackInfo &info);
+  Napi::Value Compact(const Napi::CallbackInfo &info);
+  Napi::Value Train(const Napi::CallbackInfo &info);
+  Napi::Value Reorder(const Napi::CallbackInfo &info);
+  Napi::Value SaveIndex(const Napi::CallbackInfo &info);
+  static Napi::Value LoadIndex(const Napi::CallbackInfo &info);
+  Napi::Value GetDistance(const Napi::CallbackInfo &info);
+
+  // Saving and replacing the shards of a sharded index one at a time
+  Napi::Value SaveShard(const Napi::CallbackInfo &info);
+  Napi::Value LoadShard(const Napi::CallbackInfo &info);
+
+  // Persisting changes incrementally, to a log next to the index's file
+  Napi::Value OpenChangeLog(const Napi::CallbackInfo &info);
+  Napi::Value Checkpoint(const Napi::CallbackInfo &info);
+  Napi::Value CheckpointAsync(const Napi::CallbackInfo &info);
+  Napi::Value CloseChangeLog(const Napi::CallbackInfo &info);
+
+  // Promise-returning variants that run on the libuv threadpool
+  Napi::Value AddItemsAsync(const Napi::CallbackInfo &info);
+  Napi::Value QueryAsync(const Napi::CallbackInfo &info);
+  Napi::Value RangeSearchAsync(const Napi::CallbackInfo &info);
+  Napi::Value SaveIndexAsync(const Napi::CallbackInfo &info);
+  static Napi::Value LoadIndexAsync(const Napi::CallbackInfo &info);
+  Napi::Value SaveToStream(const Napi::CallbackInfo &info);
+  static Napi::Value LoadFromStream(const Napi::CallbackInfo &info);
+  Napi::Value CompactAsync(const Napi::CallbackInfo &info);
+  Napi::Value ReorderAsync(const Napi::CallbackInfo &info);
+
+  // Building an empty index from many vectors at once
+  Napi::Value BuildFromArray(const Napi::CallbackInfo &info);
+  Napi::Value BuildFromArrayAsync(const Napi::CallbackInfo &info);
+
+  // New methods for Buffer/Stream support
+  Napi::Value ToBuffer(const Napi::CallbackInfo &info);
+  static Napi::Value FromBuffer(const Napi::CallbackInfo &info);
+  Napi::Value Has(const Napi::CallbackInfo &info);
+  Napi::Value ToString(const Napi::CallbackInfo &info);
+
+  // Sharing one index between worker_threads
+  Napi::Value Share(const Napi::CallbackInfo &info);
+  static Napi::Value Attach(const Napi::CallbackInfo &info);
+
+  // Search instrumentation
+  Napi::Value Stats(const Napi::CallbackInfo &info);
+  Napi::Value ResetStats(const Napi::CallbackInfo &info);
+
+  // Property getters/setters
+  Napi::Value GetSpace(const Napi::CallbackInfo &info);
+  Napi::Value GetNumDimensions(const Napi::CallbackInfo &info);
+  Napi::Value GetM(const Napi::CallbackInfo &info);
+  Napi::Value GetEfConstruction(const Napi::CallbackInfo &info);
+  Napi::Value GetMaxElements(const Napi::CallbackInfo &info);
+  Napi::Value GetStorageDataType(const Napi::CallbackInfo &info);
+  Napi::Value GetNumElements(const Napi::CallbackInfo &info);
+  Napi::Value GetIds(const Napi::CallbackInfo &info);
+  Napi::Value GetEf(const Napi::CallbackInfo &info);
+  Napi::Value GetLength(const Napi::CallbackInfo &info);
+  Napi::Value GetNumShards(const Napi::CallbackInfo &info);
+  Napi::Value GetAutoGrow(const Napi::CallbackInfo &info);
+  void SetEf(const Napi::CallbackInfo &info, const Napi::Value &value);
+  void SetMaxElements(const Napi::CallbackInfo &info, const Napi::Value &value);
+  void SetAutoGrow(const Napi::CallbackInfo &info, const Napi::Value &value);
+
+  // Helper methods
+  std::vector<float> ArrayToVector(const Napi::Array &arr);
+  Napi::Array VectorToArray(Napi::Env env, const std::vector<float> &vec);
+
+  // Convert the JS arguments of addItems()/query() into C++ values. Return
+  // false (with a pending JS exception) if the arguments are invalid.
+  bool ParseAddItemsArguments(const Napi::CallbackInfo &info,
+                              const std::string &methodName,
+                              FloatMatrix &vectors,
+                              std::vector<hnswlib::labeltype> &ids,
+                              int &numThreads, bool &replaceDeleted);
+  bool ParseQueryArguments(const Napi::CallbackInfo &info,
+                           const std::string &methodName, QueryInput &input);
+  bool ParseRangeSearchArguments(const Napi::CallbackInfo &info,
+                                 const std::string &methodName,
+                                 RangeSearchInput &input);
+  // Convert a single query vector, an array of them or a flat Float32Array
+  // holding several back to back, as accepted by query()/rangeSearch().
+  bool ParseQueryVectors(Napi::Env env, const Napi::Value &value,
+                         const std::string &methodName, bool &isSingleVector,
+                         FloatMatrix &vectors);
+  // As ParseAddItemsArguments, plus the onProgress option (which is left
+  // empty if not given) of buildFromArray()/buildFromArrayAsync().
+  bool ParseBuildArguments(const Napi::CallbackInfo &info,
+                           const std::string &methodName, FloatMatrix &vectors,
+                           std::vector<hnswlib::labeltype> &ids,
+                           int &numThreads, Napi::Function &onProgress);
+
+  // Return false (with a pending JS exception) if this index has been shared
+  // with (or attached from) another thread, and so can't be modified.
+  bool CheckNotShared(Napi::Env env, const std::string &methodName);
+
+  // Return the index as a ShardedIndex, or null (with a pending JS exception)
+  // if it isn't sharded.
+  ShardedIndex *GetShardedIndex(Napi::Env env, const std::string &methodName);
+};
+
+Napi::Object IndexWrapper::Init(Napi::Env env, Napi::Object exports) {
+  Napi::HandleScope scope(env);
+
+  Napi::Function func = DefineClass(
+      env, "Index",
+      {InstanceMethod("addItem", &IndexWrapper::AddItem),
+       InstanceMethod("addItems", &IndexWrapper::AddItems),
+       InstanceMethod("query", &IndexWrapper::Query),
+       InstanceMethod("rangeSearch", &IndexWrapper::RangeSearch),
+       InstanceMethod("getVector", &IndexWrapper::GetVector),
+       InstanceMethod("getVectors", &IndexWrapper::GetVectors),
+       InstanceMethod("markDeleted", &IndexWrapper::MarkDeleted),
+       InstanceMethod("unmarkDeleted", &IndexWrapper::UnmarkDeleted),
+       InstanceMethod("resize", &IndexWrapper::Resize),
+       InstanceMethod("compact", &IndexWrapper::Compact),
+       InstanceMethod("train", &IndexWrapper::Train),
+       InstanceMethod("reorder", &IndexWrapper::Reorder),
+       InstanceMethod("saveIndex", &IndexWrapper::SaveIndex),
+       StaticMethod("loadIndex", &IndexWrapper::LoadIndex),
+       InstanceMethod("getDistance", &IndexWrapper::GetDistance),
+       InstanceMethod("saveShard", &IndexWrapper::SaveShard),
+       InstanceMethod("loadShard", &IndexWrapper::LoadShard),
+       InstanceMethod("openChangeLog", &IndexWrapper::OpenChangeLog),
+       InstanceMethod("checkpoint", &IndexWrapper::Checkpoint),
+       InstanceMethod("checkpointAsync", &IndexWrapper::CheckpointAsync),
+       InstanceMethod("closeChangeLog", &IndexWrapper::CloseChangeLog),
+
+       // Async methods
+       InstanceMethod("addItemsAsync", &IndexWrapper::AddItemsAsync),
+       InstanceMethod("queryAsync", &IndexWrapper::QueryAsync),
+       InstanceMethod("rangeSearchAsync", &IndexWrapper::RangeSearchAsync),
+       InstanceMethod("saveIndexAsync", &IndexWrapper::SaveIndexAsync),
+       StaticMethod("loadIndexAsync", &IndexWrapper::LoadIndexAsync),
+       InstanceMethod("saveToStream", &IndexWrapper::SaveToStream),
+       StaticMethod("loadFromStream", &IndexWrapper::LoadFromStream),
+       InstanceMethod("compactAsync", &IndexWrapper::CompactAsync),
+       InstanceMethod("reorderAsync", &IndexWrapper::ReorderAsync),
+
+       // Building an empty index from many vectors at once
+       InstanceMethod("buildFromArray", &IndexWrapper::BuildFromArray),
+       InstanceMethod("buildFromArrayAsync",
+                      &IndexWrapper::BuildFromArrayAsync),
+
+       // New methods for Buffer/Stream support
+       InstanceMethod("toBuffer", &IndexWrapper::ToBuffer),
+       StaticMethod("fromBuffer", &IndexWrapper::FromBuffer),
+       InstanceMethod("has", &IndexWrapper::Has),
+       InstanceMethod("toString", &IndexWrapper::ToString),
+
+       // Sharing one index between worker_threads
+       InstanceMethod("share", &IndexWrapper::Share),
+       StaticMethod("attach", &IndexWrapper::Attach),
+
+       // Search instrumentation
+       InstanceMethod("stats", &IndexWrapper::Stats),
+       InstanceMethod("resetStats", &IndexWrapper::ResetStats),
+
+       // Property accessors
+       InstanceAccessor("space", &IndexWrapper::GetSpace, nullptr),
+       InstanceAccessor("numDimensions", &IndexWrapper::GetNumDimensions,
+                        nullptr),
+       InstanceAccessor("M", &IndexWrapper::GetM, nullptr),
+       InstanceAccessor("efConstruction", &IndexWrapper::GetEfConstruction,
+                        nullptr),
+       InstanceAccessor("maxElements", &IndexWrapper::GetMaxElements,
+                        &IndexWrapper::SetMaxElements),
+       InstanceAccessor("autoGrow", &IndexWrapper::GetAutoGrow,
+                        &IndexWrapper::SetAutoGrow),
+       InstanceAccessor("storageDataType", &IndexWrapper::GetStorageDataType,
+                        nullptr),
+       InstanceAccessor("numElements", &IndexWrapper::GetNumElements, nullptr),
+       InstanceAccessor("ids", &IndexWrapper::GetIds, nullptr),
+       InstanceAccessor("ef", &IndexWrapper::GetEf, &IndexWrapper::SetEf),
+       InstanceAccessor("length", &IndexWrapper::GetLength, nullptr),
+       InstanceAccessor("numShards", &IndexWrapper::GetNumShards, nullptr)});
+
+  // Each worker thread loads this module into its own environment, so the
+  // constructor is stored per-environment and freed when it is torn down.
+  env.SetInstanceData(new Napi::FunctionReference(Napi::Persistent(func)));
+
+  exports.Set("Index", func);
+  return exports;
+}
+
+IndexWrapper::IndexWrapper(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<IndexWrapper>(info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsObject()) {
+    Napi::TypeError::New(
+        env, "Index() missing required argument: 'options' (an object)")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+
+  Napi::Object options = info[0].As<Napi::Object>();
+
+  // Extract required parameters
+  if (!options.Has("space") || !options.Has("numDimensions")) {
+    Napi::TypeError::New(
+        env, "Index() missing required arguments: 'space' and 'numDimensions'")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+
+  SpaceType space = static_cast<SpaceType>(
+      options.Get("space").As<Napi::Number>().Uint32Value());
+  int numDimensions =
+      options.Get("numDimensions").As<Napi::Number>().Int32Value();
+
+  // Extract optional parameters with defaults
+  size_t M =
+      options.Has("M") ? options.Get("M").As<Napi::Number>().Int64Value() : 12;
+  size_t efConstruction =
+      options.Has("efConstruction")
+          ? options.Get("efConstruction").As<Napi::Number>().Int64Value()
+          : 200;
+  size_t randomSeed =
+      options.Has("randomSeed")
+          ? options.Get("randomSeed").As<Napi::Number>().Int64Value()
+          : 1;
+  size_t maxElements =
+      options.Has("maxElements")
+          ? options.Get("maxElements").As<Napi::Number>().Int64Value()
+          : 1;
+  StorageDataType storageDataType =
+      options.Has("storageDataType")
+          ? static_cast<StorageDataType>(
+                options.Get("storageDataType").As<Napi::Number>().Uint32Value())
+          : StorageDataType::Float32;
+  int pqSubvectors =
+      options.Has("pqSubvectors")
+          ? options.Get("pqSubvectors").As<Napi::Number>().Int32Value()
+          : 0;
+  bool storeFullPrecisionVectors =
+      options.Get("storeFullPrecisionVectors").ToBoolean();
+  int numShards =
+      options.Has("numShards")
+          ? options.Get("numShards").As<Napi::Number>().Int32Value()
+          : 0;
+  bool autoGrow = !options.Has("autoGrow") ||
+                  options.Get("autoGrow").IsUndefined() ||
+                  options.Get("autoGrow").ToBoolean();
+
+  if (storageDataType != StorageDataType::Float32 &&
+      storageDataType != StorageDataType::Float8 &&
+      storageDataType != StorageDataType::E4M3 &&
+      storageDataType != StorageDataType::PQ) {
+    Napi::TypeError::New(env, "Unknown storage data type received.")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+
+  if (options.Has("numShards") && numShards < 1) {
+    Napi::TypeError::New(env, "numShards must be a positive integer")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+
+  // Create the appropriate typed index based on storage data type
+  auto createTypedIndex =
+      [&](size_t seed, size_t indexMaxElements) -> std::unique_ptr<Index> {
+    switch (storageDataType) {
+    case StorageDataType::Float32:
+      return std::make_unique<TypedIndex<float>>(
+          space, numDimensions, M, efConstruction, seed, indexMaxElements,
+          /* enableOrderPreservingTransform */ true, 0,
+          storeFullPrecisionVectors);
+    case StorageDataType::Float8:
+      return std::make_unique<TypedIndex<float, int8_t, std::ratio<1, 127>>>(
+          space, numDimensions, M, efConstruction, seed, indexMaxElements,
+          /* enableOrderPreservingTransform */ true, 0,
+          storeFullPrecisionVectors);
+    case StorageDataType::E4M3:
+      return std::make_unique<TypedIndex<float, E4M3>>(
+          space, numDimensions, M, efConstruction, seed, indexMaxElements,
+          /* enableOrderPreservingTransform */ true, 0,
+          storeFullPrecisionVectors);
+    case StorageDataType::PQ:
+      return std::make_unique<TypedIndex<float, PQCode>>(
+          space, numDimensions, M, efConstruction, seed, indexMaxElements,
+          /* enableOrderPreservingTransform */ true, pqSubvectors,
+          storeFullPrecisionVectors);
+    default:
+      return nullptr;
+    }
+  };
+
+  try {
+    if (numShards > 0) {
+      // Each shard gets its own seed and an equal part of maxElements.
+      std::vector<std::unique_ptr<Index>> shards;
+      for (int i = 0; i < numShards; i++) {
+        shards.push_back(createTypedIndex(
+            randomSeed + i, (maxElements + numShards - 1) / numShards));
+      }
+      index_ = std::make_shared<ShardedIndex>(std::move(shards));
+    } else {
+      index_ = createTypedIndex(randomSeed, maxElements);
+    }
+    index_->setAutoGrow(autoGrow);
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return;
+  }
+}
+
+Napi::Object IndexWrapper::NewInstance(Napi::Env env,
+                                       std::shared_ptr<Index> index) {
+  // We need to create a dummy options object to pass to the constructor
+  // since we're bypassing normal initialization
+  Napi::Object dummyOptions = Napi::Object::New(env);
+  dummyOptions.Set("space",
+                   Napi::Number::New(env, static_cast<int>(index->getSpace())));
+  dummyOptions.Set("numDimensions",
+                   Napi::Number::New(env, index->getNumDimensions()));
+
+  Napi::Object instance =
+      env.GetInstanceData<Napi::FunctionReference>()->New({dummyOptions});
+  IndexWrapper *wrapper = Napi::ObjectWrap<IndexWrapper>::Unwrap(instance);
+  wrapper->index_ = index;
+  return instance;
+}
+
+// Helper method to convert Napi::Array to std::vector<float>
+std::vector<float> IndexWrapper::ArrayToVector(const Napi::Array &arr) {
+  std::vector<float> vec;
+  vec.reserve(arr.Length());
+  for (uint32_t i = 0; i < arr.Length(); i++) {
+    vec.push_back(arr.Get(i).As<Napi::Number>().FloatValue());
+  }
+  return vec;
+}
+
+// Helper method to convert std::vector<float> to Napi::Array
+Napi::Array IndexWrapper::VectorToArray(Napi::Env env,
+                                        const std::vector<float> &vec) {
+  Napi::Array arr = Napi::Array::New(env, vec.size());
+  for (size_t i = 0; i < vec.size(); i++) {
+    arr[i] = Napi::Number::New(env, vec[i]);
+  }
+  return arr;
+}
+
+Napi::Value IndexWrapper::AddItem(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "addItem()")) {
+    return env.Null();
+  }
+
+  if (info.Length() < 1 || !(info[0].IsArray() || IsFloat32Array(info[0]))) {
+    Napi::TypeError::New(env, "addItem() missing required argument: 'vector' "
+                              "(an array or a Float32Array)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::vector<float> vector;
+  AppendVector(info[0], vector);
+
+  std::optional<hnswlib::labeltype> id = std::nullopt;
+  if (info.Length() >= 2 && info[1].IsNumber()) {
+    id = info[1].As<Napi::Number>().Int64Value();
+  }
+
+  bool replaceDeleted = false;
+  if (info.Length() >= 3 && info[2].IsObject()) {
+    replaceDeleted = ParseReplaceDeleted(info[2].As<Napi::Object>());
+  }
+
+  try {
+    hnswlib::labeltype resultId =
+        index_->addItem(std::move(vector), id, replaceDeleted);
+    return Napi::Number::New(env, resultId);
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+bool IndexWrapper::ParseAddItemsArguments(
+    const Napi::CallbackInfo &info, const std::string &methodName,
+    FloatMatrix &vectors, std::vector<hnswlib::labeltype> &ids,
+    int &numThreads, bool &replaceDeleted) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() >= 1 && IsFloat32Array(info[0])) {
+    if (!ReadFlatMatrix(env, info[0].As<Napi::Float32Array>(),
+                        index_->getNumDimensions(), methodName, vectors)) {
+      return false;
+    }
+  } else if (info.Length() >= 1 && info[0].IsArray()) {
+    Napi::Array vectorsArray = info[0].As<Napi::Array>();
+    vectors.data.reserve((size_t)vectorsArray.Length() *
+                         index_->getNumDimensions());
+
+    for (uint32_t i = 0; i < vectorsArray.Length(); i++) {
+      Napi::Value row = vectorsArray.Get(i);
+      if (!(row.IsArray() || IsFloat32Array(row))) {
+        Napi::TypeError::New(env,
+                             methodName +
+                                 "() expected each element of 'vectors' to be "
+                                 "an array or a Float32Array")
+            .ThrowAsJavaScriptException();
+        return false;
+      }
+      if (!AppendRow(env, row, vectors)) {
+        return false;
+      }
+    }
+  } else {
+    Napi::TypeError::New(env, methodName +
+                                  "() missing required argument: 'vectors' "
+                                  "(an array of arrays or a Float32Array)")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  if (info.Length() >= 2 && info[1].IsArray()) {
+    Napi::Array idsArray = info[1].As<Napi::Array>();
+    ids.reserve(idsArray.Length());
+    for (uint32_t i = 0; i < idsArray.Length(); i++) {
+      ids.push_back(idsArray.Get(i).As<Napi::Number>().Int64Value());
+    }
+  }
+
+  if (info.Length() >= 3 && info[2].IsNumber()) {
+    numThreads = info[2].As<Napi::Number>().Int32Value();
+  }
+
+  if (info.Length() >= 4 && info[3].IsObject()) {
+    replaceDeleted = ParseReplaceDeleted(info[3].As<Napi::Object>());
+  }
+
+  return true;
+}
+
+Napi::Value IndexWrapper::AddItems(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "addItems()")) {
+    return env.Null();
+  }
+
+  FloatMatrix vectors;
+  std::vector<hnswlib::labeltype> ids;
+  int numThreads = -1;
+  bool replaceDeleted = false;
+  if (!ParseAddItemsArguments(info, "addItems", vectors, ids, numThreads,
+                              replaceDeleted)) {
+    return env.Null();
+  }
+
+  try {
+    // A Float32Array is added in place, rather than copied:
+    std::vector<hnswlib::labeltype> resultIds =
+        vectors.borrowed
+            ? index_->addItemsFrom(vectors.Data(), vectors.numRows, ids,
+                                   numThreads, replaceDeleted)
+            : index_->addItems(ToNDArray(std::move(vectors)), ids, numThreads,
+                               replaceDeleted);
+    return IdsToArray(env, resultIds);
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+bool IndexWrapper::ParseBuildArguments(const Napi::CallbackInfo &info,
+                                       const std::string &methodName,
+                                       FloatMatrix &vectors,
+                                       std::vector<hnswlib::labeltype> &ids,
+                                       int &numThreads,
+                                       Napi::Function &onProgress) {
+  Napi::Env env = info.Env();
+
+  bool replaceDeleted = false;
+  if (!ParseAddItemsArguments(info, methodName, vectors, ids, numThreads,
+                              replaceDeleted)) {
+    return false;
+  }
+
+  if (info.Length() >= 4 && info[3].IsObject()) {
+    Napi::Value callback = info[3].As<Napi::Object>().Get("onProgress");
+    if (callback.IsFunction()) {
+      onProgress = callback.As<Napi::Function>();
+    } else if (!callback.IsUndefined()) {
+      Napi::TypeError::New(env,
+                           methodName + "() expected onProgress to be a function")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+Napi::Value IndexWrapper::BuildFromArray(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "buildFromArray()")) {
+    return env.Null();
+  }
+
+  FloatMatrix vectors;
+  std::vector<hnswlib::labeltype> ids;
+  int numThreads = -1;
+  Napi::Function onProgress;
+  if (!ParseBuildArguments(info, "buildFromArray", vectors, ids, numThreads,
+                           onProgress)) {
+    return env.Null();
+  }
+
+  // Progress is reported from the calling thread, i.e.: this one, so the
+  // callback can be called directly. If it throws, so does the build.
+  std::function<void(size_t, size_t)> progress;
+  if (!onProgress.IsEmpty()) {
+    progress = [&](size_t numAdded, size_t numTotal) {
+      onProgress.Call(
+          {Napi::Number::New(env, numAdded), Napi::Number::New(env, numTotal)});
+    };
+  }
+
+  try {
+    std::vector<hnswlib::labeltype> resultIds = index_->buildFromArray(
+        ToNDArray(std::move(vectors)), ids, numThreads, progress);
+    return IdsToArray(env, resultIds);
+  } catch (const Napi::Error &e) {
+    e.ThrowAsJavaScriptException();
+    return env.Null();
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+bool IndexWrapper::ParseQueryArguments(const Napi::CallbackInfo &info,
+                                       const std::string &methodName,
+                                       QueryInput &input) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !(info[0].IsArray() || IsFloat32Array(info[0]))) {
+    Napi::TypeError::New(env, methodName +
+                                  "() missing required argument: 'vector' (an "
+                                  "array, an array of arrays or a "
+                                  "Float32Array)")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  if (info.Length() >= 2 && info[1].IsNumber()) {
+    input.k = info[1].As<Napi::Number>().Int32Value();
+  }
+
+  if (info.Length() >= 3 && info[2].IsNumber()) {
+    input.numThreads = info[2].As<Napi::Number>().Int32Value();
+  }
+
+  if (info.Length() >= 4 && info[3].IsNumber()) {
+    input.queryEf = info[3].As<Napi::Number>().Int64Value();
+  }
+
+  if (info.Length() >= 5 && info[4].IsObject()) {
+    Napi::Object options = info[4].As<Napi::Object>();
+    try {
+      input.resultType = ParseResultType(options.Get("resultType"));
+      input.filter = ParseFilterOptions(options);
+      input.includeStats = options.Get("includeStats").ToBoolean();
+      Napi::Value rerank = options.Get("rerank");
+      if (!rerank.IsUndefined()) {
+        if (!rerank.IsNumber()) {
+          throw std::invalid_argument("rerank must be a number");
+        }
+        input.rerank = rerank.As<Napi::Number>().Int32Value();
+      }
+    } catch (const std::exception &e) {
+      Napi::TypeError::New(env, methodName + "() " + e.what())
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+  }
+
+  return ParseQueryVectors(env, info[0], methodName, input.isSingleVector,
+                           input.vectors);
+}
+
+bool IndexWrapper::ParseQueryVectors(Napi::Env env, const Napi::Value &value,
+                                     const std::string &methodName,
+                                     bool &isSingleVector,
+                                     FloatMatrix &vectors) {
+  int numDimensions = index_->getNumDimensions();
+
+  // A Float32Array holding exactly one vector's worth of elements is a single
+  // query; otherwise it holds multiple query vectors back to back.
+  if (IsFloat32Array(value)) {
+    Napi::Float32Array inputArray = value.As<Napi::Float32Array>();
+    isSingleVector = inputArray.ElementLength() == (size_t)numDimensions;
+    return ReadFlatMatrix(env, inputArray, numDimensions, methodName,
+                          vectors);
+  }
+
+  Napi::Array inputArray = value.As<Napi::Array>();
+
+  // Check if input is a single vector or multiple vectors
+  isSingleVector =
+      inputArray.Length() > 0 && inputArray.Get(uint32_t(0)).IsNumber();
+
+  if (isSingleVector) {
+    return AppendRow(env, inputArray, vectors);
+  }
+
+  vectors.data.reserve((size_t)inputArray.Length() * numDimensions);
+  for (uint32_t i = 0; i < inputArray.Length(); i++) {
+    Napi::Value row = inputArray.Get(i);
+    if (!(row.IsArray() || IsFloat32Array(row))) {
+      Napi::TypeError::New(
+          env, methodName +
+                   "() expected one- or two-dimensional input data "
+                   "(either a single query vector or multiple query vectors)")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+    if (!AppendRow(env, row, vectors)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IndexWrapper::ParseRangeSearchArguments(const Napi::CallbackInfo &info,
+                                             const std::string &methodName,
+                                             RangeSearchInput &input) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !(info[0].IsArray() || IsFloat32Array(info[0]))) {
+    Napi::TypeError::New(env, methodName +
+                                  "() missing required argument: 'vector' (an "
+                                  "array, an array of arrays or a "
+                                  "Float32Array)")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  if (info.Length() < 2 || !info[1].IsNumber()) {
+    Napi::TypeError::New(env, methodName +
+                                  "() missing required argument: 'radius' (a "
+                                  "number)")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+  input.radius = info[1].As<Napi::Number>().FloatValue();
+
+  if (info.Length() >= 3 && info[2].IsNumber()) {
+    int64_t maxResults = info[2].As<Napi::Number>().Int64Value();
+    input.maxResults = maxResults > 0 ? maxResults : 0;
+  }
+
+  if (info.Length() >= 4 && info[3].IsNumber()) {
+    input.numThreads = info[3].As<Napi::Number>().Int32Value();
+  }
+
+  if (info.Length() >= 5 && info[4].IsNumber()) {
+    input.queryEf = info[4].As<Napi::Number>().Int64Value();
+  }
+
+  if (info.Length() >= 6 && info[5].IsObject()) {
+    Napi::Object options = info[5].As<Napi::Object>();
+    try {
+      Napi::Value resultType = options.Get("resultType");
+      if (!resultType.IsUndefined()) {
+        input.resultType = ParseResultType(resultType);
+        if (input.resultType == ResultType::Array) {
+          throw std::invalid_argument(
+              "only returns typed arrays; resultType must be "
+              "ResultType.TypedArray or ResultType.BigIntTypedArray");
+        }
+      }
+      input.filter = ParseFilterOptions(options);
+    } catch (const std::exception &e) {
+      Napi::TypeError::New(env, methodName + "() " + e.what())
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+  }
+
+  return ParseQueryVectors(env, info[0], methodName, input.isSingleVector,
+                           input.vectors);
+}
+
+Napi::Value IndexWrapper::Query(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  QueryInput input;
+  if (!ParseQueryArguments(info, "query", input)) {
+    return env.Null();
+  }
+
+  try {
+    return QueryOutputToObject(env, RunQuery(*index_, std::move(input)));
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::RangeSearch(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  RangeSearchInput input;
+  if (!ParseRangeSearchArguments(info, "rangeSearch", input)) {
+    return env.Null();
+  }
+
+  try {
+    return RangeSearchOutputToObject(env,
+                                     RunRangeSearch(*index_, std::move(input)));
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::GetVector(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    Napi::TypeError::New(
+        env, "getVector() missing required argument: 'id' (a number)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  hnswlib::labeltype id = info[0].As<Napi::Number>().Int64Value();
+
+  try {
+    std::vector<float> vector = index_->getVector(id);
+    return VectorToArray(env, vector);
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::GetVectors(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsArray()) {
+    Napi::TypeError::New(
+        env,
+        "getVectors() missing required argument: 'ids' (an array of numbers)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  Napi::Array idsArray = info[0].As<Napi::Array>();
+  std::vector<hnswlib::labeltype> ids;
+  ids.reserve(idsArray.Length());
+
+  for (uint32_t i = 0; i < idsArray.Length(); i++) {
+    ids.push_back(idsArray.Get(i).As<Napi::Number>().Int64Value());
+  }
+
+  try {
+    ResultType resultType =
+        ParseResultType(info.Length() >= 2 ? info[1] : env.Undefined());
+    NDArray<float, 2> vectors = index_->getVectors(ids);
+
+    if (resultType != ResultType::Array) {
+      // A flat, row-major Float32Array of ids.length * numDimensions elements
+      return ToTypedArray<float>(env, std::move(vectors.data));
+    }
+
+    Napi::Array result = Napi::Array::New(env, vectors.shape[0]);
+    for (size_t i = 0; i < vectors.shape[0]; i++) {
+      Napi::Array row = Napi::Array::New(env, vectors.shape[1]);
+      for (size_t j = 0; j < vectors.shape[1]; j++) {
+        row[j] = Napi::Number::New(env, vectors.data[i * vectors.shape[1] + j]);
+      }
+      result[i] = row;
+    }
+
+    return result;
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::MarkDeleted(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "markDeleted()")) {
+    return env.Null();
+  }
+
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    Napi::TypeError::New(
+        env, "markDeleted() missing required argument: 'id' (a number)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  hnswlib::labeltype id = info[0].As<Napi::Number>().Int64Value();
+
+  try {
+    index_->markDeleted(id);
+    return env.Undefined();
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::UnmarkDeleted(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "unmarkDeleted()")) {
+    return env.Null();
+  }
+
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    Napi::TypeError::New(
+        env, "unmarkDeleted() missing required argument: 'id' (a number)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  hnswlib::labeltype id = info[0].As<Napi::Number>().Int64Value();
+
+  try {
+    index_->unmarkDeleted(id);
+    return env.Undefined();
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::Resize(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "resize()")) {
+    return env.Null();
+  }
+
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    Napi::TypeError::New(
+        env, "resize() missing required argument: 'newSize' (a number)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  size_t newSize = info[0].As<Napi::Number>().Int64Value();
+
+  try {
+    index_->resizeIndex(newSize);
+    return env.Undefined();
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::Compact(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "compact()")) {
+    return env.Null();
+  }
+
+  int numThreads = -1;
+  if (info.Length() >= 1 && info[0].IsNumber()) {
+    numThreads = info[0].As<Napi::Number>().Int32Value();
+  }
+
+  try {
+    return Napi::Number::New(env, index_->compact(numThreads));
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::Train(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "train()")) {
+    return env.Null();
+  }
+
+  // train(vectors, numThreads) takes no IDs, so its second argument is
+  // never mistaken for them:
+  FloatMatrix vectors;
+  std::vector<hnswlib::labeltype> ids;
+  int numThreads = -1;
+  bool replaceDeleted = false;
+  if (!ParseAddItemsArguments(info, "train", vectors, ids, numThreads,
+                              replaceDeleted)) {
+    return env.Null();
+  }
+  if (info.Length() >= 2 && info[1].IsNumber()) {
+    numThreads = info[1].As<Napi::Number>().Int32Value();
+  }
+
+  try {
+    index_->train(ToNDArray(std::move(vectors)), numThreads);
+    return env.Undefined();
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::Reorder(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "reorder()")) {
+    return env.Null();
+  }
+
+  int numThreads = -1;
+  if (info.Length() >= 1 && info[0].IsNumber()) {
+    numThreads = info[0].As<Napi::Number>().Int32Value();
+  }
+
+  try {
+    index_->reorder(numThreads);
+    return env.Undefined();
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::SaveIndex(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(
+        env, "saveIndex() missing required argument: 'path' (a string)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::string path = info[0].As<Napi::String>().Utf8Value();
+
+  try {
+    index_->saveIndex(path);
+    return env.Undefined();
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::LoadIndex(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(
+        env, "loadIndex() missing required argument: 'path' (a string)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::string path = info[0].As<Napi::String>().Utf8Value();
+
+  // Optional parameters for loading legacy indices
+  LoadIndexOptions options =
+      ParseLoadIndexOptions(info.Length() >= 2 ? info[1] : env.Undefined());
+
+  try {
+    return NewInstance(env, LoadIndexFromFile(path, options));
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+Napi::Value IndexWrapper::GetDistance(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 2 || !info[0].IsArray() || !info[1].IsArray()) {
+    Napi::TypeError::New(
+        env,
+        "getDistance() missing required arguments: 'a' and 'b' (both arrays)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::vector<float> a = ArrayToVector(info[0].As<Napi::Array>());
+  std::vector<float> b = ArrayToVector(info[1].As<Napi::Array>());
+
+  try {
+    float distance = index_->getDistance(a, b);
+    return Napi::Number::New(env, distance);
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
 
-  if (info.Length() < 1 || !info[0].IsObject()) {
-    Napi::TypeError::New(
-        env, "Index() missing required argument: 'options' (an object)")
+ShardedIndex *IndexWrapper::GetShardedIndex(Napi::Env env,
+                                            const std::string &methodName) {
+  ShardedIndex *shardedIndex = dynamic_cast<ShardedIndex *>(index_.get());
+  if (!shardedIndex) {
+    Napi::Error::New(env, methodName + " can only be used on a sharded index "
+                                       "(created with the numShards option)")
         .ThrowAsJavaScriptException();
-    return;
   }
+  return shardedIndex;
+}
 
-  Napi::Object options = info[0].As<Napi::Object>();
+Napi::Value IndexWrapper::SaveShard(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
 
-  // Extract required parameters
-  if (!options.Has("space") || !options.Has("numDimensions")) {
-    Napi::TypeError::New(
-        env, "Index() missing required arguments: 'space' and 'numDimensions'")
+  if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsString()) {
+    Napi::TypeError::New(env, "saveShard() missing required arguments: "
+                              "'shard' (a number) and 'path' (a string)")
         .ThrowAsJavaScriptException();
-    return;
+    return env.Null();
   }
 
-  SpaceType space = static_cast<SpaceType>(
-      options.Get("space").As<Napi::Number>().Uint32Value());
-  int numDimensions =
-      options.Get("numDimensions").As<Napi::Number>().Int32Value();
+  ShardedIndex *shardedIndex = GetShardedIndex(env, "saveShard()");
+  if (!shardedIndex) {
+    return env.Null();
+  }
 
-  // Extract optional parameters with defaults
-  size_t M =
-      options.Has("M") ? options.Get("M").As<Napi::Number>().Int64Value() : 12;
-  size_t efConstruction =
-      options.Has("efConstruction")
-          ? options.Get("efConstruction").As<Napi::Number>().Int64Value()
-          : 200;
-  size_t randomSeed =
-      options.Has("randomSeed")
-          ? options.Get("randomSeed").As<Napi::Number>().Int64Value()
-          : 1;
-  size_t maxElements =
-      options.Has("maxElements")
-          ? options.Get("maxElements").As<Napi::Number>().Int64Value()
-          : 1;
-  StorageDataType storageDataType =
-      options.Has("storageDataType")
-          ? static_cast<StorageDataType>(
-                options.Get("storageDataType").As<Napi::Number>().Uint32Value())
-          : StorageDataType::Float32;
+  size_t shard = info[0].As<Napi::Number>().Int64Value();
+  std::string path = info[1].As<Napi::String>().Utf8Value();
 
-  // Create the appropriate typed index based on storage data type
   try {
-    switch (storageDataType) {
-    case StorageDataType::Float32:
-      index_ = std::make_shared<TypedIndex<float>>(
-          space, numDimensions, M, efConstruction, maxElements, randomSeed);
-      break;
-    case StorageDataType::Float8:
-      index_ = std::make_shared<TypedIndex<float, int8_t, std::ratio<1, 127>>>(
-          space, numDimensions, M, efConstruction, maxElements, randomSeed);
-      break;
-    case StorageDataType::E4M3:
-      index_ = std::make_shared<TypedIndex<float, E4M3>>(
-          space, numDimensions, M, efConstruction, maxElements, randomSeed);
-      break;
-    default:
-      Napi::TypeError::New(env, "Unknown storage data type received.")
-          .ThrowAsJavaScriptException();
-      return;
-    }
+    shardedIndex->saveShard(shard, path);
+    return env.Undefined();
   } catch (const std::exception &e) {
     Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
-    return;
+    return env.Null();
   }
 }
 
-// Helper method to convert Napi::Array to std::vector<float>
-std::vector<float> IndexWrapper::ArrayToVector(const Napi::Array &arr) {
-  std::vector<float> vec;
-  vec.reserve(arr.Length());
-  for (uint32_t i = 0; i < arr.Length(); i++) {
-    vec.push_back(arr.Get(i).As<Napi::Number>().FloatValue());
-  }
-  return vec;
-}
+Napi::Value IndexWrapper::LoadShard(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
 
-// Helper method to convert std::vector<float> to Napi::Array
-Napi::Array IndexWrapper::VectorToArray(Napi::Env env,
-                                        const std::vector<float> &vec) {
-  Napi::Array arr = Napi::Array::New(env, vec.size());
-  for (size_t i = 0; i < vec.size(); i++) {
-    arr[i] = Napi::Number::New(env, vec[i]);
+  if (!CheckNotShared(env, "loadShard()")) {
+    return env.Null();
   }
-  return arr;
-}
-
-Napi::Value IndexWrapper::AddItem(const Napi::CallbackInfo &info) {
-  Napi::Env env = info.Env();
 
-  if (info.Length() < 1 || !info[0].IsArray()) {
-    Napi::TypeError::New(
-        env, "addItem() missing required argument: 'vector' (an array)")
+  if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsString()) {
+    Napi::TypeError::New(env, "loadShard() missing required arguments: "
+                              "'shard' (a number) and 'path' (a string)")
         .ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  Napi::Array vectorArray = info[0].As<Napi::Array>();
-  std::vector<float> vector = ArrayToVector(vectorArray);
-
-  std::optional<hnswlib::labeltype> id = std::nullopt;
-  if (info.Length() >= 2 && info[1].IsNumber()) {
-    id = info[1].As<Napi::Number>().Int64Value();
+  ShardedIndex *shardedIndex = GetShardedIndex(env, "loadShard()");
+  if (!shardedIndex) {
+    return env.Null();
   }
 
+  size_t shard = info[0].As<Napi::Number>().Int64Value();
+  std::string path = info[1].As<Napi::String>().Utf8Value();
+  LoadIndexOptions options =
+      ParseLoadIndexOptions(info.Length() >= 3 ? info[2] : env.Undefined());
+
   try {
-    hnswlib::labeltype resultId = index_->addItem(vector, id);
-    return Napi::Number::New(env, resultId);
+    shardedIndex->loadShard(shard, path, options.mmap);
+    return env.Undefined();
   } catch (const std::exception &e) {
     Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
     return env.Null();
   }
 }
 
-Napi::Value IndexWrapper::AddItems(const Napi::CallbackInfo &info) {
+Napi::Value IndexWrapper::OpenChangeLog(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
-  if (info.Length() < 1 || !info[0].IsArray()) {
-    Napi::TypeError::New(
-        env,
-        "addItems() missing required argument: 'vectors' (an array of arrays)")
-        .ThrowAsJavaScriptException();
+  if (!CheckNotShared(env, "openChangeLog()")) {
     return env.Null();
   }
 
-  Napi::Array vectorsArray = info[0].As<Napi::Array>();
-  std::vector<std::vector<float>> vectors;
-  vectors.reserve(vectorsArray.Length());
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "openChangeLog() missing required argument: "
+                              "'path' (a string)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
 
-  for (uint32_t i = 0; i < vectorsArray.Length(); i++) {
-    if (!vectorsArray.Get(i).IsArray()) {
-      Napi::TypeError::New(
-          env, "addItems() expected each element of 'vectors' to be an array")
-          .ThrowAsJavaScriptException();
-      return env.Null();
+  std::string path = info[0].As<Napi::String>().Utf8Value();
+  int64_t checkpointInterval = 0;
+  if (info.Length() >= 2 && info[1].IsObject()) {
+    Napi::Object options = info[1].As<Napi::Object>();
+    if (options.Has("checkpointInterval")) {
+      checkpointInterval = options.Get("checkpointInterval")
+                               .As<Napi::Number>()
+                               .Int64Value();
     }
-    Napi::Array vec = vectorsArray.Get(i).As<Napi::Array>();
-    vectors.push_back(ArrayToVector(vec));
+  }
+  if (checkpointInterval < 0) {
+    Napi::TypeError::New(env, "checkpointInterval must not be negative")
+        .ThrowAsJavaScriptException();
+    return env.Null();
   }
 
-  std::vector<hnswlib::labeltype> ids;
-  if (info.Length() >= 2 && info[1].IsArray()) {
-    Napi::Array idsArray = info[1].As<Napi::Array>();
-    ids.reserve(idsArray.Length());
-    for (uint32_t i = 0; i < idsArray.Length(); i++) {
-      ids.push_back(idsArray.Get(i).As<Napi::Number>().Int64Value());
-    }
+  try {
+    index_->openChangeLog(path, checkpointInterval);
+    return env.Undefined();
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
   }
+}
 
-  int numThreads = -1;
-  if (info.Length() >= 3 && info[2].IsNumber()) {
-    numThreads = info[2].As<Napi::Number>().Int32Value();
+Napi::Value IndexWrapper::Checkpoint(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "checkpoint()")) {
+    return env.Null();
   }
 
   try {
-    std::vector<hnswlib::labeltype> resultIds =
-        index_->addItems(vectors, ids, numThreads);
-    Napi::Array result = Napi::Array::New(env, resultIds.size());
-    for (size_t i = 0; i < resultIds.size(); i++) {
-      result[i] = Napi::Number::New(env, resultIds[i]);
-    }
-    return result;
+    index_->checkpoint();
+    return env.Undefined();
   } catch (const std::exception &e) {
     Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
     return env.Null();
   }
 }
 
-Napi::Value IndexWrapper::Query(const Napi::CallbackInfo &info) {
+Napi::Value IndexWrapper::CloseChangeLog(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
-  if (info.Length() < 1 || !info[0].IsArray()) {
-    Napi::TypeError::New(env, "query() missing required argument: 'vector' (an "
-                              "array or an array of arrays)")
-        .ThrowAsJavaScriptException();
+  if (!CheckNotShared(env, "closeChangeLog()")) {
     return env.Null();
   }
 
-  int k = 1;
-  if (info.Length() >= 2 && info[1].IsNumber()) {
-    k = info[1].As<Napi::Number>().Int32Value();
+  try {
+    index_->closeChangeLog();
+    return env.Undefined();
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Null();
   }
+}
 
-  int numThreads = -1;
-  if (info.Length() >= 3 && info[2].IsNumber()) {
-    numThreads = info[2].As<Napi::Number>().Int32Value();
+// Base class for async workers that settle a Promise instead of calling a
+// callback. Execute() runs on the libuv threadpool and must not touch any JS
+// values; GetResult() runs back on the main thread once Execute() succeeds.
+class PromiseWorker : public Napi::AsyncWorker {
+public:
+  PromiseWorker(Napi::Env env, const char *resourceName)
+      : Napi::AsyncWorker(env, resourceName),
+        deferred(Napi::Promise::Deferred::New(env)) {}
+
+  Napi::Promise GetPromise() const { return deferred.Promise(); }
+
+  // Count this worker in `counter` until its promise settles (e.g.: so that
+  // share() can tell whether the index is still being modified).
+  void Track(std::shared_ptr<int> counter) {
+    (*counter)++;
+    tracker = std::move(counter);
   }
 
-  long queryEf = -1;
-  if (info.Length() >= 4 && info[3].IsNumber()) {
-    queryEf = info[3].As<Napi::Number>().Int64Value();
+protected:
+  virtual Napi::Value GetResult(Napi::Env env) = 0;
+
+  void OnOK() override {
+    Untrack();
+    try {
+      deferred.Resolve(GetResult(Env()));
+    } catch (const Napi::Error &e) {
+      deferred.Reject(e.Value());
+    }
   }
 
-  Napi::Array inputArray = info[0].As<Napi::Array>();
+  void OnError(const Napi::Error &e) override {
+    Untrack();
+    deferred.Reject(e.Value());
+  }
 
-  try {
-    // Check if input is a single vector or multiple vectors
-    bool isSingleVector =
-        inputArray.Length() > 0 && inputArray.Get(uint32_t(0)).IsNumber();
-
-    if (isSingleVector) {
-      // Single query vector
-      std::vector<float> queryVector = ArrayToVector(inputArray);
-      auto [neighborIds, distances] = index_->query(queryVector, k, queryEf);
-
-      Napi::Array result = Napi::Array::New(env);
-      result.Set("neighbors",
-                 VectorToArray(env, std::vector<float>(neighborIds.begin(),
-                                                       neighborIds.end())));
-      result.Set("distances", VectorToArray(env, distances));
-      return result;
-    } else {
-      // Multiple query vectors
-      std::vector<std::vector<float>> queryVectors;
-      queryVectors.reserve(inputArray.Length());
-      for (uint32_t i = 0; i < inputArray.Length(); i++) {
-        if (!inputArray.Get(i).IsArray()) {
-          Napi::TypeError::New(
-              env, "query() expected one- or two-dimensional input data "
-                   "(either a single query vector or multiple query vectors)")
-              .ThrowAsJavaScriptException();
-          return env.Null();
-        }
-        queryVectors.push_back(
-            ArrayToVector(inputArray.Get(i).As<Napi::Array>()));
-      }
+private:
+  void Untrack() {
+    if (tracker) {
+      (*tracker)--;
+      tracker.reset();
+    }
+  }
+
+  Napi::Promise::Deferred deferred;
+  std::shared_ptr<int> tracker;
+};
+
+class AddItemsWorker : public PromiseWorker {
+public:
+  AddItemsWorker(Napi::Env env, std::shared_ptr<Index> index,
+                 FloatMatrix vectors, std::vector<hnswlib::labeltype> ids,
+                 int numThreads, bool replaceDeleted)
+      : PromiseWorker(env, "voyager:addItemsAsync"), index(index),
+        vectors(std::move(vectors)), ids(std::move(ids)),
+        numThreads(numThreads), replaceDeleted(replaceDeleted) {
+    this->vectors.Own();
+  }
 
-      auto [neighborIds, distances] =
-          index_->query(queryVectors, k, numThreads, queryEf);
+  void Execute() override {
+    try {
+      resultIds = index->addItems(ToNDArray(std::move(vectors)), ids,
+                                  numThreads, replaceDeleted);
+    } catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
 
-      // Convevrt 2D NDArrays to JavaScript arrays
-      Napi::Array neighborsResult = Napi::Array::New(env, neighborIds.shape[0]);
-      Napi::Array distancesResult = Napi::Array::New(env, distances.shape[0]);
+  Napi::Value GetResult(Napi::Env env) override {
+    return IdsToArray(env, resultIds);
+  }
 
-      for (size_t i = 0; i < neighborIds.shape[0]; i++) {
-        Napi::Array neighborRow = Napi::Array::New(env, neighborIds.shape[1]);
-        Napi::Array distanceRow = Napi::Array::New(env, distances.shape[1]);
+private:
+  std::shared_ptr<Index> index;
+  FloatMatrix vectors;
+  std::vector<hnswlib::labeltype> ids;
+  int numThreads;
+  bool replaceDeleted;
+  std::vector<hnswlib::labeltype> resultIds;
+};
 
-        for (size_t j = 0; j < neighborIds.shape[1]; j++) {
-          neighborRow[j] = Napi::Number::New(
-              env, neighborIds.data[i * neighborIds.shape[1] + j]);
-          distanceRow[j] = Napi::Number::New(
-              env, distances.data[i * distances.shape[1] + j]);
-        }
+class BuildFromArrayWorker : public PromiseWorker {
+public:
+  BuildFromArrayWorker(Napi::Env env, std::shared_ptr<Index> index,
+                       FloatMatrix vectors,
+                       std::vector<hnswlib::labeltype> ids, int numThreads,
+                       std::unique_ptr<JSProgressReporter> progressReporter)
+      : PromiseWorker(env, "voyager:buildFromArrayAsync"), index(index),
+        vectors(std::move(vectors)), ids(std::move(ids)),
+        numThreads(numThreads), progressReporter(std::move(progressReporter)) {
+    this->vectors.Own();
+  }
 
-        neighborsResult[i] = neighborRow;
-        distancesResult[i] = distanceRow;
+  void Execute() override {
+    try {
+      std::function<void(size_t, size_t)> progress;
+      if (progressReporter) {
+        progress = [this](size_t numAdded, size_t numTotal) {
+          progressReporter->report(numAdded, numTotal);
+        };
       }
+      resultIds = index->buildFromArray(ToNDArray(std::move(vectors)), ids,
+                                        numThreads, progress);
+    } catch (const std::exception &e) {
+      SetError(e.what());
+    }
+    // Let the environment exit as soon as the callback is no longer needed:
+    progressReporter.reset();
+  }
+
+  Napi::Value GetResult(Napi::Env env) override {
+    return IdsToArray(env, resultIds);
+  }
+
+private:
+  std::shared_ptr<Index> index;
+  FloatMatrix vectors;
+  std::vector<hnswlib::labeltype> ids;
+  int numThreads;
+  std::unique_ptr<JSProgressReporter> progressReporter;
+  std::vector<hnswlib::labeltype> resultIds;
+};
+
+class QueryWorker : public PromiseWorker {
+public:
+  QueryWorker(Napi::Env env, std::shared_ptr<Index> index, QueryInput input)
+      : PromiseWorker(env, "voyager:queryAsync"), index(index),
+        input(std::move(input)) {
+    this->input.vectors.Own();
+  }
 
-      Napi::Object result = Napi::Object::New(env);
-      result.Set("neighbors", neighborsResult);
-      result.Set("distances", distancesResult);
-      return result;
+  void Execute() override {
+    try {
+      output = RunQuery(*index, std::move(input));
+    } catch (const std::exception &e) {
+      SetError(e.what());
     }
-  } catch (const std::exception &e) {
-    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
-    return env.Null();
   }
-}
 
-Napi::Value IndexWrapper::GetVector(const Napi::CallbackInfo &info) {
-  Napi::Env env = info.Env();
+  Napi::Value GetResult(Napi::Env env) override {
+    return QueryOutputToObject(env, std::move(output));
+  }
 
-  if (info.Length() < 1 || !info[0].IsNumber()) {
-    Napi::TypeError::New(
-        env, "getVector() missing required argument: 'id' (a number)")
-        .ThrowAsJavaScriptException();
+private:
+  std::shared_ptr<Index> index;
+  QueryInput input;
+  QueryOutput output;
+};
+
+class RangeSearchWorker : public PromiseWorker {
+public:
+  RangeSearchWorker(Napi::Env env, std::shared_ptr<Index> index,
+                    RangeSearchInput input)
+      : PromiseWorker(env, "voyager:rangeSearchAsync"), index(index),
+        input(std::move(input)) {
+    this->input.vectors.Own();
+  }
+
+  void Execute() override {
+    try {
+      output = RunRangeSearch(*index, std::move(input));
+    } catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  Napi::Value GetResult(Napi::Env env) override {
+    return RangeSearchOutputToObject(env, std::move(output));
+  }
+
+private:
+  std::shared_ptr<Index> index;
+  RangeSearchInput input;
+  RangeSearchOutput output;
+};
+
+class SaveIndexWorker : public PromiseWorker {
+public:
+  SaveIndexWorker(Napi::Env env, std::shared_ptr<Index> index,
+                  const std::string &path)
+      : PromiseWorker(env, "voyager:saveIndexAsync"), index(index),
+        path(path) {}
+
+  void Execute() override {
+    try {
+      index->saveIndex(path);
+    } catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  Napi::Value GetResult(Napi::Env env) override { return env.Undefined(); }
+
+private:
+  std::shared_ptr<Index> index;
+  std::string path;
+};
+
+class CompactWorker : public PromiseWorker {
+public:
+  CompactWorker(Napi::Env env, std::shared_ptr<Index> index, int numThreads)
+      : PromiseWorker(env, "voyager:compactAsync"), index(index),
+        numThreads(numThreads) {}
+
+  void Execute() override {
+    try {
+      numRemoved = index->compact(numThreads);
+    } catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  Napi::Value GetResult(Napi::Env env) override {
+    return Napi::Number::New(env, numRemoved);
+  }
+
+private:
+  std::shared_ptr<Index> index;
+  int numThreads;
+  size_t numRemoved = 0;
+};
+
+class CheckpointWorker : public PromiseWorker {
+public:
+  CheckpointWorker(Napi::Env env, std::shared_ptr<Index> index)
+      : PromiseWorker(env, "voyager:checkpointAsync"), index(index) {}
+
+  void Execute() override {
+    try {
+      index->checkpoint();
+    } catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  Napi::Value GetResult(Napi::Env env) override { return env.Undefined(); }
+
+private:
+  std::shared_ptr<Index> index;
+};
+
+class ReorderWorker : public PromiseWorker {
+public:
+  ReorderWorker(Napi::Env env, std::shared_ptr<Index> index, int numThreads)
+      : PromiseWorker(env, "voyager:reorderAsync"), index(index),
+        numThreads(numThreads) {}
+
+  void Execute() override {
+    try {
+      index->reorder(numThreads);
+    } catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  Napi::Value GetResult(Napi::Env env) override { return env.Undefined(); }
+
+private:
+  std::shared_ptr<Index> index;
+  int numThreads;
+};
+
+class LoadIndexWorker : public PromiseWorker {
+public:
+  LoadIndexWorker(Napi::Env env, const std::string &path,
+                  const LoadIndexOptions &options)
+      : PromiseWorker(env, "voyager:loadIndexAsync"), path(path),
+        options(options) {}
+
+  void Execute() override {
+    try {
+      loadedIndex = LoadIndexFromFile(path, options);
+    } catch (const std::exception &e) {
+      SetError(e.what());
+    }
+  }
+
+  Napi::Value GetResult(Napi::Env env) override {
+    return IndexWrapper::NewInstance(env, loadedIndex);
+  }
+
+private:
+  std::string path;
+  LoadIndexOptions options;
+  std::shared_ptr<Index> loadedIndex;
+};
+
+// Run `work` on a thread of its own, and settle the returned Promise with
+// the JS value that the function it returns produces on the main thread.
+//
+// Streaming an index in or out blocks the thread doing it whenever it has to
+// wait for JavaScript to produce or consume a chunk, and the JS streams (e.g.:
+// fs or zlib) may need the libuv threadpool to do so. If this work ran on the
+// threadpool like PromiseWorker, a few streams at once could block every one
+// of its threads, leaving none for the streams themselves.
+//
+// `tsfn` is the function that the stream calls into JavaScript with; it's
+// also used to get back to the main thread once the work is done.
+Napi::Promise
+RunOnStreamThread(Napi::Env env, Napi::ThreadSafeFunction tsfn,
+                  std::function<std::function<Napi::Value(Napi::Env)>()> work) {
+  auto deferred = std::make_shared<Napi::Promise::Deferred>(
+      Napi::Promise::Deferred::New(env));
+
+  // Released once the Promise has been settled, whenever the stream using
+  // `tsfn` releases its own reference:
+  tsfn.Acquire();
+  std::thread([tsfn, work, deferred]() mutable {
+    std::function<Napi::Value(Napi::Env)> getResult;
+    std::string error;
+    try {
+      getResult = work();
+    } catch (const std::exception &e) {
+      error = e.what();
+    }
+
+    tsfn.BlockingCall([deferred, getResult, error](Napi::Env env,
+                                                   Napi::Function) {
+      if (!getResult) {
+        deferred->Reject(Napi::Error::New(env, error).Value());
+        return;
+      }
+      try {
+        deferred->Resolve(getResult(env));
+      } catch (const Napi::Error &e) {
+        deferred->Reject(e.Value());
+      }
+    });
+    tsfn.Release();
+  }).detach();
+
+  return deferred->Promise();
+}
+
+Napi::Value IndexWrapper::AddItemsAsync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "addItemsAsync()")) {
     return env.Null();
   }
 
-  hnswlib::labeltype id = info[0].As<Napi::Number>().Int64Value();
-
-  try {
-    std::vector<float> vector = index_->getVector(id);
-    return VectorToArray(env, vector);
-  } catch (const std::exception &e) {
-    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+  FloatMatrix vectors;
+  std::vector<hnswlib::labeltype> ids;
+  int numThreads = -1;
+  bool replaceDeleted = false;
+  if (!ParseAddItemsArguments(info, "addItemsAsync", vectors, ids, numThreads,
+                              replaceDeleted)) {
     return env.Null();
   }
+
+  AddItemsWorker *worker =
+      new AddItemsWorker(env, index_, std::move(vectors), std::move(ids),
+                         numThreads, replaceDeleted);
+  Napi::Promise promise = worker->GetPromise();
+  worker->Track(pendingWrites_);
+  worker->Queue();
+  return promise;
 }
 
-Napi::Value IndexWrapper::GetVectors(const Napi::CallbackInfo &info) {
+Napi::Value IndexWrapper::BuildFromArrayAsync(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
-  if (info.Length() < 1 || !info[0].IsArray()) {
-    Napi::TypeError::New(
-        env,
-        "getVectors() missing required argument: 'ids' (an array of numbers)")
-        .ThrowAsJavaScriptException();
+  if (!CheckNotShared(env, "buildFromArrayAsync()")) {
     return env.Null();
   }
 
-  Napi::Array idsArray = info[0].As<Napi::Array>();
+  FloatMatrix vectors;
   std::vector<hnswlib::labeltype> ids;
-  ids.reserve(idsArray.Length());
+  int numThreads = -1;
+  Napi::Function onProgress;
+  if (!ParseBuildArguments(info, "buildFromArrayAsync", vectors, ids,
+                           numThreads, onProgress)) {
+    return env.Null();
+  }
 
-  for (uint32_t i = 0; i < idsArray.Length(); i++) {
-    ids.push_back(idsArray.Get(i).As<Napi::Number>().Int64Value());
+  std::unique_ptr<JSProgressReporter> progressReporter;
+  if (!onProgress.IsEmpty()) {
+    progressReporter = std::make_unique<JSProgressReporter>(
+        Napi::ThreadSafeFunction::New(env, onProgress,
+                                      "voyager:buildFromArrayAsync", 0, 1));
   }
 
-  try {
-    NDArray<float, 2> vectors = index_->getVectors(ids);
+  BuildFromArrayWorker *worker = new BuildFromArrayWorker(
+      env, index_, std::move(vectors), std::move(ids), numThreads,
+      std::move(progressReporter));
+  Napi::Promise promise = worker->GetPromise();
+  worker->Track(pendingWrites_);
+  worker->Queue();
+  return promise;
+}
 
-    Napi::Array result = Napi::Array::New(env, vectors.shape[0]);
-    for (size_t i = 0; i < vectors.shape[0]; i++) {
-      Napi::Array row = Napi::Array::New(env, vectors.shape[1]);
-      for (size_t j = 0; j < vectors.shape[1]; j++) {
-        row[j] = Napi::Number::New(env, vectors.data[i * vectors.shape[1] + j]);
-      }
-      result[i] = row;
-    }
+Napi::Value IndexWrapper::QueryAsync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
 
-    return result;
-  } catch (const std::exception &e) {
-    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+  QueryInput input;
+  if (!ParseQueryArguments(info, "queryAsync", input)) {
     return env.Null();
   }
+
+  QueryWorker *worker = new QueryWorker(env, index_, std::move(input));
+  Napi::Promise promise = worker->GetPromise();
+  worker->Queue();
+  return promise;
 }
 
-Napi::Value IndexWrapper::MarkDeleted(const Napi::CallbackInfo &info) {
+Napi::Value IndexWrapper::RangeSearchAsync(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
-  if (info.Length() < 1 || !info[0].IsNumber()) {
-    Napi::TypeError::New(
-        env, "markDeleted() missing required argument: 'id' (a number)")
-        .ThrowAsJavaScriptException();
+  RangeSearchInput input;
+  if (!ParseRangeSearchArguments(info, "rangeSearchAsync", input)) {
     return env.Null();
   }
 
-  hnswlib::labeltype id = info[0].As<Napi::Number>().Int64Value();
-
-  try {
-    index_->markDeleted(id);
-    return env.Undefined();
-  } catch (const std::exception &e) {
-    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
-    return env.Null();
-  }
+  RangeSearchWorker *worker =
+      new RangeSearchWorker(env, index_, std::move(input));
+  Napi::Promise promise = worker->GetPromise();
+  worker->Queue();
+  return promise;
 }
 
-Napi::Value IndexWrapper::UnmarkDeleted(const Napi::CallbackInfo &info) {
+Napi::Value IndexWrapper::SaveIndexAsync(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
-  if (info.Length() < 1 || !info[0].IsNumber()) {
+  if (info.Length() < 1 || !info[0].IsString()) {
     Napi::TypeError::New(
-        env, "unmarkDeleted() missing required argument: 'id' (a number)")
+        env, "saveIndexAsync() missing required argument: 'path' (a string)")
         .ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  hnswlib::labeltype id = info[0].As<Napi::Number>().Int64Value();
+  std::string path = info[0].As<Napi::String>().Utf8Value();
 
-  try {
-    index_->unmarkDeleted(id);
-    return env.Undefined();
-  } catch (const std::exception &e) {
-    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
-    return env.Null();
-  }
+  SaveIndexWorker *worker = new SaveIndexWorker(env, index_, path);
+  Napi::Promise promise = worker->GetPromise();
+  worker->Queue();
+  return promise;
 }
 
-Napi::Value IndexWrapper::Resize(const Napi::CallbackInfo &info) {
+Napi::Value IndexWrapper::CompactAsync(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
-  if (info.Length() < 1 || !info[0].IsNumber()) {
-    Napi::TypeError::New(
-        env, "resize() missing required argument: 'newSize' (a number)")
-        .ThrowAsJavaScriptException();
+  if (!CheckNotShared(env, "compactAsync()")) {
     return env.Null();
   }
 
-  size_t newSize = info[0].As<Napi::Number>().Int64Value();
-
-  try {
-    index_->resizeIndex(newSize);
-    return env.Undefined();
-  } catch (const std::exception &e) {
-    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
-    return env.Null();
+  int numThreads = -1;
+  if (info.Length() >= 1 && info[0].IsNumber()) {
+    numThreads = info[0].As<Napi::Number>().Int32Value();
   }
+
+  CompactWorker *worker = new CompactWorker(env, index_, numThreads);
+  Napi::Promise promise = worker->GetPromise();
+  worker->Track(pendingWrites_);
+  worker->Queue();
+  return promise;
 }
 
-Napi::Value IndexWrapper::SaveIndex(const Napi::CallbackInfo &info) {
+Napi::Value IndexWrapper::CheckpointAsync(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
-  if (info.Length() < 1 || !info[0].IsString()) {
-    Napi::TypeError::New(
-        env, "saveIndex() missing required argument: 'path' (a string)")
-        .ThrowAsJavaScriptException();
+  if (!CheckNotShared(env, "checkpointAsync()")) {
     return env.Null();
   }
 
-  std::string path = info[0].As<Napi::String>().Utf8Value();
+  CheckpointWorker *worker = new CheckpointWorker(env, index_);
+  Napi::Promise promise = worker->GetPromise();
+  worker->Track(pendingWrites_);
+  worker->Queue();
+  return promise;
+}
 
-  try {
-    index_->saveIndex(path);
-    return env.Undefined();
-  } catch (const std::exception &e) {
-    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+Napi::Value IndexWrapper::ReorderAsync(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "reorderAsync()")) {
     return env.Null();
   }
+
+  int numThreads = -1;
+  if (info.Length() >= 1 && info[0].IsNumber()) {
+    numThreads = info[0].As<Napi::Number>().Int32Value();
+  }
+
+  ReorderWorker *worker = new ReorderWorker(env, index_, numThreads);
+  Napi::Promise promise = worker->GetPromise();
+  worker->Track(pendingWrites_);
+  worker->Queue();
+  return promise;
 }
 
-Napi::Value IndexWrapper::LoadIndex(const Napi::CallbackInfo &info) {
+Napi::Value IndexWrapper::LoadIndexAsync(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
   if (info.Length() < 1 || !info[0].IsString()) {
     Napi::TypeError::New(
-        env, "loadIndex() missing required argument: 'path' (a string)")
+        env, "loadIndexAsync() missing required argument: 'path' (a string)")
         .ThrowAsJavaScriptException();
     return env.Null();
   }
 
   std::string path = info[0].As<Napi::String>().Utf8Value();
+  LoadIndexOptions options =
+      ParseLoadIndexOptions(info.Length() >= 2 ? info[1] : env.Undefined());
 
-  // Optional parameters for loading legacy indices
-  SpaceType space = SpaceType::Euclidean;
-  int numDimensions = 0;
-  StorageDataType storageDataType = StorageDataType::Float32;
-
-  if (info.Length() >= 2 && info[1].IsObject()) {
-    Napi::Object options = info[1].As<Napi::Object>();
-    if (options.Has("space")) {
-      space = static_cast<SpaceType>(
-          options.Get("space").As<Napi::Number>().Uint32Value());
-    }
-    if (options.Has("numDimensions")) {
-      numDimensions =
-          options.Get("numDimensions").As<Napi::Number>().Int32Value();
-    }
-    if (options.Has("storageDataType")) {
-      storageDataType = static_cast<StorageDataType>(
-          options.Get("storageDataType").As<Napi::Number>().Uint32Value());
-    }
-  }
-
-  try {
-    auto inputStream = std::make_shared<FileInputStream>(path);
-
-    // Try to load with metadata first
-    std::unique_ptr<voyager::Metadata::V1> metadata =
-        voyager::Metadata::loadFromStream(inputStream);
-
-    std::shared_ptr<Index> loadedIndex;
-    if (metadata) {
-      // Modern index with metadata - validate if options were provided
-      if (info.Length() >= 2 && info[1].IsObject()) {
-        Napi::Object options = info[1].As<Napi::Object>();
-        if (options.Has("storageDataType")) {
-          StorageDataType providedType = static_cast<StorageDataType>(
-              options.Get("storageDataType").As<Napi::Number>().Uint32Value());
-          if (metadata->getStorageDataType() != providedType) {
-            std::string errorMsg =
-                "Provided storage data type (" + toString(providedType) +
-                ") does not match the data type used in this file (" +
-                toString(metadata->getStorageDataType()) + ").";
-            Napi::Error::New(env, errorMsg).ThrowAsJavaScriptException();
-            return env.Null();
-          }
-        }
-        if (options.Has("space")) {
-          SpaceType providedSpace = static_cast<SpaceType>(
-              options.Get("space").As<Napi::Number>().Uint32Value());
-          if (metadata->getSpaceType() != providedSpace) {
-            std::string errorMsg =
-                "Provided space type (" + toString(providedSpace) +
-                ") does not match the space type used in this file (" +
-                toString(metadata->getSpaceType()) + ").";
-            Napi::Error::New(env, errorMsg).ThrowAsJavaScriptException();
-            return env.Null();
-          }
-        }
-        if (options.Has("numDimensions")) {
-          int providedDims =
-              options.Get("numDimensions").As<Napi::Number>().Uint32Value();
-          if (metadata->getNumDimensions() != providedDims) {
-            std::string errorMsg =
-                "Provided number of dimensions (" +
-                std::to_string(providedDims) +
-                ") does not match the number of dimensions used in this file "
-                "(" +
-                std::to_string(metadata->getNumDimensions()) + ").";
-            Napi::Error::New(env, errorMsg).ThrowAsJavaScriptException();
-            return env.Null();
-          }
-        }
-      }
-      loadedIndex =
-          loadTypedIndexFromMetadata(std::move(metadata), inputStream);
-    } else {
-      // Legacy index without metadata - need explicit parameters
-      if (numDimensions <= 0) {
-        Napi::TypeError::New(
-            env, "Index file has no metadata. Please provide space, "
-                 "numDimensions, and storageDataType options.")
-            .ThrowAsJavaScriptException();
-        return env.Null();
-      }
-
-      switch (storageDataType) {
-      case StorageDataType::Float32:
-        loadedIndex = std::make_shared<TypedIndex<float>>(inputStream, space,
-                                                          numDimensions);
-        break;
-      case StorageDataType::Float8:
-        loadedIndex =
-            std::make_shared<TypedIndex<float, int8_t, std::ratio<1, 127>>>(
-                inputStream, space, numDimensions);
-        break;
-      case StorageDataType::E4M3:
-        loadedIndex = std::make_shared<TypedIndex<float, E4M3>>(
-            inputStream, space, numDimensions);
-        break;
-      default:
-        Napi::TypeError::New(env, "Unknown storage data type received.")
-            .ThrowAsJavaScriptException();
-        return env.Null();
-      }
-    }
-
-    // Create a new IndexWrapper instance with the loaded index
-    // We need to creare a dummy options object to pass to the constructor
-    // since we're bypassing normal initialization
-    Napi::Object dummyOptions = Napi::Object::New(env);
-    dummyOptions.Set(
-        "space",
-        Napi::Number::New(env, static_cast<int>(loadedIndex->getSpace())));
-    dummyOptions.Set("numDimensions",
-                     Napi::Number::New(env, loadedIndex->getNumDimensions()));
+  LoadIndexWorker *worker = new LoadIndexWorker(env, path, options);
+  Napi::Promise promise = worker->GetPromise();
+  worker->Queue();
+  return promise;
+}
 
-    Napi::Object instance = constructor.New({dummyOptions});
-    IndexWrapper *wrapper = Napi::ObjectWrap<IndexWrapper>::Unwrap(instance);
-    wrapper->index_ = loadedIndex;
+// The JS wrapper adapts a Writable into `write`, a function that takes a
+// chunk (a Buffer) and returns a Promise that resolves once the stream is
+// ready for more data.
+Napi::Value IndexWrapper::SaveToStream(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
 
-    return instance;
-  } catch (const std::exception &e) {
-    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+  if (info.Length() < 1 || !info[0].IsFunction()) {
+    Napi::TypeError::New(
+        env, "saveToStream() missing required argument: 'write' (a function)")
+        .ThrowAsJavaScriptException();
     return env.Null();
   }
+
+  Napi::ThreadSafeFunction writeChunk = Napi::ThreadSafeFunction::New(
+      env, info[0].As<Napi::Function>(), "voyager:saveToStream", 0, 1);
+
+  std::shared_ptr<Index> index = index_;
+  return RunOnStreamThread(env, writeChunk, [index, writeChunk]() {
+    auto outputStream = std::make_shared<JSWritableOutputStream>(writeChunk);
+    index->saveIndex(outputStream);
+    outputStream->flush();
+    return [](Napi::Env env) -> Napi::Value { return env.Undefined(); };
+  });
 }
 
-Napi::Value IndexWrapper::GetDistance(const Napi::CallbackInfo &info) {
+// The JS wrapper adapts a Readable into `pull`, a function that returns a
+// Promise of the next few chunks (an array of Buffers), or of null at the end
+// of the stream.
+Napi::Value IndexWrapper::LoadFromStream(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
-  if (info.Length() < 2 || !info[0].IsArray() || !info[1].IsArray()) {
+  if (info.Length() < 1 || !info[0].IsFunction()) {
     Napi::TypeError::New(
-        env,
-        "getDistance() missing required arguments: 'a' and 'b' (both arrays)")
+        env, "loadFromStream() missing required argument: 'pull' (a function)")
         .ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  std::vector<float> a = ArrayToVector(info[0].As<Napi::Array>());
-  std::vector<float> b = ArrayToVector(info[1].As<Napi::Array>());
-
-  try {
-    float distance = index_->getDistance(a, b);
-    return Napi::Number::New(env, distance);
-  } catch (const std::exception &e) {
-    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+  LoadIndexOptions options =
+      ParseLoadIndexOptions(info.Length() >= 2 ? info[1] : env.Undefined());
+  if (options.mmap) {
+    Napi::TypeError::New(env, "loadFromStream() does not support the 'mmap' "
+                              "option; use loadIndex() with a file instead")
+        .ThrowAsJavaScriptException();
     return env.Null();
   }
+
+  Napi::ThreadSafeFunction pull = Napi::ThreadSafeFunction::New(
+      env, info[0].As<Napi::Function>(), "voyager:loadFromStream", 0, 1);
+
+  return RunOnStreamThread(env, pull, [pull, options]() {
+    auto inputStream = std::make_shared<JSReadableInputStream>(pull);
+    std::shared_ptr<Index> loadedIndex =
+        LoadIndexFromStream(inputStream, options, "stream");
+    return [loadedIndex](Napi::Env env) -> Napi::Value {
+      return IndexWrapper::NewInstance(env, loadedIndex);
+    };
+  });
 }
 
 // Property getters/setters
@@ -755,6 +2916,10 @@ void IndexWrapper::SetMaxElements(const Napi::CallbackInfo &info,
                                   const Napi::Value &value) {
   Napi::Env env = info.Env();
 
+  if (!CheckNotShared(env, "the maxElements setter")) {
+    return;
+  }
+
   if (!value.IsNumber()) {
     Napi::TypeError::New(env, "maxElements must be set to a number")
         .ThrowAsJavaScriptException();
@@ -770,6 +2935,28 @@ void IndexWrapper::SetMaxElements(const Napi::CallbackInfo &info,
   }
 }
 
+Napi::Value IndexWrapper::GetAutoGrow(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  return Napi::Boolean::New(env, index_->getAutoGrow());
+}
+
+void IndexWrapper::SetAutoGrow(const Napi::CallbackInfo &info,
+                               const Napi::Value &value) {
+  Napi::Env env = info.Env();
+
+  if (!CheckNotShared(env, "the autoGrow setter")) {
+    return;
+  }
+
+  if (!value.IsBoolean()) {
+    Napi::TypeError::New(env, "autoGrow must be set to a boolean")
+        .ThrowAsJavaScriptException();
+    return;
+  }
+
+  index_->setAutoGrow(value.As<Napi::Boolean>().Value());
+}
+
 Napi::Value IndexWrapper::GetStorageDataType(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
   return Napi::Number::New(env, static_cast<int>(index_->getStorageDataType()));
@@ -804,6 +2991,10 @@ void IndexWrapper::SetEf(const Napi::CallbackInfo &info,
                          const Napi::Value &value) {
   Napi::Env env = info.Env();
 
+  if (!CheckNotShared(env, "the ef setter")) {
+    return;
+  }
+
   if (!value.IsNumber()) {
     Napi::TypeError::New(env, "ef must be set to a number")
         .ThrowAsJavaScriptException();
@@ -821,7 +3012,14 @@ void IndexWrapper::SetEf(const Napi::CallbackInfo &info,
 
 Napi::Value IndexWrapper::GetLength(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
-  return Napi::Number::New(env, index_->getIDsMap().size());
+  return Napi::Number::New(env, index_->getIDsCount());
+}
+
+Napi::Value IndexWrapper::GetNumShards(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  ShardedIndex *shardedIndex = dynamic_cast<ShardedIndex *>(index_.get());
+  return Napi::Number::New(env,
+                           shardedIndex ? shardedIndex->getNumShards() : 1);
 }
 
 // New methods for Buffer/Stream support
@@ -829,11 +3027,20 @@ Napi::Value IndexWrapper::ToBuffer(const Napi::CallbackInfo &info) {
   Napi::Env env = info.Env();
 
   try {
-    auto outputStream = std::make_shared<MemoryOutputStream>();
-    index_->saveIndex(outputStream);
-    std::string bytes = outputStream->getValue();
+    // Serialize twice: once to find the exact size, then straight into the
+    // Buffer, so that the index is never held in memory more than twice.
+    auto countingStream = std::make_shared<CountingOutputStream>();
+    index_->saveIndex(countingStream);
+
     Napi::Buffer<char> buffer =
-        Napi::Buffer<char>::Copy(env, bytes.data(), bytes.size());
+        Napi::Buffer<char>::New(env, countingStream->getCount());
+    auto outputStream =
+        std::make_shared<BufferOutputStream>(buffer.Data(), buffer.Length());
+    index_->saveIndex(outputStream);
+    if (!outputStream->isFull()) {
+      throw std::runtime_error(
+          "toBuffer() failed: the index was modified while being serialized");
+    }
     return buffer;
   } catch (const std::exception &e) {
     Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
@@ -852,128 +3059,24 @@ Napi::Value IndexWrapper::FromBuffer(const Napi::CallbackInfo &info) {
   }
 
   Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
-  std::string data(buffer.Data(), buffer.Length());
 
   // Optional parameters for loading legacy indices
-  SpaceType space = SpaceType::Euclidean;
-  int numDimensions = 0;
-  StorageDataType storageDataType = StorageDataType::Float32;
-
-  if (info.Length() >= 2 && info[1].IsObject()) {
-    Napi::Object options = info[1].As<Napi::Object>();
-    if (options.Has("space")) {
-      space = static_cast<SpaceType>(
-          options.Get("space").As<Napi::Number>().Uint32Value());
-    }
-    if (options.Has("numDimensions")) {
-      numDimensions =
-          options.Get("numDimensions").As<Napi::Number>().Int32Value();
-    }
-    if (options.Has("storageDataType")) {
-      storageDataType = static_cast<StorageDataType>(
-          options.Get("storageDataType").As<Napi::Number>().Uint32Value());
-    }
+  LoadIndexOptions options =
+      ParseLoadIndexOptions(info.Length() >= 2 ? info[1] : env.Undefined());
+  if (options.mmap) {
+    Napi::TypeError::New(env, "fromBuffer() does not support the 'mmap' "
+                              "option; use loadIndex() with a file instead")
+        .ThrowAsJavaScriptException();
+    return env.Null();
   }
 
   try {
-    auto inputStream = std::make_shared<MemoryInputStream>(data);
-
-    // Try to load with metadata first
-    std::unique_ptr<voyager::Metadata::V1> metadata =
-        voyager::Metadata::loadFromStream(inputStream);
-
-    std::shared_ptr<Index> loadedIndex;
-    if (metadata) {
-      // Modern index with metadata - validate if options were provided
-      if (info.Length() >= 2 && info[1].IsObject()) {
-        Napi::Object options = info[1].As<Napi::Object>();
-        if (options.Has("storageDataType")) {
-          StorageDataType providedType = static_cast<StorageDataType>(
-              options.Get("storageDataType").As<Napi::Number>().Uint32Value());
-          if (metadata->getStorageDataType() != providedType) {
-            std::string errorMsg =
-                "Provided storage data type (" + toString(providedType) +
-                ") does not match the data type used in this file (" +
-                toString(metadata->getStorageDataType()) + ").";
-            Napi::Error::New(env, errorMsg).ThrowAsJavaScriptException();
-            return env.Null();
-          }
-        }
-        if (options.Has("space")) {
-          SpaceType providedSpace = static_cast<SpaceType>(
-              options.Get("space").As<Napi::Number>().Uint32Value());
-          if (metadata->getSpaceType() != providedSpace) {
-            std::string errorMsg =
-                "Provided space type (" + toString(providedSpace) +
-                ") does not match the space type used in this file (" +
-                toString(metadata->getSpaceType()) + ").";
-            Napi::Error::New(env, errorMsg).ThrowAsJavaScriptException();
-            return env.Null();
-          }
-        }
-        if (options.Has("numDimensions")) {
-          int providedDims =
-              options.Get("numDimensions").As<Napi::Number>().Uint32Value();
-          if (metadata->getNumDimensions() != providedDims) {
-            std::string errorMsg =
-                "Provided number of dimensions (" +
-                std::to_string(providedDims) +
-                ") does not match the number of dimensions used in this file "
-                "(" +
-                std::to_string(metadata->getNumDimensions()) + ").";
-            Napi::Error::New(env, errorMsg).ThrowAsJavaScriptException();
-            return env.Null();
-          }
-        }
-      }
-      loadedIndex =
-          loadTypedIndexFromMetadata(std::move(metadata), inputStream);
-    } else {
-      // Legacy index without metadata - need explicit parameters
-      if (numDimensions == 0) {
-        Napi::TypeError::New(
-            env, "Index buffer has no metadata. Please provide space, "
-                 "numDimensions, and storageDataType options.")
-            .ThrowAsJavaScriptException();
-        return env.Null();
-      }
-
-      switch (storageDataType) {
-      case StorageDataType::Float32:
-        loadedIndex = std::make_shared<TypedIndex<float>>(inputStream, space,
-                                                          numDimensions);
-        break;
-      case StorageDataType::Float8:
-        loadedIndex =
-            std::make_shared<TypedIndex<float, int8_t, std::ratio<1, 127>>>(
-                inputStream, space, numDimensions);
-        break;
-      case StorageDataType::E4M3:
-        loadedIndex = std::make_shared<TypedIndex<float, E4M3>>(
-            inputStream, space, numDimensions);
-        break;
-      default:
-        Napi::TypeError::New(env, "Unknown storage data type received.")
-            .ThrowAsJavaScriptException();
-        return env.Null();
-      }
-    }
-
-    // Create a new IndexWrapper instance with the loaded index
-    // We need to creare a dummy options object to pass to the constructor
-    // since we're bypassing normal initialization
-    Napi::Object dummyOptions = Napi::Object::New(env);
-    dummyOptions.Set(
-        "space",
-        Napi::Number::New(env, static_cast<int>(loadedIndex->getSpace())));
-    dummyOptions.Set("numDimensions",
-                     Napi::Number::New(env, loadedIndex->getNumDimensions()));
-
-    Napi::Object instance = constructor.New({dummyOptions});
-    IndexWrapper *wrapper = Napi::ObjectWrap<IndexWrapper>::Unwrap(instance);
-    wrapper->index_ = loadedIndex;
-
-    return instance;
+    // The Buffer stays alive (and unchanged, as JS can't run) until loading
+    // finishes, so the index can be read straight out of it.
+    auto inputStream =
+        std::make_shared<MemoryInputStream>(buffer.Data(), buffer.Length());
+    return NewInstance(env,
+                       LoadIndexFromStream(inputStream, options, "buffer"));
   } catch (const std::exception &e) {
     Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
     return env.Null();
@@ -1020,6 +3123,107 @@ Napi::Value IndexWrapper::ToString(const Napi::CallbackInfo &info) {
   }
 }
 
+Napi::Value IndexWrapper::Share(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  if (sharedHandle_ == 0) {
+    if (*pendingWrites_ > 0) {
+      Napi::Error::New(env, "Cannot share an index while it's being modified; "
+                            "wait for every async call that modifies it (e.g.: "
+                            "addItemsAsync()) to finish first.")
+          .ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    sharedHandle_ = SharedIndices::Add(index_);
+  }
+  return Napi::Number::New(env, sharedHandle_);
+}
+
+Napi::Value IndexWrapper::Attach(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsNumber()) {
+    Napi::TypeError::New(
+        env, "attach() missing required argument: 'handle' (a number)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  int64_t handle = info[0].As<Napi::Number>().Int64Value();
+  std::shared_ptr<Index> index = SharedIndices::Get(handle);
+  if (!index) {
+    Napi::Error::New(env, "attach() failed: no index shared with handle " +
+                              std::to_string(handle) +
+                              " is still alive. Keep the shared Index "
+                              "referenced until every thread has attached.")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  Napi::Object instance = NewInstance(env, index);
+  IndexWrapper *wrapper = Napi::ObjectWrap<IndexWrapper>::Unwrap(instance);
+  wrapper->sharedHandle_ = handle;
+  wrapper->attached_ = true;
+  return instance;
+}
+
+bool IndexWrapper::CheckNotShared(Napi::Env env,
+                                  const std::string &methodName) {
+  if (sharedHandle_ == 0) {
+    return true;
+  }
+  std::string message =
+      "Cannot use " + methodName +
+      (attached_ ? " on an index attached from another thread"
+                 : " on an index shared with other threads") +
+      "; shared indices can only be searched";
+  if (methodName == "the ef setter") {
+    message += " (pass queryEf to query() instead)";
+  }
+  Napi::Error::New(env, message).ThrowAsJavaScriptException();
+  return false;
+}
+
+Napi::Value IndexWrapper::Stats(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  return SearchStatsToObject(env, index_->getSearchStats(),
+                             /* includeSearches */ true);
+}
+
+Napi::Value IndexWrapper::ResetStats(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+  index_->resetSearchStats();
+  return env.Undefined();
+}
+
+// The number of worker threads in the process-wide pool used by addItems and
+// query. These run alongside libuv's threadpool: an async call occupies one
+// libuv thread, which then works on its batch together with the pool's idle
+// workers, so concurrent calls share the pool instead of each creating their
+// own threads.
+Napi::Value GetThreadPoolSize(const Napi::CallbackInfo &info) {
+  return Napi::Number::New(info.Env(), ThreadPool::global().getNumThreads());
+}
+
+Napi::Value SetThreadPoolSize(const Napi::CallbackInfo &info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsNumber() ||
+      info[0].As<Napi::Number>().Int64Value() < 0) {
+    Napi::TypeError::New(env, "setThreadPoolSize() missing required argument: "
+                              "'numThreads' (a non-negative number)")
+        .ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  try {
+    ThreadPool::global().setNumThreads(
+        info[0].As<Napi::Number>().Int64Value());
+  } catch (const std::exception &e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+  }
+  return env.Undefined();
+}
+
 // Space enum initialization
 Napi::Object InitSpace(Napi::Env env) {
   Napi::Object space = Napi::Object::New(env);
@@ -1045,6 +3249,8 @@ Napi::Object InitStorageDataType(Napi::Env env) {
   storageDataType.Set(
       "E4M3",
       Napi::Number::New(env, static_cast<uint32_t>(StorageDataType::E4M3)));
+  storageDataType.Set(
+      "PQ", Napi::Number::New(env, static_cast<uint32_t>(StorageDataType::PQ)));
   return storageDataType;
 }
 
@@ -1058,6 +3264,12 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
   // Export the StorageDataType enum
   exports.Set("StorageDataType", InitStorageDataType(env));
 
+  // Export the thread pool configuration functions
+  exports.Set("getThreadPoolSize",
+              Napi::Function::New(env, GetThreadPoolSize, "getThreadPoolSize"));
+  exports.Set("setThreadPoolSize",
+              Napi::Function::New(env, SetThreadPoolSize, "setThreadPoolSize"));
+
   return exports;
 }
 
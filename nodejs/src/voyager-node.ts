@@ -2,6 +2,8 @@
 import gyp from "node-gyp-build";
 import { fileURLToPath } from "url";
 import { dirname } from "path";
+import type { Writable } from "stream";
+import { finished } from "stream/promises";
 
 const __filename = fileURLToPath(import.meta.url);
 const __root = dirname(dirname(__filename));
@@ -27,6 +29,23 @@ export enum StorageDataType {
   Float32 = 32,
   // 8-bit floating point with range [-448, 448]
   E4M3 = 48,
+  // Product quantization: one byte per subvector (see pqSubvectors). Much
+  // smaller, but distances are approximate. The codebook is learned by
+  // train(), or else from the first batch of vectors added, which then has to
+  // hold at least 256 vectors and should be representative.
+  PQ = 64,
+}
+
+// The format in which query() and getVectors() return their results.
+export enum ResultType {
+  // Plain (nested) arrays of numbers (default)
+  Array = 0,
+  // Flat, row-major typed arrays: Float64Array neighbor IDs and Float32Array
+  // distances or vectors. Avoids allocating a JS number per element.
+  TypedArray = 1,
+  // As TypedArray, but neighbor IDs are returned as a BigUint64Array that
+  // shares memory with the native result (no copy)
+  BigIntTypedArray = 2,
 }
 
 // Options for creating a new Index
@@ -43,8 +62,26 @@ export interface IndexOptions {
   randomSeed?: number;
   // Initial maximum number of elements (default: 1)
   maxElements?: number;
+  // Grow the index to fit items added beyond maxElements, rather than
+  // throwing an error (default: true). Growing the index doesn't move the
+  // items already in it, so queries carry on while it grows.
+  autoGrow?: boolean;
   // Storage data type (default: Float32)
   storageDataType?: StorageDataType;
+  // With PQ storage, the number of bytes used to store each vector; must be
+  // at most numDimensions (default: numDimensions / 4)
+  pqSubvectors?: number;
+  // Also store a float copy of each vector (not for Float32 storage), so
+  // queries can re-rank their results exactly with the rerank option. Costs
+  // 4 bytes per dimension, but search still reads only the compact vectors.
+  storeFullPrecisionVectors?: boolean;
+  // Split the index into this many shards, each an independent index holding
+  // the items whose IDs hash to it. Queries search every shard in parallel
+  // and merge the results. saveIndex() then saves each shard to a file of
+  // its own (filePath + ".shard" + n), next to a small manifest at filePath,
+  // and shards can be saved and replaced one at a time with saveShard() and
+  // loadShard(). (default: not sharded)
+  numShards?: number;
 }
 
 // Options for loading an index from disk
@@ -55,6 +92,32 @@ export interface LoadOptions {
   numDimensions?: number;
   // Storage data type (for legacy indices without metadata)
   storageDataType?: StorageDataType;
+  // Memory-map the file instead of reading it into memory (default: false).
+  // The index opens near-instantly, and its pages are shared through the OS
+  // page cache with other processes that map the same file. The index is
+  // opened in search-only mode: it can be queried, but not modified, and ID
+  // lookups (ids, has, getVector(s)) are unavailable. The file must not be
+  // modified or overwritten while the index is open. Only supported by
+  // loadIndex() and loadIndexAsync(), not by fromBuffer() or loadFromStream().
+  mmap?: boolean;
+}
+
+// The work done by a single query, returned when includeStats is set
+export interface SearchStats {
+  // The number of nodes whose neighbors were examined, across all layers
+  hops: number;
+  // The number of distances computed between the query and stored vectors
+  distanceComputations: number;
+  // The number of distinct nodes visited in the base layer
+  visitedNodes: number;
+  // Wall-clock time spent searching, in milliseconds
+  elapsedMs: number;
+}
+
+// The total work done by every query of an index, returned by stats()
+export interface IndexStats extends SearchStats {
+  // The number of queries counted
+  searches: number;
 }
 
 // Result from querying a single vector
@@ -63,6 +126,8 @@ export interface QueryResult {
   neighbors: number[];
   // Array of distances
   distances: number[];
+  // The work done by the query, if includeStats was set
+  stats?: SearchStats;
 }
 
 // Result from querying multiple vectors
@@ -71,6 +136,152 @@ export interface QueryResults {
   neighbors: number[][];
   // Array of distance arrays (one per query)
   distances: number[][];
+  // The work done by each query, if includeStats was set
+  stats?: SearchStats[];
+}
+
+// Result from querying with ResultType.TypedArray. For multiple query vectors,
+// row i of the results is at indices [i * k, (i + 1) * k).
+export interface TypedQueryResult {
+  // Neighbor IDs
+  neighbors: Float64Array;
+  // Distances
+  distances: Float32Array;
+  // The work done by each query, if includeStats was set
+  stats?: SearchStats[];
+}
+
+// Result from querying with ResultType.BigIntTypedArray, laid out like
+// TypedQueryResult
+export interface BigIntTypedQueryResult {
+  // Neighbor IDs
+  neighbors: BigUint64Array;
+  // Distances
+  distances: Float32Array;
+  // The work done by each query, if includeStats was set
+  stats?: SearchStats[];
+}
+
+// Options for query() and queryAsync()
+export interface QueryOptions {
+  // The format of the returned results (default: ResultType.Array)
+  resultType?: ResultType;
+  // Only return neighbors with these IDs. Other vectors are still used to
+  // navigate the index, so recall stays high even for small subsets; if fewer
+  // than k allowed neighbors can be found, the query throws.
+  allowedIds?: number[] | Uint32Array | Float64Array | BigUint64Array;
+  // As allowedIds, but as a bitmap: ID i is allowed if bit (i % 8) of byte
+  // floor(i / 8) is set. IDs beyond the end of the bitmap are not allowed.
+  // Mutually exclusive with allowedIds.
+  allowedIdsBitmap?: Uint8Array;
+  // Also return the work done by each query (default: false)
+  includeStats?: boolean;
+  // Find this many candidates using the index's compact storage, then return
+  // the k of them nearest by exact distance. Must be at least k, and requires
+  // an index created with storeFullPrecisionVectors.
+  rerank?: number;
+}
+
+// Options for rangeSearch() and rangeSearchAsync()
+export interface RangeSearchOptions {
+  // The type of the returned neighbor IDs: ResultType.TypedArray for a
+  // Float64Array (default) or ResultType.BigIntTypedArray for a BigUint64Array
+  resultType?: ResultType.TypedArray | ResultType.BigIntTypedArray;
+  // Only return neighbors with these IDs, as for query()
+  allowedIds?: number[] | Uint32Array | Float64Array | BigUint64Array;
+  // As allowedIds, but as a bitmap, as for query()
+  allowedIdsBitmap?: Uint8Array;
+}
+
+// Result from rangeSearch() with a single query vector, nearest first
+export interface RangeSearchResult<
+  Ids extends Float64Array | BigUint64Array = Float64Array
+> {
+  // Neighbor IDs
+  neighbors: Ids;
+  // Distances
+  distances: Float32Array;
+}
+
+// Result from rangeSearch() with multiple query vectors. Each query finds a
+// different number of neighbors: those of query i are at indices
+// [offsets[i], offsets[i + 1]), nearest first.
+export interface RangeSearchResults<
+  Ids extends Float64Array | BigUint64Array = Float64Array
+> extends RangeSearchResult<Ids> {
+  // One more entry than there were query vectors
+  offsets: Uint32Array;
+}
+
+// Options for addItem(), addItems() and addItemsAsync()
+export interface AddItemsOptions {
+  // Store new IDs in the slots of vectors previously passed to markDeleted(),
+  // rather than growing the index (default: false). The deleted vectors' IDs
+  // are forgotten once their slots are reused.
+  replaceDeleted?: boolean;
+}
+
+// Options for buildFromArray() and buildFromArrayAsync()
+export interface BuildOptions {
+  // Called periodically as vectors are connected into the index, and once
+  // more when all of them are. Throwing from it abandons the build, leaving
+  // the index empty.
+  onProgress?: (numAdded: number, numTotal: number) => void;
+}
+
+// Options for saveToStream()
+export interface SaveToStreamOptions {
+  // End the stream once the index has been written (default: true)
+  end?: boolean;
+}
+
+// Options for openChangeLog()
+export interface ChangeLogOptions {
+  // Fold the log into a new snapshot of the index once this many items have
+  // been added, updated, deleted or undeleted since the last one (per shard,
+  // for sharded indices). 0 only writes snapshots when checkpoint() is
+  // called. (default: 0)
+  checkpointInterval?: number;
+}
+
+// Options for query() and queryAsync() calls that return plain arrays
+export type ArrayQueryOptions = QueryOptions & {
+  resultType?: ResultType.Array;
+};
+
+// Multiple vectors: an array of vectors, or a flat Float32Array holding
+// numDimensions elements per vector, back to back
+export type VectorBatch = number[][] | Float32Array[] | Float32Array;
+
+// loadFromStream() passes data to the worker thread in batches of at least
+// this many bytes, so small stream chunks don't each cost a round trip.
+const STREAM_BATCH_BYTES = 1024 * 1024;
+
+// Wait for a Writable to accept more data, rejecting if it fails or is closed
+// first.
+function waitForDrain(stream: Writable): Promise<void> {
+  return new Promise((resolve, reject) => {
+    const cleanup = () => {
+      stream.off("drain", onDrain);
+      stream.off("error", onError);
+      stream.off("close", onClose);
+    };
+    const onDrain = () => {
+      cleanup();
+      resolve();
+    };
+    const onError = (error: Error) => {
+      cleanup();
+      reject(error);
+    };
+    const onClose = () => {
+      cleanup();
+      reject(new Error("Stream was closed before the index was written"));
+    };
+    stream.on("drain", onDrain);
+    stream.on("error", onError);
+    stream.on("close", onClose);
+  });
 }
 
 /** A nearest-neighbor search index containing vector data.
@@ -89,56 +300,446 @@ export class Index {
     * @param vector - The vector to add (array of numbers)
     * @param id - Optional ID to assign
     (auto-generated if not provided)
+    * @param options - Optional settings, such as replaceDeleted
     * @returns The ID assigned to this vector 
     */
-  addItem(vector: number[], id?: number): number {
-    return this._index.addItem(vector, id);
+  addItem(
+    vector: number[] | Float32Array,
+    id?: number,
+    options?: AddItemsOptions
+  ): number {
+    return this._index.addItem(vector, id, options);
   }
 
   /** Add multiple vectors to the index simultaneously
-   * @param vectors - Array of vectors to add
+   * @param vectors - Array of vectors to add, or a flat Float32Array holding
+   * the vectors back to back (numDimensions elements each)
    * @param ids - Optional array of IDs (must match vectors length if palovided)
    * @param numThreads - Number of threads to use (-1 for auto)
+   * @param options - Optional settings, such as replaceDeleted
    * @returns Array of IDs assigned to the vectors
    */
-  addItems(vectors: number[][], ids?: number[], numThreads?: number): number[] {
-    return this._index.addItems(vectors, ids, numThreads);
+  addItems(
+    vectors: VectorBatch,
+    ids?: number[],
+    numThreads?: number,
+    options?: AddItemsOptions
+  ): number[] {
+    return this._index.addItems(vectors, ids, numThreads, options);
   }
   /** Query the index for nearest neighbors of a single vector
    * @param vector - Vector to query
    * @param k - Number of neighbors to return (default: 1)
    * @param numThreads - Number of threads for parallel queries (-1 for auto)
    * @param queryEf - Search depth for this query (-1 to use default ef)
+   * @param options - Result type and ID filter
    * @returns Object containing neighbors and distances arrays
    */
   query(
     vectors: number[],
     k?: number,
     numThreads?: number,
-    queryEf?: number
+    queryEf?: number,
+    options?: ArrayQueryOptions
   ): QueryResult;
 
+  /** Query the index for nearest neighbors of vectors stored in a flat
+   * Float32Array. An array of exactly numDimensions elements is treated as a
+   * single vector; otherwise it holds multiple vectors back to back.
+   * @param vectors - Vector(s) to query
+   * @param k - Number of neighbors to return (default: 1)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth for this query (-1 to use default ef)
+   * @param options - Result type and ID filter
+   * @returns Object containing neighbors and distances arrays
+   */
+  query(
+    vectors: Float32Array,
+    k?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: ArrayQueryOptions
+  ): QueryResult | QueryResults;
+
   /** Query the index for nearest neighbors of multiple vectors
    * @param vectors - Array of vectors to query
    * @param k - Number of neighbors to return (default: 1)
    * @param numThreads - Number of threads for parallel queries (-1 for auto)
    * @param queryEf - Search depth for this query (-1 to use default ef)
+   * @param options - Result type and ID filter
    * @returns Object containing arrays of neighbors and distances
    */
   query(
-    vectors: number[][],
+    vectors: number[][] | Float32Array[],
     k?: number,
     numThreads?: number,
-    queryEf?: number
+    queryEf?: number,
+    options?: ArrayQueryOptions
   ): QueryResults;
 
+  /** Query the index for nearest neighbors, returning flat typed arrays
+   * @param vectors - Vector(s) to query
+   * @param k - Number of neighbors to return (default: 1)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth for this query (-1 to use default ef)
+   * @param options - Result type (ResultType.TypedArray or
+   *   ResultType.BigIntTypedArray) and ID filter
+   * @returns Object containing flat, row-major neighbors and distances
+   */
+  query(
+    vectors: number[] | VectorBatch,
+    k: number | undefined,
+    numThreads: number | undefined,
+    queryEf: number | undefined,
+    options: QueryOptions & { resultType: ResultType.TypedArray }
+  ): TypedQueryResult;
+
+  query(
+    vectors: number[] | VectorBatch,
+    k: number | undefined,
+    numThreads: number | undefined,
+    queryEf: number | undefined,
+    options: QueryOptions & { resultType: ResultType.BigIntTypedArray }
+  ): BigIntTypedQueryResult;
+
   query(
-    vectors: number[] | number[][],
+    vectors: number[] | VectorBatch,
     k?: number,
     numThreads?: number,
-    queryEf?: number
-  ): QueryResult | QueryResults {
-    return this._index.query(vectors, k, numThreads, queryEf);
+    queryEf?: number,
+    options?: QueryOptions
+  ): QueryResult | QueryResults | TypedQueryResult | BigIntTypedQueryResult {
+    return this._index.query(vectors, k, numThreads, queryEf, options);
+  }
+
+  /** Add multiple vectors to the index without blocking the event loop
+   * @param vectors - Array of vectors to add
+   * @param ids - Optional array of IDs (must match vectors length if provided)
+   * @param numThreads - Number of threads to use (-1 for auto)
+   * @param options - Optional settings, such as replaceDeleted
+   * @returns Promise resolving to the array of IDs assigned to the vectors
+   */
+  addItemsAsync(
+    vectors: VectorBatch,
+    ids?: number[],
+    numThreads?: number,
+    options?: AddItemsOptions
+  ): Promise<number[]> {
+    return this._index.addItemsAsync(vectors, ids, numThreads, options);
+  }
+
+  /** Add many vectors to this empty index at once. Much faster than
+   * addItems() for large inputs: the graph is built in parallel batches, and
+   * the result doesn't depend on numThreads. The index is resized to fit the
+   * vectors exactly if it can't already hold them.
+   * @param vectors - Array of vectors to add, or a flat Float32Array holding
+   * the vectors back to back (numDimensions elements each)
+   * @param ids - Optional array of unique IDs (must match vectors length if
+   * provided)
+   * @param numThreads - Number of threads to use (-1 for auto)
+   * @param options - Optional settings, such as an onProgress callback
+   * @returns Array of IDs assigned to the vectors
+   */
+  buildFromArray(
+    vectors: VectorBatch,
+    ids?: number[],
+    numThreads?: number,
+    options?: BuildOptions
+  ): number[] {
+    return this._index.buildFromArray(vectors, ids, numThreads, options);
+  }
+
+  /** Learn the codebook of an index with PQ storage from a sample of (at
+   * least 256) vectors like those to be added, which aren't added themselves.
+   * Only needed to add vectors in batches of fewer than 256; otherwise, the
+   * codebook is learned from the first batch added. Can only be done once.
+   * @param vectors - Array of vectors, or a flat Float32Array holding the
+   * vectors back to back (numDimensions elements each)
+   * @param numThreads - Number of threads to use (-1 for auto)
+   */
+  train(vectors: VectorBatch, numThreads?: number): void {
+    this._index.train(vectors, numThreads);
+  }
+
+  /** As buildFromArray(), but without blocking the event loop. onProgress
+   * is called on the main thread; reports are skipped while it is busy, but
+   * the final one is always delivered before the Promise resolves.
+   * @param vectors - Array of vectors to add, or a flat Float32Array holding
+   * the vectors back to back (numDimensions elements each)
+   * @param ids - Optional array of unique IDs (must match vectors length if
+   * provided)
+   * @param numThreads - Number of threads to use (-1 for auto)
+   * @param options - Optional settings, such as an onProgress callback
+   * @returns Promise resolving to the array of IDs assigned to the vectors
+   */
+  buildFromArrayAsync(
+    vectors: VectorBatch,
+    ids?: number[],
+    numThreads?: number,
+    options?: BuildOptions
+  ): Promise<number[]> {
+    return this._index.buildFromArrayAsync(vectors, ids, numThreads, options);
+  }
+
+  /** Query the index for nearest neighbors of a single vector without
+   * blocking the event loop
+   * @param vector - Vector to query
+   * @param k - Number of neighbors to return (default: 1)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth for this query (-1 to use default ef)
+   * @param options - Result type and ID filter
+   * @returns Promise resolving to neighbors and distances arrays
+   */
+  queryAsync(
+    vectors: number[],
+    k?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: ArrayQueryOptions
+  ): Promise<QueryResult>;
+
+  /** Query the index for nearest neighbors of vectors stored in a flat
+   * Float32Array without blocking the event loop
+   * @param vectors - Vector(s) to query
+   * @param k - Number of neighbors to return (default: 1)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth for this query (-1 to use default ef)
+   * @param options - Result type and ID filter
+   * @returns Promise resolving to neighbors and distances arrays
+   */
+  queryAsync(
+    vectors: Float32Array,
+    k?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: ArrayQueryOptions
+  ): Promise<QueryResult | QueryResults>;
+
+  /** Query the index for nearest neighbors of multiple vectors without
+   * blocking the event loop
+   * @param vectors - Array of vectors to query
+   * @param k - Number of neighbors to return (default: 1)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth for this query (-1 to use default ef)
+   * @param options - Result type and ID filter
+   * @returns Promise resolving to arrays of neighbors and distances
+   */
+  queryAsync(
+    vectors: number[][] | Float32Array[],
+    k?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: ArrayQueryOptions
+  ): Promise<QueryResults>;
+
+  /** Query the index for nearest neighbors, returning flat typed arrays
+   * @param vectors - Vector(s) to query
+   * @param k - Number of neighbors to return (default: 1)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth for this query (-1 to use default ef)
+   * @param options - Result type (ResultType.TypedArray or
+   *   ResultType.BigIntTypedArray) and ID filter
+   * @returns Object containing flat, row-major neighbors and distances
+   */
+  queryAsync(
+    vectors: number[] | VectorBatch,
+    k: number | undefined,
+    numThreads: number | undefined,
+    queryEf: number | undefined,
+    options: QueryOptions & { resultType: ResultType.TypedArray }
+  ): Promise<TypedQueryResult>;
+
+  queryAsync(
+    vectors: number[] | VectorBatch,
+    k: number | undefined,
+    numThreads: number | undefined,
+    queryEf: number | undefined,
+    options: QueryOptions & { resultType: ResultType.BigIntTypedArray }
+  ): Promise<BigIntTypedQueryResult>;
+
+  queryAsync(
+    vectors: number[] | VectorBatch,
+    k?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: QueryOptions
+  ): Promise<
+    QueryResult | QueryResults | TypedQueryResult | BigIntTypedQueryResult
+  > {
+    return this._index.queryAsync(vectors, k, numThreads, queryEf, options);
+  }
+
+  /** Find every vector within the given distance of a query vector,
+   * rather than a fixed number of them. The search keeps following the graph
+   * for as long as it finds vectors in range, so large radii cost more.
+   * @param vectors - Vector to query
+   * @param radius - Maximum distance (as returned by query()) of a result
+   * @param maxResults - If positive, only return this many of the nearest
+   * results (default: 0, for no limit)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth used to find the first results (-1 to use
+   * default ef)
+   * @param options - Result type and ID filter
+   * @returns Object containing neighbors and distances, nearest first
+   */
+  rangeSearch(
+    vectors: number[],
+    radius: number,
+    maxResults?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: RangeSearchOptions & { resultType?: ResultType.TypedArray }
+  ): RangeSearchResult;
+
+  /** Find every vector within the given distance of each of multiple query
+   * vectors
+   * @param vectors - Vectors to query
+   * @param radius - Maximum distance (as returned by query()) of a result
+   * @param maxResults - If positive, only return this many of the nearest
+   * results per query (default: 0, for no limit)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth used to find the first results (-1 to use
+   * default ef)
+   * @param options - Result type and ID filter
+   * @returns Object containing the flat neighbors and distances of all
+   * queries, and the offsets at which each query's results start
+   */
+  rangeSearch(
+    vectors: number[][] | Float32Array[],
+    radius: number,
+    maxResults?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: RangeSearchOptions & { resultType?: ResultType.TypedArray }
+  ): RangeSearchResults;
+
+  /** Find every vector within the given distance of vectors stored in a flat
+   * Float32Array. An array of exactly numDimensions elements is treated as a
+   * single vector; otherwise it holds multiple vectors back to back.
+   * @param vectors - Vector(s) to query
+   * @param radius - Maximum distance (as returned by query()) of a result
+   * @param maxResults - If positive, only return this many of the nearest
+   * results per query (default: 0, for no limit)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth used to find the first results (-1 to use
+   * default ef)
+   * @param options - Result type and ID filter
+   * @returns Object containing neighbors and distances, and for multiple
+   * vectors, offsets
+   */
+  rangeSearch(
+    vectors: Float32Array,
+    radius: number,
+    maxResults?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: RangeSearchOptions & { resultType?: ResultType.TypedArray }
+  ): RangeSearchResult | RangeSearchResults;
+
+  rangeSearch(
+    vectors: number[] | VectorBatch,
+    radius: number,
+    maxResults: number | undefined,
+    numThreads: number | undefined,
+    queryEf: number | undefined,
+    options: RangeSearchOptions & { resultType: ResultType.BigIntTypedArray }
+  ): RangeSearchResult<BigUint64Array> | RangeSearchResults<BigUint64Array>;
+
+  rangeSearch(
+    vectors: number[] | VectorBatch,
+    radius: number,
+    maxResults?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: RangeSearchOptions
+  ): RangeSearchResult<any> | RangeSearchResults<any> {
+    return this._index.rangeSearch(
+      vectors,
+      radius,
+      maxResults,
+      numThreads,
+      queryEf,
+      options
+    );
+  }
+
+  /** As rangeSearch(), but without blocking the event loop
+   * @param vectors - Vector to query
+   * @param radius - Maximum distance (as returned by query()) of a result
+   * @param maxResults - If positive, only return this many of the nearest
+   * results (default: 0, for no limit)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth used to find the first results (-1 to use
+   * default ef)
+   * @param options - Result type and ID filter
+   * @returns Promise resolving to neighbors and distances, nearest first
+   */
+  rangeSearchAsync(
+    vectors: number[],
+    radius: number,
+    maxResults?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: RangeSearchOptions & { resultType?: ResultType.TypedArray }
+  ): Promise<RangeSearchResult>;
+
+  /** As rangeSearch(), but without blocking the event loop
+   * @param vectors - Vectors to query
+   * @param radius - Maximum distance (as returned by query()) of a result
+   * @param maxResults - If positive, only return this many of the nearest
+   * results per query (default: 0, for no limit)
+   * @param numThreads - Number of threads for parallel queries (-1 for auto)
+   * @param queryEf - Search depth used to find the first results (-1 to use
+   * default ef)
+   * @param options - Result type and ID filter
+   * @returns Promise resolving to the flat neighbors and distances of all
+   * queries, and the offsets at which each query's results start
+   */
+  rangeSearchAsync(
+    vectors: number[][] | Float32Array[],
+    radius: number,
+    maxResults?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: RangeSearchOptions & { resultType?: ResultType.TypedArray }
+  ): Promise<RangeSearchResults>;
+
+  rangeSearchAsync(
+    vectors: Float32Array,
+    radius: number,
+    maxResults?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: RangeSearchOptions & { resultType?: ResultType.TypedArray }
+  ): Promise<RangeSearchResult | RangeSearchResults>;
+
+  rangeSearchAsync(
+    vectors: number[] | VectorBatch,
+    radius: number,
+    maxResults: number | undefined,
+    numThreads: number | undefined,
+    queryEf: number | undefined,
+    options: RangeSearchOptions & { resultType: ResultType.BigIntTypedArray }
+  ): Promise<
+    RangeSearchResult<BigUint64Array> | RangeSearchResults<BigUint64Array>
+  >;
+
+  rangeSearchAsync(
+    vectors: number[] | VectorBatch,
+    radius: number,
+    maxResults?: number,
+    numThreads?: number,
+    queryEf?: number,
+    options?: RangeSearchOptions
+  ): Promise<RangeSearchResult<any> | RangeSearchResults<any>> {
+    return this._index.rangeSearchAsync(
+      vectors,
+      radius,
+      maxResults,
+      numThreads,
+      queryEf,
+      options
+    );
   }
 
   /** Get the vector stored at the given ID
@@ -153,8 +754,23 @@ export class Index {
    * @param ids - Array of IDs to retrieve
    * @returns Array of vectors
    */
-  getVectors(ids: number[]): number[][] {
-    return this._index.getVectors(ids);
+  getVectors(ids: number[], resultType?: ResultType.Array): number[][];
+
+  /** Get multiple vectors by their IDs as one flat Float32Array
+   * @param ids - Array of IDs to retrieve
+   * @param resultType - ResultType.TypedArray or ResultType.BigIntTypedArray
+   * @returns Row-major Float32Array of ids.length * numDimensions elements
+   */
+  getVectors(
+    ids: number[],
+    resultType: ResultType.TypedArray | ResultType.BigIntTypedArray
+  ): Float32Array;
+
+  getVectors(
+    ids: number[],
+    resultType?: ResultType
+  ): number[][] | Float32Array {
+    return this._index.getVectors(ids, resultType);
   }
 
   /** Mark an ID as deleted (will not appear in query results)
@@ -178,6 +794,44 @@ export class Index {
     this._index.resize(newSize);
   }
 
+  /** Physically remove all vectors marked as deleted, reconnecting the
+   * vectors that linked to them and shrinking the index's memory. Afterwards,
+   * maxElements equals numElements. Queries may run concurrently (e.g. via
+   * queryAsync), but adding or deleting vectors waits until it finishes.
+   * @param numThreads - Number of threads to use (-1 for auto)
+   * @returns The number of vectors removed
+   */
+  compact(numThreads?: number): number {
+    return this._index.compact(numThreads);
+  }
+
+  /** As compact(), but without blocking the event loop
+   * @param numThreads - Number of threads to use (-1 for auto)
+   * @returns Promise resolving to the number of vectors removed
+   */
+  compactAsync(numThreads?: number): Promise<number> {
+    return this._index.compactAsync(numThreads);
+  }
+
+  /** Rearrange the index in memory so that vectors that are neighbors in the
+   * graph are stored close together, which makes queries on large indices
+   * faster. IDs and query results are unchanged. Best done once, before
+   * saving an index that has finished building; queries, additions and
+   * deletions wait until it finishes.
+   * @param numThreads - Number of threads to use (-1 for auto)
+   */
+  reorder(numThreads?: number): void {
+    this._index.reorder(numThreads);
+  }
+
+  /** As reorder(), but without blocking the event loop
+   * @param numThreads - Number of threads to use (-1 for auto)
+   * @returns Promise resolving once the index has been reordered
+   */
+  reorderAsync(numThreads?: number): Promise<void> {
+    return this._index.reorderAsync(numThreads);
+  }
+
   /** Save the index to a file
    * @param filePath - Path where the index should be saved
    */
@@ -185,6 +839,60 @@ export class Index {
     this._index.saveIndex(filePath);
   }
 
+  /** Save one shard of a sharded index to a file, in the same format as an
+   * unsharded index
+   * @param shard - The shard to save, from 0 to numShards - 1
+   * @param filePath - Path where the shard should be saved
+   */
+  saveShard(shard: number, filePath: string): void {
+    this._index.saveShard(shard, filePath);
+  }
+
+  /** Replace one shard of a sharded index with one loaded from a file (e.g.
+   * saved by saveShard()). The shard must only contain items whose IDs belong
+   * to it, and must match the other shards' space, dimensions and storage
+   * data type.
+   * @param shard - The shard to replace, from 0 to numShards - 1
+   * @param filePath - Path to the shard's file
+   * @param options - Whether to memory-map the file (only mmap is used)
+   */
+  loadShard(shard: number, filePath: string, options?: LoadOptions): void {
+    this._index.loadShard(shard, filePath, options);
+  }
+
+  /** Persist this index at a path incrementally: write a snapshot of it
+   * there, then append each change made to it (by addItem(s), markDeleted
+   * and unmarkDeleted) to a log file next to it (at filePath + ".log"),
+   * rather than re-saving the whole index every time. loadIndex() replays the
+   * log onto the snapshot, and keeps appending to it.
+   * @param filePath - Path where the index's snapshot should be saved
+   * @param options - How often to fold the log into a new snapshot
+   */
+  openChangeLog(filePath: string, options?: ChangeLogOptions): void {
+    this._index.openChangeLog(filePath, options);
+  }
+
+  /** Fold this index's change log into a new snapshot of the index (written
+   * to the path its change log was opened with), and empty the log
+   */
+  checkpoint(): void {
+    this._index.checkpoint();
+  }
+
+  /** As checkpoint(), but without blocking the event loop
+   * @returns Promise resolving once the snapshot has been written
+   */
+  checkpointAsync(): Promise<void> {
+    return this._index.checkpointAsync();
+  }
+
+  /** Stop logging changes to this index. Changes logged so far are kept, and
+   * replayed when the index is next loaded.
+   */
+  closeChangeLog(): void {
+    this._index.closeChangeLog();
+  }
+
   /** Load an index from a file
    * @param filePath - Path to the index file
    * @param options - Optional parameters for loading legacy indices
@@ -197,6 +905,89 @@ export class Index {
     return index;
   }
 
+  /** Save the index to a file without blocking the event loop
+   * @param filePath - Path where the index should be saved
+   * @returns Promise resolving once the file has been written
+   */
+  saveIndexAsync(filePath: string): Promise<void> {
+    return this._index.saveIndexAsync(filePath);
+  }
+
+  /** Load an index from a file without blocking the event loop
+   * @param filePath - Path to the index file
+   * @param options - Optional parameters for loading legacy indices
+   * @returns Promise resolving to a new Index instance
+   */
+  static async loadIndexAsync(
+    filePath: string,
+    options?: LoadOptions
+  ): Promise<Index> {
+    const nativeIndex = await native.Index.loadIndexAsync(filePath, options);
+    const index = Object.create(Index.prototype);
+    index._index = nativeIndex;
+    return index;
+  }
+
+  /** Save the index to a stream (e.g. a file or an upload) without blocking
+   * the event loop. The index is written in chunks of a few megabytes, and
+   * writing pauses whenever the stream asks for backpressure, so the index is
+   * never copied into memory as a whole.
+   * @param stream - Writable stream to write the index to
+   * @param options - Whether to end the stream afterwards
+   * @returns Promise resolving once the index has been written (and, unless
+   * options.end is false, the stream has finished)
+   */
+  async saveToStream(
+    stream: Writable,
+    options: SaveToStreamOptions = {}
+  ): Promise<void> {
+    await this._index.saveToStream(async (chunk: Buffer) => {
+      if (stream.errored) throw stream.errored;
+      if (stream.destroyed || stream.writableEnded) {
+        throw new Error("Stream was closed before the index was written");
+      }
+      if (!stream.write(chunk)) await waitForDrain(stream);
+    });
+    if (options.end ?? true) {
+      stream.end();
+      await finished(stream, { readable: false });
+    }
+  }
+
+  /** Load an index from a stream (e.g. a file or a download) without blocking
+   * the event loop. The stream is read only as fast as the index is loaded,
+   * and is consumed to its end (or destroyed if loading fails).
+   * @param stream - Readable stream (or other async iterable) of Buffers
+   * @param options - Optional parameters for loading legacy indices
+   * @returns Promise resolving to a new Index instance
+   */
+  static async loadFromStream(
+    stream: AsyncIterable<Uint8Array>,
+    options?: LoadOptions
+  ): Promise<Index> {
+    const iterator = stream[Symbol.asyncIterator]();
+    const pull = async (): Promise<Uint8Array[] | null> => {
+      const chunks: Uint8Array[] = [];
+      let numBytes = 0;
+      while (numBytes < STREAM_BATCH_BYTES) {
+        const { value, done } = await iterator.next();
+        if (done) break;
+        chunks.push(value);
+        numBytes += value.byteLength ?? 0;
+      }
+      return chunks.length > 0 ? chunks : null;
+    };
+
+    try {
+      const nativeIndex = await native.Index.loadFromStream(pull, options);
+      const index = Object.create(Index.prototype);
+      index._index = nativeIndex;
+      return index;
+    } finally {
+      await iterator.return?.();
+    }
+  }
+
   /** Get the distance between two vectors
    * @param a - First vector
    * @param b - Second vector
@@ -206,14 +997,15 @@ export class Index {
     return this._index.getDistance(a, b);
   }
 
-  /** Serialize the index to a Buffer
+  /** Serialize the index to a Buffer. The Buffer is allocated at its exact
+   * final size and written in place, so no other copies are made.
    * @returns Buffer containing the serialized index
    */
   toBuffer(): Buffer {
     return this._index.toBuffer();
   }
 
-  /** Load an index from a Buffer
+  /** Load an index from a Buffer, reading directly from its memory
    * @param buffer - Buffer containing the serialized index
    * @param options - Optional parameters for loading legacy indices
    * @returns A new Index instance
@@ -225,6 +1017,39 @@ export class Index {
     return index;
   }
 
+  /** Share this index with other threads in this process (i.e.: workers
+   * created with worker_threads) without copying it. Pass the returned handle
+   * to a worker (e.g.: in workerData) and call Index.attach() there. The
+   * handle stays valid for as long as any Index using it is alive, so keep
+   * this Index referenced until every worker has attached.
+   *
+   * Once shared, the index is read-only on this thread too, as any worker
+   * may be searching it at the same time: methods that modify it (see
+   * attach()) throw. To change it, build or load a new Index and share that.
+   * Throws if an async call that modifies this index (e.g.: addItemsAsync())
+   * is still running.
+   * @returns A handle to pass to Index.attach()
+   */
+  share(): number {
+    return this._index.share();
+  }
+
+  /** Use an index shared by another thread with share(). The returned Index
+   * reads the same native memory as the original, so attaching costs no
+   * memory and any number of threads may search it at once. Attached indices
+   * can only be searched: methods that modify the index (addItems(),
+   * markDeleted(), resize(), compact(), reorder(), and setting ef or
+   * maxElements) throw, as they do on the Index that was shared.
+   * @param handle - A handle returned by share() on any thread
+   * @returns A search-only Index backed by the shared index
+   */
+  static attach(handle: number): Index {
+    const nativeIndex = native.Index.attach(handle);
+    const index = Object.create(Index.prototype);
+    index._index = nativeIndex;
+    return index;
+  }
+
   /** Check if an ID exists in the index
    * @param id - The ID to check
    * @returns True if the ID exists, false otherwise
@@ -233,6 +1058,21 @@ export class Index {
     return this._index.has(id);
   }
 
+  /** Get the total work done by every query of this index since it was
+   * created or loaded (or since resetStats() was last called). Useful for
+   * tuning ef against a budget of distance computations. Only queries made
+   * with includeStats are timed, so only those count towards elapsedMs.
+   * @returns Totals across all queries
+   */
+  stats(): IndexStats {
+    return this._index.stats();
+  }
+
+  /** Reset the totals returned by stats() to zero */
+  resetStats(): void {
+    this._index.resetStats();
+  }
+
   /** Get a string representation of the index
    * @returns String describing the index
    */
@@ -272,6 +1112,16 @@ export class Index {
     this._index.maxElements = value;
   }
 
+  /** Whether adding items beyond maxElements grows the index (see
+   * IndexOptions.autoGrow) rather than throwing an error */
+  get autoGrow(): boolean {
+    return this._index.autoGrow;
+  }
+
+  set autoGrow(value: boolean) {
+    this._index.autoGrow = value;
+  }
+
   /** The storage data type used by this index */
   get storageDataType(): StorageDataType {
     return this._index.storageDataType;
@@ -303,6 +1153,29 @@ export class Index {
   get length(): number {
     return this._index.length;
   }
+
+  /** The number of shards this index is split into (1 if it isn't sharded) */
+  get numShards(): number {
+    return this._index.numShards;
+  }
+}
+
+/** The number of worker threads used to parallelize addItems() and query()
+ * calls. Defaults to one fewer than the number of CPU cores, as the calling
+ * thread also takes part in the work.
+ */
+export function getThreadPoolSize(): number {
+  return native.getThreadPoolSize();
+}
+
+/** Set the number of worker threads used to parallelize addItems() and query()
+ * calls. The pool is shared by every index in the process, including calls
+ * running on libuv's threadpool via the async methods. A value of 0 runs all
+ * work on the calling thread.
+ * @param numThreads - The number of worker threads
+ */
+export function setThreadPoolSize(numThreads: number): void {
+  native.setThreadPoolSize(numThreads);
 }
 
 // Export the native enums from the C+ module
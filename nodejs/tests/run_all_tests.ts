@@ -3,6 +3,22 @@ import runE4M3Tests from "./test_e4m3.ts";
 import runIndexCreationTests from "./test_index_creation.ts";
 import runIndexRecreationTests from "./test_index_recreation.ts";
 import runLoadIndicesTests from "./test_load_indices.ts";
+import runAsyncTests from "./test_async.ts";
+import runTypedArrayTests from "./test_typed_arrays.ts";
+import runFilteredSearchTests from "./test_filtered_search.ts";
+import runSearchStatsTests from "./test_search_stats.ts";
+import runCompactTests from "./test_compact.ts";
+import runReplaceDeletedTests from "./test_replace_deleted.ts";
+import runReorderTests from "./test_reorder.ts";
+import runStreamTests from "./test_streams.ts";
+import runProductQuantizationTests from "./test_product_quantization.ts";
+import runRerankTests from "./test_rerank.ts";
+import runSharedIndexTests from "./test_shared.ts";
+import runBuildFromArrayTests from "./test_build_from_array.ts";
+import runRangeSearchTests from "./test_range_search.ts";
+import runShardedTests from "./test_sharded.ts";
+import runChangeLogTests from "./test_change_log.ts";
+import runGrowthTests from "./test_growth.ts";
 import process from "process";
 
 async function main() {
@@ -71,6 +87,196 @@ async function main() {
     allPassed = false;
   }
   console.log();
+
+  try {
+    console.log("Running Async API Tests...");
+    console.log("=".repeat(70));
+    await runAsyncTests();
+    console.log("✓ Async API tests passed");
+  } catch (error) {
+    console.error("✗ Async API tests failed with error:", error);
+    failedTests.push("Async API Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Typed Array Tests...");
+    console.log("=".repeat(70));
+    runTypedArrayTests();
+    console.log("✓ Typed array tests passed");
+  } catch (error) {
+    console.error("✗ Typed array tests failed with error:", error);
+    failedTests.push("Typed Array Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Filtered Search Tests...");
+    console.log("=".repeat(70));
+    await runFilteredSearchTests();
+    console.log("✓ Filtered search tests passed");
+  } catch (error) {
+    console.error("✗ Filtered search tests failed with error:", error);
+    failedTests.push("Filtered Search Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Search Stats Tests...");
+    console.log("=".repeat(70));
+    await runSearchStatsTests();
+    console.log("✓ Search stats tests passed");
+  } catch (error) {
+    console.error("✗ Search stats tests failed with error:", error);
+    failedTests.push("Search Stats Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Compaction Tests...");
+    console.log("=".repeat(70));
+    await runCompactTests();
+    console.log("✓ Compaction tests passed");
+  } catch (error) {
+    console.error("✗ Compaction tests failed with error:", error);
+    failedTests.push("Compaction Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Replace-Deleted Tests...");
+    console.log("=".repeat(70));
+    await runReplaceDeletedTests();
+    console.log("✓ Replace-deleted tests passed");
+  } catch (error) {
+    console.error("✗ Replace-deleted tests failed with error:", error);
+    failedTests.push("Replace-Deleted Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Reorder Tests...");
+    console.log("=".repeat(70));
+    await runReorderTests();
+    console.log("✓ Reorder tests passed");
+  } catch (error) {
+    console.error("✗ Reorder tests failed with error:", error);
+    failedTests.push("Reorder Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Stream Tests...");
+    console.log("=".repeat(70));
+    await runStreamTests();
+    console.log("✓ Stream tests passed");
+  } catch (error) {
+    console.error("✗ Stream tests failed with error:", error);
+    failedTests.push("Stream Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Product Quantization Tests...");
+    console.log("=".repeat(70));
+    await runProductQuantizationTests();
+    console.log("✓ Product quantization tests passed");
+  } catch (error) {
+    console.error("✗ Product quantization tests failed with error:", error);
+    failedTests.push("Product Quantization Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Rerank Tests...");
+    console.log("=".repeat(70));
+    await runRerankTests();
+    console.log("✓ Rerank tests passed");
+  } catch (error) {
+    console.error("✗ Rerank tests failed with error:", error);
+    failedTests.push("Rerank Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Shared Index Tests...");
+    console.log("=".repeat(70));
+    await runSharedIndexTests();
+    console.log("✓ Shared index tests passed");
+  } catch (error) {
+    console.error("✗ Shared index tests failed with error:", error);
+    failedTests.push("Shared Index Tests");
+    allPassed = false;
+  }
+  console.log();
+  try {
+    console.log("Running buildFromArray Tests...");
+    console.log("=".repeat(70));
+    await runBuildFromArrayTests();
+    console.log("✓ buildFromArray tests passed");
+  } catch (error) {
+    console.error("✗ buildFromArray tests failed with error:", error);
+    failedTests.push("buildFromArray Tests");
+    allPassed = false;
+  }
+  console.log();
+  try {
+    console.log("Running Range Search Tests...");
+    console.log("=".repeat(70));
+    await runRangeSearchTests();
+    console.log("✓ Range search tests passed");
+  } catch (error) {
+    console.error("✗ Range search tests failed with error:", error);
+    failedTests.push("Range Search Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Sharded Index Tests...");
+    console.log("=".repeat(70));
+    await runShardedTests();
+    console.log("✓ Sharded index tests passed");
+  } catch (error) {
+    console.error("✗ Sharded index tests failed with error:", error);
+    failedTests.push("Sharded Index Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Change Log Tests...");
+    console.log("=".repeat(70));
+    await runChangeLogTests();
+    console.log("✓ Change log tests passed");
+  } catch (error) {
+    console.error("✗ Change log tests failed with error:", error);
+    failedTests.push("Change Log Tests");
+    allPassed = false;
+  }
+  console.log();
+
+  try {
+    console.log("Running Growth Tests...");
+    console.log("=".repeat(70));
+    await runGrowthTests();
+    console.log("✓ Growth tests passed");
+  } catch (error) {
+    console.error("✗ Growth tests failed with error:", error);
+    failedTests.push("Growth Tests");
+    allPassed = false;
+  }
+  console.log();
   console.log("=".repeat(70));
   console.log("Test Suite Summary");
   console.log("=".repeat(70));
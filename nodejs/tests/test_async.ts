@@ -0,0 +1,264 @@
+import {
+  Index,
+  Space,
+  StorageDataType,
+  getThreadPoolSize,
+  setThreadPoolSize,
+} from "../src/voyager-node.ts";
+import fs from "fs";
+import path from "path";
+import os from "os";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function createTempFile(suffix: string = ".voy"): string {
+  const tmpDir = os.tmpdir();
+  const fileName = `voyager_test_${Date.now()}_${Math.random()
+    .toString(36)
+    .substring(7)}${suffix}`;
+  return path.join(tmpDir, fileName);
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+async function testAddItemsAndQueryAsync(): Promise<boolean> {
+  const testName = "addItemsAsync and queryAsync match synchronous results";
+  try {
+    const numDimensions = 16;
+    const inputData = generateRandomData(256, numDimensions);
+
+    const index = new Index({
+      space: Space.Euclidean,
+      numDimensions,
+      storageDataType: StorageDataType.Float32,
+    });
+
+    const ids = await index.addItemsAsync(inputData);
+    assertEqual(ids.length, inputData.length, "Number of returned IDs");
+    assertEqual(index.length, inputData.length, "Index length after add");
+
+    // Each vector should be its own nearest neighbour.
+    const batch = await index.queryAsync(inputData, 1);
+    for (let i = 0; i < inputData.length; i++) {
+      assertEqual(batch.neighbors[i][0], ids[i], `Neighbor of vector ${i}`);
+    }
+
+    const single = await index.queryAsync(inputData[0], 3);
+    const expected = index.query(inputData[0], 3);
+    assertEqual(
+      JSON.stringify(single.neighbors),
+      JSON.stringify(expected.neighbors),
+      "Single-vector queryAsync neighbors"
+    );
+
+    // Async calls copy a Float32Array before returning, so changing it while
+    // they run doesn't affect them:
+    const flat = new Float32Array(inputData[1]);
+    const unchanged = index.query(new Float32Array(flat), 1);
+    const pending = index.queryAsync(flat, 1);
+    flat.fill(100);
+    assertEqual(
+      JSON.stringify((await pending).neighbors),
+      JSON.stringify(unchanged.neighbors),
+      "queryAsync neighbors after changing its input"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testSaveAndLoadIndexAsync(): Promise<boolean> {
+  const testName = "saveIndexAsync and loadIndexAsync round-trip";
+  const outputFile = createTempFile();
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(100, numDimensions);
+
+    const index = new Index({
+      space: Space.Cosine,
+      numDimensions,
+      storageDataType: StorageDataType.Float8,
+    });
+    index.addItems(inputData);
+
+    await index.saveIndexAsync(outputFile);
+    assert(fs.existsSync(outputFile), "Output file should exist");
+
+    const loaded = await Index.loadIndexAsync(outputFile);
+    assert(loaded instanceof Index, "Loaded value should be an Index");
+    assertEqual(loaded.length, index.length, "Loaded index length");
+    assertEqual(loaded.space, index.space, "Loaded index space");
+    assertEqual(
+      loaded.numDimensions,
+      index.numDimensions,
+      "Loaded index dimensions"
+    );
+    assertEqual(
+      loaded.storageDataType,
+      index.storageDataType,
+      "Loaded index storage type"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  } finally {
+    if (fs.existsSync(outputFile)) {
+      fs.unlinkSync(outputFile);
+    }
+  }
+}
+
+async function testAsyncErrorsReject(): Promise<boolean> {
+  const testName = "Async errors reject the returned promise";
+  try {
+    const index = new Index({ space: Space.Euclidean, numDimensions: 4 });
+
+    let rejected = false;
+    try {
+      await index.addItemsAsync([[1, 2, 3]]);
+    } catch (error) {
+      rejected = true;
+    }
+    assert(rejected, "addItemsAsync with wrong dimensions should reject");
+
+    index.addItems([[1, 2, 3, 4]]);
+    rejected = false;
+    try {
+      await index.queryAsync([1, 2, 3, 4], 2, -1, 1);
+    } catch (error) {
+      rejected = true;
+    }
+    assert(rejected, "queryAsync with queryEf < k should reject");
+
+    rejected = false;
+    try {
+      await Index.loadIndexAsync(createTempFile());
+    } catch (error) {
+      rejected = true;
+    }
+    assert(rejected, "loadIndexAsync of a missing file should reject");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testConcurrentQueriesShareThreadPool(): Promise<boolean> {
+  const testName = "Concurrent async calls share a resizable thread pool";
+  const originalSize = getThreadPoolSize();
+  try {
+    const numDimensions = 16;
+    const inputData = generateRandomData(500, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(inputData);
+    const expected = index.query(inputData, 5);
+
+    for (const size of [0, 2, originalSize]) {
+      setThreadPoolSize(size);
+      assertEqual(getThreadPoolSize(), size, "Thread pool size");
+
+      const results = await Promise.all(
+        Array.from({ length: 8 }, () => index.queryAsync(inputData, 5))
+      );
+      for (const result of results) {
+        assertEqual(
+          JSON.stringify(result.neighbors),
+          JSON.stringify(expected.neighbors),
+          `Neighbors with ${size} pool threads`
+        );
+      }
+    }
+
+    let threw = false;
+    try {
+      setThreadPoolSize(-1);
+    } catch (error) {
+      threw = true;
+    }
+    assert(threw, "Negative thread pool sizes should be rejected");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  } finally {
+    setThreadPoolSize(originalSize);
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running async API tests...\n");
+
+  const results = [
+    await testAddItemsAndQueryAsync(),
+    await testSaveAndLoadIndexAsync(),
+    await testAsyncErrorsReject(),
+    await testConcurrentQueriesShareThreadPool(),
+  ];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Async API Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All async API tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
@@ -0,0 +1,247 @@
+import { Index, Space } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function flatten(data: number[][]): Float32Array {
+  const numDimensions = data.length > 0 ? data[0].length : 0;
+  const flat = new Float32Array(data.length * numDimensions);
+  data.forEach((vector, i) => flat.set(vector, i * numDimensions));
+  return flat;
+}
+
+function testBuildFromArray(): boolean {
+  const testName = "buildFromArray finds each vector and reports progress";
+  try {
+    const numDimensions = 16;
+    const inputData = generateRandomData(3000, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    const progress: number[] = [];
+    const ids = index.buildFromArray(flatten(inputData), undefined, -1, {
+      onProgress: (numAdded, numTotal) => {
+        assertEqual(numTotal, inputData.length, "Progress total");
+        progress.push(numAdded);
+      },
+    });
+    assertEqual(ids.length, inputData.length, "Number of returned IDs");
+    assertEqual(index.length, inputData.length, "Index length after build");
+    assertEqual(index.maxElements, inputData.length, "Exact preallocation");
+    assert(progress.length > 0, "Progress should be reported");
+    assertEqual(progress[progress.length - 1], inputData.length, "Last report");
+    for (let i = 1; i < progress.length; i++) {
+      assert(progress[i] > progress[i - 1], "Progress should increase");
+    }
+
+    const result = index.query(inputData, 1);
+    let numFound = 0;
+    for (let i = 0; i < inputData.length; i++) {
+      if (result.neighbors[i][0] === ids[i]) numFound++;
+    }
+    assert(numFound >= 0.99 * inputData.length, `Recall too low: ${numFound}`);
+
+    // The result doesn't depend on the number of threads:
+    const other = new Index({ space: Space.Euclidean, numDimensions });
+    other.buildFromArray(inputData, undefined, 1);
+    assertEqual(
+      JSON.stringify(other.query(inputData, 5).neighbors),
+      JSON.stringify(index.query(inputData, 5).neighbors),
+      "Neighbors with a single thread"
+    );
+
+    let threw = false;
+    try {
+      index.buildFromArray(inputData);
+    } catch (error) {
+      threw = true;
+    }
+    assert(threw, "buildFromArray on a non-empty index should throw");
+
+    // onProgress can search the index while it's being built:
+    const searched = new Index({ space: Space.Euclidean, numDimensions });
+    let numSearches = 0;
+    searched.buildFromArray(inputData, undefined, -1, {
+      onProgress: (numAdded, numTotal) => {
+        const { neighbors } = searched.query(inputData[0], 1);
+        numSearches++;
+        if (numAdded === numTotal) {
+          assertEqual(neighbors[0], 0, "Neighbor found from onProgress");
+        }
+      },
+    });
+    assertEqual(numSearches, progress.length, "Searches from onProgress");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testBuildFromArrayErrors(): boolean {
+  const testName = "buildFromArray leaves the index empty when it fails";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(2000, numDimensions);
+    const index = new Index({ space: Space.Cosine, numDimensions });
+
+    let threw = false;
+    try {
+      index.buildFromArray(inputData.slice(0, 2), [5, 5]);
+    } catch (error) {
+      threw = true;
+    }
+    assert(threw, "Duplicate IDs should throw");
+    assertEqual(index.length, 0, "Index length after duplicate IDs");
+
+    threw = false;
+    try {
+      index.buildFromArray(inputData, undefined, -1, {
+        onProgress: () => {
+          throw new Error("Cancelled");
+        },
+      });
+    } catch (error) {
+      threw = (error as Error).message === "Cancelled";
+    }
+    assert(threw, "Errors thrown by onProgress should be rethrown");
+    assertEqual(index.length, 0, "Index length after cancelling");
+
+    const ids = inputData.map((_, i) => i * 2);
+    index.buildFromArray(inputData, ids);
+    assertEqual(index.query(inputData[1], 1).neighbors[0], 2, "Given IDs");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testBuildFromArrayAsync(): Promise<boolean> {
+  const testName = "buildFromArrayAsync matches buildFromArray";
+  try {
+    const numDimensions = 16;
+    const inputData = generateRandomData(3000, numDimensions);
+
+    const expected = new Index({ space: Space.Euclidean, numDimensions });
+    expected.buildFromArray(inputData);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    const progress: number[] = [];
+    const ids = await index.buildFromArrayAsync(inputData, undefined, -1, {
+      onProgress: (numAdded) => progress.push(numAdded),
+    });
+    assertEqual(ids.length, inputData.length, "Number of returned IDs");
+    assert(progress.length > 0, "Progress should be reported");
+    assertEqual(progress[progress.length - 1], inputData.length, "Last report");
+    assertEqual(
+      JSON.stringify(index.query(inputData, 5).neighbors),
+      JSON.stringify(expected.query(inputData, 5).neighbors),
+      "Neighbors of the async build"
+    );
+
+    const cancelled = new Index({ space: Space.Euclidean, numDimensions });
+    let rejected = false;
+    try {
+      await cancelled.buildFromArrayAsync(inputData, undefined, -1, {
+        onProgress: () => {
+          throw new Error("Cancelled");
+        },
+      });
+    } catch (error) {
+      rejected = true;
+    }
+    assert(rejected, "Errors thrown by onProgress should reject");
+    assertEqual(cancelled.length, 0, "Index length after cancelling");
+
+    // onProgress can search the index while it's being built on another
+    // thread, including when the build waits for the final report:
+    const searched = new Index({ space: Space.Euclidean, numDimensions });
+    let numSearches = 0;
+    await searched.buildFromArrayAsync(inputData, undefined, -1, {
+      onProgress: () => {
+        searched.query(inputData[0], 1);
+        numSearches++;
+      },
+    });
+    assert(numSearches > 0, "onProgress should search the index");
+    assertEqual(
+      searched.query(inputData[0], 1).neighbors[0],
+      0,
+      "Neighbor found after the async build"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running buildFromArray tests...\n");
+
+  const results = [
+    testBuildFromArray(),
+    testBuildFromArrayErrors(),
+    await testBuildFromArrayAsync(),
+  ];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== buildFromArray Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All buildFromArray tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
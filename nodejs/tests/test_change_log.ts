@@ -0,0 +1,201 @@
+import { Index, Space } from "../src/voyager-node.ts";
+import fs from "fs";
+import path from "path";
+import os from "os";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function assertThrows(fn: () => void, message?: string): void {
+  let threw = false;
+  try {
+    fn();
+  } catch (error) {
+    threw = true;
+  }
+  assert(threw, message || "Expected function to throw");
+}
+
+function createTempFile(suffix: string = ".voy"): string {
+  const tmpDir = os.tmpdir();
+  const fileName = `voyager_test_${Date.now()}_${Math.random()
+    .toString(36)
+    .substring(7)}${suffix}`;
+  return path.join(tmpDir, fileName);
+}
+
+function removeIndexFiles(filePath: string): void {
+  for (const file of [filePath, `${filePath}.log`]) {
+    if (fs.existsSync(file)) fs.unlinkSync(file);
+  }
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function testChangesAreReplayed(): boolean {
+  const testName = "Changes logged since the last snapshot are replayed";
+  const filePath = createTempFile();
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(300, numDimensions);
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(inputData.slice(0, 200));
+    index.openChangeLog(filePath);
+    assert(fs.existsSync(filePath), "A snapshot is written right away");
+    const snapshotSize = fs.statSync(filePath).size;
+
+    index.addItems(inputData.slice(200));
+    index.markDeleted(5);
+    index.addItem(inputData[0], 3);
+    assertEqual(
+      fs.statSync(filePath).size,
+      snapshotSize,
+      "Changes don't rewrite the snapshot"
+    );
+    assert(
+      fs.statSync(`${filePath}.log`).size > 0,
+      "Changes are appended to the log"
+    );
+
+    // Load the index without saving it, as if the process had crashed:
+    const loaded = Index.loadIndex(filePath);
+    assertEqual(loaded.numElements, 300, "Added items are replayed");
+    assert(
+      loaded.query(inputData[5], 1).neighbors[0] !== 5,
+      "Deletions are replayed"
+    );
+    assertEqual(
+      loaded.query(inputData[0], 2).distances[1],
+      0,
+      "Updated vectors are replayed"
+    );
+
+    // The log stays open after loading:
+    loaded.markDeleted(6);
+    assert(
+      Index.loadIndex(filePath).query(inputData[6], 1).neighbors[0] !== 6,
+      "Changes to a loaded index are logged"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  } finally {
+    removeIndexFiles(filePath);
+  }
+}
+
+async function testCheckpoints(): Promise<boolean> {
+  const testName = "Checkpoints fold the log into a new snapshot";
+  const filePath = createTempFile();
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(100, numDimensions);
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    assertThrows(() => index.checkpoint(), "checkpoint() needs a change log");
+
+    index.openChangeLog(filePath, { checkpointInterval: 50 });
+    const emptyLogSize = fs.statSync(`${filePath}.log`).size;
+    index.addItems(inputData.slice(0, 10));
+    assert(
+      fs.statSync(`${filePath}.log`).size > emptyLogSize,
+      "Changes are logged"
+    );
+    index.addItems(inputData.slice(10, 60));
+    assertEqual(
+      fs.statSync(`${filePath}.log`).size,
+      emptyLogSize,
+      "Enough changes trigger a checkpoint"
+    );
+
+    index.markDeleted(0);
+    await index.checkpointAsync();
+    assertEqual(
+      fs.statSync(`${filePath}.log`).size,
+      emptyLogSize,
+      "checkpointAsync() empties the log"
+    );
+    const loaded = Index.loadIndex(filePath, { mmap: true });
+    assertEqual(loaded.numElements, 60, "Snapshots hold every change");
+    assert(
+      loaded.query(inputData[0], 1).neighbors[0] !== 0,
+      "Snapshots hold deletions"
+    );
+
+    index.closeChangeLog();
+    index.markDeleted(1);
+    assertEqual(
+      fs.statSync(`${filePath}.log`).size,
+      emptyLogSize,
+      "Changes aren't logged once the log is closed"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  } finally {
+    removeIndexFiles(filePath);
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running change log tests...\n");
+
+  const results = [testChangesAreReplayed(), await testCheckpoints()];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+
+  console.log("\n=== Change Log Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All change log tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
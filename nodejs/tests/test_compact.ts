@@ -0,0 +1,129 @@
+import { Index, Space } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function testCompact(): boolean {
+  const testName = "compact removes deleted vectors and shrinks the index";
+  try {
+    const numDimensions = 16;
+    const inputData = generateRandomData(1000, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    const ids = index.addItems(inputData);
+    const deleted = ids.filter((id) => id % 4 === 0);
+    deleted.forEach((id) => index.markDeleted(id));
+
+    assertEqual(index.compact(), deleted.length, "Number removed");
+    assertEqual(index.numElements, ids.length - deleted.length, "numElements");
+    assertEqual(index.maxElements, index.numElements, "maxElements");
+    assertEqual(index.compact(), 0, "Nothing left to remove");
+    assert(!index.has(0), "Deleted IDs are gone");
+    assert(index.has(1), "Remaining IDs are kept");
+
+    let numFound = 0;
+    for (let id = 1; id < inputData.length; id++) {
+      if (id % 4 === 0) continue;
+      const result = index.query(inputData[id], 1);
+      if (result.neighbors[0] === id) numFound++;
+    }
+    assert(
+      numFound >= 0.98 * index.numElements,
+      `Recall after compaction: ${numFound} of ${index.numElements}`
+    );
+
+    index.addItem(inputData[0], 0);
+    assertEqual(index.query(inputData[0], 1).neighbors[0], 0, "Re-added ID");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testCompactAsync(): Promise<boolean> {
+  const testName = "compactAsync can run alongside queries";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(500, numDimensions);
+
+    const index = new Index({ space: Space.Cosine, numDimensions });
+    index.addItems(inputData);
+    for (let id = 0; id < 250; id++) index.markDeleted(id);
+
+    const [numRemoved, results] = await Promise.all([
+      index.compactAsync(),
+      index.queryAsync(inputData.slice(250), 1),
+    ]);
+    assertEqual(numRemoved, 250, "Number removed");
+    assertEqual(results.neighbors.length, 250, "Concurrent query results");
+    assertEqual(index.length, 250, "length");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running compaction tests...\n");
+
+  const results = [testCompact(), await testCompactAsync()];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Compaction Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All compaction tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
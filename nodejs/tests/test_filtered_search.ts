@@ -0,0 +1,222 @@
+import { Index, ResultType, Space } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function assertThrows(fn: () => void, message?: string): void {
+  let threw = false;
+  try {
+    fn();
+  } catch (error) {
+    threw = true;
+  }
+  assert(threw, message || "Expected function to throw");
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function testAllowedIds(): boolean {
+  const testName = "allowedIds restricts results to the given IDs";
+  try {
+    const numDimensions = 16;
+    const k = 10;
+    const inputData = generateRandomData(1000, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    const ids = index.addItems(inputData);
+    const evenIds = ids.filter((id) => id % 2 === 0);
+
+    const variants = [
+      evenIds,
+      Uint32Array.from(evenIds),
+      Float64Array.from(evenIds),
+      BigUint64Array.from(evenIds.map((id) => BigInt(id))),
+    ];
+    for (const allowedIds of variants) {
+      const result = index.query(inputData, k, -1, -1, { allowedIds });
+      for (let i = 0; i < inputData.length; i++) {
+        for (const neighbor of result.neighbors[i]) {
+          assert(neighbor % 2 === 0, `Odd neighbor ${neighbor} returned`);
+        }
+        if (i % 2 === 0) {
+          assertEqual(result.neighbors[i][0], i, `Neighbor of vector ${i}`);
+        }
+      }
+    }
+
+    const typed = index.query(inputData[1], k, -1, -1, {
+      resultType: ResultType.TypedArray,
+      allowedIds: evenIds,
+    });
+    assertEqual(typed.neighbors.length, k, "Typed result length");
+    typed.neighbors.forEach((neighbor) =>
+      assert(neighbor % 2 === 0, `Odd neighbor ${neighbor} returned`)
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testAllowedIdsBitmap(): boolean {
+  const testName = "allowedIdsBitmap restricts results to the set bits";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(500, numDimensions);
+
+    const index = new Index({ space: Space.Cosine, numDimensions });
+    index.addItems(inputData);
+
+    // Allow IDs 0-99 only.
+    const bitmap = new Uint8Array(Math.ceil(100 / 8));
+    for (let id = 0; id < 100; id++) {
+      bitmap[id >> 3] |= 1 << (id & 7);
+    }
+
+    const result = index.query(inputData[400], 5, -1, -1, {
+      allowedIdsBitmap: bitmap,
+    });
+    assertEqual(result.neighbors.length, 5, "Result length");
+    result.neighbors.forEach((neighbor) =>
+      assert(neighbor < 100, `Disallowed neighbor ${neighbor} returned`)
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testFilteredQueryAsync(): Promise<boolean> {
+  const testName = "queryAsync accepts the same filters as query";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(200, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(inputData);
+
+    const allowedIds = [3, 14, 15, 92, 65];
+    const expected = index.query(inputData, 3, -1, -1, { allowedIds });
+    const actual = await index.queryAsync(inputData, 3, -1, -1, {
+      allowedIds,
+    });
+    assertEqual(
+      JSON.stringify(actual.neighbors),
+      JSON.stringify(expected.neighbors),
+      "queryAsync neighbors"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testInvalidFilters(): boolean {
+  const testName = "Invalid or unsatisfiable filters are rejected";
+  try {
+    const numDimensions = 4;
+    const inputData = generateRandomData(50, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(inputData);
+
+    assertThrows(
+      () => index.query(inputData[0], 5, -1, -1, { allowedIds: [1, 2] }),
+      "k larger than the number of allowed IDs should throw"
+    );
+    assertThrows(
+      () =>
+        index.query(inputData[0], 1, -1, -1, {
+          allowedIds: [1],
+          allowedIdsBitmap: new Uint8Array([1]),
+        }),
+      "allowedIds and allowedIdsBitmap are mutually exclusive"
+    );
+    assertThrows(
+      () =>
+        index.query(inputData[0], 1, -1, -1, {
+          allowedIds: new Int8Array([1]) as unknown as Uint32Array,
+        }),
+      "Unsupported typed arrays should be rejected"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running filtered search tests...\n");
+
+  const results = [
+    testAllowedIds(),
+    testAllowedIdsBitmap(),
+    await testFilteredQueryAsync(),
+    testInvalidFilters(),
+  ];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Filtered Search Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All filtered search tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
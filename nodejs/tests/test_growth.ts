@@ -0,0 +1,159 @@
+import { Index, Space } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function assertThrows(fn: () => void, message?: string): void {
+  let threw = false;
+  try {
+    fn();
+  } catch (error) {
+    threw = true;
+  }
+  assert(threw, message || "Expected function to throw");
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function testAutoGrowOption(): boolean {
+  const testName = "autoGrow controls whether the index grows to fit";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(30, numDimensions);
+    const growing = new Index({
+      space: Space.Euclidean,
+      numDimensions,
+      maxElements: 10,
+    });
+    assertEqual(growing.autoGrow, true, "autoGrow defaults to true");
+    growing.addItems(inputData);
+    assertEqual(growing.numElements, 30, "The index grew to fit every item");
+
+    const fixed = new Index({
+      space: Space.Euclidean,
+      numDimensions,
+      maxElements: 10,
+      autoGrow: false,
+    });
+    assertEqual(fixed.autoGrow, false, "autoGrow can be disabled");
+    fixed.addItems(inputData.slice(0, 10));
+    assertThrows(
+      () => fixed.addItems(inputData.slice(10, 20)),
+      "Adding too many items throws without autoGrow"
+    );
+    assertThrows(
+      () => fixed.addItem(inputData[10]),
+      "Adding one item too many throws without autoGrow"
+    );
+    assertEqual(fixed.numElements, 10, "Nothing was added");
+    assertEqual(fixed.maxElements, 10, "The index didn't grow");
+
+    fixed.maxElements = 20;
+    fixed.addItems(inputData.slice(10, 20));
+    assertEqual(fixed.numElements, 20, "Explicit resizes still work");
+
+    fixed.autoGrow = true;
+    fixed.addItems(inputData.slice(20));
+    assertEqual(fixed.numElements, 30, "autoGrow can be enabled later");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testQueriesDuringGrowth(): Promise<boolean> {
+  const testName = "Queries keep working while the index grows";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(2000, numDimensions);
+    const index = new Index({
+      space: Space.Euclidean,
+      numDimensions,
+      maxElements: 100,
+    });
+    index.addItems(inputData.slice(0, 100));
+
+    const queries: Promise<unknown>[] = [];
+    for (let start = 100; start < inputData.length; start += 100) {
+      queries.push(index.queryAsync(inputData[start % 100], 1));
+      await index.addItemsAsync(inputData.slice(start, start + 100));
+    }
+    await Promise.all(queries);
+
+    assertEqual(index.numElements, 2000, "Every item was added");
+    for (let i = 0; i < inputData.length; i += 97) {
+      assertEqual(
+        index.query(inputData[i], 1).neighbors[0],
+        i,
+        "Items added while growing can be found"
+      );
+    }
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running growth tests...\n");
+
+  const results = [testAutoGrowOption(), await testQueriesDuringGrowth()];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+
+  console.log("\n=== Growth Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All growth tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
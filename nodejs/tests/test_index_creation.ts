@@ -567,6 +567,68 @@ function testLoadFromBuffer(): boolean {
   return allPassed;
 }
 
+// Test memory-mapped, search-only loading
+function testLoadWithMmap(): boolean {
+  const testName = "LoadIndex with mmap returns the same query results";
+  const outputFile = createTempFile();
+  try {
+    const numDimensions = 32;
+    const inputData = generateRandomData(1000, numDimensions);
+
+    const index = new Index({
+      space: Space.Euclidean,
+      numDimensions,
+      storageDataType: StorageDataType.Float32,
+    });
+    index.addItems(inputData);
+    index.markDeleted(3);
+    index.saveIndex(outputFile);
+
+    const mapped = Index.loadIndex(outputFile, { mmap: true });
+    assertEqual(mapped.length, index.length, "Mapped index length");
+    assertEqual(
+      mapped.numDimensions,
+      numDimensions,
+      "Mapped index dimensions"
+    );
+
+    const expected = index.query(inputData, 5);
+    const actual = mapped.query(inputData, 5);
+    for (let i = 0; i < inputData.length; i++) {
+      assertEqual(
+        JSON.stringify(actual.neighbors[i]),
+        JSON.stringify(expected.neighbors[i]),
+        `Neighbors of vector ${i}`
+      );
+      assert(
+        !actual.neighbors[i].includes(3),
+        "Deleted items should not be returned"
+      );
+    }
+
+    let threw = false;
+    try {
+      mapped.addItem(inputData[0]);
+    } catch (error) {
+      threw = true;
+    }
+    assert(threw, "Adding to a memory-mapped index should fail");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(
+      `  Error: ${error instanceof Error ? error.message : String(error)}`
+    );
+    return false;
+  } finally {
+    if (fs.existsSync(outputFile)) {
+      fs.unlinkSync(outputFile);
+    }
+  }
+}
+
 // Test query_ef parameter
 function testQueryEf(): boolean {
   const spaces = [
@@ -875,6 +937,14 @@ export default function runAllTests(): boolean {
     passedTests++;
   }
 
+  // Run mmap load tests
+  console.log("\nLoad With Mmap Tests:");
+  console.log("-".repeat(70));
+  totalTests++;
+  if (testLoadWithMmap()) {
+    passedTests++;
+  }
+
   // Run query_ef tests
   console.log("\nQuery EF Tests:");
   console.log("-".repeat(70));
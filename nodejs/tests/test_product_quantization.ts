@@ -0,0 +1,208 @@
+import { Index, Space, StorageDataType } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function testRecall(space: Space, name: string): boolean {
+  const testName = `PQ index finds exact neighbors (${name})`;
+  try {
+    const numDimensions = 32;
+    const inputData = generateRandomData(2000, numDimensions);
+    const queries = generateRandomData(100, numDimensions);
+
+    const index = new Index({
+      space,
+      numDimensions,
+      storageDataType: StorageDataType.PQ,
+      pqSubvectors: 16,
+    });
+    const exact = new Index({ space, numDimensions });
+    index.addItems(inputData);
+    exact.addItems(inputData);
+    index.ef = 100;
+    exact.ef = 100;
+
+    assertEqual(index.storageDataType, StorageDataType.PQ, "storageDataType");
+    const approximate = index.query(queries, 10).neighbors;
+    const expected = exact.query(queries, 1).neighbors;
+    const numFound = expected.filter((neighbors, i) =>
+      approximate[i].includes(neighbors[0])
+    ).length;
+    assert(numFound >= 75, `Recall: ${numFound} of 100`);
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testSerialization(): boolean {
+  const testName = "PQ index survives toBuffer and fromBuffer";
+  try {
+    const numDimensions = 16;
+    const inputData = generateRandomData(500, numDimensions);
+    const index = new Index({
+      space: Space.Cosine,
+      numDimensions,
+      storageDataType: StorageDataType.PQ,
+    });
+    index.addItems(inputData);
+
+    const loaded = Index.fromBuffer(index.toBuffer());
+    assertEqual(loaded.storageDataType, StorageDataType.PQ, "storageDataType");
+    assertEqual(loaded.numElements, 500, "numElements");
+    assertEqual(
+      JSON.stringify(loaded.query(inputData.slice(0, 50), 5)),
+      JSON.stringify(index.query(inputData.slice(0, 50), 5)),
+      "Query results"
+    );
+    assertEqual(
+      JSON.stringify(loaded.getVector(3)),
+      JSON.stringify(index.getVector(3)),
+      "Decoded vectors"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testTraining(): boolean {
+  const testName = "PQ index must be trained before adding few vectors";
+  try {
+    const numDimensions = 16;
+    const index = new Index({
+      space: Space.Euclidean,
+      numDimensions,
+      storageDataType: StorageDataType.PQ,
+    });
+
+    let threw = false;
+    try {
+      index.addItem(generateRandomData(1, numDimensions)[0]);
+    } catch (e) {
+      threw = true;
+    }
+    assert(threw, "Adding one vector to an untrained index throws");
+    assertEqual(index.numElements, 0, "numElements");
+
+    index.train(generateRandomData(256, numDimensions));
+    const inputData = generateRandomData(10, numDimensions);
+    for (const vector of inputData) {
+      index.addItem(vector);
+    }
+    assertEqual(index.numElements, 10, "numElements");
+    assertEqual(index.query(inputData[3], 1).neighbors[0], 3, "Nearest");
+
+    threw = false;
+    try {
+      index.train(generateRandomData(256, numDimensions));
+    } catch (e) {
+      threw = true;
+    }
+    assert(threw, "Training twice throws");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testInvalidSubvectors(): boolean {
+  const testName = "pqSubvectors must be at most numDimensions";
+  try {
+    let threw = false;
+    try {
+      new Index({
+        space: Space.Euclidean,
+        numDimensions: 8,
+        storageDataType: StorageDataType.PQ,
+        pqSubvectors: 9,
+      });
+    } catch (e) {
+      threw = true;
+    }
+    assert(threw, "Too many subvectors throws");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running product quantization tests...\n");
+
+  const results = [
+    testRecall(Space.Euclidean, "Euclidean"),
+    testRecall(Space.InnerProduct, "InnerProduct"),
+    testRecall(Space.Cosine, "Cosine"),
+    testSerialization(),
+    testTraining(),
+    testInvalidSubvectors(),
+  ];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Product Quantization Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All product quantization tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
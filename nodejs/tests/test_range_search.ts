@@ -0,0 +1,255 @@
+import { Index, ResultType, Space } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function assertThrows(fn: () => void, message?: string): void {
+  let threw = false;
+  try {
+    fn();
+  } catch (error) {
+    threw = true;
+  }
+  assert(threw, message || "Expected function to throw");
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+// A radius that includes about `fraction` of the items around inputData[0].
+function pickRadius(
+  index: Index,
+  inputData: number[][],
+  fraction: number
+): number {
+  const distances = inputData
+    .map((vector) => index.getDistance(inputData[0], vector))
+    .sort((a, b) => a - b);
+  return distances[Math.floor(inputData.length * fraction)];
+}
+
+function testFindsItemsWithinRadius(): boolean {
+  const testName = "rangeSearch finds the items within the radius";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(2000, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(inputData);
+    const radius = pickRadius(index, inputData, 0.01);
+
+    let expectedTotal = 0;
+    let foundTotal = 0;
+    for (let q = 0; q < 20; q++) {
+      const result = index.rangeSearch(inputData[q], radius);
+      assert(result.neighbors instanceof Float64Array, "Float64Array IDs");
+      assert(result.distances instanceof Float32Array, "Float32Array distances");
+      assertEqual(result.neighbors.length, result.distances.length);
+      assertEqual(result.neighbors[0], q, "Each query should find itself");
+
+      const expected = new Set<number>();
+      inputData.forEach((vector, i) => {
+        if (index.getDistance(inputData[q], vector) <= radius) {
+          expected.add(i);
+        }
+      });
+      for (let i = 0; i < result.neighbors.length; i++) {
+        assert(expected.has(result.neighbors[i]), "Result out of range");
+        assert(result.distances[i] <= radius, "Distance out of range");
+        if (i > 0) {
+          assert(
+            result.distances[i - 1] <= result.distances[i],
+            "Results should be nearest first"
+          );
+        }
+      }
+      expectedTotal += expected.size;
+      foundTotal += result.neighbors.length;
+    }
+    assert(
+      foundTotal >= expectedTotal * 0.95,
+      `Found only ${foundTotal} of ${expectedTotal} items in range`
+    );
+
+    const limited = index.rangeSearch(inputData[0], radius, 3);
+    const nearest = index.query(inputData[0], 3);
+    assertEqual(limited.neighbors.length, 3);
+    assertEqual(
+      Array.from(limited.neighbors).join(),
+      nearest.neighbors.join(),
+      "maxResults should keep the nearest results"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testBatchRangeSearch(): Promise<boolean> {
+  const testName = "Batch rangeSearch matches single-vector searches";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(1000, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(inputData);
+    const radius = pickRadius(index, inputData, 0.02);
+
+    const queries = inputData.slice(0, 50);
+    const flatQueries = new Float32Array(queries.length * numDimensions);
+    queries.forEach((vector, i) => flatQueries.set(vector, i * numDimensions));
+
+    const batch = index.rangeSearch(queries, radius);
+    const flatBatch = index.rangeSearch(flatQueries, radius, 0, 2);
+    const asyncBatch = await index.rangeSearchAsync(queries, radius);
+    for (const other of [flatBatch, asyncBatch]) {
+      assert("offsets" in other, "Batch results should include offsets");
+      assertEqual(
+        Array.from((other as typeof batch).offsets).join(),
+        Array.from(batch.offsets).join()
+      );
+      assertEqual(
+        Array.from(other.neighbors).join(),
+        Array.from(batch.neighbors).join()
+      );
+    }
+
+    assertEqual(batch.offsets.length, queries.length + 1);
+    assertEqual(batch.offsets[queries.length], batch.neighbors.length);
+    queries.forEach((query, q) => {
+      const single = index.rangeSearch(query, radius);
+      const start = batch.offsets[q];
+      const end = batch.offsets[q + 1];
+      assertEqual(
+        Array.from(batch.neighbors.subarray(start, end)).join(),
+        Array.from(single.neighbors).join(),
+        `Results for query ${q}`
+      );
+    });
+
+    const bigInts = index.rangeSearch(inputData[0], radius, 0, -1, -1, {
+      resultType: ResultType.BigIntTypedArray,
+    });
+    assert(bigInts.neighbors instanceof BigUint64Array, "BigUint64Array IDs");
+    assertEqual(bigInts.neighbors[0], 0n);
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testFiltersAndErrors(): boolean {
+  const testName = "rangeSearch applies filters and rejects invalid arguments";
+  try {
+    const numDimensions = 4;
+    const inputData = generateRandomData(500, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    const ids = index.addItems(inputData);
+    const radius = pickRadius(index, inputData, 0.1);
+
+    const evenIds = ids.filter((id) => id % 2 === 0);
+    const result = index.rangeSearch(inputData[0], radius, 0, -1, -1, {
+      allowedIds: evenIds,
+    });
+    assert(result.neighbors.length > 0, "Should find allowed items in range");
+    for (const id of result.neighbors) {
+      assertEqual(id % 2, 0, "Only allowed IDs should be returned");
+    }
+
+    assertEqual(
+      index.rangeSearch(inputData[0], -1).neighbors.length,
+      0,
+      "A negative radius should find nothing"
+    );
+
+    assertThrows(
+      () => (index as any).rangeSearch(inputData[0]),
+      "radius is required"
+    );
+    assertThrows(
+      () => index.rangeSearch([1, 2], radius),
+      "Vectors of the wrong size should be rejected"
+    );
+    assertThrows(
+      () =>
+        index.rangeSearch(inputData[0], radius, 0, -1, -1, {
+          resultType: ResultType.Array as any,
+        }),
+      "Plain array results aren't supported"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running range search tests...\n");
+
+  const results = [
+    testFindsItemsWithinRadius(),
+    await testBatchRangeSearch(),
+    testFiltersAndErrors(),
+  ];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Range Search Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All range search tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
@@ -0,0 +1,127 @@
+import { Index, Space } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function testReorder(): boolean {
+  const testName = "reorder keeps IDs and query results";
+  try {
+    const numDimensions = 16;
+    const inputData = generateRandomData(1000, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(inputData);
+    for (let id = 0; id < 1000; id += 10) index.markDeleted(id);
+
+    const before = index.query(inputData, 5);
+    index.reorder();
+    const after = index.query(inputData, 5);
+    assertEqual(
+      JSON.stringify(after.neighbors),
+      JSON.stringify(before.neighbors),
+      "Neighbors"
+    );
+    assertEqual(index.numElements, 1000, "numElements");
+    assert(index.has(0), "Deleted IDs are still known");
+    let threw = false;
+    try {
+      index.getVector(0);
+    } catch (e) {
+      threw = true;
+    }
+    assert(threw, "Deleted IDs stay deleted");
+    assertEqual(
+      JSON.stringify(index.getVector(1)),
+      JSON.stringify(inputData[1].map(Math.fround)),
+      "Vectors are kept"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testReorderAsync(): Promise<boolean> {
+  const testName = "reorderAsync resolves once the index is reordered";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(500, numDimensions);
+
+    const index = new Index({ space: Space.Cosine, numDimensions });
+    const ids = index.addItems(inputData);
+    await index.reorderAsync();
+    const results = await index.queryAsync(inputData, 1);
+    const numFound = results.neighbors.filter(
+      (neighbors, i) => neighbors[0] === ids[i]
+    ).length;
+    assert(numFound >= 0.98 * ids.length, `Recall: ${numFound} of 500`);
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running reorder tests...\n");
+
+  const results = [testReorder(), await testReorderAsync()];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Reorder Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All reorder tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
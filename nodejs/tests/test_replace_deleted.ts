@@ -0,0 +1,129 @@
+import { Index, Space } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function testReplaceDeleted(): boolean {
+  const testName = "replaceDeleted reuses the slots of deleted vectors";
+  try {
+    const numDimensions = 16;
+    const inputData = generateRandomData(1000, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(inputData);
+    const maxElements = index.maxElements;
+    for (let id = 0; id < 200; id++) index.markDeleted(id);
+
+    const newData = generateRandomData(200, numDimensions);
+    const newIds = newData.map((_, i) => 1000 + i);
+    index.addItems(newData, newIds, -1, { replaceDeleted: true });
+    assertEqual(index.numElements, 1000, "numElements");
+    assertEqual(index.maxElements, maxElements, "maxElements");
+    assertEqual(index.length, 1000, "length");
+    assert(!index.has(0), "Replaced IDs are gone");
+    assert(index.has(1000), "New IDs are present");
+
+    let numFound = 0;
+    newData.forEach((vector, i) => {
+      if (index.query(vector, 1).neighbors[0] === newIds[i]) numFound++;
+    });
+    assert(numFound >= 0.98 * newData.length, `Recall: ${numFound} of 200`);
+
+    // With no deleted vectors left, the index grows as usual:
+    index.addItem(inputData[0], 0, { replaceDeleted: true });
+    assertEqual(index.numElements, 1001, "numElements after growing");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testReplaceDeletedAsync(): Promise<boolean> {
+  const testName = "addItemsAsync accepts replaceDeleted";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(300, numDimensions);
+
+    const index = new Index({ space: Space.Cosine, numDimensions });
+    index.addItems(inputData);
+    for (let id = 0; id < 100; id++) index.markDeleted(id);
+
+    const ids = await index.addItemsAsync(
+      generateRandomData(150, numDimensions),
+      undefined,
+      -1,
+      { replaceDeleted: true }
+    );
+    assertEqual(ids.length, 150, "Number of IDs returned");
+    assertEqual(index.numElements, 350, "Only 50 new slots were used");
+    assertEqual(index.length, 350, "length");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running replace-deleted tests...\n");
+
+  const results = [testReplaceDeleted(), await testReplaceDeletedAsync()];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Replace-Deleted Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All replace-deleted tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
@@ -0,0 +1,210 @@
+import { Index, Space, StorageDataType } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function squaredDistance(a: number[], b: number[]): number {
+  let sum = 0;
+  for (let i = 0; i < a.length; i++) {
+    sum += (a[i] - b[i]) * (a[i] - b[i]);
+  }
+  return sum;
+}
+
+function testRerank(storageDataType: StorageDataType, name: string): boolean {
+  const testName = `rerank returns exact distances (${name})`;
+  try {
+    const numDimensions = 32;
+    const inputData = generateRandomData(2000, numDimensions);
+    const queries = generateRandomData(50, numDimensions);
+
+    const index = new Index({
+      space: Space.Euclidean,
+      numDimensions,
+      storageDataType,
+      storeFullPrecisionVectors: true,
+    });
+    const exact = new Index({ space: Space.Euclidean, numDimensions });
+    const ids = index.addItems(inputData);
+    exact.addItems(inputData);
+
+    const results = index.query(queries, 5, -1, 100, { rerank: 50 });
+    const expected = exact.query(queries, 1, -1, 100);
+    let numFound = 0;
+    for (let i = 0; i < queries.length; i++) {
+      for (let j = 0; j < 5; j++) {
+        const vector = inputData[ids.indexOf(results.neighbors[i][j])];
+        const distance = squaredDistance(queries[i], vector);
+        assert(
+          Math.abs(results.distances[i][j] - distance) < 1e-3,
+          `Distance ${results.distances[i][j]} should be ${distance}`
+        );
+      }
+      numFound += Number(
+        results.neighbors[i][0] === expected.neighbors[i][0]
+      );
+    }
+    assert(numFound >= 45, `Recall: ${numFound} of 50`);
+
+    const single = index.query(queries[0], 5, -1, 100, { rerank: 50 });
+    assertEqual(
+      JSON.stringify(single.neighbors),
+      JSON.stringify(results.neighbors[0]),
+      "Single query"
+    );
+    assertEqual(
+      JSON.stringify(index.getVector(ids[3])),
+      JSON.stringify(inputData[3].map(Math.fround)),
+      "Vectors are stored at full precision"
+    );
+
+    const loaded = Index.fromBuffer(index.toBuffer());
+    assertEqual(
+      JSON.stringify(loaded.query(queries, 5, -1, 100, { rerank: 50 })),
+      JSON.stringify(results),
+      "Reloaded results"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testRerankAsync(): Promise<boolean> {
+  const testName = "queryAsync accepts the rerank option";
+  try {
+    const numDimensions = 16;
+    const inputData = generateRandomData(500, numDimensions);
+    const index = new Index({
+      space: Space.Cosine,
+      numDimensions,
+      storageDataType: StorageDataType.Float8,
+      storeFullPrecisionVectors: true,
+    });
+    index.addItems(inputData.map((v) => v.map((x) => x * 0.5)));
+
+    const expected = index.query(inputData.slice(0, 10), 3, -1, -1, {
+      rerank: 20,
+    });
+    const actual = await index.queryAsync(inputData.slice(0, 10), 3, -1, -1, {
+      rerank: 20,
+    });
+    assertEqual(
+      JSON.stringify(actual),
+      JSON.stringify(expected),
+      "Async results"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testRerankErrors(): boolean {
+  const testName = "rerank requires full-precision vectors";
+  try {
+    const index = new Index({
+      space: Space.Euclidean,
+      numDimensions: 8,
+      storageDataType: StorageDataType.E4M3,
+    });
+    index.addItems(generateRandomData(100, 8));
+
+    let threw = false;
+    try {
+      index.query(generateRandomData(1, 8)[0], 5, -1, -1, { rerank: 10 });
+    } catch (e) {
+      threw = true;
+    }
+    assert(threw, "Index without full-precision vectors throws");
+
+    threw = false;
+    try {
+      new Index({
+        space: Space.Euclidean,
+        numDimensions: 8,
+        storeFullPrecisionVectors: true,
+      });
+    } catch (e) {
+      threw = true;
+    }
+    assert(threw, "Float32 index with full-precision copies throws");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running rerank tests...\n");
+
+  const results = [
+    testRerank(StorageDataType.E4M3, "E4M3"),
+    testRerank(StorageDataType.PQ, "PQ"),
+    await testRerankAsync(),
+    testRerankErrors(),
+  ];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Rerank Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All rerank tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
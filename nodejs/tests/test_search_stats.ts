@@ -0,0 +1,149 @@
+import { Index, ResultType, Space } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function testPerQueryStats(): boolean {
+  const testName = "includeStats returns the work done by each query";
+  try {
+    const numDimensions = 16;
+    const inputData = generateRandomData(1000, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(inputData);
+
+    const single = index.query(inputData[0], 10, -1, 50, {
+      includeStats: true,
+    });
+    assert(single.stats !== undefined, "Single query stats missing");
+    assert(single.stats!.hops > 0, "Single query hops");
+    assert(single.stats!.visitedNodes >= 50, "Single query visited nodes");
+    assert(
+      single.stats!.distanceComputations >= single.stats!.visitedNodes,
+      "Every visited node has its distance computed"
+    );
+    assert(single.stats!.elapsedMs >= 0, "Single query elapsed time");
+
+    const batch = index.query(inputData.slice(0, 20), 10, -1, 50, {
+      includeStats: true,
+    });
+    assertEqual(batch.stats!.length, 20, "Batch stats length");
+
+    const typed = index.query(inputData.slice(0, 5), 10, -1, -1, {
+      resultType: ResultType.TypedArray,
+      includeStats: true,
+    });
+    assertEqual(typed.stats!.length, 5, "Typed result stats length");
+
+    const withoutStats = index.query(inputData[0], 10);
+    assertEqual(withoutStats.stats, undefined, "Stats are opt-in");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testIndexStats(): Promise<boolean> {
+  const testName = "stats() totals the work done by every query";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(500, numDimensions);
+
+    const index = new Index({ space: Space.Cosine, numDimensions });
+    index.addItems(inputData);
+    index.resetStats();
+    assertEqual(index.stats().searches, 0, "Searches after reset");
+
+    const batch = index.query(inputData.slice(0, 10), 5, -1, -1, {
+      includeStats: true,
+    });
+    const asyncResult = await index.queryAsync(inputData[10], 5, -1, -1, {
+      includeStats: true,
+    });
+
+    const perQuery = [...batch.stats!, asyncResult.stats!];
+    const stats = index.stats();
+    assertEqual(stats.searches, 11, "Searches");
+    assertEqual(
+      stats.distanceComputations,
+      perQuery.reduce((sum, s) => sum + s.distanceComputations, 0),
+      "Distance computations"
+    );
+    assertEqual(
+      stats.hops,
+      perQuery.reduce((sum, s) => sum + s.hops, 0),
+      "Hops"
+    );
+
+    index.resetStats();
+    assertEqual(index.stats().distanceComputations, 0, "Reset");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running search stats tests...\n");
+
+  const results = [testPerQueryStats(), await testIndexStats()];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Search Stats Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All search stats tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
@@ -0,0 +1,214 @@
+import { Index, Space } from "../src/voyager-node.ts";
+import fs from "fs";
+import path from "path";
+import os from "os";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function assertThrows(fn: () => void, message?: string): void {
+  let threw = false;
+  try {
+    fn();
+  } catch (error) {
+    threw = true;
+  }
+  assert(threw, message || "Expected function to throw");
+}
+
+function createTempFile(suffix: string = ".voy"): string {
+  const tmpDir = os.tmpdir();
+  const fileName = `voyager_test_${Date.now()}_${Math.random()
+    .toString(36)
+    .substring(7)}${suffix}`;
+  return path.join(tmpDir, fileName);
+}
+
+function removeIndexFiles(filePath: string, numShards: number): void {
+  for (const file of [
+    filePath,
+    ...Array.from({ length: numShards }, (_, i) => `${filePath}.shard${i}`),
+  ]) {
+    if (fs.existsSync(file)) fs.unlinkSync(file);
+  }
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function testShardedQueries(): boolean {
+  const testName = "Sharded indices find each item's nearest neighbors";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(2000, numDimensions);
+    const index = new Index({
+      space: Space.Euclidean,
+      numDimensions,
+      numShards: 4,
+    });
+    const ids = index.addItems(inputData);
+
+    assertEqual(index.numShards, 4, "numShards");
+    assertEqual(index.numElements, inputData.length, "numElements");
+    assertEqual(index.length, inputData.length, "length");
+    assertEqual(ids[10], 10, "IDs are assigned in order across shards");
+    assert(index.has(10), "has() finds items in any shard");
+
+    const results = index.query(inputData, 5);
+    let numCorrect = 0;
+    for (let i = 0; i < inputData.length; i++) {
+      if (results.neighbors[i][0] === i) numCorrect++;
+      for (let j = 1; j < 5; j++) {
+        assert(
+          results.distances[i][j - 1] <= results.distances[i][j],
+          "Merged results are sorted by distance"
+        );
+      }
+    }
+    assert(numCorrect > inputData.length * 0.99, `Recall: ${numCorrect}`);
+
+    index.markDeleted(0);
+    assert(
+      index.query(inputData[0], 1).neighbors[0] !== 0,
+      "Deleted items aren't returned"
+    );
+
+    const unsharded = new Index({ space: Space.Euclidean, numDimensions });
+    assertEqual(unsharded.numShards, 1, "Unsharded indices have one shard");
+    assertThrows(
+      () => unsharded.saveShard(0, createTempFile()),
+      "saveShard() needs a sharded index"
+    );
+    assertThrows(
+      () =>
+        new Index({ space: Space.Euclidean, numDimensions, numShards: 0 }),
+      "numShards must be positive"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testShardedPersistence(): boolean {
+  const testName = "Sharded indices can be saved and loaded";
+  const filePath = createTempFile();
+  const shardPath = createTempFile();
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(1000, numDimensions);
+    const index = new Index({
+      space: Space.Euclidean,
+      numDimensions,
+      numShards: 3,
+    });
+    index.addItems(inputData);
+    const expected = JSON.stringify(index.query(inputData, 5).neighbors);
+
+    index.saveIndex(filePath);
+    assert(fs.existsSync(`${filePath}.shard2`), "Each shard has its own file");
+    for (const mmap of [false, true]) {
+      const loaded = Index.loadIndex(filePath, { mmap });
+      assertEqual(loaded.numShards, 3, "Loaded numShards");
+      assertEqual(
+        JSON.stringify(loaded.query(inputData, 5).neighbors),
+        expected,
+        "Loaded query results"
+      );
+    }
+
+    const fromBuffer = Index.fromBuffer(index.toBuffer());
+    assertEqual(fromBuffer.numShards, 3, "numShards from a buffer");
+    assertEqual(
+      JSON.stringify(fromBuffer.query(inputData, 5).neighbors),
+      expected,
+      "Query results from a buffer"
+    );
+
+    // Replace each shard with an updated copy of itself:
+    const updated = Index.loadIndex(filePath);
+    updated.markDeleted(0);
+    for (let shard = 0; shard < 3; shard++) {
+      updated.saveShard(shard, shardPath);
+      index.loadShard(shard, shardPath);
+    }
+    assert(
+      index.query(inputData[0], 1).neighbors[0] !== 0,
+      "The replacement shards are searched"
+    );
+    updated.saveShard(0, shardPath);
+    assertThrows(
+      () => index.loadShard(1, shardPath),
+      "Shards can't hold items that belong to other shards"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  } finally {
+    removeIndexFiles(filePath, 3);
+    removeIndexFiles(shardPath, 0);
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running sharded index tests...\n");
+
+  const results = [testShardedQueries(), testShardedPersistence()];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+
+  console.log("\n=== Sharded Index Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All sharded index tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
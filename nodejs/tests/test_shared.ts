@@ -0,0 +1,210 @@
+import { Worker } from "worker_threads";
+import { Index, Space } from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+// Runs in each worker: attaches to the shared index, queries it and checks
+// that it can't be modified.
+const workerSource = `
+const { parentPort, workerData } = require("worker_threads");
+import(workerData.moduleUrl).then(({ Index }) => {
+  const index = Index.attach(workerData.handle);
+  let addItemsThrew = false;
+  try {
+    index.addItems(workerData.queries);
+  } catch (e) {
+    addItemsThrew = true;
+  }
+  let efThrew = false;
+  try {
+    index.ef = 20;
+  } catch (e) {
+    efThrew = true;
+  }
+  parentPort.postMessage({
+    numElements: index.numElements,
+    results: index.query(workerData.queries, 5, -1, 50),
+    addItemsThrew,
+    efThrew,
+  });
+});
+`;
+
+function runWorker(handle: number, queries: number[][]): Promise<any> {
+  return new Promise((resolve, reject) => {
+    const worker = new Worker(workerSource, {
+      eval: true,
+      workerData: {
+        handle,
+        queries,
+        moduleUrl: new URL("../src/voyager-node.ts", import.meta.url).href,
+      },
+    });
+    worker.once("message", resolve);
+    worker.once("error", reject);
+  });
+}
+
+async function testWorkersShareIndex(): Promise<boolean> {
+  const testName = "workers attach to and search a shared index";
+  try {
+    const numDimensions = 16;
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(generateRandomData(1000, numDimensions));
+    const queries = generateRandomData(20, numDimensions);
+    const expected = JSON.stringify(index.query(queries, 5, -1, 50));
+
+    const handle = index.share();
+    assertEqual(index.share(), handle, "Sharing again returns the same handle");
+
+    const replies = await Promise.all([
+      runWorker(handle, queries),
+      runWorker(handle, queries),
+    ]);
+    for (const reply of replies) {
+      assertEqual(reply.numElements, 1000, "Worker numElements");
+      assertEqual(JSON.stringify(reply.results), expected, "Worker results");
+      assert(reply.addItemsThrew, "addItems() on an attached index throws");
+      assert(reply.efThrew, "Setting ef on an attached index throws");
+    }
+
+    // The owning thread can't modify the index once it's shared either
+    let ownerAddItemsThrew = false;
+    try {
+      index.addItems(generateRandomData(10, numDimensions));
+    } catch (e) {
+      ownerAddItemsThrew = true;
+    }
+    assert(ownerAddItemsThrew, "addItems() on a shared index throws");
+    let ownerEfThrew = false;
+    try {
+      index.ef = 20;
+    } catch (e) {
+      ownerEfThrew = true;
+    }
+    assert(ownerEfThrew, "Setting ef on a shared index throws");
+    assertEqual(Index.attach(handle).numElements, 1000, "Shared numElements");
+    assertEqual(
+      JSON.stringify(index.query(queries, 5, -1, 50)),
+      expected,
+      "Owner results after sharing"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testShareWaitsForAsyncWrites(): Promise<boolean> {
+  const testName = "share() throws while an async write is running";
+  try {
+    const numDimensions = 8;
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    const pending = index.addItemsAsync(generateRandomData(100, numDimensions));
+
+    let threw = false;
+    try {
+      index.share();
+    } catch (e) {
+      threw = true;
+    }
+    assert(threw, "share() during addItemsAsync() throws");
+
+    await pending;
+    const handle = index.share();
+    assertEqual(Index.attach(handle).numElements, 100, "Shared numElements");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testAttachInvalidHandle(): boolean {
+  const testName = "attach() throws for unknown handles";
+  try {
+    let threw = false;
+    try {
+      Index.attach(123456789);
+    } catch (e) {
+      threw = true;
+    }
+    assert(threw, "Unknown handle throws");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running shared index tests...\n");
+
+  const results = [
+    await testWorkersShareIndex(),
+    await testShareWaitsForAsyncWrites(),
+    testAttachInvalidHandle(),
+  ];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Shared Index Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All shared index tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
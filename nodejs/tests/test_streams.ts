@@ -0,0 +1,368 @@
+import { Index, Space, StorageDataType } from "../src/voyager-node.ts";
+import fs from "fs";
+import path from "path";
+import os from "os";
+import { PassThrough, Readable, Writable } from "stream";
+import { pipeline } from "stream/promises";
+import zlib from "zlib";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function createTempFile(suffix: string = ".voy"): string {
+  const tmpDir = os.tmpdir();
+  const fileName = `voyager_test_${Date.now()}_${Math.random()
+    .toString(36)
+    .substring(7)}${suffix}`;
+  return path.join(tmpDir, fileName);
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+// Large enough (~10MB) to span several of the chunks passed between threads.
+function createIndex(): { index: Index; inputData: number[][] } {
+  const numDimensions = 256;
+  const inputData = generateRandomData(10000, numDimensions);
+  const index = new Index({
+    space: Space.Euclidean,
+    numDimensions,
+    storageDataType: StorageDataType.Float32,
+  });
+  index.addItems(inputData);
+  return { index, inputData };
+}
+
+// Split a Buffer into a Readable of small, unevenly-sized chunks.
+function toReadable(buffer: Buffer, chunkSize: number): Readable {
+  const chunks: Buffer[] = [];
+  for (let offset = 0, i = 0; offset < buffer.length; i++) {
+    const size = chunkSize + (i % 7) * 13;
+    chunks.push(buffer.subarray(offset, offset + size));
+    offset += size;
+  }
+  return Readable.from(chunks);
+}
+
+async function testSaveToStream(index: Index): Promise<boolean> {
+  const testName = "saveToStream writes the same bytes as toBuffer";
+  try {
+    const chunks: Buffer[] = [];
+    const stream = new PassThrough();
+    stream.on("data", (chunk: Buffer) => chunks.push(chunk));
+    await index.saveToStream(stream);
+
+    assert(stream.writableFinished, "Stream is ended by default");
+    assert(chunks.length > 1, "Index is written in several chunks");
+    assert(Buffer.concat(chunks).equals(index.toBuffer()), "Saved bytes");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testSaveToSlowStream(index: Index): Promise<boolean> {
+  const testName = "saveToStream waits for a slow stream to drain";
+  try {
+    const chunks: Buffer[] = [];
+    let buffered = 0;
+    let maxBuffered = 0;
+    const stream = new Writable({
+      highWaterMark: 1024,
+      write(chunk: Buffer, _encoding, callback) {
+        buffered += chunk.length;
+        maxBuffered = Math.max(maxBuffered, buffered);
+        setTimeout(() => {
+          buffered -= chunk.length;
+          chunks.push(chunk);
+          callback();
+        }, 5);
+      },
+    });
+    await index.saveToStream(stream, { end: false });
+
+    assert(!stream.writableEnded, "Stream is left open");
+    assert(Buffer.concat(chunks).equals(index.toBuffer()), "Saved bytes");
+    assert(
+      maxBuffered <= 2 * 4 * 1024 * 1024,
+      `At most two chunks are buffered at a time (got ${maxBuffered} bytes)`
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testLoadFromStream(
+  index: Index,
+  inputData: number[][]
+): Promise<boolean> {
+  const testName = "loadFromStream loads an index from small chunks";
+  try {
+    const buffer = index.toBuffer();
+    const loaded = await Index.loadFromStream(toReadable(buffer, 1000));
+
+    assertEqual(loaded.numElements, index.numElements, "numElements");
+    assertEqual(loaded.numDimensions, index.numDimensions, "numDimensions");
+    assert(loaded.toBuffer().equals(buffer), "Reserialized bytes");
+    const expected = index.query(inputData.slice(0, 20), 5);
+    const actual = loaded.query(inputData.slice(0, 20), 5);
+    assertEqual(
+      JSON.stringify(actual.neighbors),
+      JSON.stringify(expected.neighbors),
+      "Query results"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testFileRoundTrip(index: Index): Promise<boolean> {
+  const testName = "saveToStream and loadFromStream work with file streams";
+  const filePath = createTempFile();
+  try {
+    await index.saveToStream(fs.createWriteStream(filePath));
+    assert(
+      fs.readFileSync(filePath).equals(index.toBuffer()),
+      "File contents match toBuffer"
+    );
+
+    const loaded = await Index.loadFromStream(
+      fs.createReadStream(filePath, { highWaterMark: 4096 })
+    );
+    assertEqual(loaded.numElements, index.numElements, "numElements");
+    assert(loaded.toBuffer().equals(index.toBuffer()), "Reloaded bytes");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  } finally {
+    if (fs.existsSync(filePath)) {
+      fs.unlinkSync(filePath);
+    }
+  }
+}
+
+async function testManyConcurrentStreams(
+  inputData: number[][]
+): Promise<boolean> {
+  const testName =
+    "more concurrent streams than threadpool threads don't deadlock";
+  const numStreams = 2 * Number(process.env.UV_THREADPOOL_SIZE || 4);
+  const filePaths = Array.from({ length: numStreams }, () =>
+    createTempFile(".voy.gz")
+  );
+  let timer: NodeJS.Timeout | undefined;
+  try {
+    const index = new Index({ space: Space.Euclidean, numDimensions: 8 });
+    index.addItems(inputData.map((vector) => vector.slice(0, 8)));
+    const expected = index.toBuffer();
+
+    // zlib and fs both run on the threadpool, so they'd never get to finish
+    // if every threadpool thread was waiting on them.
+    const roundTrips = Promise.all(
+      filePaths.map(async (filePath) => {
+        const gzip = zlib.createGzip();
+        const written = pipeline(gzip, fs.createWriteStream(filePath));
+        await index.saveToStream(gzip);
+        await written;
+        const loaded = await Index.loadFromStream(
+          fs.createReadStream(filePath).pipe(zlib.createGunzip())
+        );
+        assert(loaded.toBuffer().equals(expected), "Reloaded bytes");
+      })
+    );
+    const timeout = new Promise((_, reject) => {
+      timer = setTimeout(() => reject(new Error("Timed out")), 60000);
+    });
+    await Promise.race([roundTrips, timeout]);
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  } finally {
+    clearTimeout(timer);
+    for (const filePath of filePaths) {
+      if (fs.existsSync(filePath)) {
+        fs.unlinkSync(filePath);
+      }
+    }
+  }
+}
+
+async function testLoadFromStreamOptions(
+  inputData: number[][]
+): Promise<boolean> {
+  const testName = "loadFromStream validates options against metadata";
+  try {
+    const index = new Index({ space: Space.Cosine, numDimensions: 8 });
+    index.addItems(inputData.map((vector) => vector.slice(0, 8)));
+
+    let error: unknown = null;
+    try {
+      await Index.loadFromStream(toReadable(index.toBuffer(), 512), {
+        space: Space.Euclidean,
+      });
+    } catch (e) {
+      error = e;
+    }
+    assert(error !== null, "Mismatched space rejects");
+
+    error = null;
+    try {
+      await Index.loadFromStream(toReadable(index.toBuffer(), 512), {
+        mmap: true,
+      });
+    } catch (e) {
+      error = e;
+    }
+    assert(error !== null, "mmap is rejected");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+async function testStreamErrors(index: Index): Promise<boolean> {
+  const testName = "stream errors reject instead of hanging";
+  try {
+    const buffer = index.toBuffer();
+
+    // A truncated index
+    let error: unknown = null;
+    try {
+      await Index.loadFromStream(
+        toReadable(buffer.subarray(0, buffer.length / 2), 4096)
+      );
+    } catch (e) {
+      error = e;
+    }
+    assert(error !== null, "Truncated stream rejects");
+
+    // A source that fails partway through
+    async function* failingSource() {
+      yield buffer.subarray(0, 100000);
+      throw new Error("Connection reset");
+    }
+    error = null;
+    try {
+      await Index.loadFromStream(failingSource());
+    } catch (e) {
+      error = e;
+    }
+    assert(
+      String(error).includes("Connection reset"),
+      `Source error is passed on (got ${error})`
+    );
+
+    // A destination that fails partway through
+    let bytesWritten = 0;
+    const failing = new Writable({
+      write(chunk: Buffer, _encoding, callback) {
+        bytesWritten += chunk.length;
+        callback(bytesWritten > 1000000 ? new Error("Disk full") : null);
+      },
+    });
+    failing.on("error", () => {});
+    error = null;
+    try {
+      await index.saveToStream(failing);
+    } catch (e) {
+      error = e;
+    }
+    assert(error !== null, "Destination error rejects");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default async function runAllTests(): Promise<boolean> {
+  console.log("Running stream tests...\n");
+
+  const { index, inputData } = createIndex();
+  const results = [
+    await testSaveToStream(index),
+    await testSaveToSlowStream(index),
+    await testLoadFromStream(index, inputData),
+    await testFileRoundTrip(index),
+    await testManyConcurrentStreams(inputData),
+    await testLoadFromStreamOptions(inputData),
+    await testStreamErrors(index),
+  ];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Stream Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All stream tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    await runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
@@ -0,0 +1,282 @@
+import {
+  Index,
+  ResultType,
+  Space,
+  StorageDataType,
+} from "../src/voyager-node.ts";
+
+function assert(condition: boolean, message?: string): void {
+  if (!condition) {
+    throw new Error(message || "Assertion failed");
+  }
+}
+
+function assertEqual<T>(actual: T, expected: T, message?: string): void {
+  if (actual !== expected) {
+    throw new Error(
+      `${message || "Assertion failed"}: Expected ${expected}, got ${actual}`
+    );
+  }
+}
+
+function assertThrows(fn: () => void, message?: string): void {
+  let threw = false;
+  try {
+    fn();
+  } catch (error) {
+    threw = true;
+  }
+  assert(threw, message || "Expected function to throw");
+}
+
+function generateRandomData(
+  numElements: number,
+  numDimensions: number
+): number[][] {
+  const data: number[][] = [];
+  for (let i = 0; i < numElements; i++) {
+    const vector: number[] = [];
+    for (let j = 0; j < numDimensions; j++) {
+      vector.push(Math.random() * 2 - 1);
+    }
+    data.push(vector);
+  }
+  return data;
+}
+
+function flatten(data: number[][]): Float32Array {
+  const numDimensions = data.length > 0 ? data[0].length : 0;
+  const flat = new Float32Array(data.length * numDimensions);
+  data.forEach((vector, i) => flat.set(vector, i * numDimensions));
+  return flat;
+}
+
+function testFlatFloat32ArrayInput(): boolean {
+  const testName = "Flat Float32Array input matches nested array input";
+  try {
+    const numDimensions = 32;
+    const inputData = generateRandomData(200, numDimensions);
+
+    const fromArrays = new Index({ space: Space.Euclidean, numDimensions });
+    const fromFlat = new Index({ space: Space.Euclidean, numDimensions });
+
+    const ids = inputData.map((_, i) => i * 2);
+    fromArrays.addItems(inputData, ids);
+    fromFlat.addItems(flatten(inputData), ids);
+    assertEqual(fromFlat.length, inputData.length, "Flat index length");
+
+    for (const id of ids) {
+      const a = fromArrays.getVector(id);
+      const b = fromFlat.getVector(id);
+      for (let j = 0; j < numDimensions; j++) {
+        assertEqual(a[j], b[j], `Vector ${id} element ${j}`);
+      }
+    }
+
+    // A flat batch query returns one row per query vector...
+    const batch = fromFlat.query(flatten(inputData), 1) as {
+      neighbors: number[][];
+    };
+    assertEqual(batch.neighbors.length, inputData.length, "Batch rows");
+    for (let i = 0; i < inputData.length; i++) {
+      assertEqual(batch.neighbors[i][0], ids[i], `Neighbor of vector ${i}`);
+    }
+
+    // ...while a numDimensions-long Float32Array is a single query.
+    const single = fromFlat.query(new Float32Array(inputData[5]), 1);
+    assertEqual(
+      (single.neighbors as number[])[0],
+      ids[5],
+      "Single Float32Array query"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testArrayOfFloat32ArraysInput(): boolean {
+  const testName = "Arrays of Float32Arrays are accepted as vectors";
+  try {
+    const numDimensions = 8;
+    const inputData = generateRandomData(50, numDimensions);
+    const rows = inputData.map((vector) => new Float32Array(vector));
+
+    const index = new Index({
+      space: Space.Cosine,
+      numDimensions,
+      storageDataType: StorageDataType.Float8,
+    });
+    const ids = index.addItems(rows);
+    index.addItem(new Float32Array(numDimensions).fill(0.5), 1000);
+    assertEqual(index.length, rows.length + 1, "Index length");
+    assert(index.has(1000), "Index should contain the Float32Array item");
+
+    const result = index.query(rows, 1);
+    assertEqual(result.neighbors.length, rows.length, "Query rows");
+    assertEqual(result.neighbors[0][0], ids[0], "Neighbor of first row");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testInvalidFloat32ArrayInput(): boolean {
+  const testName = "Float32Arrays with a mismatched length are rejected";
+  try {
+    const numDimensions = 4;
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+
+    assertThrows(
+      () => index.addItems(new Float32Array(numDimensions * 3 + 1)),
+      "addItems should reject a flat array that isn't a multiple of 4"
+    );
+    assertThrows(
+      () => index.addItems([new Float32Array(4), new Float32Array(3)]),
+      "addItems should reject rows of different lengths"
+    );
+
+    index.addItems(new Float32Array(numDimensions * 3).fill(1));
+    assertThrows(
+      () => index.query(new Float32Array(numDimensions + 1)),
+      "query should reject a flat array that isn't a multiple of 4"
+    );
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testTypedArrayQueryResults(): boolean {
+  const testName = "Typed-array query results match array results";
+  try {
+    const numDimensions = 16;
+    const k = 5;
+    const inputData = generateRandomData(300, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    index.addItems(inputData);
+
+    const expected = index.query(inputData, k);
+    const typed = index.query(inputData, k, -1, -1, {
+      resultType: ResultType.TypedArray,
+    });
+    const bigint = index.query(inputData, k, -1, -1, {
+      resultType: ResultType.BigIntTypedArray,
+    });
+
+    assert(typed.neighbors instanceof Float64Array, "Float64Array neighbors");
+    assert(typed.distances instanceof Float32Array, "Float32Array distances");
+    assert(
+      bigint.neighbors instanceof BigUint64Array,
+      "BigUint64Array neighbors"
+    );
+    assertEqual(typed.neighbors.length, inputData.length * k, "Flat length");
+
+    for (let i = 0; i < inputData.length; i++) {
+      for (let j = 0; j < k; j++) {
+        const offset = i * k + j;
+        assertEqual(typed.neighbors[offset], expected.neighbors[i][j]);
+        assertEqual(Number(bigint.neighbors[offset]), expected.neighbors[i][j]);
+        assertEqual(
+          typed.distances[offset],
+          Math.fround(expected.distances[i][j]),
+          `Distance ${i},${j}`
+        );
+      }
+    }
+
+    const single = index.query(inputData[0], k, -1, -1, {
+      resultType: ResultType.TypedArray,
+    });
+    assertEqual(single.neighbors.length, k, "Single query result length");
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+function testTypedArrayGetVectors(): boolean {
+  const testName = "getVectors can return a flat Float32Array";
+  try {
+    const numDimensions = 6;
+    const inputData = generateRandomData(20, numDimensions);
+
+    const index = new Index({ space: Space.Euclidean, numDimensions });
+    const ids = index.addItems(inputData);
+
+    const expected = index.getVectors(ids);
+    const flat = index.getVectors(ids, ResultType.TypedArray);
+    assert(flat instanceof Float32Array, "Result should be a Float32Array");
+    assertEqual(flat.length, ids.length * numDimensions, "Flat length");
+    for (let i = 0; i < ids.length; i++) {
+      for (let j = 0; j < numDimensions; j++) {
+        assertEqual(
+          flat[i * numDimensions + j],
+          Math.fround(expected[i][j]),
+          `Element ${i},${j}`
+        );
+      }
+    }
+
+    console.log(`✓ ${testName}`);
+    return true;
+  } catch (error) {
+    console.error(`✗ ${testName}`);
+    console.error(`  Error: ${error}`);
+    return false;
+  }
+}
+
+export default function runAllTests(): boolean {
+  console.log("Running typed array tests...\n");
+
+  const results = [
+    testFlatFloat32ArrayInput(),
+    testArrayOfFloat32ArraysInput(),
+    testInvalidFloat32ArrayInput(),
+    testTypedArrayQueryResults(),
+    testTypedArrayGetVectors(),
+  ];
+
+  const totalTests = results.length;
+  const passedTests = results.filter((passed) => passed).length;
+  const failed = totalTests - passedTests;
+  console.log("\n=== Typed Array Test Summary ===");
+  console.log(`Passed: ${passedTests}`);
+  console.log(`Failed: ${failed}`);
+  console.log(`Total: ${totalTests}`);
+
+  if (failed === 0) {
+    console.log("✓ All typed array tests passed!");
+    return true;
+  } else {
+    console.log(`✗ ${failed} tests failed`);
+    throw new Error(`${failed} tests failed`);
+  }
+}
+
+// Run tests if this file is executed directly
+if (import.meta.url === `file://${process.argv[1]}`) {
+  try {
+    runAllTests();
+  } catch (error) {
+    process.exit(1);
+  }
+}
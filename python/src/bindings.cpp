@@ -126,10 +126,8 @@ nb::ndarray<T, nb::numpy> vectorToPyArray(std::vector<T> input) {
  */
 class LabelSetView {
 public:
-  LabelSetView(
-      const std::unordered_map<hnswlib::labeltype, hnswlib::tableint> &map)
-      : map(map) {}
-  std::unordered_map<hnswlib::labeltype, hnswlib::tableint> const &map;
+  LabelSetView(const hnswlib::LabelLookup &map) : map(map) {}
+  hnswlib::LabelLookup const &map;
 };
 
 inline void init_LabelSetView(nb::module_ &m) {
@@ -991,7 +989,14 @@ of Voyager prior to v1.3.
                 std::to_string(metadata->getNumDimensions()) + ").");
           }
 
-          return loadTypedIndexFromMetadata(std::move(metadata), inputStream);
+          // Snapshots written by a change log are brought up to date by
+          // replaying it:
+          std::unique_ptr<Index> index =
+              loadTypedIndexFromMetadata(std::move(metadata), inputStream);
+          if (index->isLogAware()) {
+            index->openChangeLog(filename);
+          }
+          return index;
         }
 
         switch (storageDataType) {
@@ -1017,8 +1022,7 @@ of Voyager prior to v1.3.
       [](const std::string filename) -> std::shared_ptr<Index> {
         nb::gil_scoped_release release;
 
-        return loadTypedIndexFromStream(
-            std::make_shared<FileInputStream>(filename));
+        return loadTypedIndexFromFile(filename);
       },
       nb::arg("filename"), LOAD_DOCSTRING);
 